@@ -0,0 +1,543 @@
+// focusNexus_bench: microbenchmarks of the interpreter's hot paths and
+// macro benchmarks of whole scripts, with JSON output that can be kept
+// and compared against later builds.
+//
+// Every benchmark runs once to warm up, then --repeat times. A sample is
+// the time of one run divided by the operations in it, so micro results
+// are per operation and macro results are per script run. Results are
+// compared by their median.
+
+#include "session.hpp"
+#include "error/error_handler.hpp"
+#include "runtime/callable.hpp"
+#include "runtime/environment.hpp"
+#include "runtime/library_manager.hpp"
+#include "utils/file_utils.hpp"
+#include "vm/compiler.hpp"
+#include "vm/vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string filter;       // only benchmarks whose name contains this
+    int repeat = 5;
+    std::string jsonPath;     // where to write the results; empty when off
+    std::string baselinePath; // results to compare with; empty when off
+    double tolerance = 10;    // percent a median may grow before it counts as a regression
+    bool list = false;
+};
+
+struct Result {
+    std::string name;
+    size_t operations = 0; // per sample
+    std::vector<double> samples; // nanoseconds per operation
+    bool skipped = false;  // needs something this build or host doesn't have
+    bool failed = false;
+
+    double min() const { return *std::min_element(samples.begin(), samples.end()); }
+    double mean() const {
+        double total = 0;
+        for (double sample : samples) total += sample;
+        return total / samples.size();
+    }
+    double median() const {
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        size_t middle = sorted.size() / 2;
+        return sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+    }
+};
+
+// A run of the benchmark: performs its operations, returning false if it
+// failed
+using Run = std::function<bool()>;
+
+struct Benchmark {
+    std::string name;
+    size_t operations;
+    // Prepares the benchmark; returns an empty Run to skip it
+    std::function<Run()> setup;
+};
+
+// Discards what scripts print while they are timed
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+volatile bool sink; // keeps results the compiler could otherwise drop
+
+double nanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+Token identifier(const std::string& name) {
+    return Token(TokenType::IDENTIFIER, name, "", 0, 0);
+}
+
+// --- Micro: the environment chain -----------------------------------------
+
+// A global read through depth frames, each a failed hash lookup
+Benchmark environmentGet(int depth) {
+    return {"micro/environment/get/depth_" + std::to_string(depth), 1000000, [depth]() -> Run {
+        auto globals = std::make_shared<Environment>();
+        globals->define("x", Value(1.0));
+        auto frame = globals;
+        for (int i = 0; i < depth; i++) frame = Environment::create(frame, 0);
+        return [globals, frame] {
+            Token name = identifier("x");
+            for (int i = 0; i < 1000000; i++) sink = frame->get(name).isNil();
+            return true;
+        };
+    }};
+}
+
+// A resolved local distance frames out
+Benchmark environmentGetAt(int distance) {
+    return {"micro/environment/get_at/distance_" + std::to_string(distance), 1000000, [distance]() -> Run {
+        auto globals = std::make_shared<Environment>();
+        auto frame = Environment::create(globals, 1);
+        frame->defineAt(0, Value(1.0));
+        for (int i = 0; i < distance; i++) frame = Environment::create(frame, 1);
+        return [globals, frame, distance] {
+            for (int i = 0; i < 1000000; i++) sink = frame->getAt(distance, 0).isNil();
+            return true;
+        };
+    }};
+}
+
+// --- Micro: instances -------------------------------------------------------
+
+const char* kPointClass = R"(
+class Point:
+{
+    function init(x, y):
+    {
+        this.x = x
+        this.y = y
+    }
+    function norm():
+    {
+        return this.x * this.x + this.y * this.y
+    }
+}
+var p = Point(3, 4)
+)";
+
+// FocusInstance::get of p.member, through an inline cache or not
+Benchmark instanceGet(const std::string& label, const std::string& member, bool cached) {
+    return {"micro/instance/get/" + label, 1000000, [member, cached]() -> Run {
+        auto session = std::make_shared<Session>();
+        if (!session->run(kPointClass)) return [] { return false; };
+        return [session, member, cached] {
+            auto instance = session->get("p").asInstance();
+            Token name = identifier(member);
+            PropertyCache cache;
+            for (int i = 0; i < 1000000; i++) {
+                sink = instance->get(name, cached ? &cache : nullptr).isNil();
+            }
+            return true;
+        };
+    }};
+}
+
+Benchmark instanceSet() {
+    return {"micro/instance/set/field_cached", 1000000, []() -> Run {
+        auto session = std::make_shared<Session>();
+        if (!session->run(kPointClass)) return [] { return false; };
+        return [session] {
+            auto instance = session->get("p").asInstance();
+            Token name = identifier("x");
+            PropertyCache cache;
+            for (int i = 0; i < 1000000; i++) instance->set(name, Value(static_cast<double>(i)), &cache);
+            return true;
+        };
+    }};
+}
+
+// --- Micro: scripts ---------------------------------------------------------
+
+const char* kScriptSetup = R"(
+function f(a):
+{
+    return a
+}
+class C:
+{
+    function m(a):
+    {
+        return a
+    }
+}
+function twice(x):
+{
+    return x * 2
+}
+function even(x):
+{
+    return x % 2 == 0
+}
+var c = C()
+var g = lambda(a):
+    a
+var s = "abc"
+)";
+
+// Runs source, in which N stands for the operation count, in a session
+// that has run kScriptSetup. The timing includes parsing source, which is
+// small next to the loop.
+Benchmark script(const std::string& name, size_t operations, const std::string& source) {
+    return {"micro/" + name, operations, [operations, source]() -> Run {
+        auto session = std::make_shared<Session>();
+        if (!session->run(kScriptSetup)) return [] { return false; };
+        std::string text = source;
+        for (size_t at = text.find('N'); at != std::string::npos; at = text.find('N', at)) {
+            text.replace(at, 1, std::to_string(operations));
+        }
+        return [session, text] { return session->run(text); };
+    }};
+}
+
+// --- Micro: native bridges ---------------------------------------------------
+
+// Calls function in library, loaded from path as type, with args. A
+// library that can't be loaded here skips the benchmark.
+Benchmark bridge(const std::string& name, const std::string& path, const std::string& type,
+                 const std::string& function, std::vector<Value> args,
+                 const NativeSignature* signature = nullptr) {
+    return {"micro/bridge/" + name, 100000, [name, path, type, function, args, signature]() -> Run {
+        LibraryManager& libraries = LibraryManager::getInstance();
+        std::string alias = "bench_" + type;
+        if (!libraries.hasLibrary(alias) && !libraries.loadLibrary(alias, path, type)) return nullptr;
+        if (!libraries.hasFunction(alias, function)) return nullptr;
+
+        if (signature) {
+            libraries.bindFunction(alias, function, *signature);
+            auto site = std::make_shared<NativeCallSite>();
+            return [&libraries, alias, function, args, site] {
+                for (int i = 0; i < 100000; i++) {
+                    sink = libraries.callFunction(*site, alias, function, Arguments(args)).isNil();
+                }
+                return true;
+            };
+        }
+        return [&libraries, alias, type, function, args] {
+            for (int i = 0; i < 100000; i++) {
+                sink = libraries.callFunction(alias, function, args).isNil();
+                // The example plugin logs every call; keep the log short
+                if (type == "custom" && i % 4096 == 0) libraries.callFunction(alias, "clear_plugin_log", {});
+            }
+            return true;
+        };
+    }};
+}
+
+NativeSignature doubleSignature(int arity) {
+    NativeSignature signature;
+    signature.result = NativeType::Double;
+    signature.arity = static_cast<uint8_t>(arity);
+    signature.declared = true;
+    for (int i = 0; i < arity; i++) signature.params[i] = NativeType::Double;
+    return signature;
+}
+
+// --- Macro: whole scripts -----------------------------------------------------
+
+// One run of bench/<name>.fn from source, as the command line runs it
+// with --no-cache on the given engine
+Benchmark macro(const std::string& name, bool vm) {
+    std::string path = std::string(BENCH_SCRIPT_DIR) + "/" + name + ".fn";
+    return {"macro/" + name + (vm ? "/vm" : "/tree"), 1, [path, vm]() -> Run {
+        return [path, vm] {
+            ErrorHandler::reset();
+            if (!vm) {
+                Session session;
+                return session.runFile(path);
+            }
+            MappedFile file(path);
+            AstArena arena;
+            auto statements = Session::parse(file.contents(), arena, true);
+            if (ErrorHandler::getHadError()) return false;
+            VM machine;
+            Compiler compiler(machine);
+            auto compiled = compiler.compile(statements);
+            if (ErrorHandler::getHadError()) return false;
+            machine.interpret(compiled);
+            return !ErrorHandler::getHadRuntimeError();
+        };
+    }};
+}
+
+std::vector<Benchmark> benchmarks() {
+    static const NativeSignature twoDoubles = doubleSignature(2);
+    std::vector<Benchmark> all;
+
+    for (int depth : {1, 8, 32}) all.push_back(environmentGet(depth));
+    for (int distance : {0, 4, 16}) all.push_back(environmentGetAt(distance));
+
+    all.push_back(instanceGet("field_cached", "x", true));
+    all.push_back(instanceGet("field_uncached", "x", false));
+    all.push_back(instanceGet("method_cached", "norm", true));
+    all.push_back(instanceSet());
+
+    // Loops over range() whose body is just the call, so the cost of each
+    // call is its time less that of iterable/range
+    all.push_back(script("iterable/range", 1000000, "for i in range(N):\n    i\n"));
+    all.push_back(script("call/function", 200000, "for i in range(N):\n    f(i)\n"));
+    all.push_back(script("call/method", 200000, "for i in range(N):\n    c.m(i)\n"));
+    all.push_back(script("call/lambda", 200000, "for i in range(N):\n    g(i)\n"));
+    all.push_back(script("call/native", 200000, "for i in range(N):\n    len(s)\n"));
+    all.push_back(script("string/concat", 200000, "var t = \"\"\nfor i in range(N):\n    t = t + \"x\"\nlen(t)\n"));
+    all.push_back(script("string/concat_number", 200000,
+                         "var t = \"\"\nfor i in range(N):\n    t = t + str(i)\nlen(t)\n"));
+    all.push_back(script("iterable/map", 200000, "list(map(twice, range(N)))\n"));
+    all.push_back(script("iterable/filter", 200000, "list(filter(even, range(N)))\n"));
+    all.push_back(script("iterable/map_filter", 200000, "list(filter(even, map(twice, range(N))))\n"));
+
+    all.push_back(bridge("cpp/undeclared", BENCH_MATH_LIBRARY, "cpp", "multiply_numbers", {Value(1.5), Value(2.5)}));
+    all.push_back(bridge("cpp/declared", BENCH_MATH_LIBRARY, "cpp", "add_numbers", {Value(1.5), Value(2.5)},
+                         &twoDoubles));
+    all.push_back(bridge("custom", BENCH_PLUGIN, "custom", "calculate_hypotenuse", {Value(3.0), Value(4.0)}));
+#ifdef PYTHON_SUPPORT
+    all.push_back(bridge("python", "math", "python", "sqrt", {Value(2.0)}));
+#endif
+#ifdef JNI_SUPPORT
+    all.push_back(bridge("java", "java/lang/Math", "java", "sqrt", {Value(2.0)}));
+#endif
+
+    for (const char* name : {"fib", "nbody", "binary_trees", "json_parse"}) {
+        all.push_back(macro(name, false));
+        all.push_back(macro(name, true));
+    }
+    return all;
+}
+
+Result measure(const Benchmark& benchmark, int repeat) {
+    Result result;
+    result.name = benchmark.name;
+    result.operations = benchmark.operations;
+
+    NullBuffer discard;
+    std::streambuf* output = std::cout.rdbuf(&discard);
+    try {
+        Run run = benchmark.setup();
+        if (!run) {
+            result.skipped = true;
+        } else if (!run()) {
+            result.failed = true;
+        } else {
+            for (int i = 0; i < repeat && !result.failed; i++) {
+                auto start = std::chrono::steady_clock::now();
+                result.failed = !run();
+                result.samples.push_back(nanosecondsSince(start) / benchmark.operations);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << benchmark.name << ": " << e.what() << std::endl;
+        result.failed = true;
+    }
+    std::cout.rdbuf(output);
+    return result;
+}
+
+std::string formatDuration(double nanoseconds) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(nanoseconds < 100 ? 2 : 1);
+    if (nanoseconds < 1e4) text << nanoseconds << " ns";
+    else if (nanoseconds < 1e7) text << nanoseconds / 1e3 << " us";
+    else text << nanoseconds / 1e6 << " ms";
+    return text.str();
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) escaped += c;
+    }
+    return escaped;
+}
+
+std::string compilerName() {
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + std::to_string(_MSC_VER);
+#else
+    return "unknown";
+#endif
+}
+
+// One benchmark per line, so that readBaseline() needs no JSON parser
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+    std::time_t now = std::time(nullptr);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+#ifdef NDEBUG
+    bool optimized = true;
+#else
+    bool optimized = false;
+#endif
+
+    out << "{\n";
+    out << "  \"schema\": 1,\n";
+    out << "  \"timestamp\": \"" << timestamp << "\",\n";
+    out << "  \"compiler\": \"" << jsonEscape(compilerName()) << "\",\n";
+    out << "  \"optimized\": " << (optimized ? "true" : "false") << ",\n";
+    out << "  \"threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"benchmarks\": [\n";
+    bool first = true;
+    for (const Result& result : results) {
+        if (result.skipped || result.failed) continue;
+        out << (first ? "" : ",\n") << std::setprecision(6)
+            << "    {\"name\": \"" << result.name << "\", \"operations\": " << result.operations
+            << ", \"samples\": " << result.samples.size() << ", \"min_ns\": " << result.min()
+            << ", \"median_ns\": " << result.median() << ", \"mean_ns\": " << result.mean() << "}";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+}
+
+// Median per benchmark name from a file written by writeJson()
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Can't read baseline '" + path + "'");
+    std::map<std::string, double> medians;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t name = line.find("\"name\": \"");
+        size_t median = line.find("\"median_ns\": ");
+        if (name == std::string::npos || median == std::string::npos) continue;
+        name += 9;
+        medians[line.substr(name, line.find('"', name) - name)] = std::stod(line.substr(median + 13));
+    }
+    return medians;
+}
+
+// Prints how each result moved against the baseline; returns the number
+// of regressions
+int compare(const std::vector<Result>& results, const std::map<std::string, double>& baseline, double tolerance) {
+    int regressions = 0;
+    std::cout << "\nAgainst baseline (tolerance " << tolerance << "%):\n";
+    for (const Result& result : results) {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end() || result.samples.empty()) continue;
+        double change = (result.median() / it->second - 1) * 100;
+        const char* verdict = "";
+        if (change > tolerance) {
+            verdict = "  REGRESSION";
+            regressions++;
+        } else if (change < -tolerance) {
+            verdict = "  improved";
+        }
+        std::cout << "  " << std::left << std::setw(44) << result.name << std::right << std::showpos
+                  << std::fixed << std::setprecision(1) << std::setw(8) << change << "%" << std::noshowpos
+                  << verdict << "\n";
+    }
+    return regressions;
+}
+
+int usage() {
+    std::cout << "Usage: focusNexus_bench [--filter=text] [--repeat=N] [--json=file]"
+              << " [--baseline=file] [--tolerance=percent] [--list]" << std::endl;
+    return 64;
+}
+
+} // namespace
+
+// Exits with 1 if a benchmark failed or regressed against the baseline
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        try {
+            if (arg.rfind("--filter=", 0) == 0) {
+                options.filter = arg.substr(9);
+            } else if (arg.rfind("--repeat=", 0) == 0) {
+                options.repeat = std::stoi(arg.substr(9));
+                if (options.repeat < 1) return usage();
+            } else if (arg.rfind("--json=", 0) == 0 && arg.size() > 7) {
+                options.jsonPath = arg.substr(7);
+            } else if (arg.rfind("--baseline=", 0) == 0 && arg.size() > 11) {
+                options.baselinePath = arg.substr(11);
+            } else if (arg.rfind("--tolerance=", 0) == 0) {
+                options.tolerance = std::stod(arg.substr(12));
+            } else if (arg == "--list") {
+                options.list = true;
+            } else {
+                return usage();
+            }
+        } catch (const std::exception&) {
+            return usage();
+        }
+    }
+
+    std::vector<Benchmark> selected;
+    for (Benchmark& benchmark : benchmarks()) {
+        if (benchmark.name.find(options.filter) != std::string::npos) selected.push_back(std::move(benchmark));
+    }
+    if (options.list) {
+        for (const Benchmark& benchmark : selected) std::cout << benchmark.name << "\n";
+        return 0;
+    }
+#ifndef NDEBUG
+    std::cerr << "Warning: not an optimized build; use -DCMAKE_BUILD_TYPE=Release for numbers worth keeping\n";
+#endif
+
+    std::vector<Result> results;
+    bool failed = false;
+    std::cout << std::left << std::setw(44) << "benchmark" << std::right << std::setw(12) << "median"
+              << std::setw(12) << "min" << "\n";
+    for (const Benchmark& benchmark : selected) {
+        Result result = measure(benchmark, options.repeat);
+        std::cout << std::left << std::setw(44) << result.name << std::right;
+        if (result.skipped) {
+            std::cout << std::setw(12) << "skipped";
+        } else if (result.failed) {
+            std::cout << std::setw(12) << "FAILED";
+            failed = true;
+        } else {
+            std::cout << std::setw(12) << formatDuration(result.median()) << std::setw(12)
+                      << formatDuration(result.min());
+        }
+        std::cout << std::endl;
+        results.push_back(std::move(result));
+    }
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream json(options.jsonPath);
+        if (!json) {
+            std::cerr << "Could not write results to " << options.jsonPath << std::endl;
+            failed = true;
+        } else {
+            writeJson(json, results);
+        }
+    }
+
+    int regressions = 0;
+    if (!options.baselinePath.empty()) {
+        try {
+            regressions = compare(results, readBaseline(options.baselinePath), options.tolerance);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            failed = true;
+        }
+    }
+
+    LibraryManager::getInstance().unloadAllLibraries();
+    return failed || regressions > 0 ? 1 : 0;
+}
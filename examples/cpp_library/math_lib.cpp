@@ -1,6 +1,7 @@
 // Example C++ library for Focus Nexus integration
 // Compile with: g++ -shared -fPIC -o libmath.so math_lib.cpp -lm
 
+#include <cctype>
 #include <cmath>
 #include <cstring>
 #include <algorithm>
@@ -2,8 +2,8 @@
 // This demonstrates how to create a custom plugin using the Focus Nexus Plugin API
 //
 // Compile with:
-// Linux: g++ -shared -fPIC -o my_plugin.so my_plugin.cpp -I../../src
-// Windows: g++ -shared -o my_plugin.dll my_plugin.cpp -I../../src
+// Linux: g++ -O2 -shared -fPIC -o my_plugin.so my_plugin.cpp -I../../src
+// Windows: g++ -O2 -shared -o my_plugin.dll my_plugin.cpp -I../../src
 
 #include <cmath>
 #include <string>
@@ -14,51 +14,51 @@
 #include <iomanip>
 #include <ctime>
 
-// Include the Focus Nexus plugin API
-// Note: In a real implementation, this would include the actual Value class
-// For this example, we'll create a simplified version
-
-// Simplified Value class for demonstration
-class Value {
-private:
-    enum Type { NIL, BOOL, NUMBER, STRING } type;
-    union {
-        bool boolValue;
-        double numberValue;
-    };
-    std::string stringValue;
-
-public:
-    Value() : type(NIL) {}
-    Value(bool b) : type(BOOL), boolValue(b) {}
-    Value(double d) : type(NUMBER), numberValue(d) {}
-    Value(const std::string& s) : type(STRING), stringValue(s) {}
-    Value(const char* s) : type(STRING), stringValue(s) {}
-    
-    bool isNumber() const { return type == NUMBER; }
-    bool isString() const { return type == STRING; }
-    bool isBool() const { return type == BOOL; }
-    bool isNil() const { return type == NIL; }
-    
-    double asNumber() const { return numberValue; }
-    std::string asString() const { return stringValue; }
-    bool asBool() const { return boolValue; }
-    
-    std::string toString() const {
-        switch (type) {
-            case NIL: return "nil";
-            case BOOL: return boolValue ? "true" : "false";
-            case NUMBER: return std::to_string(numberValue);
-            case STRING: return stringValue;
-        }
-        return "unknown";
-    }
-};
+// The plugin ABI is plain C: values cross the boundary as FnValue, so the
+// plugin doesn't have to be built with the same compiler as Focus Nexus
+#include "runtime/plugin_abi.h"
 
 // Plugin state
 static std::mt19937 rng(std::time(nullptr));
 static std::vector<std::string> plugin_log;
 
+// Strings returned to Focus Nexus only need to last until our next call
+// on the same thread
+static thread_local std::string returned_text;
+
+static int return_string(FnValue* result, const std::string& text) {
+    returned_text = text;
+    *result = fn_string(returned_text.data(), returned_text.size());
+    return FN_OK;
+}
+
+static int return_number(FnValue* result, double number) {
+    *result = fn_number(number);
+    return FN_OK;
+}
+
+static int return_bool(FnValue* result, bool value) {
+    *result = fn_bool(value);
+    return FN_OK;
+}
+
+static bool is_number(const FnValue& value) { return value.type == FN_NUMBER; }
+static bool is_string(const FnValue& value) { return value.type == FN_STRING; }
+
+static std::string as_string(const FnValue& value) {
+    return std::string(value.as.string.data, value.as.string.length);
+}
+
+// The value of a batch argument at row i: a column of numbers or a scalar
+// shared by every row
+static inline double number_at(const FnValue& value, size_t i) {
+    return value.type == FN_NUMBERS ? value.as.numbers.data[i] : value.as.number;
+}
+
+static bool is_numeric_column(const FnValue& value) {
+    return value.type == FN_NUMBERS || value.type == FN_NUMBER;
+}
+
 // Plugin initialization function
 void plugin_init() {
     plugin_log.push_back("Plugin initialized at " + std::to_string(std::time(nullptr)));
@@ -73,433 +73,428 @@ void plugin_cleanup() {
 
 // Plugin information function
 const char* plugin_info() {
-    return "Focus Nexus Custom Plugin v1.0 - Mathematical and utility functions";
+    return "Focus Nexus Custom Plugin v2.0 - Mathematical and utility functions";
 }
 
 // Mathematical functions
-Value calculate_distance(const std::vector<Value>& args) {
-    if (args.size() != 4) {
-        throw std::runtime_error("calculate_distance requires 4 arguments: x1, y1, x2, y2");
-    }
-    
-    if (!args[0].isNumber() || !args[1].isNumber() || 
-        !args[2].isNumber() || !args[3].isNumber()) {
-        throw std::runtime_error("All arguments must be numbers");
-    }
-    
-    double x1 = args[0].asNumber();
-    double y1 = args[1].asNumber();
-    double x2 = args[2].asNumber();
-    double y2 = args[3].asNumber();
-    
+int calculate_distance(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 4) {
+        return fn_error(result, "calculate_distance requires 4 arguments: x1, y1, x2, y2");
+    }
+
+    if (!is_number(args[0]) || !is_number(args[1]) ||
+        !is_number(args[2]) || !is_number(args[3])) {
+        return fn_error(result, "All arguments must be numbers");
+    }
+
+    double x1 = args[0].as.number;
+    double y1 = args[1].as.number;
+    double x2 = args[2].as.number;
+    double y2 = args[3].as.number;
+
     double distance = std::sqrt(std::pow(x2 - x1, 2) + std::pow(y2 - y1, 2));
-    
+
     plugin_log.push_back("Calculated distance: " + std::to_string(distance));
-    return Value(distance);
+    return return_number(result, distance);
 }
 
-Value calculate_area_circle(const std::vector<Value>& args) {
-    if (args.size() != 1) {
-        throw std::runtime_error("calculate_area_circle requires 1 argument: radius");
+int calculate_area_circle(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1) {
+        return fn_error(result, "calculate_area_circle requires 1 argument: radius");
     }
-    
-    if (!args[0].isNumber()) {
-        throw std::runtime_error("Radius must be a number");
+
+    if (!is_number(args[0])) {
+        return fn_error(result, "Radius must be a number");
     }
-    
-    double radius = args[0].asNumber();
+
+    double radius = args[0].as.number;
     if (radius < 0) {
-        throw std::runtime_error("Radius cannot be negative");
+        return fn_error(result, "Radius cannot be negative");
     }
-    
+
     double area = M_PI * radius * radius;
     plugin_log.push_back("Calculated circle area: " + std::to_string(area));
-    return Value(area);
+    return return_number(result, area);
 }
 
-Value calculate_area_rectangle(const std::vector<Value>& args) {
-    if (args.size() != 2) {
-        throw std::runtime_error("calculate_area_rectangle requires 2 arguments: width, height");
+// Batch version: calculate_area_circle([1, 2, 3]) is one call with one
+// loop the compiler can vectorize
+int calculate_area_circle_batch(const FnValue* args, size_t count, size_t rows, double* out, FnValue* error) {
+    if (count != 1 || !is_numeric_column(args[0])) {
+        return fn_error(error, "calculate_area_circle requires 1 argument: radius");
     }
-    
-    if (!args[0].isNumber() || !args[1].isNumber()) {
-        throw std::runtime_error("Width and height must be numbers");
+
+    const FnValue& radii = args[0];
+    bool negative = false;
+    for (size_t i = 0; i < rows; i++) {
+        double radius = number_at(radii, i);
+        negative |= radius < 0;
+        out[i] = M_PI * radius * radius;
+    }
+    if (negative) {
+        return fn_error(error, "Radius cannot be negative");
+    }
+
+    plugin_log.push_back("Calculated " + std::to_string(rows) + " circle areas");
+    return FN_OK;
+}
+
+int calculate_area_rectangle(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 2) {
+        return fn_error(result, "calculate_area_rectangle requires 2 arguments: width, height");
     }
-    
-    double width = args[0].asNumber();
-    double height = args[1].asNumber();
-    
+
+    if (!is_number(args[0]) || !is_number(args[1])) {
+        return fn_error(result, "Width and height must be numbers");
+    }
+
+    double width = args[0].as.number;
+    double height = args[1].as.number;
+
     if (width < 0 || height < 0) {
-        throw std::runtime_error("Width and height cannot be negative");
+        return fn_error(result, "Width and height cannot be negative");
     }
-    
+
     double area = width * height;
     plugin_log.push_back("Calculated rectangle area: " + std::to_string(area));
-    return Value(area);
+    return return_number(result, area);
 }
 
-Value calculate_hypotenuse(const std::vector<Value>& args) {
-    if (args.size() != 2) {
-        throw std::runtime_error("calculate_hypotenuse requires 2 arguments: a, b");
+int calculate_hypotenuse(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 2) {
+        return fn_error(result, "calculate_hypotenuse requires 2 arguments: a, b");
     }
-    
-    if (!args[0].isNumber() || !args[1].isNumber()) {
-        throw std::runtime_error("Both arguments must be numbers");
+
+    if (!is_number(args[0]) || !is_number(args[1])) {
+        return fn_error(result, "Both arguments must be numbers");
     }
-    
-    double a = args[0].asNumber();
-    double b = args[1].asNumber();
-    
+
+    double a = args[0].as.number;
+    double b = args[1].as.number;
+
     double hypotenuse = std::sqrt(a * a + b * b);
     plugin_log.push_back("Calculated hypotenuse: " + std::to_string(hypotenuse));
-    return Value(hypotenuse);
+    return return_number(result, hypotenuse);
+}
+
+// Batch version: either side may be a list or a single number
+int calculate_hypotenuse_batch(const FnValue* args, size_t count, size_t rows, double* out, FnValue* error) {
+    if (count != 2 || !is_numeric_column(args[0]) || !is_numeric_column(args[1])) {
+        return fn_error(error, "calculate_hypotenuse requires 2 arguments: a, b");
+    }
+
+    const FnValue& as = args[0];
+    const FnValue& bs = args[1];
+    for (size_t i = 0; i < rows; i++) {
+        double a = number_at(as, i);
+        double b = number_at(bs, i);
+        out[i] = std::sqrt(a * a + b * b);
+    }
+
+    plugin_log.push_back("Calculated " + std::to_string(rows) + " hypotenuses");
+    return FN_OK;
 }
 
 // Random number functions
-Value random_number(const std::vector<Value>& args) {
+int random_number(const FnValue* args, size_t count, FnValue* result) {
     double min = 0.0, max = 1.0;
-    
-    if (args.size() >= 1 && args[0].isNumber()) {
-        min = args[0].asNumber();
+
+    if (count >= 1 && is_number(args[0])) {
+        min = args[0].as.number;
     }
-    if (args.size() >= 2 && args[1].isNumber()) {
-        max = args[1].asNumber();
+    if (count >= 2 && is_number(args[1])) {
+        max = args[1].as.number;
     }
-    
+
     if (min > max) {
         std::swap(min, max);
     }
-    
+
     std::uniform_real_distribution<double> dist(min, max);
-    double result = dist(rng);
-    
-    plugin_log.push_back("Generated random number: " + std::to_string(result));
-    return Value(result);
+    double value = dist(rng);
+
+    plugin_log.push_back("Generated random number: " + std::to_string(value));
+    return return_number(result, value);
 }
 
-Value random_integer(const std::vector<Value>& args) {
+int random_integer(const FnValue* args, size_t count, FnValue* result) {
     int min = 0, max = 100;
-    
-    if (args.size() >= 1 && args[0].isNumber()) {
-        min = static_cast<int>(args[0].asNumber());
+
+    if (count >= 1 && is_number(args[0])) {
+        min = static_cast<int>(args[0].as.number);
     }
-    if (args.size() >= 2 && args[1].isNumber()) {
-        max = static_cast<int>(args[1].asNumber());
+    if (count >= 2 && is_number(args[1])) {
+        max = static_cast<int>(args[1].as.number);
     }
-    
+
     if (min > max) {
         std::swap(min, max);
     }
-    
+
     std::uniform_int_distribution<int> dist(min, max);
-    int result = dist(rng);
-    
-    plugin_log.push_back("Generated random integer: " + std::to_string(result));
-    return Value(static_cast<double>(result));
+    int value = dist(rng);
+
+    plugin_log.push_back("Generated random integer: " + std::to_string(value));
+    return return_number(result, static_cast<double>(value));
 }
 
-Value shuffle_seed(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isNumber()) {
-        throw std::runtime_error("shuffle_seed requires 1 numeric argument: seed");
+int shuffle_seed(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_number(args[0])) {
+        return fn_error(result, "shuffle_seed requires 1 numeric argument: seed");
     }
-    
-    unsigned int seed = static_cast<unsigned int>(args[0].asNumber());
+
+    unsigned int seed = static_cast<unsigned int>(args[0].as.number);
     rng.seed(seed);
-    
+
     plugin_log.push_back("Set random seed to: " + std::to_string(seed));
-    return Value(true);
+    return return_bool(result, true);
 }
 
 // String manipulation functions
-Value capitalize_words(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isString()) {
-        throw std::runtime_error("capitalize_words requires one string argument");
+int capitalize_words(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_string(args[0])) {
+        return fn_error(result, "capitalize_words requires one string argument");
     }
-    
-    std::string input = args[0].asString();
-    std::string result;
+
+    std::string input = as_string(args[0]);
+    std::string output;
     bool capitalize_next = true;
-    
+
     for (char c : input) {
         if (std::isspace(c)) {
             capitalize_next = true;
-            result += c;
+            output += c;
         } else if (capitalize_next) {
-            result += std::toupper(c);
+            output += std::toupper(c);
             capitalize_next = false;
         } else {
-            result += std::tolower(c);
+            output += std::tolower(c);
         }
     }
-    
-    plugin_log.push_back("Capitalized words: " + result);
-    return Value(result);
+
+    plugin_log.push_back("Capitalized words: " + output);
+    return return_string(result, output);
 }
 
-Value reverse_string(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isString()) {
-        throw std::runtime_error("reverse_string requires one string argument");
+int reverse_string(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_string(args[0])) {
+        return fn_error(result, "reverse_string requires one string argument");
     }
-    
-    std::string input = args[0].asString();
-    std::string result = input;
-    std::reverse(result.begin(), result.end());
-    
-    plugin_log.push_back("Reversed string: " + result);
-    return Value(result);
+
+    std::string output = as_string(args[0]);
+    std::reverse(output.begin(), output.end());
+
+    plugin_log.push_back("Reversed string: " + output);
+    return return_string(result, output);
 }
 
-Value count_characters(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isString()) {
-        throw std::runtime_error("count_characters requires one string argument");
+int count_characters(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_string(args[0])) {
+        return fn_error(result, "count_characters requires one string argument");
     }
-    
-    std::string input = args[0].asString();
-    double count = static_cast<double>(input.length());
-    
-    plugin_log.push_back("Counted characters: " + std::to_string(count));
-    return Value(count);
+
+    double characters = static_cast<double>(args[0].as.string.length);
+
+    plugin_log.push_back("Counted characters: " + std::to_string(characters));
+    return return_number(result, characters);
 }
 
-Value count_words(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isString()) {
-        throw std::runtime_error("count_words requires one string argument");
+int count_words(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_string(args[0])) {
+        return fn_error(result, "count_words requires one string argument");
     }
-    
-    std::string input = args[0].asString();
-    std::istringstream iss(input);
+
+    std::istringstream iss(as_string(args[0]));
     std::string word;
-    int count = 0;
-    
+    int words = 0;
+
     while (iss >> word) {
-        count++;
+        words++;
     }
-    
-    plugin_log.push_back("Counted words: " + std::to_string(count));
-    return Value(static_cast<double>(count));
+
+    plugin_log.push_back("Counted words: " + std::to_string(words));
+    return return_number(result, static_cast<double>(words));
 }
 
-Value remove_spaces(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isString()) {
-        throw std::runtime_error("remove_spaces requires one string argument");
+int remove_spaces(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_string(args[0])) {
+        return fn_error(result, "remove_spaces requires one string argument");
     }
-    
-    std::string input = args[0].asString();
-    std::string result;
-    
+
+    std::string input = as_string(args[0]);
+    std::string output;
+
     for (char c : input) {
         if (!std::isspace(c)) {
-            result += c;
+            output += c;
         }
     }
-    
-    plugin_log.push_back("Removed spaces: " + result);
-    return Value(result);
+
+    plugin_log.push_back("Removed spaces: " + output);
+    return return_string(result, output);
 }
 
 // Utility functions
-Value format_number(const std::vector<Value>& args) {
-    if (args.size() < 1 || !args[0].isNumber()) {
-        throw std::runtime_error("format_number requires at least one numeric argument");
+int format_number(const FnValue* args, size_t count, FnValue* result) {
+    if (count < 1 || !is_number(args[0])) {
+        return fn_error(result, "format_number requires at least one numeric argument");
     }
-    
-    double number = args[0].asNumber();
+
+    double number = args[0].as.number;
     int precision = 2;
-    
-    if (args.size() >= 2 && args[1].isNumber()) {
-        precision = static_cast<int>(args[1].asNumber());
+
+    if (count >= 2 && is_number(args[1])) {
+        precision = static_cast<int>(args[1].as.number);
         if (precision < 0) precision = 0;
         if (precision > 10) precision = 10;
     }
-    
+
     std::ostringstream oss;
     oss << std::fixed << std::setprecision(precision) << number;
-    std::string result = oss.str();
-    
-    plugin_log.push_back("Formatted number: " + result);
-    return Value(result);
+    std::string output = oss.str();
+
+    plugin_log.push_back("Formatted number: " + output);
+    return return_string(result, output);
 }
 
-Value current_timestamp(const std::vector<Value>& args) {
+int current_timestamp(const FnValue* args, size_t count, FnValue* result) {
     double timestamp = static_cast<double>(std::time(nullptr));
     plugin_log.push_back("Got current timestamp: " + std::to_string(timestamp));
-    return Value(timestamp);
+    return return_number(result, timestamp);
 }
 
-Value is_even(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isNumber()) {
-        throw std::runtime_error("is_even requires one numeric argument");
+int is_even(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_number(args[0])) {
+        return fn_error(result, "is_even requires one numeric argument");
     }
-    
-    double number = args[0].asNumber();
+
+    double number = args[0].as.number;
     int intNumber = static_cast<int>(number);
-    
+
     // Check if it's actually an integer
     if (number != intNumber) {
-        return Value(false);
+        return return_bool(result, false);
     }
-    
-    bool result = (intNumber % 2 == 0);
-    plugin_log.push_back("Checked if " + std::to_string(intNumber) + " is even: " + (result ? "true" : "false"));
-    return Value(result);
+
+    bool even = (intNumber % 2 == 0);
+    plugin_log.push_back("Checked if " + std::to_string(intNumber) + " is even: " + (even ? "true" : "false"));
+    return return_bool(result, even);
 }
 
-Value is_odd(const std::vector<Value>& args) {
-    if (args.size() != 1 || !args[0].isNumber()) {
-        throw std::runtime_error("is_odd requires one numeric argument");
+int is_odd(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 1 || !is_number(args[0])) {
+        return fn_error(result, "is_odd requires one numeric argument");
     }
-    
-    double number = args[0].asNumber();
+
+    double number = args[0].as.number;
     int intNumber = static_cast<int>(number);
-    
+
     // Check if it's actually an integer
     if (number != intNumber) {
-        return Value(false);
+        return return_bool(result, false);
     }
-    
-    bool result = (intNumber % 2 != 0);
-    plugin_log.push_back("Checked if " + std::to_string(intNumber) + " is odd: " + (result ? "true" : "false"));
-    return Value(result);
+
+    bool odd = (intNumber % 2 != 0);
+    plugin_log.push_back("Checked if " + std::to_string(intNumber) + " is odd: " + (odd ? "true" : "false"));
+    return return_bool(result, odd);
 }
 
-Value clamp_number(const std::vector<Value>& args) {
-    if (args.size() != 3 || !args[0].isNumber() || !args[1].isNumber() || !args[2].isNumber()) {
-        throw std::runtime_error("clamp_number requires 3 numeric arguments: value, min, max");
+int clamp_number(const FnValue* args, size_t count, FnValue* result) {
+    if (count != 3 || !is_number(args[0]) || !is_number(args[1]) || !is_number(args[2])) {
+        return fn_error(result, "clamp_number requires 3 numeric arguments: value, min, max");
     }
-    
-    double value = args[0].asNumber();
-    double min_val = args[1].asNumber();
-    double max_val = args[2].asNumber();
-    
+
+    double value = args[0].as.number;
+    double min_val = args[1].as.number;
+    double max_val = args[2].as.number;
+
     if (min_val > max_val) {
         std::swap(min_val, max_val);
     }
-    
-    double result = std::max(min_val, std::min(max_val, value));
-    plugin_log.push_back("Clamped " + std::to_string(value) + " to range [" + 
-                        std::to_string(min_val) + ", " + std::to_string(max_val) + 
-                        "] = " + std::to_string(result));
-    return Value(result);
+
+    double clamped = std::max(min_val, std::min(max_val, value));
+    plugin_log.push_back("Clamped " + std::to_string(value) + " to range [" +
+                        std::to_string(min_val) + ", " + std::to_string(max_val) +
+                        "] = " + std::to_string(clamped));
+    return return_number(result, clamped);
+}
+
+// Batch version: clamps a whole list against scalar or per-row bounds
+int clamp_number_batch(const FnValue* args, size_t count, size_t rows, double* out, FnValue* error) {
+    if (count != 3 || !is_numeric_column(args[0]) || !is_numeric_column(args[1]) || !is_numeric_column(args[2])) {
+        return fn_error(error, "clamp_number requires 3 numeric arguments: value, min, max");
+    }
+
+    for (size_t i = 0; i < rows; i++) {
+        double min_val = number_at(args[1], i);
+        double max_val = number_at(args[2], i);
+        double low = std::min(min_val, max_val);
+        double high = std::max(min_val, max_val);
+        out[i] = std::max(low, std::min(high, number_at(args[0], i)));
+    }
+
+    plugin_log.push_back("Clamped " + std::to_string(rows) + " numbers");
+    return FN_OK;
 }
 
 // Plugin management functions
-Value get_plugin_log(const std::vector<Value>& args) {
+int get_plugin_log(const FnValue* args, size_t count, FnValue* result) {
     std::string log_string;
     for (size_t i = 0; i < plugin_log.size(); i++) {
         if (i > 0) log_string += "\n";
         log_string += plugin_log[i];
     }
-    return Value(log_string);
+    return return_string(result, log_string);
 }
 
-Value clear_plugin_log(const std::vector<Value>& args) {
-    size_t count = plugin_log.size();
+int clear_plugin_log(const FnValue* args, size_t count, FnValue* result) {
+    size_t entries = plugin_log.size();
     plugin_log.clear();
     plugin_log.push_back("Log cleared");
-    return Value(static_cast<double>(count));
+    return return_number(result, static_cast<double>(entries));
 }
 
-Value get_plugin_version(const std::vector<Value>& args) {
-    return Value("1.0.0");
+int get_plugin_version(const FnValue* args, size_t count, FnValue* result) {
+    return return_string(result, "2.0.0");
 }
 
 // Export functions using the Focus Nexus plugin API
-extern "C" {
-    // Plugin lifecycle functions
-    void focus_nexus_plugin_init() {
-        plugin_init();
-    }
-    
-    void focus_nexus_plugin_cleanup() {
-        plugin_cleanup();
-    }
-    
-    const char* focus_nexus_plugin_info() {
-        return plugin_info();
-    }
-    
-    // Mathematical functions
-    Value focus_nexus_calculate_distance(const std::vector<Value>& args) {
-        return calculate_distance(args);
-    }
-    
-    Value focus_nexus_calculate_area_circle(const std::vector<Value>& args) {
-        return calculate_area_circle(args);
-    }
-    
-    Value focus_nexus_calculate_area_rectangle(const std::vector<Value>& args) {
-        return calculate_area_rectangle(args);
-    }
-    
-    Value focus_nexus_calculate_hypotenuse(const std::vector<Value>& args) {
-        return calculate_hypotenuse(args);
-    }
-    
-    // Random number functions
-    Value focus_nexus_random_number(const std::vector<Value>& args) {
-        return random_number(args);
-    }
-    
-    Value focus_nexus_random_integer(const std::vector<Value>& args) {
-        return random_integer(args);
-    }
-    
-    Value focus_nexus_shuffle_seed(const std::vector<Value>& args) {
-        return shuffle_seed(args);
-    }
-    
-    // String manipulation functions
-    Value focus_nexus_capitalize_words(const std::vector<Value>& args) {
-        return capitalize_words(args);
-    }
-    
-    Value focus_nexus_reverse_string(const std::vector<Value>& args) {
-        return reverse_string(args);
-    }
-    
-    Value focus_nexus_count_characters(const std::vector<Value>& args) {
-        return count_characters(args);
-    }
-    
-    Value focus_nexus_count_words(const std::vector<Value>& args) {
-        return count_words(args);
-    }
-    
-    Value focus_nexus_remove_spaces(const std::vector<Value>& args) {
-        return remove_spaces(args);
-    }
-    
-    // Utility functions
-    Value focus_nexus_format_number(const std::vector<Value>& args) {
-        return format_number(args);
-    }
-    
-    Value focus_nexus_current_timestamp(const std::vector<Value>& args) {
-        return current_timestamp(args);
-    }
-    
-    Value focus_nexus_is_even(const std::vector<Value>& args) {
-        return is_even(args);
-    }
-    
-    Value focus_nexus_is_odd(const std::vector<Value>& args) {
-        return is_odd(args);
-    }
-    
-    Value focus_nexus_clamp_number(const std::vector<Value>& args) {
-        return clamp_number(args);
-    }
-    
-    // Plugin management functions
-    Value focus_nexus_get_plugin_log(const std::vector<Value>& args) {
-        return get_plugin_log(args);
-    }
-    
-    Value focus_nexus_clear_plugin_log(const std::vector<Value>& args) {
-        return clear_plugin_log(args);
-    }
-    
-    Value focus_nexus_get_plugin_version(const std::vector<Value>& args) {
-        return get_plugin_version(args);
-    }
-}
\ No newline at end of file
+FOCUS_NEXUS_PLUGIN_ABI()
+
+// Plugin lifecycle functions
+FOCUS_NEXUS_PLUGIN_INIT(plugin_init)
+FOCUS_NEXUS_PLUGIN_CLEANUP(plugin_cleanup)
+FOCUS_NEXUS_PLUGIN_INFO(plugin_info())
+
+// Mathematical functions
+FOCUS_NEXUS_EXPORT(calculate_distance, calculate_distance)
+FOCUS_NEXUS_EXPORT(calculate_area_circle, calculate_area_circle)
+FOCUS_NEXUS_EXPORT_BATCH(calculate_area_circle, calculate_area_circle_batch)
+FOCUS_NEXUS_EXPORT(calculate_area_rectangle, calculate_area_rectangle)
+FOCUS_NEXUS_EXPORT(calculate_hypotenuse, calculate_hypotenuse)
+FOCUS_NEXUS_EXPORT_BATCH(calculate_hypotenuse, calculate_hypotenuse_batch)
+
+// Random number functions
+FOCUS_NEXUS_EXPORT(random_number, random_number)
+FOCUS_NEXUS_EXPORT(random_integer, random_integer)
+FOCUS_NEXUS_EXPORT(shuffle_seed, shuffle_seed)
+
+// String manipulation functions
+FOCUS_NEXUS_EXPORT(capitalize_words, capitalize_words)
+FOCUS_NEXUS_EXPORT(reverse_string, reverse_string)
+FOCUS_NEXUS_EXPORT(count_characters, count_characters)
+FOCUS_NEXUS_EXPORT(count_words, count_words)
+FOCUS_NEXUS_EXPORT(remove_spaces, remove_spaces)
+
+// Utility functions
+FOCUS_NEXUS_EXPORT(format_number, format_number)
+FOCUS_NEXUS_EXPORT(current_timestamp, current_timestamp)
+FOCUS_NEXUS_EXPORT(is_even, is_even)
+FOCUS_NEXUS_EXPORT(is_odd, is_odd)
+FOCUS_NEXUS_EXPORT(clamp_number, clamp_number)
+FOCUS_NEXUS_EXPORT_BATCH(clamp_number, clamp_number_batch)
+
+// Plugin management functions
+FOCUS_NEXUS_EXPORT(get_plugin_log, get_plugin_log)
+FOCUS_NEXUS_EXPORT(clear_plugin_log, clear_plugin_log)
+FOCUS_NEXUS_EXPORT(get_plugin_version, get_plugin_version)
@@ -1,9 +1,10 @@
 #include "error_handler.hpp"
 #include "exceptions.hpp"
+#include "../runtime/output.hpp"
 #include <iostream>
 
-bool ErrorHandler::hadError = false;
-bool ErrorHandler::hadRuntimeError = false;
+thread_local bool ErrorHandler::hadError = false;
+thread_local bool ErrorHandler::hadRuntimeError = false;
 
 void ErrorHandler::error(int line, int column, const std::string& message) {
     report(line, column, "", message);
@@ -13,17 +14,19 @@ void ErrorHandler::error(const Token& token, const std::string& message) {
     if (token.type == TokenType::EOF_TOKEN) {
         report(token.line, token.column, " at end", message);
     } else {
-        report(token.line, token.column, " at '" + token.lexeme + "'", message);
+        report(token.line, token.column, " at '" + token.text() + "'", message);
     }
 }
 
 void ErrorHandler::runtimeError(const RuntimeError& error) {
+    Output::flush(); // what the script printed before failing comes first
     std::cerr << "[line " << error.token.line << ", column " << error.token.column << "] Runtime Error: " 
               << error.what() << std::endl;
     hadRuntimeError = true;
 }
 
 void ErrorHandler::report(int line, int column, const std::string& where, const std::string& message) {
+    Output::flush();
     std::cerr << "[line " << line << ", column " << column << "] Error" << where << ": " << message << std::endl;
     hadError = true;
 }
\ No newline at end of file
@@ -2,10 +2,12 @@
 #include "../lexer/token.hpp"
 #include <string>
 
+// Error state is kept per thread, so interpreters embedded on different
+// threads each see only their own errors
 class ErrorHandler {
 private:
-    static bool hadError;
-    static bool hadRuntimeError;
+    static thread_local bool hadError;
+    static thread_local bool hadRuntimeError;
 
 public:
     static void error(int line, int column, const std::string& message);
@@ -14,22 +14,7 @@ public:
     Token token;
     
     RuntimeError(Token token, const std::string& message)
-        : std::runtime_error(message), token(std::move(token)) {}
+        : std::runtime_error(message), token(std::move(token)) {
+        Metrics::count(Metrics::Exceptions);
+    }
 };
-
-class ReturnValue : public std::runtime_error {
-public:
-    Value value;
-    
-    explicit ReturnValue(Value value) : std::runtime_error("return"), value(std::move(value)) {}
-};
-
-class BreakException : public std::runtime_error {
-public:
-    BreakException() : std::runtime_error("break") {}
-};
-
-class ContinueException : public std::runtime_error {
-public:
-    ContinueException() : std::runtime_error("continue") {}
-};
\ No newline at end of file
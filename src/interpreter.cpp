@@ -1,41 +1,72 @@
 #include "interpreter.hpp"
+#include "runtime/async.hpp"
 #include "runtime/callable.hpp"
+#include "runtime/hash_map.hpp"
+#include "runtime/iterable.hpp"
 #include "runtime/native_functions.hpp"
 #include "runtime/library_manager.hpp"
+#include "runtime/module.hpp"
+#include "runtime/output.hpp"
+#include "runtime/parallel.hpp"
+#include "runtime/profiler.hpp"
 #include "error/error_handler.hpp"
 #include "error/exceptions.hpp"
 #include <cmath>
 #include <iostream>
 #include <utility>
 
-Interpreter::Interpreter() {
+Interpreter::Interpreter() : Interpreter(std::make_shared<Modules>()) {
+    ownsModules = true;
+}
+
+Interpreter::Interpreter(std::shared_ptr<Modules> modules) : modules(std::move(modules)) {
     globals = std::make_shared<Environment>();
     environment = globals;
     
     // Define native functions
-    globals->define("print", Value(createPrintFunction()));
-    globals->define("input", Value(createInputFunction()));
-    globals->define("len", Value(createLenFunction()));
-    globals->define("str", Value(createStrFunction()));
-    globals->define("num", Value(createNumFunction()));
-    globals->define("type", Value(createTypeFunction()));
-    globals->define("clock", Value(createClockFunction()));
-    globals->define("range", Value(createRangeFunction()));
-    globals->define("map", Value(createMapFunction()));
-    globals->define("filter", Value(createFilterFunction()));
-}
-
-void Interpreter::interpret(const std::vector<StmtPtr>& statements) {
+    for (const auto& native : createNativeFunctions()) {
+        globals->define(native.first, Value(native.second));
+    }
+}
+
+Interpreter::Interpreter(WorkerTag, std::shared_ptr<Environment> globals, std::shared_ptr<Modules> modules)
+    : globals(std::move(globals)), task(currentParallelTask()), modules(std::move(modules)) {
+    environment = this->globals;
+}
+
+Interpreter::~Interpreter() {
+    // The modules' interpreters hold the table too
+    if (ownsModules) modules->clear();
+}
+
+std::unique_ptr<Interpreter> Interpreter::createWorker() const {
+    return std::unique_ptr<Interpreter>(new Interpreter(WorkerTag{}, globals, modules));
+}
+
+void Interpreter::interpret(const NodeList<StmtPtr>& statements) {
+    bool failed = false;
     try {
-        for (const auto& statement : statements) {
-            execute(*statement);
-        }
+        run(statements);
     } catch (const RuntimeError& error) {
         ErrorHandler::runtimeError(error);
+        failed = true;
+    }
+    // The script's tasks end with it
+    EventLoop::local().finish(!failed);
+    completion = Completion::Normal;
+    returnValue = Value();
+}
+
+void Interpreter::run(const NodeList<StmtPtr>& statements) {
+    for (const auto& statement : statements) {
+        execute(*statement);
+        if (completion != Completion::Normal) break; // top-level return ends the script
     }
+    completion = Completion::Normal;
+    returnValue = Value();
 }
 
-void Interpreter::executeBlock(const std::vector<StmtPtr>& statements, 
+void Interpreter::executeBlock(const NodeList<StmtPtr>& statements, 
                               std::shared_ptr<Environment> environment) {
     auto previous = this->environment;
     
@@ -44,6 +75,7 @@ void Interpreter::executeBlock(const std::vector<StmtPtr>& statements,
         
         for (const auto& statement : statements) {
             execute(*statement);
+            if (completion != Completion::Normal) break;
         }
     } catch (...) {
         this->environment = previous;
@@ -53,17 +85,66 @@ void Interpreter::executeBlock(const std::vector<StmtPtr>& statements,
     this->environment = previous;
 }
 
+Value Interpreter::executeBody(const NodeList<StmtPtr>& body, std::shared_ptr<Environment> environment) {
+    EventLoop::checkStack();
+    executeBlock(body, std::move(environment));
+    
+    if (completion == Completion::Return) {
+        completion = Completion::Normal;
+        return std::move(returnValue);
+    }
+    return {};
+}
+
 Value Interpreter::evaluate(Expr& expr) {
     return expr.accept(*this);
 }
 
 void Interpreter::execute(Stmt& stmt) {
+    ProfileLine line(stmt.line);
+    Heap::safePoint();
     stmt.accept(*this);
 }
 
+Value Interpreter::lookUpVariable(const Token& name, const VarSlot& slot) {
+    if (slot.isLocal()) {
+        return environment->getAt(slot.depth, slot.index);
+    }
+    return globals->get(name);
+}
+
+// Called after each loop body; returns true when the loop must stop
+bool Interpreter::finishIteration() {
+    switch (completion) {
+        case Completion::Normal:
+            return false;
+        case Completion::Continue:
+            completion = Completion::Normal;
+            return false;
+        case Completion::Break:
+            completion = Completion::Normal;
+            return true;
+        case Completion::Return:
+            return true;
+    }
+    return true;
+}
+
+void Interpreter::declare(const Token& name, int slot, const Value& value) {
+    if (slot >= 0) {
+        environment->defineAt(slot, value);
+    } else {
+        environment->define(name.symbol, value);
+    }
+}
+
 Value Interpreter::visitBinaryExpr(BinaryExpr& expr) {
     Value left = evaluate(*expr.left);
     Value right = evaluate(*expr.right);
+    Value result;
+#ifdef NUMERIC_TIER
+    expr.feedback.record(left, right);
+#endif
     
     switch (expr.operator_.type) {
         case TokenType::GREATER:
@@ -83,6 +164,7 @@ Value Interpreter::visitBinaryExpr(BinaryExpr& expr) {
         case TokenType::EQUAL_EQUAL:
             return Value(isEqual(left, right));
         case TokenType::MINUS:
+            if (arrayOperands(expr.operator_, ArrayOp::Subtract, left, right, result)) return result;
             checkNumberOperands(expr.operator_, left, right);
             return Value(left.asNumber() - right.asNumber());
         case TokenType::PLUS:
@@ -90,16 +172,19 @@ Value Interpreter::visitBinaryExpr(BinaryExpr& expr) {
                 return Value(left.asNumber() + right.asNumber());
             }
             if (left.isString() || right.isString()) {
-                return Value(left.toString() + right.toString());
+                return Value::concat(left, right);
             }
+            if (arrayOperands(expr.operator_, ArrayOp::Add, left, right, result)) return result;
             throw RuntimeError(expr.operator_, "Operands must be two numbers or strings");
         case TokenType::SLASH:
+            if (arrayOperands(expr.operator_, ArrayOp::Divide, left, right, result)) return result;
             checkNumberOperands(expr.operator_, left, right);
             if (right.asNumber() == 0) {
                 throw RuntimeError(expr.operator_, "Division by zero");
             }
             return Value(left.asNumber() / right.asNumber());
         case TokenType::STAR:
+            if (arrayOperands(expr.operator_, ArrayOp::Multiply, left, right, result)) return result;
             checkNumberOperands(expr.operator_, left, right);
             return Value(left.asNumber() * right.asNumber());
         case TokenType::PERCENT:
@@ -151,6 +236,8 @@ Value Interpreter::visitUnaryExpr(UnaryExpr& expr) {
         case TokenType::TILDE:
             checkNumberOperand(expr.operator_, right);
             return Value(static_cast<double>(~static_cast<int>(right.asNumber())));
+        case TokenType::AWAIT:
+            return EventLoop::local().await(right, expr.operator_);
         default:
             break;
     }
@@ -167,41 +254,109 @@ Value Interpreter::visitGroupingExpr(GroupingExpr& expr) {
 }
 
 Value Interpreter::visitVariableExpr(VariableExpr& expr) {
-    return environment->get(expr.name);
+    return lookUpVariable(expr.name, expr.slot);
 }
 
 Value Interpreter::visitAssignExpr(AssignExpr& expr) {
     Value value = evaluate(*expr.value);
-    environment->assign(expr.name, value);
+    
+    if (expr.slot.isLocal()) {
+        if (task != 0 && environment->ancestor(expr.slot.depth)->ownerTask() != task) {
+            throw RuntimeError(expr.name, "Parallel callables can't assign captured variable '" + expr.name.text() + "'");
+        }
+        environment->assignAt(expr.slot.depth, expr.slot.index, value);
+    } else {
+        if (task != 0) {
+            throw RuntimeError(expr.name, "Parallel callables can't assign global '" + expr.name.text() + "'");
+        }
+        globals->assign(expr.name, value);
+    }
     return value;
 }
 
 Value Interpreter::visitCallExpr(CallExpr& expr) {
-    Value callee = evaluate(*expr.callee);
+    if (expr.property != nullptr) {
+        return invokeMethod(expr, *expr.property);
+    }
     
-    std::vector<Value> arguments;
-    for (const auto& argument : expr.arguments) {
-        arguments.push_back(evaluate(*argument));
+    Value callee = evaluate(*expr.callee);
+    ArgumentFrame arguments(argumentStack, expr.arguments.size());
+    evaluateArguments(expr, arguments);
+#ifdef NUMERIC_TIER
+    for (const Value& argument : arguments.view()) expr.argumentTypes.record(argument);
+#endif
+    return callValue(callee, arguments.view(), expr.paren);
+}
+
+void Interpreter::evaluateArguments(CallExpr& expr, ArgumentFrame& arguments) {
+    for (size_t i = 0; i < expr.arguments.size(); i++) {
+        arguments[i] = evaluate(*expr.arguments[i]);
+    }
+}
+
+Value Interpreter::callValue(const Value& callee, Arguments arguments, const Token& paren) {
+    std::shared_ptr<Callable> function;
+    if (callee.isCallable()) {
+        function = callee.asCallable();
+    } else if (callee.isClass()) {
+        function = callee.asClass();
+    } else {
+        throw RuntimeError(paren, "Can only call functions and classes");
     }
     
-    if (!callee.isCallable()) {
-        throw RuntimeError(expr.paren, "Can only call functions and classes");
+    checkArity(function->arity(), arguments.size(), paren);
+    return function->call(*this, arguments);
+}
+
+// obj.name(...): a method found through the call site's cache is run
+// directly on the receiver instead of allocating a BoundMethod
+Value Interpreter::invokeMethod(CallExpr& expr, GetExpr& property) {
+    Value object = evaluate(*property.object);
+    if (object.isModule()) {
+        Value callee = object.asModule()->get(property.name);
+        ArgumentFrame arguments(argumentStack, expr.arguments.size());
+        evaluateArguments(expr, arguments);
+        return callValue(callee, arguments.view(), expr.paren);
+    }
+    if (!object.isInstance()) {
+        throw RuntimeError(property.name, "Only instances have properties");
     }
     
-    auto function = callee.asCallable();
-    if (function->arity() != -1 && arguments.size() != function->arity()) {
-        throw RuntimeError(expr.paren, "Expected " + std::to_string(function->arity()) + 
-                          " arguments but got " + std::to_string(arguments.size()));
+    auto found = object.asInstance()->lookup(property.name.text(), &property.cache);
+    if (found.method == nullptr) {
+        if (found.field == nullptr) {
+            throw RuntimeError(property.name, "Undefined property '" + property.name.text() + "'");
+        }
+        // Copied first: evaluating the arguments may reassign the field
+        Value callee = *found.field;
+        ArgumentFrame arguments(argumentStack, expr.arguments.size());
+        evaluateArguments(expr, arguments);
+        return callValue(callee, arguments.view(), expr.paren);
     }
     
-    return function->call(*this, arguments);
+    // The receiver's class keeps the method alive
+    Callable* method = found.method;
+    ArgumentFrame arguments(argumentStack, expr.arguments.size());
+    evaluateArguments(expr, arguments);
+    checkArity(method->arity(), expr.arguments.size(), expr.paren);
+    return method->callMethod(*this, object, arguments.view());
+}
+
+void Interpreter::checkArity(int arity, size_t argumentCount, const Token& paren) {
+    if (arity != -1 && argumentCount != static_cast<size_t>(arity)) {
+        throw RuntimeError(paren, "Expected " + std::to_string(arity) + 
+                          " arguments but got " + std::to_string(argumentCount));
+    }
 }
 
 Value Interpreter::visitGetExpr(GetExpr& expr) {
     Value object = evaluate(*expr.object);
     
     if (object.isInstance()) {
-        return object.asInstance()->get(expr.name);
+        return object.asInstance()->get(expr.name, &expr.cache);
+    }
+    if (object.isModule()) {
+        return object.asModule()->get(expr.name);
     }
     
     throw RuntimeError(expr.name, "Only instances have properties");
@@ -221,38 +376,85 @@ Value Interpreter::visitIndexExpr(IndexExpr& expr) {
     Value object = evaluate(*expr.object);
     Value index = evaluate(*expr.index);
     
-    if (!object.isList()) {
-        throw RuntimeError(Token(TokenType::LEFT_BRACKET, "[", "", 0, 0), 
-                          "Only lists can be indexed");
+    if (object.isMap()) {
+        const Value* value = object.asMap()->find(index);
+        if (value == nullptr) {
+            throw RuntimeError(expr.bracket, "Key not found: " + index.toString());
+        }
+        return *value;
+    }
+    
+    if (!object.isList() && !object.isArray()) {
+        throw RuntimeError(expr.bracket, "Only lists, arrays and maps can be indexed");
     }
     
     if (!index.isNumber()) {
-        throw RuntimeError(Token(TokenType::LEFT_BRACKET, "[", "", 0, 0), 
-                          "List index must be a number");
+        throw RuntimeError(expr.bracket, "List index must be a number");
     }
     
-    auto list = object.asList();
     int idx = static_cast<int>(index.asNumber());
+    if (object.isArray()) {
+        const auto& array = object.asArray();
+        if (idx < 0 || idx >= static_cast<int>(array->size())) {
+            throw RuntimeError(expr.bracket, "Array index out of range");
+        }
+        return Value((*array)[idx]);
+    }
     
+    auto list = object.asList();
     if (idx < 0 || idx >= static_cast<int>(list->size())) {
-        throw RuntimeError(Token(TokenType::LEFT_BRACKET, "[", "", 0, 0), 
-                          "List index out of range");
+        throw RuntimeError(expr.bracket, "List index out of range");
     }
     
     return (*list)[idx];
 }
 
+Value Interpreter::visitMapExpr(MapExpr& expr) {
+    auto map = std::make_shared<FocusMap>(expr.entries.size());
+    
+    for (const auto& entry : expr.entries) {
+        Value key = evaluate(*entry.first);
+        map->set(key, evaluate(*entry.second));
+    }
+    
+    return Value(map);
+}
+
+Value Interpreter::visitSetIndexExpr(SetIndexExpr& expr) {
+    Value object = evaluate(*expr.object);
+    
+    if (!object.isMap()) {
+        throw RuntimeError(expr.bracket, "Only map entries can be assigned");
+    }
+    
+    Value index = evaluate(*expr.index);
+    Value value = evaluate(*expr.value);
+    if (task != 0 && object.asMap()->ownerTask() != task) {
+        throw RuntimeError(expr.bracket, "Parallel callables can only change maps they created");
+    }
+    object.asMap()->set(index, value);
+    return value;
+}
+
 Value Interpreter::visitExternExpr(ExternExpr& expr) {
-    std::vector<Value> arguments;
-    for (const auto& argument : expr.arguments) {
-        arguments.push_back(evaluate(*argument));
+    ArgumentFrame arguments(argumentStack, expr.arguments.size());
+    for (size_t i = 0; i < expr.arguments.size(); i++) {
+        arguments[i] = evaluate(*expr.arguments[i]);
     }
     
     try {
+        if (expr.spawned) {
+            return Value(LibraryManager::getInstance().spawnFunction(
+                expr.library.text(),
+                expr.function.text(),
+                std::vector<Value>(arguments.view().begin(), arguments.view().end())
+            ));
+        }
         return LibraryManager::getInstance().callFunction(
-            expr.library.lexeme, 
-            expr.function.lexeme, 
-            arguments
+            expr.site,
+            expr.library.text(), 
+            expr.function.text(), 
+            arguments.view()
         );
     } catch (const std::exception& e) {
         throw RuntimeError(expr.function, "External function call failed: " + std::string(e.what()));
@@ -261,20 +463,20 @@ Value Interpreter::visitExternExpr(ExternExpr& expr) {
 
 Value Interpreter::visitLoadLibraryExpr(LoadLibraryExpr& expr) {
     bool success = LibraryManager::getInstance().loadLibrary(
-        expr.alias.lexeme,
-        expr.libraryPath.literal,
+        expr.alias.text(),
+        std::string(expr.libraryPath.literal),
         expr.libraryType
     );
     
     if (!success) {
-        throw RuntimeError(expr.alias, "Failed to load library: " + expr.libraryPath.literal);
+        throw RuntimeError(expr.alias, "Failed to load library: " + std::string(expr.libraryPath.literal));
     }
     
     return Value(true);
 }
 
 Value Interpreter::visitLambdaExpr(LambdaExpr& expr) {
-    return Value(std::make_shared<Lambda>(expr.params, std::move(expr.body), environment));
+    return Value(std::make_shared<Lambda>(&expr, environment));
 }
 
 Value Interpreter::visitTernaryExpr(TernaryExpr& expr) {
@@ -295,7 +497,10 @@ Value Interpreter::visitSetExpr(SetExpr& expr) {
     }
     
     Value value = evaluate(*expr.value);
-    object.asInstance()->set(expr.name, value);
+    if (task != 0 && object.asInstance()->ownerTask() != task) {
+        throw RuntimeError(expr.name, "Parallel callables can only set fields on instances they created");
+    }
+    object.asInstance()->set(expr.name, value, &expr.cache);
     return value;
 }
 
@@ -305,7 +510,7 @@ Value Interpreter::visitSuperExpr(SuperExpr& expr) {
 }
 
 Value Interpreter::visitThisExpr(ThisExpr& expr) {
-    return environment->get(expr.keyword);
+    return lookUpVariable(expr.keyword, expr.slot);
 }
 
 void Interpreter::visitExpressionStmt(ExpressionStmt& stmt) {
@@ -314,7 +519,10 @@ void Interpreter::visitExpressionStmt(ExpressionStmt& stmt) {
 
 void Interpreter::visitPrintStmt(PrintStmt& stmt) {
     Value value = evaluate(*stmt.expression);
-    std::cout << stringify(value) << std::endl;
+    std::string line;
+    value.appendTo(line);
+    line += '\n';
+    Output::write(line);
 }
 
 void Interpreter::visitVarStmt(VarStmt& stmt) {
@@ -323,11 +531,11 @@ void Interpreter::visitVarStmt(VarStmt& stmt) {
         value = evaluate(*stmt.initializer);
     }
     
-    environment->define(stmt.name.lexeme, value);
+    declare(stmt.name, stmt.slot, value);
 }
 
 void Interpreter::visitBlockStmt(BlockStmt& stmt) {
-    executeBlock(stmt.statements, std::make_shared<Environment>(environment));
+    executeBlock(stmt.statements, Environment::create(environment, stmt.slotCount));
 }
 
 void Interpreter::visitIfStmt(IfStmt& stmt) {
@@ -341,11 +549,12 @@ void Interpreter::visitIfStmt(IfStmt& stmt) {
 void Interpreter::visitWhileStmt(WhileStmt& stmt) {
     while (evaluate(*stmt.condition).isTruthy()) {
         execute(*stmt.body);
+        if (finishIteration()) break;
     }
 }
 
 void Interpreter::visitForStmt(ForStmt& stmt) {
-    auto forEnvironment = std::make_shared<Environment>(environment);
+    auto forEnvironment = Environment::create(environment, stmt.slotCount);
     auto previous = environment;
     
     try {
@@ -361,6 +570,7 @@ void Interpreter::visitForStmt(ForStmt& stmt) {
             }
             
             execute(*stmt.body);
+            if (finishIteration()) break;
             
             if (stmt.increment != nullptr) {
                 evaluate(*stmt.increment);
@@ -376,7 +586,7 @@ void Interpreter::visitForStmt(ForStmt& stmt) {
 
 void Interpreter::visitFunctionStmt(FunctionStmt& stmt) {
     auto function = std::make_shared<Function>(&stmt, environment);
-    environment->define(stmt.name.lexeme, Value(function));
+    declare(stmt.name, stmt.slot, Value(function));
 }
 
 void Interpreter::visitReturnStmt(ReturnStmt& stmt) {
@@ -385,7 +595,16 @@ void Interpreter::visitReturnStmt(ReturnStmt& stmt) {
         value = evaluate(*stmt.value);
     }
     
-    throw ReturnValue(value);
+    returnValue = std::move(value);
+    completion = Completion::Return;
+}
+
+void Interpreter::visitBreakStmt(BreakStmt& stmt) {
+    completion = Completion::Break;
+}
+
+void Interpreter::visitContinueStmt(ContinueStmt& stmt) {
+    completion = Completion::Continue;
 }
 
 void Interpreter::visitClassStmt(ClassStmt& stmt) {
@@ -399,82 +618,129 @@ void Interpreter::visitClassStmt(ClassStmt& stmt) {
         superclass = superclassValue.asClass();
     }
     
-    environment->define(stmt.name.lexeme, Value());
+    declare(stmt.name, stmt.slot, Value());
     
-    std::unordered_map<std::string, std::shared_ptr<Function>> methods;
+    std::unordered_map<std::string, std::shared_ptr<Callable>> methods;
     for (const auto& method : stmt.methods) {
-        auto functionStmt = dynamic_cast<FunctionStmt*>(method.get());
+        auto functionStmt = dynamic_cast<FunctionStmt*>(method);
         if (functionStmt) {
             auto function = std::make_shared<Function>(functionStmt, environment);
-            methods[functionStmt->name.lexeme] = function;
+            methods[functionStmt->name.text()] = function;
         }
     }
     
-    auto klass = std::make_shared<FocusClass>(stmt.name.lexeme, superclass, methods);
-    environment->assign(stmt.name, Value(klass));
+    auto klass = std::make_shared<FocusClass>(stmt.name.text(), superclass, methods);
+    declare(stmt.name, stmt.slot, Value(klass));
 }
 
 void Interpreter::visitExternStmt(ExternStmt& stmt) {
     bool success = LibraryManager::getInstance().loadLibrary(
-        stmt.alias.lexeme,
-        stmt.libraryPath.literal,
+        stmt.alias.text(),
+        std::string(stmt.libraryPath.literal),
         stmt.libraryType
     );
     
     if (!success) {
-        throw RuntimeError(stmt.alias, "Failed to load external library: " + stmt.libraryPath.literal);
+        throw RuntimeError(stmt.alias, "Failed to load external library: " + std::string(stmt.libraryPath.literal));
+    }
+
+    for (size_t i = 0; i < stmt.functions.size(); i++) {
+        if (!stmt.signatures[i].declared) continue;
+        try {
+            LibraryManager::getInstance().bindFunction(stmt.alias.text(), stmt.functions[i].text(), stmt.signatures[i]);
+        } catch (const std::exception& e) {
+            throw RuntimeError(stmt.functions[i], "Can't bind native function: " + std::string(e.what()));
+        }
     }
     
     // Define the library alias in the environment
-    environment->define(stmt.alias.lexeme, Value("library:" + stmt.alias.lexeme));
+    declare(stmt.alias, stmt.slot, Value("library:" + stmt.alias.text()));
 }
 
 void Interpreter::visitPluginStmt(PluginStmt& stmt) {
     bool success = LibraryManager::getInstance().loadLibrary(
-        stmt.alias.lexeme,
-        stmt.pluginPath.literal,
+        stmt.alias.text(),
+        std::string(stmt.pluginPath.literal),
         "custom"
     );
     
     if (!success) {
-        throw RuntimeError(stmt.alias, "Failed to load plugin: " + stmt.pluginPath.literal);
+        throw RuntimeError(stmt.alias, "Failed to load plugin: " + std::string(stmt.pluginPath.literal));
     }
     
     // Define the plugin alias in the environment
-    environment->define(stmt.alias.lexeme, Value("plugin:" + stmt.alias.lexeme));
+    declare(stmt.alias, stmt.slot, Value("plugin:" + stmt.alias.text()));
 }
 
 void Interpreter::visitImportStmt(ImportStmt& stmt) {
-    // Simplified import - just define the module name
-    environment->define(stmt.module.lexeme, Value("imported_module"));
+    // The module only runs once a member is read
+    Value module(modules->import(stmt.module.text()));
+    declare(stmt.module, stmt.moduleSlot, module);
     
     if (!stmt.alias.lexeme.empty()) {
-        environment->define(stmt.alias.lexeme, Value("imported_module"));
+        declare(stmt.alias, stmt.aliasSlot, module);
     }
 }
 
+void Interpreter::visitForInStmt(ForInStmt& stmt) {
+    Value iterable = evaluate(*stmt.iterable);
+    auto iterator = makeIterator(iterable);
+    if (iterator == nullptr) {
+        throw RuntimeError(stmt.variable, "Can only iterate over lists, strings and iterables");
+    }
+    
+    auto loopEnvironment = Environment::create(environment, stmt.slotCount);
+    auto previous = environment;
+    
+    try {
+        environment = loopEnvironment;
+        
+        Value item;
+        while (iterator->next(*this, item)) {
+            environment->defineAt(stmt.slot, item);
+            execute(*stmt.body);
+            if (finishIteration()) break;
+        }
+    } catch (...) {
+        environment = previous;
+        throw;
+    }
+    
+    environment = previous;
+}
+
 void Interpreter::visitTryStmt(TryStmt& stmt) {
+    // The catch block runs after the C++ handler is left: a task may be
+    // suspended in it, and handlers can't be left open across tasks
+    bool caught = false;
+    std::string message;
     try {
         execute(*stmt.tryBlock);
     } catch (const RuntimeError& error) {
-        if (stmt.catchBlock != nullptr) {
-            auto catchEnv = std::make_shared<Environment>(environment);
-            if (!stmt.catchVar.lexeme.empty()) {
-                catchEnv->define(stmt.catchVar.lexeme, Value(error.what()));
-            }
-            
-            auto previous = environment;
-            environment = catchEnv;
-            try {
-                execute(*stmt.catchBlock);
-            } catch (...) {
-                environment = previous;
-                throw;
-            }
+        caught = true;
+        message = error.what();
+    }
+    if (caught && stmt.catchBlock != nullptr) {
+        auto catchEnv = Environment::create(environment, stmt.catchSlotCount);
+        
+        auto previous = environment;
+        environment = catchEnv;
+        if (!stmt.catchVar.lexeme.empty()) {
+            declare(stmt.catchVar, stmt.catchSlot, Value(message));
+        }
+        try {
+            execute(*stmt.catchBlock);
+        } catch (...) {
             environment = previous;
+            throw;
         }
+        environment = previous;
     }
     
+    // return/break/continue out of the try or catch block skip finally,
+    // as an escaping return always has
+    if (completion != Completion::Normal) return;
+    
     if (stmt.finallyBlock != nullptr) {
         execute(*stmt.finallyBlock);
     }
@@ -488,16 +754,28 @@ void Interpreter::visitThrowStmt(ThrowStmt& stmt) {
 void Interpreter::visitSwitchStmt(SwitchStmt& stmt) {
     Value switchValue = evaluate(*stmt.expr);
     
+    if (stmt.table != nullptr) {
+        int index = stmt.table->find(switchValue);
+        StmtPtr body = index >= 0 ? stmt.cases[index].second : stmt.defaultCase;
+        if (body != nullptr) {
+            execute(*body);
+            if (completion == Completion::Break) completion = Completion::Normal;
+        }
+        return;
+    }
+    
     for (const auto& caseStmt : stmt.cases) {
         Value caseValue = evaluate(*caseStmt.first);
         if (isEqual(switchValue, caseValue)) {
             execute(*caseStmt.second);
+            if (completion == Completion::Break) completion = Completion::Normal;
             return;
         }
     }
     
     if (stmt.defaultCase != nullptr) {
         execute(*stmt.defaultCase);
+        if (completion == Completion::Break) completion = Completion::Normal;
     }
 }
 
@@ -517,6 +795,14 @@ void Interpreter::checkNumberOperands(const Token& operator_, const Value& left,
     }
 }
 
+bool Interpreter::arrayOperands(const Token& operator_, ArrayOp op, const Value& left, const Value& right, Value& result) {
+    try {
+        return arrayArithmetic(op, left, right, result);
+    } catch (const std::runtime_error& e) {
+        throw RuntimeError(operator_, e.what());
+    }
+}
+
 std::string Interpreter::stringify(const Value& value) {
     return value.toString();
 }
\ No newline at end of file
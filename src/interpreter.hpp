@@ -1,20 +1,85 @@
 #pragma once
 
 #include "parser/ast.hpp"
+#include "runtime/arguments.hpp"
 #include "runtime/environment.hpp"
+#include "runtime/numeric_array.hpp"
 #include "runtime/value.hpp"
+#include <cstdint>
 #include <memory>
 
+class Modules;
+
+// Statements must have been through the Resolver before they are
+// executed: locals are read from environment slots and every unresolved
+// name is looked up in the globals.
 class Interpreter : public ASTVisitor {
 private:
+    // How the last statement finished. return/break/continue set it and
+    // every statement list stops as soon as it is not Normal, so control
+    // flow leaves nested statements without throwing.
+    enum class Completion { Normal, Return, Break, Continue };
+
     std::shared_ptr<Environment> globals;
     std::shared_ptr<Environment> environment;
+    Completion completion = Completion::Normal;
+    Value returnValue;
+    ArgumentStack argumentStack; // arguments of the calls in progress
+    // Parallel task this interpreter runs for, 0 for the main interpreter.
+    // A worker only writes to frames and instances created by its own task.
+    uint64_t task = 0;
+    // The modules imported through this interpreter, shared with its
+    // workers and with the interpreters of the modules themselves
+    std::shared_ptr<Modules> modules;
+    bool ownsModules = false;
+
+    struct WorkerTag {};
+    Interpreter(WorkerTag, std::shared_ptr<Environment> globals, std::shared_ptr<Modules> modules);
 
 public:
+    // A session's interpreter, with modules of its own
     Interpreter();
+    // A module's interpreter, importing into the table of its session
+    explicit Interpreter(std::shared_ptr<Modules> modules);
+    ~Interpreter() override;
+
+    // Interpreter for the parallel task running on the calling thread. It
+    // shares this interpreter's globals but none of its call state.
+    std::unique_ptr<Interpreter> createWorker() const;
+
+    const std::shared_ptr<Environment>& getGlobals() const { return globals; }
+    Modules& getModules() const { return *modules; }
+
+    // Makes the globals of the module a function was declared in the
+    // current ones while it runs; a no-op for the running script's own
+    // functions
+    class GlobalsScope {
+    public:
+        GlobalsScope(Interpreter& interpreter, Environment* globals) : interpreter(interpreter) {
+            if (globals != nullptr && globals != interpreter.globals.get()) {
+                saved = std::move(interpreter.globals);
+                interpreter.globals = globals->shared_from_this();
+            }
+        }
+        GlobalsScope(const GlobalsScope&) = delete;
+        GlobalsScope& operator=(const GlobalsScope&) = delete;
+        ~GlobalsScope() {
+            if (saved != nullptr) interpreter.globals = std::move(saved);
+        }
+
+    private:
+        Interpreter& interpreter;
+        std::shared_ptr<Environment> saved;
+    };
     
-    void interpret(const std::vector<StmtPtr>& statements);
-    void executeBlock(const std::vector<StmtPtr>& statements, std::shared_ptr<Environment> environment);
+    // Stops at a runtime error, which is reported on stderr
+    void interpret(const NodeList<StmtPtr>& statements);
+    // Same, but the error is thrown to the caller
+    void run(const NodeList<StmtPtr>& statements);
+    void executeBlock(const NodeList<StmtPtr>& statements, std::shared_ptr<Environment> environment);
+    // Runs a function body and returns the value of its return statement,
+    // or nil if it finished without one.
+    Value executeBody(const NodeList<StmtPtr>& body, std::shared_ptr<Environment> environment);
     
     // Expression visitors
     Value visitLambdaExpr(LambdaExpr& expr) override;
@@ -32,6 +97,8 @@ public:
     Value visitGetExpr(GetExpr& expr) override;
     Value visitListExpr(ListExpr& expr) override;
     Value visitIndexExpr(IndexExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSetIndexExpr(SetIndexExpr& expr) override;
     Value visitExternExpr(ExternExpr& expr) override;
     Value visitLoadLibraryExpr(LoadLibraryExpr& expr) override;
     
@@ -50,14 +117,26 @@ public:
     void visitIfStmt(IfStmt& stmt) override;
     void visitWhileStmt(WhileStmt& stmt) override;
     void visitForStmt(ForStmt& stmt) override;
+    void visitForInStmt(ForInStmt& stmt) override;
     void visitFunctionStmt(FunctionStmt& stmt) override;
     void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitBreakStmt(BreakStmt& stmt) override;
+    void visitContinueStmt(ContinueStmt& stmt) override;
 
 private:
     Value evaluate(Expr& expr);
     void execute(Stmt& stmt);
+    Value lookUpVariable(const Token& name, const VarSlot& slot);
+    void evaluateArguments(CallExpr& expr, ArgumentFrame& arguments);
+    Value callValue(const Value& callee, Arguments arguments, const Token& paren);
+    Value invokeMethod(CallExpr& expr, GetExpr& property);
+    static void checkArity(int arity, size_t argumentCount, const Token& paren);
+    void declare(const Token& name, int slot, const Value& value);
+    bool finishIteration();
     static bool isEqual(const Value& a, const Value& b);
     static void checkNumberOperand(const Token& operator_, const Value& operand);
     static void checkNumberOperands(const Token& operator_, const Value& left, const Value& right);
+    // Elementwise arithmetic when either operand is an array; false if neither is
+    static bool arrayOperands(const Token& operator_, ArrayOp op, const Value& left, const Value& right, Value& result);
     static std::string stringify(const Value& value);
 };
\ No newline at end of file
@@ -103,7 +103,26 @@ TokenType TokenUtils::getKeywordType(const std::string& text) {
     return TokenType::IDENTIFIER;
 }
 
-Lexer::Lexer(std::string source) : source(std::move(source)) {}
+TokenType TokenUtils::getKeywordType(Symbol symbol) {
+    static const std::unordered_map<Symbol, TokenType> bySymbol = [] {
+        std::unordered_map<Symbol, TokenType> table;
+        for (const auto& keyword : keywords) {
+            table.emplace(SymbolTable::intern(keyword.first), keyword.second);
+        }
+        return table;
+    }();
+
+    auto it = bySymbol.find(symbol);
+    if (it != bySymbol.end()) {
+        return it->second;
+    }
+    return TokenType::IDENTIFIER;
+}
+
+Lexer::Lexer(std::string_view source) : source(source), spellings(ownSpellings) {}
+
+Lexer::Lexer(std::string_view source, SpellingCache& spellings, int firstLine)
+    : source(source), spellings(spellings), continues(true), line(firstLine) {}
 
 std::vector<Token> Lexer::scanTokens() {
     while (!isAtEnd()) {
@@ -193,6 +212,7 @@ std::vector<Token> Lexer::scanTokens() {
                         }
                         advance();
                     }
+                    if (isAtEnd() && stopOpen()) break;
                     if (!isAtEnd()) {
                         advance(); // *
                         advance(); // /
@@ -226,12 +246,12 @@ std::vector<Token> Lexer::scanTokens() {
         }
     }
 
-    tokens.emplace_back(TokenType::EOF_TOKEN, "", "", line, column);
+    tokens.emplace_back(TokenType::EOF_TOKEN, Symbol(), Symbol(), line, column);
     return tokens;
 }
 
 bool Lexer::isAtEnd() {
-    return current >= source.length();
+    return static_cast<size_t>(current) >= source.length();
 }
 
 char Lexer::advance() {
@@ -240,12 +260,31 @@ char Lexer::advance() {
 }
 
 void Lexer::addToken(TokenType type) {
-    addToken(type, "");
+    addToken(type, Symbol());
 }
 
-void Lexer::addToken(TokenType type, const std::string& literal) {
-    std::string text = source.substr(start, current - start);
-    tokens.emplace_back(type, text, literal, line, column - text.length());
+void Lexer::addToken(TokenType type, Symbol literal) {
+    addToken(type, symbolFor(source.substr(start, current - start)), literal);
+}
+
+void Lexer::addToken(TokenType type, Symbol lexeme, Symbol literal) {
+    tokens.emplace_back(type, lexeme, literal, line, column - (current - start));
+}
+
+// Spellings repeat a lot, so each one only reaches the shared table once
+Symbol Lexer::symbolFor(std::string_view text) {
+    auto it = spellings.find(text);
+    if (it != spellings.end()) return it->second;
+
+    Symbol symbol = SymbolTable::intern(text);
+    spellings.emplace(SymbolTable::text(symbol), symbol);
+    return symbol;
+}
+
+bool Lexer::stopOpen() {
+    if (!continues) return false;
+    open = true;
+    return true;
 }
 
 bool Lexer::match(char expected) {
@@ -263,7 +302,7 @@ char Lexer::peek() {
 }
 
 char Lexer::peekNext() {
-    if (current + 1 >= source.length()) return '\0';
+    if (static_cast<size_t>(current) + 1 >= source.length()) return '\0';
     return source[current + 1];
 }
 
@@ -293,13 +332,13 @@ void Lexer::string() {
     }
 
     if (isAtEnd()) {
-        ErrorHandler::error(line, column, "Unterminated string");
+        if (!stopOpen()) ErrorHandler::error(line, column, "Unterminated string");
         return;
     }
 
     // The closing "
     advance();
-    addToken(TokenType::STRING, value);
+    addToken(TokenType::STRING, SymbolTable::intern(value));
 }
 
 void Lexer::number() {
@@ -313,16 +352,15 @@ void Lexer::number() {
         while (isDigit(peek())) advance();
     }
 
-    std::string value = source.substr(start, current - start);
-    addToken(TokenType::NUMBER, value);
+    Symbol text = symbolFor(source.substr(start, current - start));
+    addToken(TokenType::NUMBER, text, text);
 }
 
 void Lexer::identifier() {
     while (isAlphaNumeric(peek())) advance();
 
-    std::string text = source.substr(start, current - start);
-    TokenType type = TokenUtils::getKeywordType(text);
-    addToken(type);
+    Symbol text = symbolFor(source.substr(start, current - start));
+    addToken(TokenUtils::getKeywordType(text), text, Symbol());
 }
 
 bool Lexer::isDigit(char c) {
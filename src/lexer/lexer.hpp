@@ -1,12 +1,25 @@
 #pragma once
 #include "token.hpp"
-#include <vector>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
+// Scans source into tokens. The source is only read while scanTokens()
+// runs; the tokens refer to interned text, not into it.
 class Lexer {
+public:
+    // Symbols by spelling, keyed by views into the interned text, so a
+    // cache can outlive the source and be shared by successive lexers
+    using SpellingCache = std::unordered_map<std::string_view, Symbol>;
+
 private:
-    std::string source;
+    std::string_view source;
     std::vector<Token> tokens;
+    SpellingCache ownSpellings;
+    SpellingCache& spellings;
+    bool continues = false; // more input may follow source
+    bool open = false;      // source ended inside a string or comment
     int start = 0;
     int current = 0;
     int line = 1;
@@ -15,7 +28,9 @@ private:
     bool isAtEnd();
     char advance();
     void addToken(TokenType type);
-    void addToken(TokenType type, const std::string& literal);
+    void addToken(TokenType type, Symbol literal);
+    void addToken(TokenType type, Symbol lexeme, Symbol literal);
+    Symbol symbolFor(std::string_view text);
     bool match(char expected);
     char peek();
     char peekNext();
@@ -28,7 +43,19 @@ private:
     void skipWhitespace();
     void skipComment();
 
+    // A string or block comment reaches the end of a piece that more
+    // input continues: stop before it rather than report an error
+    bool stopOpen();
+
 public:
-    explicit Lexer(std::string source);
+    explicit Lexer(std::string_view source);
+    // Scans one piece of input that arrives in pieces, as in the REPL.
+    // Lines are numbered from firstLine, and a string or block comment
+    // still open at the end of the piece is not an error: scanning stops
+    // there and endsOpen() is set, so the piece is scanned again with
+    // the input that follows.
+    Lexer(std::string_view source, SpellingCache& spellings, int firstLine);
+
     std::vector<Token> scanTokens();
+    bool endsOpen() const { return open; }
 };
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "symbol_table.hpp"
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+std::atomic<std::string*> SymbolTable::chunks[SymbolTable::kMaxChunks];
+
+struct SymbolTable::State {
+    std::mutex mutex;
+    std::unordered_map<std::string_view, Symbol> index; // views into chunks
+    std::vector<std::unique_ptr<std::string[]>> owned;
+    uint32_t count = 1;
+
+    State() {
+        owned.push_back(std::make_unique<std::string[]>(kChunkSize));
+        chunks[0].store(owned.back().get(), std::memory_order_release);
+        index.emplace(std::string_view(owned.back()[0]), 0);
+    }
+};
+
+// Built on first use, so other static initializers may intern too
+SymbolTable::State& SymbolTable::state() {
+    static State state;
+    return state;
+}
+
+namespace {
+
+// Sets up symbol 0 at startup, so text(0) works before anything is interned
+const Symbol emptySymbol = SymbolTable::intern("");
+
+} // namespace
+
+Symbol SymbolTable::intern(std::string_view text) {
+    State& state = SymbolTable::state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    auto it = state.index.find(text);
+    if (it != state.index.end()) return it->second;
+
+    uint32_t chunk = state.count >> kChunkBits;
+    if (chunk == kMaxChunks) {
+        throw std::length_error("Too many distinct symbols");
+    }
+    if ((state.count & (kChunkSize - 1)) == 0) {
+        state.owned.push_back(std::make_unique<std::string[]>(kChunkSize));
+        chunks[chunk].store(state.owned.back().get(), std::memory_order_release);
+    }
+
+    std::string& stored = chunks[chunk].load(std::memory_order_relaxed)[state.count & (kChunkSize - 1)];
+    stored.assign(text.data(), text.size());
+    Symbol symbol = state.count++;
+    state.index.emplace(std::string_view(stored), symbol);
+    return symbol;
+}
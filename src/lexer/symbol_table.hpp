@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Id of an interned spelling; 0 is the empty string
+using Symbol = uint32_t;
+
+// Every distinct identifier, keyword and literal text the lexer sees is
+// stored here once for the life of the process. Tokens keep views into
+// this storage, so they stay valid after the source buffer is gone, and
+// later passes compare and hash names by Symbol instead of by text.
+class SymbolTable {
+public:
+    static Symbol intern(std::string_view text);
+
+    // Lock-free: interned strings never move
+    static const std::string& text(Symbol symbol) {
+        return chunks[symbol >> kChunkBits].load(std::memory_order_acquire)[symbol & (kChunkSize - 1)];
+    }
+
+private:
+    static constexpr uint32_t kChunkBits = 12;
+    static constexpr uint32_t kChunkSize = 1u << kChunkBits;
+    static constexpr uint32_t kMaxChunks = 1u << 14; // 64M symbols
+
+    struct State;
+    static State& state();
+
+    // Zero-initialized, so it is usable before any constructor has run
+    static std::atomic<std::string*> chunks[kMaxChunks];
+};
@@ -1,5 +1,7 @@
 #pragma once
+#include "symbol_table.hpp"
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 enum class TokenType {
@@ -35,17 +37,27 @@ enum class TokenType {
     NEWLINE, EOF_TOKEN
 };
 
+// Tokens don't own any text: lexeme and literal view interned strings,
+// so copying a token is cheap and it outlives the source it came from.
 struct Token {
     TokenType type;
-    std::string lexeme;
-    std::string literal;
+    std::string_view lexeme;
+    std::string_view literal; // string contents or number text
+    Symbol symbol;            // the lexeme's id
     int line;
     int column;
 
-    Token() : type(TokenType::EOF_TOKEN), lexeme(""), literal(""), line(0), column(0) {}
+    Token() : type(TokenType::EOF_TOKEN), symbol(0), line(0), column(0) {}
 
-    Token(TokenType type, std::string lexeme, std::string literal, int line, int column)
-        : type(type), lexeme(std::move(lexeme)), literal(std::move(literal)), line(line), column(column) {}
+    Token(TokenType type, Symbol symbol, Symbol literal, int line, int column)
+        : type(type), lexeme(SymbolTable::text(symbol)), literal(SymbolTable::text(literal)),
+          symbol(symbol), line(line), column(column) {}
+
+    Token(TokenType type, std::string_view lexeme, std::string_view literal, int line, int column)
+        : Token(type, SymbolTable::intern(lexeme), SymbolTable::intern(literal), line, column) {}
+
+    // The lexeme as a string, for APIs keyed by std::string
+    const std::string& text() const { return SymbolTable::text(symbol); }
 };
 
 class TokenUtils {
@@ -53,4 +65,6 @@ public:
     static std::unordered_map<std::string, TokenType> keywords;
     static std::string tokenTypeToString(TokenType type);
     static TokenType getKeywordType(const std::string& text);
+    // Keyword lookup by interned spelling
+    static TokenType getKeywordType(Symbol symbol);
 };
\ No newline at end of file
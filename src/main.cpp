@@ -1,93 +1,185 @@
-#include "lexer/lexer.hpp"
-#include "parser/parser.hpp"
 #include "interpreter.hpp"
+#include "repl.hpp"
+#include "session.hpp"
+#include "vm/compiler.hpp"
+#include "vm/vm.hpp"
+#include "vm/bytecode_cache.hpp"
 #include "error/error_handler.hpp"
 #include "utils/file_utils.hpp"
+#include "runtime/gc.hpp"
+#include "runtime/profiler.hpp"
+#include "runtime/library_manager.hpp"
+#include "runtime/metrics.hpp"
+#include "runtime/module.hpp"
+#include "runtime/numeric_tier.hpp"
+#include "runtime/output.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
 #include <iostream>
 #include <string>
 
-void runFile(const std::string& path) {
-    try {
-        std::string source = FileUtils::readFile(path);
-        
-        Lexer lexer(source);
-        auto tokens = lexer.scanTokens();
-        
+enum class Engine { Tree, VM };
+
+struct Options {
+    Engine engine = Engine::Tree;
+    bool useCache = true;
+    bool optimize = true;
+    std::string profilePath; // where --profile writes its stacks; empty when off
+    size_t gcThreshold = Heap::kDefaultThreshold;
+    bool gc = true;
+    std::string metricsPath; // rewritten by --metrics-out every metricsInterval ms; empty when off
+    size_t metricsInterval = 1000;
+    Output::Mode output = Output::Mode::Default;
+};
+
+// Parses a positive decimal count, as taken by --gc-threshold and --metrics-interval
+bool parseCount(const std::string& text, size_t& count) {
+    if (text.empty() || text.size() > 18 || !std::all_of(text.begin(), text.end(), ::isdigit)) return false;
+    count = std::stoull(text);
+    return count > 0;
+}
+
+// Prints the --profile summary and writes the collapsed stacks
+void reportProfile(const std::string& stacksPath) {
+    Output::flush();
+    Profiler::writeSummary(std::cerr);
+    
+    std::ofstream stacks(stacksPath);
+    if (!stacks) {
+        std::cerr << "Could not write profile to " << stacksPath << std::endl;
+        return;
+    }
+    Profiler::writeCollapsedStacks(stacks);
+    std::cerr << "\nCollapsed stacks written to " << stacksPath << std::endl;
+}
+
+// On the VM a script is compiled once per change of its source: the
+// bytecode is kept next to it and reused while the source hash matches.
+// Caches always hold optimized code, so --no-optimize bypasses them.
+void runFileOnVm(const std::string& path, std::string_view source, const Options& options) {
+    VM vm;
+    bool useCache = options.useCache && options.optimize;
+    uint64_t hash = BytecodeCache::hash(source);
+    std::shared_ptr<VmFunction> script = useCache ? BytecodeCache::load(path, hash, vm) : nullptr;
+    
+    if (!script) {
+        // Compiled code doesn't point into the tree, so it goes right away
+        AstArena arena;
+        auto statements = Session::parse(source, arena, options.optimize);
         if (ErrorHandler::getHadError()) return;
         
-        Parser parser(std::move(tokens));
-        auto statements = parser.parse();
-        
+        Compiler compiler(vm);
+        script = compiler.compile(statements);
         if (ErrorHandler::getHadError()) return;
-        
-        Interpreter interpreter;
-        interpreter.interpret(statements);
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        if (useCache) BytecodeCache::store(path, hash, *script, vm);
     }
+    
+    if (!options.profilePath.empty()) Profiler::start();
+    vm.interpret(script);
 }
 
-void runPrompt() {
-    std::cout << "Focus Nexus Interactive Interpreter v1.0" << std::endl;
-    std::cout << "Type 'exit' to quit" << std::endl;
-    
-    Interpreter interpreter;
-    std::string line;
-    
-    while (true) {
-        std::cout << "> ";
-        std::getline(std::cin, line);
-        
-        if (line == "exit" || line == "quit") {
-            break;
-        }
-        
-        if (line.empty()) {
-            continue;
-        }
-        
-        // Add newline for proper parsing
-        line += "\n";
+void runFile(const std::string& path, const Options& options) {
+    try {
+        MappedFile file(path);
+        std::string_view source = file.contents();
+        Modules::addSearchDirectory(FileUtils::getDirectory(path));
         
-        try {
-            Lexer lexer(line);
-            auto tokens = lexer.scanTokens();
-            
-            if (ErrorHandler::getHadError()) {
-                ErrorHandler::reset();
-                continue;
-            }
-            
-            Parser parser(std::move(tokens));
-            auto statements = parser.parse();
-            
-            if (ErrorHandler::getHadError()) {
-                ErrorHandler::reset();
-                continue;
-            }
+        if (options.engine == Engine::VM) {
+            runFileOnVm(path, source, options);
+        } else {
+            AstArena arena;
+            auto statements = Session::parse(source, arena, options.optimize);
+            if (ErrorHandler::getHadError()) return;
             
+            Interpreter interpreter;
+            if (!options.profilePath.empty()) Profiler::start();
             interpreter.interpret(statements);
-            
-        } catch (const std::exception& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
         }
         
-        ErrorHandler::reset();
+        if (Profiler::enabled()) {
+            Profiler::stop();
+            reportProfile(options.profilePath);
+        }
+        
+    } catch (const std::exception& e) {
+        Output::flush();
+        std::cerr << "Error: " << e.what() << std::endl;
     }
 }
 
+void runPrompt(const Options& options) {
+    std::cout << "Focus Nexus Interactive Interpreter v1.0" << std::endl;
+    std::cout << "Type 'exit' to quit, ':help' for commands" << std::endl;
+
+    Repl repl(options.engine == Engine::VM, options.optimize);
+    repl.run(std::cin, std::cout);
+}
+
+// Prints the usage line; returns the exit status for a bad command line
+int usage() {
+    std::cout << "Usage: focusNexus [--engine=tree|vm] [--profile[=stacks-file]] [--no-cache] [--no-optimize]"
+              << " [--gc-threshold=N] [--no-gc] [--no-tier]"
+              << " [--metrics] [--metrics-out=file] [--metrics-interval=ms]"
+              << " [--output=line|block|unbuffered] [script]" << std::endl;
+    return 64;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc > 2) {
-        std::cout << "Usage: focusNexus [script]" << std::endl;
-        return 64;
-    } else if (argc == 2) {
-        runFile(argv[1]);
-        if (ErrorHandler::getHadError()) return 65;
-        if (ErrorHandler::getHadRuntimeError()) return 70;
-    } else {
-        runPrompt();
+    Options options;
+    std::string script;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--engine=tree") {
+            options.engine = Engine::Tree;
+        } else if (arg == "--engine=vm") {
+            options.engine = Engine::VM;
+        } else if (arg == "--profile") {
+            options.profilePath = "profile.folded";
+        } else if (arg.rfind("--profile=", 0) == 0 && arg.size() > 10) {
+            options.profilePath = arg.substr(10);
+        } else if (arg == "--no-cache") {
+            options.useCache = false;
+        } else if (arg == "--no-optimize") {
+            options.optimize = false;
+        } else if (arg.rfind("--gc-threshold=", 0) == 0) {
+            if (!parseCount(arg.substr(15), options.gcThreshold)) return usage();
+        } else if (arg == "--no-gc") {
+            options.gc = false;
+        } else if (arg == "--no-tier") {
+            NumericTier::setEnabled(false);
+        } else if (arg == "--metrics") {
+            Metrics::setTiming(true);
+        } else if (arg.rfind("--metrics-out=", 0) == 0 && arg.size() > 14) {
+            options.metricsPath = arg.substr(14);
+        } else if (arg.rfind("--metrics-interval=", 0) == 0) {
+            if (!parseCount(arg.substr(19), options.metricsInterval)) return usage();
+        } else if (arg.rfind("--output=", 0) == 0) {
+            if (!Output::parseMode(std::string_view(arg).substr(9), options.output)) return usage();
+        } else if (arg.rfind("--", 0) != 0 && script.empty()) {
+            script = arg;
+        } else {
+            return usage();
+        }
     }
+    Heap::configure(options.gcThreshold, options.gc);
+    Output::configure(options.output);
+    if (!options.metricsPath.empty()) Metrics::startDumping(options.metricsPath, options.metricsInterval);
     
-    return 0;
+    int status = 0;
+    if (!script.empty()) {
+        runFile(script, options);
+        if (ErrorHandler::getHadError()) status = 65;
+        else if (ErrorHandler::getHadRuntimeError()) status = 70;
+    } else {
+        runPrompt(options);
+    }
+    Metrics::stopDumping();
+    Output::flush();
+
+    // Unload libraries while their own static objects are still alive:
+    // a plugin's cleanup may use them, and they go before the manager does
+    LibraryManager::getInstance().unloadAllLibraries();
+    return status;
 }
\ No newline at end of file
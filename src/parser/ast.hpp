@@ -1,16 +1,31 @@
 #pragma once
 #include "../lexer/token.hpp"
 #include "../runtime/value.hpp"
+#include "../runtime/native_binding.hpp"
+#include "../runtime/numeric_tier.hpp"
+#include "../runtime/shape.hpp"
+#include "../runtime/switch_table.hpp"
+#include "ast_arena.hpp"
 #include <memory>
-#include <vector>
 
 // Forward declarations
 class ASTVisitor;
 class Expr;
 class Stmt;
 
-using ExprPtr = std::unique_ptr<Expr>;
-using StmtPtr = std::unique_ptr<Stmt>;
+// Nodes live in the AstArena of their parse, which owns them all
+using ExprPtr = Expr*;
+using StmtPtr = Stmt*;
+
+// Storage location of a variable reference, filled in by the Resolver.
+// depth counts environments to walk outwards; depth == -1 means the name
+// was not found in any local scope and is looked up in the globals.
+struct VarSlot {
+    int depth = -1;
+    int index = -1;
+
+    [[nodiscard]] bool isLocal() const { return depth >= 0; }
+};
 
 // Base expression class
 class Expr {
@@ -22,10 +37,11 @@ public:
 // Expression types
 class LambdaExpr : public Expr {
 public:
-    std::vector<Token> params;
-    std::vector<StmtPtr> body;
+    NodeList<Token> params;
+    NodeList<StmtPtr> body;
+    int slotCount = 0;
 
-    LambdaExpr(std::vector<Token> params, std::vector<StmtPtr> body)
+    LambdaExpr(NodeList<Token> params, NodeList<StmtPtr> body)
         : params(std::move(params)), body(std::move(body)) {}
 
     Value accept(ASTVisitor& visitor) override;
@@ -48,6 +64,7 @@ public:
     ExprPtr object;
     Token name;
     ExprPtr value;
+    PropertyCache cache;
 
     SetExpr(ExprPtr object, Token name, ExprPtr value)
         : object(std::move(object)), name(std::move(name)), value(std::move(value)) {}
@@ -69,6 +86,7 @@ public:
 class ThisExpr : public Expr {
 public:
     Token keyword;
+    VarSlot slot;
 
     explicit ThisExpr(Token keyword) : keyword(std::move(keyword)) {}
 
@@ -80,6 +98,7 @@ public:
     ExprPtr left;
     Token operator_;
     ExprPtr right;
+    TypeFeedback feedback; // operands seen by the interpreter
 
     BinaryExpr(ExprPtr left, Token operator_, ExprPtr right)
         : left(std::move(left)), operator_(std::move(operator_)), right(std::move(right)) {}
@@ -119,6 +138,7 @@ public:
 class VariableExpr : public Expr {
 public:
     Token name;
+    VarSlot slot;
 
     explicit VariableExpr(Token name) : name(std::move(name)) {}
 
@@ -129,6 +149,7 @@ class AssignExpr : public Expr {
 public:
     Token name;
     ExprPtr value;
+    VarSlot slot;
 
     AssignExpr(Token name, ExprPtr value)
         : name(std::move(name)), value(std::move(value)) {}
@@ -136,13 +157,17 @@ public:
     Value accept(ASTVisitor& visitor) override;
 };
 
+class GetExpr;
+
 class CallExpr : public Expr {
 public:
     ExprPtr callee;
     Token paren;
-    std::vector<ExprPtr> arguments;
+    NodeList<ExprPtr> arguments;
+    GetExpr* property = nullptr; // set by the Resolver for obj.name(...) calls
+    TypeFeedback argumentTypes;  // arguments seen by the interpreter
 
-    CallExpr(ExprPtr callee, Token paren, std::vector<ExprPtr> arguments)
+    CallExpr(ExprPtr callee, Token paren, NodeList<ExprPtr> arguments)
         : callee(std::move(callee)), paren(std::move(paren)), arguments(std::move(arguments)) {}
 
     Value accept(ASTVisitor& visitor) override;
@@ -152,6 +177,7 @@ class GetExpr : public Expr {
 public:
     ExprPtr object;
     Token name;
+    PropertyCache cache;
 
     GetExpr(ExprPtr object, Token name)
         : object(std::move(object)), name(std::move(name)) {}
@@ -161,9 +187,9 @@ public:
 
 class ListExpr : public Expr {
 public:
-    std::vector<ExprPtr> elements;
+    NodeList<ExprPtr> elements;
 
-    explicit ListExpr(std::vector<ExprPtr> elements) : elements(std::move(elements)) {}
+    explicit ListExpr(NodeList<ExprPtr> elements) : elements(std::move(elements)) {}
 
     Value accept(ASTVisitor& visitor) override;
 };
@@ -171,10 +197,35 @@ public:
 class IndexExpr : public Expr {
 public:
     ExprPtr object;
+    Token bracket;
     ExprPtr index;
 
-    IndexExpr(ExprPtr object, ExprPtr index)
-        : object(std::move(object)), index(std::move(index)) {}
+    IndexExpr(ExprPtr object, Token bracket, ExprPtr index)
+        : object(std::move(object)), bracket(std::move(bracket)), index(std::move(index)) {}
+
+    Value accept(ASTVisitor& visitor) override;
+};
+
+// {key: value, ...}
+class MapExpr : public Expr {
+public:
+    NodeList<std::pair<ExprPtr, ExprPtr>> entries;
+
+    explicit MapExpr(NodeList<std::pair<ExprPtr, ExprPtr>> entries) : entries(std::move(entries)) {}
+
+    Value accept(ASTVisitor& visitor) override;
+};
+
+// object[index] = value; only maps can be assigned to
+class SetIndexExpr : public Expr {
+public:
+    ExprPtr object;
+    Token bracket;
+    ExprPtr index;
+    ExprPtr value;
+
+    SetIndexExpr(ExprPtr object, Token bracket, ExprPtr index, ExprPtr value)
+        : object(std::move(object)), bracket(std::move(bracket)), index(std::move(index)), value(std::move(value)) {}
 
     Value accept(ASTVisitor& visitor) override;
 };
@@ -184,10 +235,12 @@ class ExternExpr : public Expr {
 public:
     Token library;
     Token function;
-    std::vector<ExprPtr> arguments;
+    NodeList<ExprPtr> arguments;
     std::string libraryType; // "cpp", "python", "java", "custom"
+    NativeCallSite site;
+    bool spawned = false; // `spawn call_native(...)`: returns a future right away
 
-    ExternExpr(Token library, Token function, std::vector<ExprPtr> arguments, std::string libraryType)
+    ExternExpr(Token library, Token function, NodeList<ExprPtr> arguments, std::string libraryType)
         : library(std::move(library)), function(std::move(function)), 
           arguments(std::move(arguments)), libraryType(std::move(libraryType)) {}
 
@@ -210,6 +263,8 @@ public:
 // Base statement class
 class Stmt {
 public:
+    int line = 0; // line of the statement's first token
+
     virtual ~Stmt() = default;
     virtual void accept(ASTVisitor& visitor) = 0;
 };
@@ -219,9 +274,10 @@ class ClassStmt : public Stmt {
 public:
     Token name;
     ExprPtr superclass;
-    std::vector<StmtPtr> methods;
+    NodeList<StmtPtr> methods;
+    int slot = -1;
 
-    ClassStmt(Token name, ExprPtr superclass, std::vector<StmtPtr> methods)
+    ClassStmt(Token name, ExprPtr superclass, NodeList<StmtPtr> methods)
         : name(std::move(name)), superclass(std::move(superclass)), methods(std::move(methods)) {}
 
     void accept(ASTVisitor& visitor) override;
@@ -231,9 +287,11 @@ class ImportStmt : public Stmt {
 public:
     Token module;
     Token alias;
-    std::vector<Token> items;
+    NodeList<Token> items;
+    int moduleSlot = -1;
+    int aliasSlot = -1;
 
-    ImportStmt(Token module, Token alias, std::vector<Token> items)
+    ImportStmt(Token module, Token alias, NodeList<Token> items)
         : module(std::move(module)), alias(std::move(alias)), items(std::move(items)) {}
 
     void accept(ASTVisitor& visitor) override;
@@ -245,6 +303,8 @@ public:
     Token catchVar;
     StmtPtr catchBlock;
     StmtPtr finallyBlock;
+    int catchSlot = -1;
+    int catchSlotCount = 0;
 
     TryStmt(StmtPtr tryBlock, Token catchVar, StmtPtr catchBlock, StmtPtr finallyBlock)
         : tryBlock(std::move(tryBlock)), catchVar(std::move(catchVar)), 
@@ -265,10 +325,11 @@ public:
 class SwitchStmt : public Stmt {
 public:
     ExprPtr expr;
-    std::vector<std::pair<ExprPtr, StmtPtr>> cases;
+    NodeList<std::pair<ExprPtr, StmtPtr>> cases;
     StmtPtr defaultCase;
+    std::unique_ptr<SwitchTable> table; // case indices, set by the Optimizer
 
-    SwitchStmt(ExprPtr expr, std::vector<std::pair<ExprPtr, StmtPtr>> cases, StmtPtr defaultCase)
+    SwitchStmt(ExprPtr expr, NodeList<std::pair<ExprPtr, StmtPtr>> cases, StmtPtr defaultCase)
         : expr(std::move(expr)), cases(std::move(cases)), defaultCase(std::move(defaultCase)) {}
 
     void accept(ASTVisitor& visitor) override;
@@ -296,6 +357,7 @@ class VarStmt : public Stmt {
 public:
     Token name;
     ExprPtr initializer;
+    int slot = -1;
 
     VarStmt(Token name, ExprPtr initializer)
         : name(std::move(name)), initializer(std::move(initializer)) {}
@@ -305,9 +367,10 @@ public:
 
 class BlockStmt : public Stmt {
 public:
-    std::vector<StmtPtr> statements;
+    NodeList<StmtPtr> statements;
+    int slotCount = 0;
 
-    explicit BlockStmt(std::vector<StmtPtr> statements) : statements(std::move(statements)) {}
+    explicit BlockStmt(NodeList<StmtPtr> statements) : statements(std::move(statements)) {}
 
     void accept(ASTVisitor& visitor) override;
 };
@@ -341,6 +404,7 @@ public:
     ExprPtr condition;
     ExprPtr increment;
     StmtPtr body;
+    int slotCount = 0;
 
     ForStmt(StmtPtr initializer, ExprPtr condition, ExprPtr increment, StmtPtr body)
         : initializer(std::move(initializer)), condition(std::move(condition)),
@@ -349,13 +413,32 @@ public:
     void accept(ASTVisitor& visitor) override;
 };
 
+// for name in iterable: body
+class ForInStmt : public Stmt {
+public:
+    Token variable;
+    ExprPtr iterable;
+    StmtPtr body;
+    int slot = -1;
+    int slotCount = 0;
+
+    ForInStmt(Token variable, ExprPtr iterable, StmtPtr body)
+        : variable(std::move(variable)), iterable(std::move(iterable)), body(std::move(body)) {}
+
+    void accept(ASTVisitor& visitor) override;
+};
+
 class FunctionStmt : public Stmt {
 public:
     Token name;
-    std::vector<Token> params;
-    std::vector<StmtPtr> body;
-
-    FunctionStmt(Token name, std::vector<Token> params, std::vector<StmtPtr> body)
+    NodeList<Token> params;
+    NodeList<StmtPtr> body;
+    int slot = -1;
+    int slotCount = 0;
+    bool isAsync = false; // calls start a task and return its future
+    TierSlot tier;
+
+    FunctionStmt(Token name, NodeList<Token> params, NodeList<StmtPtr> body)
         : name(std::move(name)), params(std::move(params)), body(std::move(body)) {}
 
     void accept(ASTVisitor& visitor) override;
@@ -372,17 +455,39 @@ public:
     void accept(ASTVisitor& visitor) override;
 };
 
+class BreakStmt : public Stmt {
+public:
+    Token keyword;
+
+    explicit BreakStmt(Token keyword) : keyword(std::move(keyword)) {}
+
+    void accept(ASTVisitor& visitor) override;
+};
+
+class ContinueStmt : public Stmt {
+public:
+    Token keyword;
+
+    explicit ContinueStmt(Token keyword) : keyword(std::move(keyword)) {}
+
+    void accept(ASTVisitor& visitor) override;
+};
+
 // Library integration statements
 class ExternStmt : public Stmt {
 public:
     Token libraryPath;
     Token alias;
     std::string libraryType;
-    std::vector<Token> functions;
+    NodeList<Token> functions;
+    NodeList<NativeSignature> signatures; // one per function, declared or not
+    int slot = -1;
 
-    ExternStmt(Token libraryPath, Token alias, std::string libraryType, std::vector<Token> functions)
+    ExternStmt(Token libraryPath, Token alias, std::string libraryType, NodeList<Token> functions,
+               NodeList<NativeSignature> signatures)
         : libraryPath(std::move(libraryPath)), alias(std::move(alias)), 
-          libraryType(std::move(libraryType)), functions(std::move(functions)) {}
+          libraryType(std::move(libraryType)), functions(std::move(functions)),
+          signatures(std::move(signatures)) {}
 
     void accept(ASTVisitor& visitor) override;
 };
@@ -391,9 +496,10 @@ class PluginStmt : public Stmt {
 public:
     Token pluginPath;
     Token alias;
-    std::vector<Token> exports;
+    NodeList<Token> exports;
+    int slot = -1;
 
-    PluginStmt(Token pluginPath, Token alias, std::vector<Token> exports)
+    PluginStmt(Token pluginPath, Token alias, NodeList<Token> exports)
         : pluginPath(std::move(pluginPath)), alias(std::move(alias)), exports(std::move(exports)) {}
 
     void accept(ASTVisitor& visitor) override;
@@ -420,6 +526,8 @@ public:
     virtual Value visitGetExpr(GetExpr& expr) = 0;
     virtual Value visitListExpr(ListExpr& expr) = 0;
     virtual Value visitIndexExpr(IndexExpr& expr) = 0;
+    virtual Value visitMapExpr(MapExpr& expr) = 0;
+    virtual Value visitSetIndexExpr(SetIndexExpr& expr) = 0;
     virtual Value visitExternExpr(ExternExpr& expr) = 0;
     virtual Value visitLoadLibraryExpr(LoadLibraryExpr& expr) = 0;
 
@@ -438,6 +546,9 @@ public:
     virtual void visitIfStmt(IfStmt& stmt) = 0;
     virtual void visitWhileStmt(WhileStmt& stmt) = 0;
     virtual void visitForStmt(ForStmt& stmt) = 0;
+    virtual void visitForInStmt(ForInStmt& stmt) = 0;
     virtual void visitFunctionStmt(FunctionStmt& stmt) = 0;
     virtual void visitReturnStmt(ReturnStmt& stmt) = 0;
+    virtual void visitBreakStmt(BreakStmt& stmt) = 0;
+    virtual void visitContinueStmt(ContinueStmt& stmt) = 0;
 };
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "ast_arena.hpp"
+
+AstArena::~AstArena() {
+    // Children are made before their parents, so parents go first
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+        it->destroy(it->object);
+    }
+}
+
+void* AstArena::allocate(size_t size, size_t alignment) {
+    auto address = reinterpret_cast<uintptr_t>(cursor);
+    size_t padding = (alignment - address % alignment) % alignment;
+
+    if (cursor == nullptr || padding + size > static_cast<size_t>(limit - cursor)) {
+        // Oversized requests get a block of their own
+        size_t blockSize = size + alignment > kBlockSize ? size + alignment : kBlockSize;
+        blocks.emplace_back(new char[blockSize]);
+        cursor = blocks.back().get();
+        limit = cursor + blockSize;
+        address = reinterpret_cast<uintptr_t>(cursor);
+        padding = (alignment - address % alignment) % alignment;
+    }
+
+    char* memory = cursor + padding;
+    cursor = memory + size;
+    used += padding + size;
+    return memory;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Fixed-size run of nodes (or tokens) stored contiguously in an AstArena.
+// Copying one copies the view, not the elements.
+template <typename T>
+class NodeList {
+private:
+    T* items = nullptr;
+    uint32_t count = 0;
+
+public:
+    NodeList() = default;
+    NodeList(T* items, uint32_t count) : items(items), count(count) {}
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t index) const { return items[index]; }
+    T& front() const { return items[0]; }
+    T& back() const { return items[count - 1]; }
+};
+
+// Bump allocator owning the syntax tree of one parse. Nodes and their
+// child lists are placed back to back in large blocks, so building the
+// tree is mostly pointer increments and walking it stays within a few
+// blocks of memory. Nothing is freed individually: the arena destroys
+// every node and releases its blocks at once when it goes away, so it
+// has to outlive anything that points into the tree (functions declared
+// by the program, for one).
+class AstArena {
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+    ~AstArena();
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({node, [](void* object) { static_cast<T*>(object)->~T(); }});
+        }
+        return node;
+    }
+
+    // Moves items into the arena
+    template <typename T>
+    NodeList<T> list(std::vector<T>&& items) {
+        static_assert(std::is_trivially_destructible_v<T>, "node lists hold pointers and tokens");
+        if (items.empty()) return NodeList<T>();
+        T* storage = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+        for (size_t i = 0; i < items.size(); i++) {
+            new (storage + i) T(std::move(items[i]));
+        }
+        return NodeList<T>(storage, static_cast<uint32_t>(items.size()));
+    }
+
+    // Bytes handed out so far (alignment padding included)
+    size_t bytesUsed() const { return used; }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t used = 0;
+    std::vector<Destructor> destructors;
+
+    void* allocate(size_t size, size_t alignment);
+};
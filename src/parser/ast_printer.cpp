@@ -61,6 +61,14 @@ Value IndexExpr::accept(ASTVisitor& visitor) {
     return visitor.visitIndexExpr(*this);
 }
 
+Value MapExpr::accept(ASTVisitor& visitor) {
+    return visitor.visitMapExpr(*this);
+}
+
+Value SetIndexExpr::accept(ASTVisitor& visitor) {
+    return visitor.visitSetIndexExpr(*this);
+}
+
 Value ExternExpr::accept(ASTVisitor& visitor) {
     return visitor.visitExternExpr(*this);
 }
@@ -125,10 +133,22 @@ void ForStmt::accept(ASTVisitor& visitor) {
     visitor.visitForStmt(*this);
 }
 
+void ForInStmt::accept(ASTVisitor& visitor) {
+    visitor.visitForInStmt(*this);
+}
+
 void FunctionStmt::accept(ASTVisitor& visitor) {
     visitor.visitFunctionStmt(*this);
 }
 
 void ReturnStmt::accept(ASTVisitor& visitor) {
     visitor.visitReturnStmt(*this);
+}
+
+void BreakStmt::accept(ASTVisitor& visitor) {
+    visitor.visitBreakStmt(*this);
+}
+
+void ContinueStmt::accept(ASTVisitor& visitor) {
+    visitor.visitContinueStmt(*this);
 }
\ No newline at end of file
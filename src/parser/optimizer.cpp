@@ -0,0 +1,425 @@
+#include "optimizer.hpp"
+#include <climits>
+#include <cmath>
+
+namespace {
+
+// static_cast<int> of the interpreter is only defined inside this range
+bool fitsInt(double value) {
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+// Mirrors Interpreter::visitBinaryExpr; false where that would raise an
+// error (or rely on undefined behaviour), so those stay for runtime
+bool foldBinary(TokenType op, const Value& left, const Value& right, Value& result) {
+    switch (op) {
+        case TokenType::EQUAL_EQUAL: result = Value(left == right); return true;
+        case TokenType::BANG_EQUAL: result = Value(left != right); return true;
+        case TokenType::AND: result = left.isTruthy() ? right : left; return true;
+        case TokenType::OR: result = left.isTruthy() ? left : right; return true;
+        case TokenType::PLUS:
+            if (left.isNumber() && right.isNumber()) {
+                result = Value(left.asNumber() + right.asNumber());
+                return true;
+            }
+            if (left.isString() || right.isString()) {
+                result = Value(left.toString() + right.toString());
+                return true;
+            }
+            return false;
+        default:
+            break;
+    }
+
+    if (!left.isNumber() || !right.isNumber()) return false;
+    double a = left.asNumber();
+    double b = right.asNumber();
+
+    switch (op) {
+        case TokenType::GREATER: result = Value(a > b); return true;
+        case TokenType::GREATER_EQUAL: result = Value(a >= b); return true;
+        case TokenType::LESS: result = Value(a < b); return true;
+        case TokenType::LESS_EQUAL: result = Value(a <= b); return true;
+        case TokenType::MINUS: result = Value(a - b); return true;
+        case TokenType::STAR: result = Value(a * b); return true;
+        case TokenType::STAR_STAR: result = Value(pow(a, b)); return true;
+        case TokenType::SLASH:
+            if (b == 0) return false;
+            result = Value(a / b);
+            return true;
+        case TokenType::PERCENT:
+            if (b == 0) return false;
+            result = Value(fmod(a, b));
+            return true;
+        default:
+            break;
+    }
+
+    if (!fitsInt(a) || !fitsInt(b)) return false;
+    int x = static_cast<int>(a);
+    int y = static_cast<int>(b);
+
+    switch (op) {
+        case TokenType::LEFT_SHIFT:
+            if (x < 0 || y < 0 || y > 31 || x > (INT_MAX >> y)) return false;
+            result = Value(static_cast<double>(x << y));
+            return true;
+        case TokenType::RIGHT_SHIFT:
+            if (y < 0 || y > 31) return false;
+            result = Value(static_cast<double>(x >> y));
+            return true;
+        case TokenType::AMPERSAND: result = Value(static_cast<double>(x & y)); return true;
+        case TokenType::PIPE: result = Value(static_cast<double>(x | y)); return true;
+        case TokenType::CARET: result = Value(static_cast<double>(x ^ y)); return true;
+        default:
+            return false;
+    }
+}
+
+// Mirrors Interpreter::visitUnaryExpr
+bool foldUnary(TokenType op, const Value& right, Value& result) {
+    switch (op) {
+        case TokenType::BANG:
+            result = Value(!right.isTruthy());
+            return true;
+        case TokenType::MINUS:
+            if (!right.isNumber()) return false;
+            result = Value(-right.asNumber());
+            return true;
+        case TokenType::TILDE:
+            if (!right.isNumber() || !fitsInt(right.asNumber())) return false;
+            result = Value(static_cast<double>(~static_cast<int>(right.asNumber())));
+            return true;
+        default:
+            return false;
+    }
+}
+
+// True if dividing by divisor is exactly multiplying by reciprocal,
+// which holds for powers of two whose reciprocal is a normal double
+bool exactReciprocal(double divisor, double& reciprocal) {
+    int exponent;
+    double mantissa = std::frexp(std::fabs(divisor), &exponent);
+    if (mantissa != 0.5 || exponent - 1 < -1021 || exponent - 1 > 1021) return false;
+    reciprocal = std::copysign(std::ldexp(1.0, 1 - exponent), divisor);
+    return true;
+}
+
+bool hasSwitchableValue(const Value& value) {
+    return value.isNil() || value.isBool() || value.isNumber() || value.isString();
+}
+
+} // namespace
+
+void Optimizer::optimize(NodeList<StmtPtr>& statements) {
+    rewriteAll(statements);
+}
+
+void Optimizer::rewrite(ExprPtr& expr) {
+    folded = nullptr;
+    expr->accept(*this);
+    if (folded != nullptr) {
+        expr = folded;
+        folded = nullptr;
+    }
+}
+
+void Optimizer::rewriteAll(NodeList<ExprPtr>& exprs) {
+    for (auto& expr : exprs) {
+        rewrite(expr);
+    }
+}
+
+bool Optimizer::rewrite(StmtPtr& stmt) {
+    replacement = nullptr;
+    removed = false;
+    stmt->accept(*this);
+    if (removed) {
+        removed = false;
+        return false;
+    }
+    if (replacement != nullptr) {
+        stmt = replacement;
+        replacement = nullptr;
+    }
+    return true;
+}
+
+void Optimizer::rewriteAll(NodeList<StmtPtr>& statements) {
+    // Survivors are moved up in place; the list only ever shrinks
+    size_t kept = 0;
+    for (size_t i = 0; i < statements.size(); i++) {
+        StmtPtr stmt = statements[i];
+        if (rewrite(stmt)) {
+            statements[kept++] = stmt;
+        }
+    }
+    statements = NodeList<StmtPtr>(statements.begin(), static_cast<uint32_t>(kept));
+}
+
+void Optimizer::rewriteBranch(StmtPtr& stmt) {
+    int line = stmt->line;
+    if (!rewrite(stmt)) {
+        stmt = arena.make<BlockStmt>(NodeList<StmtPtr>());
+        stmt->line = line;
+    }
+}
+
+const Value* Optimizer::literal(const ExprPtr& expr) {
+    auto* literal = dynamic_cast<LiteralExpr*>(expr);
+    return literal != nullptr ? &literal->value : nullptr;
+}
+
+ExprPtr Optimizer::makeLiteral(Value value) {
+    return arena.make<LiteralExpr>(std::move(value));
+}
+
+// Expressions
+
+Value Optimizer::visitLambdaExpr(LambdaExpr& expr) {
+    rewriteAll(expr.body);
+    return {};
+}
+
+Value Optimizer::visitTernaryExpr(TernaryExpr& expr) {
+    rewrite(expr.condition);
+    rewrite(expr.thenExpr);
+    rewrite(expr.elseExpr);
+    if (const Value* condition = literal(expr.condition)) {
+        folded = condition->isTruthy() ? expr.thenExpr : expr.elseExpr;
+    }
+    return {};
+}
+
+Value Optimizer::visitSetExpr(SetExpr& expr) {
+    rewrite(expr.object);
+    rewrite(expr.value);
+    return {};
+}
+
+Value Optimizer::visitSuperExpr(SuperExpr&) {
+    return {};
+}
+
+Value Optimizer::visitThisExpr(ThisExpr&) {
+    return {};
+}
+
+Value Optimizer::visitBinaryExpr(BinaryExpr& expr) {
+    rewrite(expr.left);
+    rewrite(expr.right);
+
+    const Value* left = literal(expr.left);
+    const Value* right = literal(expr.right);
+    Value result;
+    if (left != nullptr && right != nullptr && foldBinary(expr.operator_.type, *left, *right, result)) {
+        folded = makeLiteral(std::move(result));
+        return {};
+    }
+
+    // Strength reduction. Both forms check their operands and report
+    // errors exactly like the operator they replace.
+    if (right == nullptr || !right->isNumber()) return {};
+    Token times(TokenType::STAR, "*", "", expr.operator_.line, expr.operator_.column);
+
+    auto* variable = dynamic_cast<VariableExpr*>(expr.left);
+    if (expr.operator_.type == TokenType::STAR_STAR && right->asNumber() == 2 && variable != nullptr) {
+        folded = arena.make<BinaryExpr>(expr.left, times, arena.make<VariableExpr>(variable->name));
+        return {};
+    }
+
+    double reciprocal;
+    if (expr.operator_.type == TokenType::SLASH && exactReciprocal(right->asNumber(), reciprocal)) {
+        folded = arena.make<BinaryExpr>(expr.left, times, makeLiteral(Value(reciprocal)));
+    }
+    return {};
+}
+
+Value Optimizer::visitUnaryExpr(UnaryExpr& expr) {
+    rewrite(expr.right);
+
+    Value result;
+    const Value* right = literal(expr.right);
+    if (right != nullptr && foldUnary(expr.operator_.type, *right, result)) {
+        folded = makeLiteral(std::move(result));
+    }
+    return {};
+}
+
+Value Optimizer::visitLiteralExpr(LiteralExpr&) {
+    return {};
+}
+
+Value Optimizer::visitGroupingExpr(GroupingExpr& expr) {
+    rewrite(expr.expression);
+    // (obj.name)(...) calls the property instead of invoking a method
+    if (dynamic_cast<GetExpr*>(expr.expression) == nullptr) {
+        folded = expr.expression;
+    }
+    return {};
+}
+
+Value Optimizer::visitVariableExpr(VariableExpr&) {
+    return {};
+}
+
+Value Optimizer::visitAssignExpr(AssignExpr& expr) {
+    rewrite(expr.value);
+    return {};
+}
+
+Value Optimizer::visitCallExpr(CallExpr& expr) {
+    rewrite(expr.callee);
+    rewriteAll(expr.arguments);
+    return {};
+}
+
+Value Optimizer::visitGetExpr(GetExpr& expr) {
+    rewrite(expr.object);
+    return {};
+}
+
+Value Optimizer::visitListExpr(ListExpr& expr) {
+    rewriteAll(expr.elements);
+    return {};
+}
+
+Value Optimizer::visitIndexExpr(IndexExpr& expr) {
+    rewrite(expr.object);
+    rewrite(expr.index);
+    return {};
+}
+
+Value Optimizer::visitMapExpr(MapExpr& expr) {
+    for (auto& entry : expr.entries) {
+        rewrite(entry.first);
+        rewrite(entry.second);
+    }
+    return {};
+}
+
+Value Optimizer::visitSetIndexExpr(SetIndexExpr& expr) {
+    rewrite(expr.object);
+    rewrite(expr.index);
+    rewrite(expr.value);
+    return {};
+}
+
+Value Optimizer::visitExternExpr(ExternExpr& expr) {
+    rewriteAll(expr.arguments);
+    return {};
+}
+
+Value Optimizer::visitLoadLibraryExpr(LoadLibraryExpr&) {
+    return {};
+}
+
+// Statements
+
+void Optimizer::visitClassStmt(ClassStmt& stmt) {
+    for (auto& method : stmt.methods) {
+        rewrite(method);
+    }
+}
+
+void Optimizer::visitImportStmt(ImportStmt&) {}
+
+void Optimizer::visitTryStmt(TryStmt& stmt) {
+    rewriteBranch(stmt.tryBlock);
+    if (stmt.catchBlock != nullptr) rewriteBranch(stmt.catchBlock);
+    if (stmt.finallyBlock != nullptr) rewriteBranch(stmt.finallyBlock);
+}
+
+void Optimizer::visitThrowStmt(ThrowStmt& stmt) {
+    rewrite(stmt.value);
+}
+
+void Optimizer::visitSwitchStmt(SwitchStmt& stmt) {
+    rewrite(stmt.expr);
+
+    bool allLiterals = !stmt.cases.empty();
+    for (auto& caseStmt : stmt.cases) {
+        rewrite(caseStmt.first);
+        rewriteBranch(caseStmt.second);
+        const Value* value = literal(caseStmt.first);
+        allLiterals = allLiterals && value != nullptr && hasSwitchableValue(*value);
+    }
+    if (stmt.defaultCase != nullptr) rewriteBranch(stmt.defaultCase);
+
+    if (allLiterals) {
+        stmt.table = std::make_unique<SwitchTable>();
+        for (size_t i = 0; i < stmt.cases.size(); i++) {
+            stmt.table->add(*literal(stmt.cases[i].first), static_cast<int>(i));
+        }
+    }
+}
+
+void Optimizer::visitExternStmt(ExternStmt&) {}
+
+void Optimizer::visitPluginStmt(PluginStmt&) {}
+
+void Optimizer::visitExpressionStmt(ExpressionStmt& stmt) {
+    rewrite(stmt.expression);
+}
+
+void Optimizer::visitPrintStmt(PrintStmt& stmt) {
+    rewrite(stmt.expression);
+}
+
+void Optimizer::visitVarStmt(VarStmt& stmt) {
+    if (stmt.initializer != nullptr) rewrite(stmt.initializer);
+}
+
+void Optimizer::visitBlockStmt(BlockStmt& stmt) {
+    rewriteAll(stmt.statements);
+}
+
+void Optimizer::visitIfStmt(IfStmt& stmt) {
+    rewrite(stmt.condition);
+    rewriteBranch(stmt.thenBranch);
+    if (stmt.elseBranch != nullptr) rewriteBranch(stmt.elseBranch);
+
+    const Value* condition = literal(stmt.condition);
+    if (condition == nullptr) return;
+    if (condition->isTruthy()) {
+        replacement = stmt.thenBranch;
+    } else if (stmt.elseBranch != nullptr) {
+        replacement = stmt.elseBranch;
+    } else {
+        removed = true;
+    }
+}
+
+void Optimizer::visitWhileStmt(WhileStmt& stmt) {
+    rewrite(stmt.condition);
+    rewriteBranch(stmt.body);
+
+    const Value* condition = literal(stmt.condition);
+    if (condition != nullptr && !condition->isTruthy()) {
+        removed = true;
+    }
+}
+
+void Optimizer::visitForStmt(ForStmt& stmt) {
+    if (stmt.initializer != nullptr) rewriteBranch(stmt.initializer);
+    if (stmt.condition != nullptr) rewrite(stmt.condition);
+    if (stmt.increment != nullptr) rewrite(stmt.increment);
+    rewriteBranch(stmt.body);
+}
+
+void Optimizer::visitForInStmt(ForInStmt& stmt) {
+    rewrite(stmt.iterable);
+    rewriteBranch(stmt.body);
+}
+
+void Optimizer::visitFunctionStmt(FunctionStmt& stmt) {
+    rewriteAll(stmt.body);
+}
+
+void Optimizer::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.value != nullptr) rewrite(stmt.value);
+}
+
+void Optimizer::visitBreakStmt(BreakStmt&) {}
+
+void Optimizer::visitContinueStmt(ContinueStmt&) {}
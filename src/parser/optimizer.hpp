@@ -0,0 +1,85 @@
+#pragma once
+#include "ast.hpp"
+
+// Rewrites a freshly parsed tree before it is resolved:
+//  - operators whose operands are all literals become the literal they
+//    evaluate to, unless evaluating them would raise an error;
+//  - if, while and ?: with a literal condition keep only the branch that
+//    can run;
+//  - x ** 2 becomes x * x for variables, and division by a power of two
+//    a multiplication by its exact reciprocal;
+//  - switches whose cases are all literals get a SwitchTable.
+// Every rewrite leaves the program's output and errors as they were.
+class Optimizer : public ASTVisitor {
+private:
+    AstArena& arena;
+    // What the node just visited should be replaced with: set by
+    // expression visitors that fold their node, and by statement visitors
+    // for the branch left over (or removed, if none can run)
+    ExprPtr folded = nullptr;
+    StmtPtr replacement = nullptr;
+    bool removed = false;
+
+public:
+    // New nodes are made in arena, normally the one holding the tree
+    explicit Optimizer(AstArena& arena) : arena(arena) {}
+
+    void optimize(NodeList<StmtPtr>& statements);
+
+    // Expression visitors
+    Value visitLambdaExpr(LambdaExpr& expr) override;
+    Value visitTernaryExpr(TernaryExpr& expr) override;
+    Value visitSetExpr(SetExpr& expr) override;
+    Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitThisExpr(ThisExpr& expr) override;
+    Value visitBinaryExpr(BinaryExpr& expr) override;
+    Value visitUnaryExpr(UnaryExpr& expr) override;
+    Value visitLiteralExpr(LiteralExpr& expr) override;
+    Value visitGroupingExpr(GroupingExpr& expr) override;
+    Value visitVariableExpr(VariableExpr& expr) override;
+    Value visitAssignExpr(AssignExpr& expr) override;
+    Value visitCallExpr(CallExpr& expr) override;
+    Value visitGetExpr(GetExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitIndexExpr(IndexExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSetIndexExpr(SetIndexExpr& expr) override;
+    Value visitExternExpr(ExternExpr& expr) override;
+    Value visitLoadLibraryExpr(LoadLibraryExpr& expr) override;
+
+    // Statement visitors
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitImportStmt(ImportStmt& stmt) override;
+    void visitTryStmt(TryStmt& stmt) override;
+    void visitThrowStmt(ThrowStmt& stmt) override;
+    void visitSwitchStmt(SwitchStmt& stmt) override;
+    void visitExternStmt(ExternStmt& stmt) override;
+    void visitPluginStmt(PluginStmt& stmt) override;
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitForStmt(ForStmt& stmt) override;
+    void visitForInStmt(ForInStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitBreakStmt(BreakStmt& stmt) override;
+    void visitContinueStmt(ContinueStmt& stmt) override;
+
+private:
+    // Each may replace what it is given
+    void rewrite(ExprPtr& expr);
+    void rewriteAll(NodeList<ExprPtr>& exprs);
+    // False if stmt can't run and should be dropped
+    bool rewrite(StmtPtr& stmt);
+    // Drops statements that can't run from the list
+    void rewriteAll(NodeList<StmtPtr>& statements);
+    // Puts an empty block where a statement that can't run was
+    void rewriteBranch(StmtPtr& stmt);
+
+    // The literal an expression is, or null
+    static const Value* literal(const ExprPtr& expr);
+    ExprPtr makeLiteral(Value value);
+};
@@ -3,9 +3,9 @@
 #include "../error/error_handler.hpp"
 #include "../error/exceptions.hpp"
 
-Parser::Parser(std::vector<Token> tokens) : tokens(std::move(tokens)) {}
+Parser::Parser(std::vector<Token> tokens, AstArena& arena) : tokens(std::move(tokens)), arena(arena) {}
 
-std::vector<StmtPtr> Parser::parse() {
+NodeList<StmtPtr> Parser::parse() {
     std::vector<StmtPtr> statements;
     
     while (!isAtEnd()) {
@@ -18,47 +18,60 @@ std::vector<StmtPtr> Parser::parse() {
             if (auto stmt = declaration()) {
                 statements.push_back(std::move(stmt));
             }
-        } catch ([[maybe_unused]] const ParseError& error) {
+        } catch (const ParseError& error) {
+            skippedErrors.emplace_back(error.what());
             synchronize();
         }
     }
     
-    return statements;
+    return arena.list(std::move(statements));
 }
 
 StmtPtr Parser::declaration() {
     try {
-        if (match({TokenType::CLASS})) return classDeclaration();
-        if (match({TokenType::EXTERN})) return externDeclaration();
-        if (match({TokenType::PLUGIN})) return pluginDeclaration();
-        if (match({TokenType::IMPORT})) return importStatement();
-        if (match({TokenType::FUNCTION})) return functionStatement("function");
-        if (match({TokenType::VAR, TokenType::LET})) return varDeclaration();
-        return statement();
-    } catch ([[maybe_unused]] const ParseError& error) {
+        int line = peek().line;
+        StmtPtr declaration;
+        if (match({TokenType::CLASS})) declaration = classDeclaration();
+        else if (match({TokenType::EXTERN})) declaration = externDeclaration();
+        else if (match({TokenType::PLUGIN})) declaration = pluginDeclaration();
+        else if (match({TokenType::IMPORT})) declaration = importStatement();
+        else if (match({TokenType::FUNCTION})) declaration = functionStatement("function");
+        else if (match({TokenType::ASYNC})) declaration = asyncFunctionStatement();
+        else if (match({TokenType::VAR, TokenType::LET})) declaration = varDeclaration();
+        else return statement();
+        declaration->line = line;
+        return declaration;
+    } catch (const ParseError& error) {
+        skippedErrors.emplace_back(error.what());
         synchronize();
         return nullptr;
     }
 }
 
 StmtPtr Parser::statement() {
-    if (match({TokenType::TRY})) return tryStatement();
-    if (match({TokenType::THROW})) return throwStatement();
-    if (match({TokenType::SWITCH})) return switchStatement();
-    if (match({TokenType::IF})) return ifStatement();
-    if (match({TokenType::PRINT})) return printStatement();
-    if (match({TokenType::RETURN})) return returnStatement();
-    if (match({TokenType::WHILE})) return whileStatement();
-    if (match({TokenType::FOR})) return forStatement();
-    if (match({TokenType::LEFT_BRACE})) return blockStatement();
-
-    return expressionStatement();
+    int line = peek().line;
+    StmtPtr statement;
+    if (match({TokenType::TRY})) statement = tryStatement();
+    else if (match({TokenType::THROW})) statement = throwStatement();
+    else if (match({TokenType::SWITCH})) statement = switchStatement();
+    else if (match({TokenType::IF})) statement = ifStatement();
+    else if (match({TokenType::PRINT})) statement = printStatement();
+    else if (match({TokenType::RETURN})) statement = returnStatement();
+    else if (match({TokenType::BREAK})) statement = breakStatement();
+    else if (match({TokenType::CONTINUE})) statement = continueStatement();
+    else if (match({TokenType::WHILE})) statement = whileStatement();
+    else if (match({TokenType::FOR})) statement = forStatement();
+    else if (match({TokenType::LEFT_BRACE})) statement = blockStatement();
+    else statement = expressionStatement();
+
+    statement->line = line;
+    return statement;
 }
 
 StmtPtr Parser::printStatement() {
     auto value = expression();
     consume(TokenType::NEWLINE, "Expected newline after value");
-    return std::make_unique<PrintStmt>(std::move(value));
+    return arena.make<PrintStmt>(std::move(value));
 }
 
 StmtPtr Parser::returnStatement() {
@@ -70,7 +83,25 @@ StmtPtr Parser::returnStatement() {
     }
 
     consume(TokenType::NEWLINE, "Expected newline after return value");
-    return std::make_unique<ReturnStmt>(keyword, std::move(value));
+    return arena.make<ReturnStmt>(keyword, std::move(value));
+}
+
+StmtPtr Parser::breakStatement() {
+    Token keyword = previous();
+    if (loopDepth == 0 && switchDepth == 0) {
+        ErrorHandler::error(keyword.line, keyword.column, "Can't use 'break' outside of a loop or switch");
+    }
+    consume(TokenType::NEWLINE, "Expected newline after 'break'");
+    return arena.make<BreakStmt>(keyword);
+}
+
+StmtPtr Parser::continueStatement() {
+    Token keyword = previous();
+    if (loopDepth == 0) {
+        ErrorHandler::error(keyword.line, keyword.column, "Can't use 'continue' outside of a loop");
+    }
+    consume(TokenType::NEWLINE, "Expected newline after 'continue'");
+    return arena.make<ContinueStmt>(keyword);
 }
 
 StmtPtr Parser::varDeclaration() {
@@ -82,13 +113,13 @@ StmtPtr Parser::varDeclaration() {
     }
 
     consume(TokenType::NEWLINE, "Expected newline after variable declaration");
-    return std::make_unique<VarStmt>(name, std::move(initializer));
+    return arena.make<VarStmt>(name, std::move(initializer));
 }
 
 StmtPtr Parser::expressionStatement() {
     auto expr = expression();
     consume(TokenType::NEWLINE, "Expected newline after expression");
-    return std::make_unique<ExpressionStmt>(std::move(expr));
+    return arena.make<ExpressionStmt>(std::move(expr));
 }
 
 StmtPtr Parser::functionStatement(const std::string& kind) {
@@ -111,12 +142,25 @@ StmtPtr Parser::functionStatement(const std::string& kind) {
     consume(TokenType::NEWLINE, "Expected newline after ':'");
 
     consume(TokenType::LEFT_BRACE, "Expected '{' before " + kind + " body");
+    // Loops outside the function can't be left from inside it
+    int enclosingLoopDepth = loopDepth;
+    int enclosingSwitchDepth = switchDepth;
+    loopDepth = 0;
+    switchDepth = 0;
     auto blockStmt = blockStatement();
-    auto blockPtr = dynamic_cast<BlockStmt*>(blockStmt.get());
-    std::vector<StmtPtr> body = std::move(blockPtr->statements);
-    //blockStmt.release(); // Release ownership since we moved the statements
+    loopDepth = enclosingLoopDepth;
+    switchDepth = enclosingSwitchDepth;
+    auto blockPtr = dynamic_cast<BlockStmt*>(blockStmt);
+    NodeList<StmtPtr> body = blockPtr->statements;
 
-    return std::make_unique<FunctionStmt>(name, std::move(parameters), std::move(body));
+    return arena.make<FunctionStmt>(name, arena.list(std::move(parameters)), body);
+}
+
+StmtPtr Parser::asyncFunctionStatement() {
+    consume(TokenType::FUNCTION, "Expected 'function' after 'async'");
+    auto function = static_cast<FunctionStmt*>(functionStatement("function"));
+    function->isAsync = true;
+    return function;
 }
 
 StmtPtr Parser::ifStatement() {
@@ -133,7 +177,7 @@ StmtPtr Parser::ifStatement() {
         elseBranch = statement();
     }
 
-    return std::make_unique<IfStmt>(std::move(condition), std::move(thenBranch), std::move(elseBranch));
+    return arena.make<IfStmt>(std::move(condition), std::move(thenBranch), std::move(elseBranch));
 }
 
 StmtPtr Parser::whileStatement() {
@@ -141,15 +185,23 @@ StmtPtr Parser::whileStatement() {
     consume(TokenType::COLON, "Expected ':' after while condition");
     consume(TokenType::NEWLINE, "Expected newline after ':'");
 
+    loopDepth++;
     auto body = statement();
-    return std::make_unique<WhileStmt>(std::move(condition), std::move(body));
+    loopDepth--;
+    return arena.make<WhileStmt>(std::move(condition), std::move(body));
 }
 
 StmtPtr Parser::forStatement() {
     consume(TokenType::IDENTIFIER, "Expected variable name");
     Token variable = previous();
+    // 'in' is only special here, so it stays usable as a name elsewhere
+    if (check(TokenType::IDENTIFIER) && peek().lexeme == "in") {
+        advance();
+        return forInStatement(variable);
+    }
     consume(TokenType::EQUAL, "Expected '=' after for loop variable");
-    auto initializer = std::make_unique<VarStmt>(variable, expression());
+    auto initializer = arena.make<VarStmt>(variable, expression());
+    initializer->line = variable.line;
 
     consume(TokenType::SEMICOLON, "Expected ';' after for loop initializer");
 
@@ -166,12 +218,26 @@ StmtPtr Parser::forStatement() {
     consume(TokenType::COLON, "Expected ':' after for clauses");
     consume(TokenType::NEWLINE, "Expected newline after ':'");
 
+    loopDepth++;
     auto body = statement();
+    loopDepth--;
 
-    return std::make_unique<ForStmt>(std::move(initializer), std::move(condition),
+    return arena.make<ForStmt>(std::move(initializer), std::move(condition),
                                    std::move(increment), std::move(body));
 }
 
+StmtPtr Parser::forInStatement(const Token& variable) {
+    auto iterable = expression();
+    consume(TokenType::COLON, "Expected ':' after for loop iterable");
+    consume(TokenType::NEWLINE, "Expected newline after ':'");
+
+    loopDepth++;
+    auto body = statement();
+    loopDepth--;
+
+    return arena.make<ForInStmt>(std::move(variable), std::move(iterable), std::move(body));
+}
+
 StmtPtr Parser::blockStatement() {
     std::vector<StmtPtr> statements;
     
@@ -185,7 +251,7 @@ StmtPtr Parser::blockStatement() {
     }
     
     consume(TokenType::RIGHT_BRACE, "Expected '}' after block");
-    return std::make_unique<BlockStmt>(std::move(statements));
+    return arena.make<BlockStmt>(arena.list(std::move(statements)));
 }
 
 StmtPtr Parser::classDeclaration() {
@@ -194,7 +260,7 @@ StmtPtr Parser::classDeclaration() {
     ExprPtr superclass = nullptr;
     if (match({TokenType::EXTENDS})) {
         consume(TokenType::IDENTIFIER, "Expected superclass name");
-        superclass = std::make_unique<VariableExpr>(previous());
+        superclass = arena.make<VariableExpr>(previous());
     }
     
     consume(TokenType::COLON, "Expected ':' before class body");
@@ -204,11 +270,15 @@ StmtPtr Parser::classDeclaration() {
     std::vector<StmtPtr> methods;
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
         if (match({TokenType::NEWLINE})) continue;
-        methods.push_back(functionStatement("method"));
+        bool isAsync = match({TokenType::ASYNC});
+        match({TokenType::FUNCTION}); // methods may be spelled like functions
+        auto method = static_cast<FunctionStmt*>(functionStatement("method"));
+        method->isAsync = isAsync;
+        methods.push_back(method);
     }
     
     consume(TokenType::RIGHT_BRACE, "Expected '}' after class body");
-    return std::make_unique<ClassStmt>(name, std::move(superclass), std::move(methods));
+    return arena.make<ClassStmt>(name, std::move(superclass), arena.list(std::move(methods)));
 }
 
 StmtPtr Parser::importStatement() {
@@ -221,7 +291,7 @@ StmtPtr Parser::importStatement() {
     }
     
     consume(TokenType::NEWLINE, "Expected newline after import");
-    return std::make_unique<ImportStmt>(module, alias, std::move(items));
+    return arena.make<ImportStmt>(module, alias, arena.list(std::move(items)));
 }
 
 StmtPtr Parser::tryStatement() {
@@ -250,13 +320,13 @@ StmtPtr Parser::tryStatement() {
         finallyBlock = statement();
     }
     
-    return std::make_unique<TryStmt>(std::move(tryBlock), catchVar, std::move(catchBlock), std::move(finallyBlock));
+    return arena.make<TryStmt>(std::move(tryBlock), catchVar, std::move(catchBlock), std::move(finallyBlock));
 }
 
 StmtPtr Parser::throwStatement() {
     auto value = expression();
     consume(TokenType::NEWLINE, "Expected newline after throw expression");
-    return std::make_unique<ThrowStmt>(std::move(value));
+    return arena.make<ThrowStmt>(std::move(value));
 }
 
 StmtPtr Parser::switchStatement() {
@@ -268,6 +338,7 @@ StmtPtr Parser::switchStatement() {
     std::vector<std::pair<ExprPtr, StmtPtr>> cases;
     StmtPtr defaultCase = nullptr;
     
+    switchDepth++;
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
         if (match({TokenType::NEWLINE})) continue;
         
@@ -285,9 +356,10 @@ StmtPtr Parser::switchStatement() {
             break;
         }
     }
+    switchDepth--;
     
     consume(TokenType::RIGHT_BRACE, "Expected '}' after switch body");
-    return std::make_unique<SwitchStmt>(std::move(expr), std::move(cases), std::move(defaultCase));
+    return arena.make<SwitchStmt>(std::move(expr), arena.list(std::move(cases)), std::move(defaultCase));
 }
 
 StmtPtr Parser::externDeclaration() {
@@ -302,11 +374,14 @@ StmtPtr Parser::externDeclaration() {
         libraryType = typeToken.lexeme;
     }
     
+    // Each name may state its C signature: name(double, string) -> int
     std::vector<Token> functions;
+    std::vector<NativeSignature> signatures;
     if (match({TokenType::LEFT_BRACE})) {
         while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
             if (match({TokenType::NEWLINE})) continue;
             functions.push_back(consume(TokenType::IDENTIFIER, "Expected function name"));
+            signatures.push_back(match({TokenType::LEFT_PAREN}) ? nativeSignature() : NativeSignature());
             if (!check(TokenType::RIGHT_BRACE)) {
                 consume(TokenType::COMMA, "Expected ',' between function names");
             }
@@ -315,7 +390,40 @@ StmtPtr Parser::externDeclaration() {
     }
     
     consume(TokenType::NEWLINE, "Expected newline after extern declaration");
-    return std::make_unique<ExternStmt>(libraryPath, alias, libraryType, std::move(functions));
+    return arena.make<ExternStmt>(libraryPath, alias, libraryType, arena.list(std::move(functions)),
+                                  arena.list(std::move(signatures)));
+}
+
+NativeSignature Parser::nativeSignature() {
+    NativeSignature signature;
+    signature.declared = true;
+    if (!check(TokenType::RIGHT_PAREN)) {
+        do {
+            if (signature.arity == NativeSignature::kMaxParams) {
+                ErrorHandler::error(peek().line, peek().column,
+                                    "Can't have more than " + std::to_string(NativeSignature::kMaxParams) +
+                                    " native parameters");
+                nativeType(false);
+                continue;
+            }
+            signature.params[signature.arity++] = nativeType(false);
+        } while (match({TokenType::COMMA}));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expected ')' after parameter types");
+    consume(TokenType::ARROW, "Expected '->' before return type");
+    signature.result = nativeType(true);
+    return signature;
+}
+
+NativeType Parser::nativeType(bool allowVoid) {
+    const Token& name = consume(TokenType::IDENTIFIER, "Expected native type");
+    NativeType type = NativeType::Double;
+    if (!NativeSignature::typeFromName(name.lexeme, type)) {
+        ErrorHandler::error(name.line, name.column, "Unknown native type '" + name.text() + "'");
+    } else if (type == NativeType::Void && !allowVoid) {
+        ErrorHandler::error(name.line, name.column, "Only a return type can be 'void'");
+    }
+    return type;
 }
 
 StmtPtr Parser::pluginDeclaration() {
@@ -337,7 +445,7 @@ StmtPtr Parser::pluginDeclaration() {
     }
     
     consume(TokenType::NEWLINE, "Expected newline after plugin declaration");
-    return std::make_unique<PluginStmt>(pluginPath, alias, std::move(exports));
+    return arena.make<PluginStmt>(pluginPath, alias, arena.list(std::move(exports)));
 }
 
 ExprPtr Parser::expression() {
@@ -351,7 +459,7 @@ ExprPtr Parser::ternary() {
         auto thenExpr = expression();
         consume(TokenType::COLON, "Expected ':' after ternary then expression");
         auto elseExpr = ternary();
-        return std::make_unique<TernaryExpr>(std::move(expr), std::move(thenExpr), std::move(elseExpr));
+        return arena.make<TernaryExpr>(std::move(expr), std::move(thenExpr), std::move(elseExpr));
     }
     
     return expr;
@@ -364,12 +472,13 @@ ExprPtr Parser::assignment() {
         Token equals = previous();
         auto value = assignment();
         
-        if (auto var = dynamic_cast<VariableExpr*>(expr.get())) {
+        if (auto var = dynamic_cast<VariableExpr*>(expr)) {
             Token name = var->name;
-            //expr.release(); // Release ownership
-            return std::make_unique<AssignExpr>(name, std::move(value));
-        } else if (auto get = dynamic_cast<GetExpr*>(expr.get())) {
-            return std::make_unique<SetExpr>(std::move(get->object), get->name, std::move(value));
+            return arena.make<AssignExpr>(name, std::move(value));
+        } else if (auto get = dynamic_cast<GetExpr*>(expr)) {
+            return arena.make<SetExpr>(std::move(get->object), get->name, std::move(value));
+        } else if (auto index = dynamic_cast<IndexExpr*>(expr)) {
+            return arena.make<SetIndexExpr>(index->object, index->bracket, index->index, std::move(value));
         }
         
         ErrorHandler::error(equals.line, equals.column, "Invalid assignment target");
@@ -384,7 +493,7 @@ ExprPtr Parser::logicalOr() {
     while (match({TokenType::OR})) {
         Token operator_ = previous();
         auto right = logicalAnd();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), operator_, std::move(right));
+        expr = arena.make<BinaryExpr>(std::move(expr), operator_, std::move(right));
     }
     
     return expr;
@@ -396,7 +505,7 @@ ExprPtr Parser::logicalAnd() {
     while (match({TokenType::AND})) {
         Token operator_ = previous();
         auto right = equality();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), operator_, std::move(right));
+        expr = arena.make<BinaryExpr>(std::move(expr), operator_, std::move(right));
     }
     
     return expr;
@@ -408,7 +517,7 @@ ExprPtr Parser::equality() {
     while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
         Token operator_ = previous();
         auto right = comparison();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), operator_, std::move(right));
+        expr = arena.make<BinaryExpr>(std::move(expr), operator_, std::move(right));
     }
     
     return expr;
@@ -420,7 +529,7 @@ ExprPtr Parser::comparison() {
     while (match({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL})) {
         Token operator_ = previous();
         auto right = term();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), operator_, std::move(right));
+        expr = arena.make<BinaryExpr>(std::move(expr), operator_, std::move(right));
     }
     
     return expr;
@@ -432,7 +541,7 @@ ExprPtr Parser::term() {
     while (match({TokenType::MINUS, TokenType::PLUS})) {
         Token operator_ = previous();
         auto right = factor();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), operator_, std::move(right));
+        expr = arena.make<BinaryExpr>(std::move(expr), operator_, std::move(right));
     }
     
     return expr;
@@ -444,17 +553,31 @@ ExprPtr Parser::factor() {
     while (match({TokenType::SLASH, TokenType::STAR})) {
         Token operator_ = previous();
         auto right = unary();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), operator_, std::move(right));
+        expr = arena.make<BinaryExpr>(std::move(expr), operator_, std::move(right));
     }
     
     return expr;
 }
 
 ExprPtr Parser::unary() {
-    if (match({TokenType::BANG, TokenType::MINUS})) {
+    if (match({TokenType::BANG, TokenType::MINUS, TokenType::AWAIT})) {
         Token operator_ = previous();
         auto right = unary();
-        return std::make_unique<UnaryExpr>(operator_, std::move(right));
+        return arena.make<UnaryExpr>(operator_, std::move(right));
+    }
+    
+    // spawn is only a keyword right before call_native, so it stays
+    // free as a name everywhere else
+    if (check(TokenType::IDENTIFIER) && peek().symbol == spawnSymbol &&
+        tokens[current + 1].type == TokenType::CALL_NATIVE) {
+        int line = advance().line;
+        auto expr = call();
+        auto external = dynamic_cast<ExternExpr*>(expr);
+        if (!external) {
+            throw ParseError("Only call_native(...) can be spawned at line " + std::to_string(line));
+        }
+        external->spawned = true;
+        return expr;
     }
     
     return call();
@@ -467,12 +590,13 @@ ExprPtr Parser::call() {
         if (match({TokenType::LEFT_PAREN})) {
             expr = finishCall(std::move(expr));
         } else if (match({TokenType::LEFT_BRACKET})) {
+            Token bracket = previous();
             auto index = expression();
             consume(TokenType::RIGHT_BRACKET, "Expected ']' after index");
-            expr = std::make_unique<IndexExpr>(std::move(expr), std::move(index));
+            expr = arena.make<IndexExpr>(std::move(expr), bracket, std::move(index));
         } else if (match({TokenType::DOT})) {
             Token name = consume(TokenType::IDENTIFIER, "Expected property name after '.'");
-            expr = std::make_unique<GetExpr>(std::move(expr), name);
+            expr = arena.make<GetExpr>(std::move(expr), name);
         } else {
             break;
         }
@@ -494,19 +618,19 @@ ExprPtr Parser::finishCall(ExprPtr callee) {
     }
     
     Token paren = consume(TokenType::RIGHT_PAREN, "Expected ')' after arguments");
-    return std::make_unique<CallExpr>(std::move(callee), paren, std::move(arguments));
+    return arena.make<CallExpr>(std::move(callee), paren, arena.list(std::move(arguments)));
 }
 
 ExprPtr Parser::primary() {
-    if (match({TokenType::FALSE})) return std::make_unique<LiteralExpr>(Value(false));
-    if (match({TokenType::TRUE})) return std::make_unique<LiteralExpr>(Value(true));
-    if (match({TokenType::NIL})) return std::make_unique<LiteralExpr>(Value());
-    if (match({TokenType::THIS})) return std::make_unique<ThisExpr>(previous());
+    if (match({TokenType::FALSE})) return arena.make<LiteralExpr>(Value(false));
+    if (match({TokenType::TRUE})) return arena.make<LiteralExpr>(Value(true));
+    if (match({TokenType::NIL})) return arena.make<LiteralExpr>(Value());
+    if (match({TokenType::THIS})) return arena.make<ThisExpr>(previous());
     if (match({TokenType::SUPER})) {
         Token keyword = previous();
         consume(TokenType::DOT, "Expected '.' after 'super'");
         Token method = consume(TokenType::IDENTIFIER, "Expected superclass method name");
-        return std::make_unique<SuperExpr>(keyword, method);
+        return arena.make<SuperExpr>(keyword, method);
     }
     
     if (match({TokenType::LAMBDA})) {
@@ -524,6 +648,10 @@ ExprPtr Parser::primary() {
         consume(TokenType::NEWLINE, "Expected newline after ':'");
         
         std::vector<StmtPtr> body;
+        int enclosingLoopDepth = loopDepth;
+        int enclosingSwitchDepth = switchDepth;
+        loopDepth = 0;
+        switchDepth = 0;
         if (match({TokenType::LEFT_BRACE})) {
             while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
                 if (match({TokenType::NEWLINE})) continue;
@@ -535,29 +663,31 @@ ExprPtr Parser::primary() {
         } else {
             // Single expression lambda
             auto expr = expression();
-            body.push_back(std::make_unique<ReturnStmt>(Token(TokenType::RETURN, "return", "", 0, 0), std::move(expr)));
+            body.push_back(arena.make<ReturnStmt>(Token(TokenType::RETURN, "return", "", 0, 0), std::move(expr)));
         }
+        loopDepth = enclosingLoopDepth;
+        switchDepth = enclosingSwitchDepth;
         
-        return std::make_unique<LambdaExpr>(std::move(parameters), std::move(body));
+        return arena.make<LambdaExpr>(arena.list(std::move(parameters)), arena.list(std::move(body)));
     }
     
     if (match({TokenType::NUMBER})) {
-        double value = std::stod(previous().literal);
-        return std::make_unique<LiteralExpr>(Value(value));
+        double value = std::stod(std::string(previous().literal));
+        return arena.make<LiteralExpr>(Value(value));
     }
     
     if (match({TokenType::STRING})) {
-        return std::make_unique<LiteralExpr>(Value(previous().literal));
+        return arena.make<LiteralExpr>(Value(std::string(previous().literal)));
     }
     
     if (match({TokenType::IDENTIFIER})) {
-        return std::make_unique<VariableExpr>(previous());
+        return arena.make<VariableExpr>(previous());
     }
     
     if (match({TokenType::LEFT_PAREN})) {
         auto expr = expression();
         consume(TokenType::RIGHT_PAREN, "Expected ')' after expression");
-        return std::make_unique<GroupingExpr>(std::move(expr));
+        return arena.make<GroupingExpr>(std::move(expr));
     }
     
     if (match({TokenType::LEFT_BRACKET})) {
@@ -570,7 +700,25 @@ ExprPtr Parser::primary() {
         }
         
         consume(TokenType::RIGHT_BRACKET, "Expected ']' after list elements");
-        return std::make_unique<ListExpr>(std::move(elements));
+        return arena.make<ListExpr>(arena.list(std::move(elements)));
+    }
+    
+    if (match({TokenType::LEFT_BRACE})) {
+        // Map literal; entries may be spread over several lines
+        std::vector<std::pair<ExprPtr, ExprPtr>> entries;
+        skipNewlines();
+        while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+            auto key = expression();
+            consume(TokenType::COLON, "Expected ':' after map key");
+            auto value = expression();
+            entries.emplace_back(key, value);
+            skipNewlines();
+            if (!match({TokenType::COMMA})) break;
+            skipNewlines();
+        }
+        
+        consume(TokenType::RIGHT_BRACE, "Expected '}' after map entries");
+        return arena.make<MapExpr>(arena.list(std::move(entries)));
     }
     
     if (match({TokenType::LOAD_LIBRARY})) {
@@ -582,11 +730,11 @@ ExprPtr Parser::primary() {
         std::string libraryType = "cpp";
         if (match({TokenType::COMMA})) {
             Token typeToken = consume(TokenType::STRING, "Expected library type");
-            libraryType = typeToken.literal;
+            libraryType = std::string(typeToken.literal);
         }
         
         consume(TokenType::RIGHT_PAREN, "Expected ')' after load_library arguments");
-        return std::make_unique<LoadLibraryExpr>(libraryPath, alias, libraryType);
+        return arena.make<LoadLibraryExpr>(libraryPath, alias, libraryType);
     }
     
     if (match({TokenType::CALL_NATIVE})) {
@@ -603,12 +751,16 @@ ExprPtr Parser::primary() {
         }
         
         consume(TokenType::RIGHT_PAREN, "Expected ')' after call_native arguments");
-        return std::make_unique<ExternExpr>(library, function, std::move(arguments), "native");
+        return arena.make<ExternExpr>(library, function, arena.list(std::move(arguments)), "native");
     }
     
     throw ParseError("Expected expression at line " + std::to_string(peek().line));
 }
 
+void Parser::skipNewlines() {
+    while (match({TokenType::NEWLINE})) {}
+}
+
 bool Parser::match(std::initializer_list<TokenType> types) {
     for (TokenType type : types) { // NOLINT(*-use-anyofallof)
         if (check(type)) {
@@ -619,7 +771,7 @@ bool Parser::match(std::initializer_list<TokenType> types) {
     return false;
 }
 
-Token Parser::advance() {
+const Token& Parser::advance() {
     if (!isAtEnd()) current++;
     return previous();
 }
@@ -628,11 +780,11 @@ bool Parser::isAtEnd() {
     return peek().type == TokenType::EOF_TOKEN;
 }
 
-Token Parser::peek() {
+const Token& Parser::peek() {
     return tokens[current];
 }
 
-Token Parser::previous() {
+const Token& Parser::previous() {
     return tokens[current - 1];
 }
 
@@ -641,10 +793,10 @@ bool Parser::check(TokenType type) {
     return peek().type == type;
 }
 
-Token Parser::consume(TokenType type, const std::string& message) {
+const Token& Parser::consume(TokenType type, const std::string& message) {
     if (check(type)) return advance();
     
-    Token token = peek();
+    const Token& token = peek();
     throw ParseError(message + " at line " + std::to_string(token.line) + ", column " + std::to_string(token.column));
 }
 
@@ -657,6 +809,7 @@ void Parser::synchronize() {
         switch (peek().type) {
             case TokenType::CLASS:
             case TokenType::FUNCTION:
+            case TokenType::ASYNC:
             case TokenType::VAR:
             case TokenType::FOR:
             case TokenType::IF:
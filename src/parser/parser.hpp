@@ -6,16 +6,23 @@
 class Parser {
 private:
     std::vector<Token> tokens;
+    AstArena& arena; // receives every node
     int current = 0;
+    // Enclosing loops and switches in the current function body
+    int loopDepth = 0;
+    int switchDepth = 0;
+    std::vector<std::string> skippedErrors;
+    const Symbol spawnSymbol = SymbolTable::intern("spawn");
 
     // Helper methods
+    void skipNewlines();
     bool match(std::initializer_list<TokenType> types);
-    Token advance();
+    const Token& advance();
     bool isAtEnd();
-    Token peek();
-    Token previous();
+    const Token& peek();
+    const Token& previous();
     bool check(TokenType type);
-    Token consume(TokenType type, const std::string& message);
+    const Token& consume(TokenType type, const std::string& message);
     void synchronize();
 
     // Expression parsing
@@ -42,8 +49,12 @@ private:
     StmtPtr ifStatement();
     StmtPtr whileStatement();
     StmtPtr forStatement();
+    StmtPtr forInStatement(const Token& variable);
     StmtPtr functionStatement(const std::string& kind);
+    StmtPtr asyncFunctionStatement();
     StmtPtr returnStatement();
+    StmtPtr breakStatement();
+    StmtPtr continueStatement();
     StmtPtr declaration();
     StmtPtr classDeclaration();
     StmtPtr importStatement();
@@ -51,9 +62,16 @@ private:
     StmtPtr throwStatement();
     StmtPtr switchStatement();
     StmtPtr externDeclaration();
+    NativeSignature nativeSignature();
+    NativeType nativeType(bool allowVoid);
     StmtPtr pluginDeclaration();
 
 public:
-    explicit Parser(std::vector<Token> tokens);
-    std::vector<StmtPtr> parse();
+    // The tree is built in arena, which has to outlive it
+    Parser(std::vector<Token> tokens, AstArena& arena);
+    NodeList<StmtPtr> parse();
+
+    // Statements that fail to parse are skipped without a report; these
+    // are the reasons, in order, for front ends that show them
+    const std::vector<std::string>& skipped() const { return skippedErrors; }
 };
\ No newline at end of file
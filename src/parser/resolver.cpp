@@ -0,0 +1,345 @@
+#include "resolver.hpp"
+
+void Resolver::resolve(NodeList<StmtPtr>& statements) {
+    resolveStatements(statements);
+
+    // Top-level functions only see globals beyond their own scope, so
+    // they can be resolved once the whole program has been walked.
+    std::vector<PendingFunction> pending = std::move(globalPending);
+    globalPending.clear();
+    for (const auto& function : pending) {
+        resolveFunction(function);
+    }
+}
+
+void Resolver::resolve(Stmt& stmt) {
+    stmt.accept(*this);
+}
+
+void Resolver::resolve(Expr& expr) {
+    expr.accept(*this);
+}
+
+void Resolver::resolveStatements(NodeList<StmtPtr>& statements) {
+    for (auto& statement : statements) {
+        if (statement != nullptr) {
+            resolve(*statement);
+        }
+    }
+}
+
+void Resolver::resolveFunction(const PendingFunction& function) {
+    beginScope();
+    if (function.isMethod) {
+        // Callable::callMethod binds the instance to slot 0
+        declare(thisSymbol);
+    }
+    for (const auto& param : *function.params) {
+        declare(param.symbol);
+    }
+    resolveStatements(*function.body);
+    *function.slotCount = endScope();
+}
+
+void Resolver::deferFunction(const PendingFunction& function) {
+    if (scopes.empty()) {
+        globalPending.push_back(function);
+    } else {
+        scopes.back().pending.push_back(function);
+    }
+}
+
+void Resolver::beginScope() {
+    scopes.emplace_back();
+}
+
+int Resolver::endScope() {
+    // Resolving a body pushes and pops its own scope, so the pending list
+    // of the scope being closed cannot grow while it is drained.
+    std::vector<PendingFunction> pending = std::move(scopes.back().pending);
+    for (const auto& function : pending) {
+        resolveFunction(function);
+    }
+
+    int slotCount = static_cast<int>(scopes.back().slots.size());
+    scopes.pop_back();
+    return slotCount;
+}
+
+int Resolver::declare(Symbol name) {
+    if (scopes.empty()) return -1; // globals stay name-based
+
+    auto& slots = scopes.back().slots;
+    auto it = slots.find(name);
+    if (it != slots.end()) {
+        return it->second; // redeclaration reuses the slot
+    }
+
+    int slot = static_cast<int>(slots.size());
+    slots.emplace(name, slot);
+    return slot;
+}
+
+VarSlot Resolver::resolveLocal(Symbol name) const {
+    for (int i = static_cast<int>(scopes.size()) - 1; i >= 0; i--) {
+        auto it = scopes[i].slots.find(name);
+        if (it != scopes[i].slots.end()) {
+            VarSlot slot;
+            slot.depth = static_cast<int>(scopes.size()) - 1 - i;
+            slot.index = it->second;
+            return slot;
+        }
+    }
+    return {};
+}
+
+// Expressions
+
+Value Resolver::visitLambdaExpr(LambdaExpr& expr) {
+    deferFunction({&expr.params, &expr.body, &expr.slotCount, false});
+    return {};
+}
+
+Value Resolver::visitTernaryExpr(TernaryExpr& expr) {
+    resolve(*expr.condition);
+    resolve(*expr.thenExpr);
+    resolve(*expr.elseExpr);
+    return {};
+}
+
+Value Resolver::visitSetExpr(SetExpr& expr) {
+    resolve(*expr.object);
+    resolve(*expr.value);
+    return {};
+}
+
+Value Resolver::visitSuperExpr(SuperExpr& expr) {
+    return {};
+}
+
+Value Resolver::visitThisExpr(ThisExpr& expr) {
+    expr.slot = resolveLocal(expr.keyword.symbol);
+    return {};
+}
+
+Value Resolver::visitBinaryExpr(BinaryExpr& expr) {
+    resolve(*expr.left);
+    resolve(*expr.right);
+    return {};
+}
+
+Value Resolver::visitUnaryExpr(UnaryExpr& expr) {
+    resolve(*expr.right);
+    return {};
+}
+
+Value Resolver::visitLiteralExpr(LiteralExpr& expr) {
+    return {};
+}
+
+Value Resolver::visitGroupingExpr(GroupingExpr& expr) {
+    resolve(*expr.expression);
+    return {};
+}
+
+Value Resolver::visitVariableExpr(VariableExpr& expr) {
+    expr.slot = resolveLocal(expr.name.symbol);
+    return {};
+}
+
+Value Resolver::visitAssignExpr(AssignExpr& expr) {
+    resolve(*expr.value);
+    expr.slot = resolveLocal(expr.name.symbol);
+    return {};
+}
+
+Value Resolver::visitCallExpr(CallExpr& expr) {
+    // Method calls are invoked without binding the method first
+    expr.property = dynamic_cast<GetExpr*>(expr.callee);
+    resolve(*expr.callee);
+    for (auto& argument : expr.arguments) {
+        resolve(*argument);
+    }
+    return {};
+}
+
+Value Resolver::visitGetExpr(GetExpr& expr) {
+    resolve(*expr.object);
+    return {};
+}
+
+Value Resolver::visitListExpr(ListExpr& expr) {
+    for (auto& element : expr.elements) {
+        resolve(*element);
+    }
+    return {};
+}
+
+Value Resolver::visitIndexExpr(IndexExpr& expr) {
+    resolve(*expr.object);
+    resolve(*expr.index);
+    return {};
+}
+
+Value Resolver::visitMapExpr(MapExpr& expr) {
+    for (auto& entry : expr.entries) {
+        resolve(*entry.first);
+        resolve(*entry.second);
+    }
+    return {};
+}
+
+Value Resolver::visitSetIndexExpr(SetIndexExpr& expr) {
+    resolve(*expr.object);
+    resolve(*expr.index);
+    resolve(*expr.value);
+    return {};
+}
+
+Value Resolver::visitExternExpr(ExternExpr& expr) {
+    for (auto& argument : expr.arguments) {
+        resolve(*argument);
+    }
+    return {};
+}
+
+Value Resolver::visitLoadLibraryExpr(LoadLibraryExpr& expr) {
+    return {};
+}
+
+// Statements
+
+void Resolver::visitClassStmt(ClassStmt& stmt) {
+    if (stmt.superclass != nullptr) {
+        resolve(*stmt.superclass);
+    }
+
+    stmt.slot = declare(stmt.name.symbol);
+
+    for (auto& method : stmt.methods) {
+        auto functionStmt = dynamic_cast<FunctionStmt*>(method);
+        if (functionStmt) {
+            deferFunction({&functionStmt->params, &functionStmt->body, &functionStmt->slotCount, true});
+        }
+    }
+}
+
+void Resolver::visitImportStmt(ImportStmt& stmt) {
+    stmt.moduleSlot = declare(stmt.module.symbol);
+    if (!stmt.alias.lexeme.empty()) {
+        stmt.aliasSlot = declare(stmt.alias.symbol);
+    }
+}
+
+void Resolver::visitTryStmt(TryStmt& stmt) {
+    resolve(*stmt.tryBlock);
+
+    if (stmt.catchBlock != nullptr) {
+        beginScope();
+        if (!stmt.catchVar.lexeme.empty()) {
+            stmt.catchSlot = declare(stmt.catchVar.symbol);
+        }
+        resolve(*stmt.catchBlock);
+        stmt.catchSlotCount = endScope();
+    }
+
+    if (stmt.finallyBlock != nullptr) {
+        resolve(*stmt.finallyBlock);
+    }
+}
+
+void Resolver::visitThrowStmt(ThrowStmt& stmt) {
+    resolve(*stmt.value);
+}
+
+void Resolver::visitSwitchStmt(SwitchStmt& stmt) {
+    resolve(*stmt.expr);
+    for (auto& caseStmt : stmt.cases) {
+        resolve(*caseStmt.first);
+        resolve(*caseStmt.second);
+    }
+    if (stmt.defaultCase != nullptr) {
+        resolve(*stmt.defaultCase);
+    }
+}
+
+void Resolver::visitExternStmt(ExternStmt& stmt) {
+    stmt.slot = declare(stmt.alias.symbol);
+}
+
+void Resolver::visitPluginStmt(PluginStmt& stmt) {
+    stmt.slot = declare(stmt.alias.symbol);
+}
+
+void Resolver::visitExpressionStmt(ExpressionStmt& stmt) {
+    resolve(*stmt.expression);
+}
+
+void Resolver::visitPrintStmt(PrintStmt& stmt) {
+    resolve(*stmt.expression);
+}
+
+void Resolver::visitVarStmt(VarStmt& stmt) {
+    // The initializer sees the enclosing binding, as it did at runtime
+    if (stmt.initializer != nullptr) {
+        resolve(*stmt.initializer);
+    }
+    stmt.slot = declare(stmt.name.symbol);
+}
+
+void Resolver::visitBlockStmt(BlockStmt& stmt) {
+    beginScope();
+    resolveStatements(stmt.statements);
+    stmt.slotCount = endScope();
+}
+
+void Resolver::visitIfStmt(IfStmt& stmt) {
+    resolve(*stmt.condition);
+    resolve(*stmt.thenBranch);
+    if (stmt.elseBranch != nullptr) {
+        resolve(*stmt.elseBranch);
+    }
+}
+
+void Resolver::visitWhileStmt(WhileStmt& stmt) {
+    resolve(*stmt.condition);
+    resolve(*stmt.body);
+}
+
+void Resolver::visitForStmt(ForStmt& stmt) {
+    beginScope();
+    if (stmt.initializer != nullptr) {
+        resolve(*stmt.initializer);
+    }
+    if (stmt.condition != nullptr) {
+        resolve(*stmt.condition);
+    }
+    resolve(*stmt.body);
+    if (stmt.increment != nullptr) {
+        resolve(*stmt.increment);
+    }
+    stmt.slotCount = endScope();
+}
+
+void Resolver::visitForInStmt(ForInStmt& stmt) {
+    resolve(*stmt.iterable);
+    beginScope();
+    stmt.slot = declare(stmt.variable.symbol);
+    resolve(*stmt.body);
+    stmt.slotCount = endScope();
+}
+
+void Resolver::visitFunctionStmt(FunctionStmt& stmt) {
+    stmt.slot = declare(stmt.name.symbol);
+    deferFunction({&stmt.params, &stmt.body, &stmt.slotCount, false});
+}
+
+void Resolver::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.value != nullptr) {
+        resolve(*stmt.value);
+    }
+}
+
+void Resolver::visitBreakStmt(BreakStmt& stmt) {}
+
+void Resolver::visitContinueStmt(ContinueStmt& stmt) {}
@@ -0,0 +1,89 @@
+#pragma once
+#include "ast.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Static pass run between Parser::parse() and Interpreter::interpret().
+// Every local declaration is given a slot in its scope's environment and
+// every variable reference a (depth, slot) pair, so the interpreter can
+// reach locals by index instead of hashing names at each scope.
+//
+// Function and lambda bodies are resolved when their enclosing scope
+// closes, so they see every name declared in that scope (e.g. mutually
+// recursive local functions) just like the dynamic lookup did.
+class Resolver : public ASTVisitor {
+private:
+    struct PendingFunction {
+        const NodeList<Token>* params;
+        NodeList<StmtPtr>* body;
+        int* slotCount;
+        bool isMethod;
+    };
+
+    struct Scope {
+        std::unordered_map<Symbol, int> slots;
+        std::vector<PendingFunction> pending;
+    };
+
+    std::vector<Scope> scopes;
+    std::vector<PendingFunction> globalPending;
+    const Symbol thisSymbol = SymbolTable::intern("this");
+
+public:
+    void resolve(NodeList<StmtPtr>& statements);
+
+    // Expression visitors
+    Value visitLambdaExpr(LambdaExpr& expr) override;
+    Value visitTernaryExpr(TernaryExpr& expr) override;
+    Value visitSetExpr(SetExpr& expr) override;
+    Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitThisExpr(ThisExpr& expr) override;
+    Value visitBinaryExpr(BinaryExpr& expr) override;
+    Value visitUnaryExpr(UnaryExpr& expr) override;
+    Value visitLiteralExpr(LiteralExpr& expr) override;
+    Value visitGroupingExpr(GroupingExpr& expr) override;
+    Value visitVariableExpr(VariableExpr& expr) override;
+    Value visitAssignExpr(AssignExpr& expr) override;
+    Value visitCallExpr(CallExpr& expr) override;
+    Value visitGetExpr(GetExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitIndexExpr(IndexExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSetIndexExpr(SetIndexExpr& expr) override;
+    Value visitExternExpr(ExternExpr& expr) override;
+    Value visitLoadLibraryExpr(LoadLibraryExpr& expr) override;
+
+    // Statement visitors
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitImportStmt(ImportStmt& stmt) override;
+    void visitTryStmt(TryStmt& stmt) override;
+    void visitThrowStmt(ThrowStmt& stmt) override;
+    void visitSwitchStmt(SwitchStmt& stmt) override;
+    void visitExternStmt(ExternStmt& stmt) override;
+    void visitPluginStmt(PluginStmt& stmt) override;
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitForStmt(ForStmt& stmt) override;
+    void visitForInStmt(ForInStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitBreakStmt(BreakStmt& stmt) override;
+    void visitContinueStmt(ContinueStmt& stmt) override;
+
+private:
+    void resolve(Stmt& stmt);
+    void resolve(Expr& expr);
+    void resolveStatements(NodeList<StmtPtr>& statements);
+    void resolveFunction(const PendingFunction& function);
+    void deferFunction(const PendingFunction& function);
+
+    void beginScope();
+    int endScope();
+    int declare(Symbol name);
+    VarSlot resolveLocal(Symbol name) const;
+};
@@ -0,0 +1,193 @@
+#include "repl.hpp"
+#include "error/error_handler.hpp"
+#include "parser/optimizer.hpp"
+#include "parser/parser.hpp"
+#include "runtime/gc.hpp"
+#include "vm/compiler.hpp"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Resident set size in bytes, 0 where it can't be read
+size_t residentBytes() {
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+double megabytes(double bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+} // namespace
+
+Repl::Repl(bool useVm, bool optimize) : useVm(useVm), optimize(optimize) {}
+
+void Repl::run(std::istream& in, std::ostream& out) {
+    std::string line;
+    while (true) {
+        out << (continuing() ? "... " : "> ") << std::flush;
+        if (!std::getline(in, line)) break;
+        if (!feed(line, out)) break;
+    }
+}
+
+bool Repl::feed(const std::string& line, std::ostream& out) {
+    if (!continuing()) {
+        if (line == "exit" || line == "quit") return false;
+        if (line.empty()) return true;
+        if (line[0] == ':') return command(line, out);
+    }
+
+    try {
+        // A blank line ends a block; inside brackets it is just blank
+        if (line.empty() && carry.empty() && depth <= 0) {
+            execute(out);
+            return true;
+        }
+
+        scan(line);
+        if (ErrorHandler::getHadError()) {
+            reset();
+            ErrorHandler::reset();
+        } else if (carry.empty() && depth <= 0 && last != TokenType::COLON && !multiLine) {
+            execute(out);
+        } else if (carry.empty()) {
+            // Strings and comments that only ran on do not count
+            multiLine = true;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        reset();
+    }
+    return true;
+}
+
+bool Repl::command(const std::string& line, std::ostream& out) {
+    if (line == ":time") {
+        reportTime = !reportTime;
+        out << "Timing " << (reportTime ? "on" : "off") << std::endl;
+    } else if (line == ":mem") {
+        reportMemory = !reportMemory;
+        out << "Memory report " << (reportMemory ? "on" : "off") << std::endl;
+    } else if (line == ":help") {
+        out << ":time  toggle the run time of each statement" << std::endl;
+        out << ":mem   toggle memory use after each statement" << std::endl;
+        out << "exit   leave (or quit, or end of input)" << std::endl;
+    } else {
+        out << "Unknown command " << line << "; :help lists them" << std::endl;
+    }
+    return true;
+}
+
+// Lexes the line on its own unless an open string or comment carries
+// over, which is scanned again together with the line that continues it
+void Repl::scan(const std::string& line) {
+    if (carry.empty()) carryLine = nextLine;
+    carry += line;
+    carry += '\n';
+
+    Lexer lexer(carry, spellings, carryLine);
+    std::vector<Token> scanned = lexer.scanTokens();
+    if (ErrorHandler::getHadError() || lexer.endsOpen()) return;
+
+    nextLine = scanned.back().line;
+    scanned.pop_back(); // EOF: the entry may go on
+    for (Token& token : scanned) {
+        switch (token.type) {
+            case TokenType::LEFT_PAREN:
+            case TokenType::LEFT_BRACKET:
+            case TokenType::LEFT_BRACE:
+                depth++;
+                break;
+            case TokenType::RIGHT_PAREN:
+            case TokenType::RIGHT_BRACKET:
+            case TokenType::RIGHT_BRACE:
+                depth--;
+                break;
+            default:
+                break;
+        }
+        if (token.type != TokenType::NEWLINE) last = token.type;
+        tokens.push_back(std::move(token));
+    }
+    carry.clear();
+}
+
+void Repl::execute(std::ostream& out) {
+    tokens.emplace_back(TokenType::EOF_TOKEN, Symbol(), Symbol(), nextLine, 1);
+    Parser parser(std::move(tokens), arena);
+    NodeList<StmtPtr> statements = parser.parse();
+    reset();
+    // Scripts drop such statements quietly, but at a prompt they are typos
+    for (const std::string& error : parser.skipped()) {
+        std::cerr << "Syntax error: " << error << std::endl;
+    }
+    if (ErrorHandler::getHadError()) {
+        ErrorHandler::reset();
+        return;
+    }
+
+    if (optimize) {
+        Optimizer optimizer(arena);
+        optimizer.optimize(statements);
+    }
+    resolver.resolve(statements);
+
+    for (StmtPtr& statement : statements) {
+        size_t before = reportMemory ? residentBytes() : 0;
+        auto start = std::chrono::steady_clock::now();
+        runStatement(statement);
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (reportTime || reportMemory) {
+            out << "[line " << statement->line << "]" << std::fixed << std::setprecision(3);
+            if (reportTime) out << " " << elapsed << " ms";
+            if (reportMemory) {
+                size_t after = residentBytes();
+                GcStats gc = Heap::local().stats();
+                out << (reportTime ? "," : "") << " rss " << std::setprecision(1) << megabytes(after)
+                    << " MB (" << std::showpos << megabytes(static_cast<double>(after) - before)
+                    << std::noshowpos << " MB), " << StringObject::internedCount() << " strings, "
+                    << gc.tracked << " tracked objects, " << arena.bytesUsed() / 1024 << " KB of trees";
+            }
+            out << std::defaultfloat << std::endl;
+        }
+
+        if (ErrorHandler::getHadError() || ErrorHandler::getHadRuntimeError()) break;
+    }
+    ErrorHandler::reset();
+}
+
+void Repl::runStatement(StmtPtr& statement) {
+    NodeList<StmtPtr> single(&statement, 1);
+    if (useVm) {
+        Compiler compiler(vm);
+        auto script = compiler.compile(single);
+        if (!ErrorHandler::getHadError()) vm.interpret(script);
+    } else {
+        interpreter.interpret(single);
+    }
+}
+
+void Repl::reset() {
+    tokens.clear();
+    carry.clear();
+    nextLine = 1;
+    depth = 0;
+    multiLine = false;
+    last = TokenType::NEWLINE;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "interpreter.hpp"
+#include "lexer/lexer.hpp"
+#include "parser/ast_arena.hpp"
+#include "parser/resolver.hpp"
+#include "vm/vm.hpp"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Interactive front end. Each line is lexed once, as it arrives, with a
+// spelling cache kept for the whole session; an entry that is still open
+// (an unclosed bracket, a block header ending in ':', a string or comment
+// running on) collects further lines until it is complete, and a block
+// spanning several lines ends at a blank line. Complete entries are
+// parsed into one arena that lives as long as the session, resolved by
+// one resolver and run a statement at a time, so nothing entered earlier
+// is parsed or run again.
+//
+// Commands: ":time" and ":mem" toggle a report after every statement of
+// its run time and of the process's memory, ":help" lists them, and
+// "exit" or "quit" ends the session.
+class Repl {
+public:
+    Repl(bool useVm, bool optimize);
+
+    // Prompts on out and reads lines from in until it ends or the user quits
+    void run(std::istream& in, std::ostream& out);
+
+    // Takes one line without its newline. Returns false if it asked to quit.
+    bool feed(const std::string& line, std::ostream& out);
+    // Whether the entry being typed needs more lines
+    bool continuing() const { return !tokens.empty() || !carry.empty(); }
+
+private:
+    bool useVm;
+    bool optimize;
+    Interpreter interpreter;
+    VM vm;
+    AstArena arena; // every entry's tree: functions declared in it point into it
+    Resolver resolver;
+    Lexer::SpellingCache spellings;
+
+    // The entry being typed
+    std::vector<Token> tokens;
+    std::string carry;   // lines ending in an open string or comment
+    int carryLine = 1;   // line of the entry carry starts on
+    int nextLine = 1;    // line of the entry the next line is
+    int depth = 0;       // brackets left open
+    bool multiLine = false;
+    TokenType last = TokenType::NEWLINE; // last token but newlines
+
+    bool reportTime = false;
+    bool reportMemory = false;
+
+    bool command(const std::string& line, std::ostream& out);
+    void scan(const std::string& line);
+    void execute(std::ostream& out);
+    void runStatement(StmtPtr& statement);
+    void reset();
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include "value.hpp"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Read-only view of a call's arguments. The values are owned by the
+// caller (the interpreter's ArgumentStack, the VM stack, or a local) and
+// stay valid for the duration of the call.
+class Arguments {
+private:
+    const Value* values;
+    size_t count;
+
+public:
+    Arguments() : values(nullptr), count(0) {}
+    Arguments(const Value* values, size_t count) : values(values), count(count) {}
+    Arguments(const std::vector<Value>& values) : values(values.data()), count(values.size()) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Value& operator[](size_t index) const { return values[index]; }
+    const Value* begin() const { return values; }
+    const Value* end() const { return values + count; }
+};
+
+// Storage for the arguments of in-flight calls. Space is handed out in
+// segments that never move, so a view given to a callee stays valid while
+// calls nested inside it reserve their own arguments. Reservations are
+// released in reverse order.
+class ArgumentStack {
+private:
+    static constexpr size_t kSegmentSize = 1024;
+
+    struct Segment {
+        std::unique_ptr<Value[]> values;
+        size_t capacity;
+        size_t used;
+    };
+
+    std::vector<Segment> segments;
+    size_t current = 0;
+
+public:
+    // count contiguous nil slots
+    Value* reserve(size_t count) {
+        if (!segments.empty()) {
+            Segment& segment = segments[current];
+            if (segment.capacity - segment.used >= count) {
+                Value* slots = segment.values.get() + segment.used;
+                segment.used += count;
+                return slots;
+            }
+        }
+        return reserveSlow(count);
+    }
+
+    // Releases the most recent reservation, dropping its values
+    void release(Value* slots, size_t count) {
+        if (count == 0) return;
+        for (size_t i = 0; i < count; i++) {
+            slots[i] = Value();
+        }
+        Segment& segment = segments[current];
+        segment.used -= count;
+        if (segment.used == 0 && current > 0) {
+            current--;
+        }
+    }
+
+private:
+    Value* reserveSlow(size_t count) {
+        if (!segments.empty() && segments[current].used > 0) {
+            current++;
+        }
+        if (current == segments.size()) {
+            size_t capacity = count > kSegmentSize ? count : kSegmentSize;
+            segments.push_back({std::unique_ptr<Value[]>(new Value[capacity]), capacity, 0});
+        } else if (segments[current].capacity < count) {
+            segments[current] = {std::unique_ptr<Value[]>(new Value[count]), count, 0};
+        }
+        segments[current].used = count;
+        return segments[current].values.get();
+    }
+};
+
+// Reservation whose lifetime is one call; exceptions release it too
+class ArgumentFrame {
+private:
+    ArgumentStack& stack;
+    Value* slots;
+    size_t count;
+
+public:
+    ArgumentFrame(ArgumentStack& stack, size_t count) : stack(stack), slots(stack.reserve(count)), count(count) {}
+    ArgumentFrame(const ArgumentFrame&) = delete;
+    ArgumentFrame& operator=(const ArgumentFrame&) = delete;
+    ~ArgumentFrame() { stack.release(slots, count); }
+
+    Value& operator[](size_t index) { return slots[index]; }
+    Arguments view() const { return Arguments(slots, count); }
+};
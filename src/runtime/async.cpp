@@ -0,0 +1,708 @@
+#include "async.hpp"
+#include "../error/exceptions.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#if defined(__linux__)
+#define FOCUS_ASYNC_EPOLL 1
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#endif
+
+namespace {
+
+// Thrown into a task that finish() cancels. Not an exception scripts
+// or natives catch, so it unwinds the whole task.
+struct TaskCancelled {};
+
+} // namespace
+
+WorkerPool::WorkerPool(size_t threads) {
+    for (size_t i = 0; i < threads; i++) {
+        std::thread([this] { work(); }).detach();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wakeUp.notify_one();
+}
+
+WorkerPool& WorkerPool::blocking() {
+    // Blocking jobs of every loop; never destroyed, as its threads never stop
+    static WorkerPool* pool = new WorkerPool(4);
+    return *pool;
+}
+
+void WorkerPool::work() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this] { return !jobs.empty(); });
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+// A task's own stack, and the context switches between it and the
+// loop's. A fiber only ever resumes from the thread's own stack and
+// suspends back to it.
+class Fiber {
+public:
+    bool finished = false;
+    bool cancelled = false;
+    // Set while suspended in wait(); cleared by whichever wakes it first
+    std::shared_ptr<bool> waiting;
+
+    Fiber(std::function<void()> body, std::function<void()> onSwitch);
+    Fiber(const Fiber&) = delete;
+    Fiber& operator=(const Fiber&) = delete;
+    ~Fiber();
+
+    static Fiber* current() { return running; }
+    void resume();
+    static void suspend();
+
+private:
+    // Room for about a thousand nested script calls, and small enough for
+    // tens of thousands of tasks; only what is used is ever backed.
+    // kStackReserve of it is left to natives below the deepest script
+    // call, which EventLoop::checkStack() enforces.
+    static constexpr size_t kStackSize = 1024 * 1024;
+    static constexpr size_t kStackReserve = 64 * 1024;
+    static inline thread_local Fiber* running = nullptr;
+
+    std::function<void()> body;
+    std::function<void()> onSwitch;
+    void run();
+    void switchTo();
+
+#if defined(_WIN32)
+    LPVOID fiber = nullptr;
+    LPVOID caller = nullptr;
+    static VOID CALLBACK entry(LPVOID self) { static_cast<Fiber*>(self)->run(); }
+#else
+    void* stack = nullptr;
+    ucontext_t context;
+    ucontext_t caller;
+    static void entry() { running->run(); }
+
+    // Stacks are carved out of slabs of kSlabStacks, each slab a single
+    // mapping: a guard page per stack would split it into two mappings per
+    // task, and the kernel only allows about 65k. Stacks are never
+    // unmapped; past kSpareStacks free ones, their memory is given back.
+    static inline thread_local std::vector<void*> freeStacks;
+    static constexpr size_t kSlabStacks = 64;
+    static constexpr size_t kSpareStacks = 64;
+    static size_t pageSize() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+    static void* takeStack();
+#endif
+};
+
+#if defined(_WIN32)
+
+Fiber::Fiber(std::function<void()> body, std::function<void()> onSwitch)
+    : body(std::move(body)), onSwitch(std::move(onSwitch)) {
+    fiber = CreateFiber(kStackSize, &Fiber::entry, this);
+    if (fiber == nullptr) throw RuntimeError(Token(), "Can't create a task: out of memory");
+}
+
+Fiber::~Fiber() {
+    DeleteFiber(fiber);
+}
+
+void Fiber::switchTo() {
+    // The thread has to be a fiber itself to switch to one
+    static thread_local LPVOID threadFiber = ConvertThreadToFiber(nullptr);
+    caller = threadFiber;
+    SwitchToFiber(fiber);
+}
+
+void Fiber::suspend() {
+    SwitchToFiber(running->caller);
+}
+
+void Fiber::run() {
+    if (!cancelled) body();
+    finished = true;
+    SwitchToFiber(caller);
+}
+
+#else
+
+void* Fiber::takeStack() {
+    if (freeStacks.empty()) {
+        // Mapped, not allocated: only the pages tasks touch are ever backed
+        // by memory. The slab's lowest page is a guard page for its lowest
+        // stack; the others are kept apart by checkStack().
+        size_t size = kSlabStacks * kStackSize;
+        void* slab = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (slab == MAP_FAILED) throw RuntimeError(Token(), "Can't create a task: out of memory");
+        mprotect(slab, pageSize(), PROT_NONE);
+        for (size_t i = kSlabStacks; i-- > 0;) {
+            freeStacks.push_back(static_cast<char*>(slab) + i * kStackSize);
+        }
+    }
+    void* stack = freeStacks.back();
+    freeStacks.pop_back();
+    return stack;
+}
+
+Fiber::Fiber(std::function<void()> body, std::function<void()> onSwitch)
+    : body(std::move(body)), onSwitch(std::move(onSwitch)) {
+    stack = takeStack();
+    getcontext(&context);
+    // Every stack skips its lowest page, so the guard page of a slab's
+    // lowest one is no special case
+    context.uc_stack.ss_sp = static_cast<char*>(stack) + pageSize();
+    context.uc_stack.ss_size = kStackSize - pageSize();
+    context.uc_link = &caller; // where run() goes once it returns
+    makecontext(&context, &Fiber::entry, 0);
+}
+
+Fiber::~Fiber() {
+    if (freeStacks.size() >= kSpareStacks) madvise(stack, kStackSize, MADV_DONTNEED);
+    freeStacks.push_back(stack);
+}
+
+void Fiber::switchTo() {
+    swapcontext(&caller, &context);
+}
+
+void Fiber::suspend() {
+    Fiber* self = running;
+    swapcontext(&self->context, &self->caller);
+}
+
+void Fiber::run() {
+    if (!cancelled) body();
+    finished = true;
+}
+
+#endif
+
+void Fiber::resume() {
+    if (onSwitch) onSwitch();
+    Fiber* previous = running;
+    uintptr_t previousLimit = EventLoop::stackLimit;
+    running = this;
+#if !defined(_WIN32)
+    EventLoop::stackLimit = reinterpret_cast<uintptr_t>(stack) + pageSize() + kStackReserve;
+#endif
+    switchTo();
+    running = previous;
+    EventLoop::stackLimit = previousLimit;
+    if (onSwitch) onSwitch();
+}
+
+// Readiness of the descriptors tasks wait for, and a way for other
+// threads to wake the loop up
+class EventLoop::Poller {
+public:
+#if defined(FOCUS_ASYNC_EPOLL)
+    Poller() : epoll(epoll_create1(EPOLL_CLOEXEC)), wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, wakeFd, &event);
+    }
+    ~Poller() {
+        ::close(wakeFd);
+        ::close(epoll);
+    }
+
+    // Reports fd once it is ready for one of the events, then forgets
+    // about it until it is watched again
+    void watch(int fd, bool read, bool write) {
+        epoll_event event{};
+        event.events = EPOLLONESHOT | (read ? EPOLLIN : 0u) | (write ? EPOLLOUT : 0u);
+        event.data.fd = fd;
+        if (registered.insert(fd).second) {
+            epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        } else {
+            epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+        }
+    }
+    void forget(int fd) {
+        if (registered.erase(fd) != 0) epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // Descriptors that became ready within timeoutMs (-1: no limit);
+    // sets woken if another thread called wake()
+    std::vector<int> wait(int timeoutMs, bool& woken) {
+        epoll_event events[64];
+        int count = epoll_wait(epoll, events, 64, timeoutMs);
+        std::vector<int> fds;
+        woken = false;
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == wakeFd) {
+                uint64_t value;
+                while (::read(wakeFd, &value, sizeof(value)) > 0) {}
+                woken = true;
+            } else {
+                fds.push_back(events[i].data.fd);
+            }
+        }
+        return fds;
+    }
+    void wake() {
+        uint64_t one = 1;
+        (void)!::write(wakeFd, &one, sizeof(one));
+    }
+
+private:
+    int epoll;
+    int wakeFd;
+    std::unordered_set<int> registered;
+#elif !defined(_WIN32)
+    Poller() {
+        if (pipe(wakePipe) == 0) {
+            for (int fd : wakePipe) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+    }
+    ~Poller() {
+        ::close(wakePipe[0]);
+        ::close(wakePipe[1]);
+    }
+
+    void watch(int fd, bool read, bool write) {
+        interest[fd] = static_cast<short>((read ? POLLIN : 0) | (write ? POLLOUT : 0));
+    }
+    void forget(int fd) { interest.erase(fd); }
+
+    std::vector<int> wait(int timeoutMs, bool& woken) {
+        std::vector<pollfd> fds{{wakePipe[0], POLLIN, 0}};
+        for (const auto& entry : interest) {
+            fds.push_back({entry.first, entry.second, 0});
+        }
+        int count = poll(fds.data(), static_cast<nfds_t>(fds.size()), timeoutMs);
+        std::vector<int> ready;
+        woken = false;
+        if (count <= 0) return ready;
+        if (fds[0].revents != 0) {
+            char buffer[64];
+            while (::read(wakePipe[0], buffer, sizeof(buffer)) > 0) {}
+            woken = true;
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents == 0) continue;
+            interest.erase(fds[i].fd); // one-shot, as with epoll
+            ready.push_back(fds[i].fd);
+        }
+        return ready;
+    }
+    void wake() {
+        char one = 1;
+        (void)!::write(wakePipe[1], &one, 1);
+    }
+
+private:
+    int wakePipe[2] = {-1, -1};
+    std::unordered_map<int, short> interest;
+#else
+    // No descriptors to wait for: only timers and worker results
+    void watch(int, bool, bool) {}
+    void forget(int) {}
+
+    std::vector<int> wait(int timeoutMs, bool& woken) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (timeoutMs < 0) {
+            wakeUp.wait(lock, [this] { return signalled; });
+        } else {
+            wakeUp.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return signalled; });
+        }
+        woken = signalled;
+        signalled = false;
+        return {};
+    }
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex);
+        signalled = true;
+        wakeUp.notify_one();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool signalled = false;
+#endif
+};
+
+// Future implementation
+Value Future::get() {
+    if (state_ == State::Failed) {
+        observed = true;
+        throw std::runtime_error(message);
+    }
+    return value;
+}
+
+void Future::resolve(Value result) {
+    if (isDone()) return;
+    value = std::move(result);
+    finish(State::Done);
+}
+
+void Future::fail(std::string error) {
+    if (isDone()) return;
+    message = std::move(error);
+    finish(State::Failed);
+}
+
+void Future::finish(State state) {
+    state_ = state;
+    if (state == State::Failed && isTask) loop->taskFailed(shared_from_this());
+    std::vector<std::function<void()>> pending = std::move(callbacks);
+    callbacks.clear();
+    for (auto& callback : pending) {
+        callback();
+    }
+}
+
+void Future::onDone(std::function<void()> callback) {
+    if (isDone()) {
+        callback();
+    } else {
+        callbacks.push_back(std::move(callback));
+    }
+}
+
+std::string Future::toString() const {
+    switch (state_) {
+        case State::Pending: return "<future pending>";
+        case State::Done: return "<future done>";
+        case State::Failed: return "<future failed>";
+    }
+    return "<future>";
+}
+
+// EventLoop implementation
+EventLoop::EventLoop() : poller(std::make_unique<Poller>()) {}
+
+EventLoop::~EventLoop() = default;
+
+EventLoop& EventLoop::local() {
+    // Never destroyed, like the heaps: workers may still post results to
+    // a loop whose thread is gone
+    static thread_local EventLoop* loop = new EventLoop();
+    return *loop;
+}
+
+bool EventLoop::inTask() {
+    return Fiber::current() != nullptr;
+}
+
+void EventLoop::stackOverflow() {
+    throw RuntimeError(Token(), "Stack overflow in task");
+}
+
+double EventLoop::now() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::shared_ptr<Future> EventLoop::spawn(std::function<Value()> body, std::function<void()> onSwitch) {
+    auto future = std::make_shared<Future>(*this);
+    future->isTask = true;
+    Fiber* fiber = new Fiber([future, body = std::move(body)] {
+        try {
+            future->resolve(body());
+        } catch (const TaskCancelled&) {
+            future->observed = true;
+            future->fail("Task cancelled");
+        } catch (const std::exception& e) {
+            future->fail(e.what());
+        } catch (...) {
+            future->fail("Task failed");
+        }
+    }, std::move(onSwitch));
+    ready.push_back(fiber);
+    return future;
+}
+
+void EventLoop::schedule(Fiber* fiber) {
+    suspended.erase(fiber);
+    ready.push_back(fiber);
+}
+
+void EventLoop::cancel(Fiber* fiber) {
+    if (fiber->waiting) *fiber->waiting = false;
+    fiber->cancelled = true;
+    schedule(fiber);
+}
+
+void EventLoop::taskFailed(const std::shared_ptr<Future>& future) {
+    failedTasks.push_back(future);
+}
+
+void EventLoop::wait(Future& future) {
+    if (&future.owner() != this) {
+        throw std::runtime_error("A future can only be awaited on the thread that made it");
+    }
+    if (future.isDone()) return;
+
+    Fiber* fiber = Fiber::current();
+    if (fiber == nullptr) {
+        // Not a task: the loop runs right here until the future is done
+        while (!future.isDone()) {
+            // The last completion may have been the future's own
+            if (!step() && !future.isDone()) {
+                throw std::runtime_error("Await can't finish: nothing is left that could complete it");
+            }
+        }
+        return;
+    }
+
+    auto waiting = std::make_shared<bool>(true);
+    fiber->waiting = waiting;
+    future.onDone([this, fiber, waiting] {
+        if (!*waiting) return;
+        *waiting = false;
+        schedule(fiber);
+    });
+    suspended.insert(fiber);
+    Fiber::suspend();
+    fiber->waiting = nullptr;
+    if (fiber->cancelled) throw TaskCancelled{};
+}
+
+Value EventLoop::await(const Value& awaited, const Token& where) {
+    if (!awaited.isFuture()) return awaited;
+    std::shared_ptr<Future> future = awaited.asFuture();
+    try {
+        wait(*future);
+        return future->get();
+    } catch (const std::runtime_error& e) {
+        throw RuntimeError(where, e.what());
+    }
+}
+
+bool EventLoop::step() {
+    runCompleted();
+    fireTimers();
+    if (!ready.empty()) {
+        runReady();
+        // Tasks that keep each other busy still let I/O through
+        if (!waits.empty()) pollIo(0);
+        return true;
+    }
+    if (waits.empty() && timers.empty() && offloaded == 0) return false;
+
+    int timeout = -1;
+    if (!timers.empty()) {
+        timeout = static_cast<int>(std::ceil(std::max(0.0, timers.front().deadline - now())));
+    }
+    pollIo(timeout);
+    return true;
+}
+
+// Fibers made ready by these wait for the next round
+void EventLoop::runReady() {
+    for (size_t count = ready.size(); count > 0 && !ready.empty(); count--) {
+        Fiber* fiber = ready.front();
+        ready.pop_front();
+        fiber->resume();
+        if (fiber->finished) delete fiber;
+    }
+}
+
+void EventLoop::fireTimers() {
+    if (timers.empty()) return;
+    double time = now();
+    while (!timers.empty() && timers.front().deadline <= time) {
+        std::pop_heap(timers.begin(), timers.end(), std::greater<Timer>());
+        std::shared_ptr<Future> future = std::move(timers.back().future);
+        timers.pop_back();
+        future->resolve(Value());
+    }
+}
+
+void EventLoop::runCompleted() {
+    std::vector<std::function<void()>> done;
+    {
+        std::lock_guard<std::mutex> lock(completedMutex);
+        done.swap(completed);
+    }
+    for (auto& completion : done) {
+        offloaded--;
+        completion();
+    }
+}
+
+void EventLoop::post(std::function<void()> completion) {
+    {
+        std::lock_guard<std::mutex> lock(completedMutex);
+        completed.push_back(std::move(completion));
+    }
+    poller->wake();
+}
+
+void EventLoop::pollIo(int timeoutMs) {
+    bool woken = false;
+    for (int fd : poller->wait(timeoutMs, woken)) {
+        retry(fd);
+    }
+    if (woken) runCompleted();
+    fireTimers();
+}
+
+void EventLoop::finish(bool runTasks) {
+    // Nested script runs (a module, a native callback) leave it to the
+    // outermost one
+    if (inTask()) return;
+
+    for (;;) {
+        if (runTasks) {
+            while (step()) {}
+        }
+        if (suspended.empty() && ready.empty()) break;
+
+        // Whatever they wait for can't happen any more
+        std::vector<Fiber*> waiting(suspended.begin(), suspended.end());
+        for (Fiber* fiber : waiting) {
+            cancel(fiber);
+        }
+        for (Fiber* fiber : ready) {
+            fiber->cancelled = true;
+        }
+        while (!ready.empty()) {
+            runReady();
+        }
+    }
+    timers.clear();
+    waits.clear();
+
+    for (const auto& future : failedTasks) {
+        if (!future->observed) std::cerr << "Unhandled error in task: " << future->error() << std::endl;
+    }
+    failedTasks.clear();
+}
+
+std::shared_ptr<Future> EventLoop::sleep(double milliseconds) {
+    auto future = std::make_shared<Future>(*this);
+    timers.push_back({now() + std::max(0.0, milliseconds), timerSequence++, future});
+    std::push_heap(timers.begin(), timers.end(), std::greater<Timer>());
+    return future;
+}
+
+std::shared_ptr<Future> EventLoop::gather(const std::vector<Value>& awaited) {
+    auto result = std::make_shared<Future>(*this);
+    auto values = std::make_shared<std::vector<Value>>(awaited);
+    auto remaining = std::make_shared<size_t>(awaited.size());
+
+    for (size_t i = 0; i < awaited.size(); i++) {
+        if (!awaited[i].isFuture()) {
+            --*remaining;
+            continue;
+        }
+        std::shared_ptr<Future> future = awaited[i].asFuture();
+        if (&future->owner() != this) {
+            throw std::runtime_error("gather() can only wait for futures made on its own thread");
+        }
+    }
+    if (*remaining == 0) {
+        result->resolve(Value(values));
+        return result;
+    }
+
+    for (size_t i = 0; i < awaited.size(); i++) {
+        if (!awaited[i].isFuture()) continue;
+        std::shared_ptr<Future> future = awaited[i].asFuture();
+        future->onDone([result, values, remaining, future, i] {
+            if (result->isDone()) return;
+            if (future->state() == Future::State::Failed) {
+                future->observed = true;
+                result->fail(future->error());
+                return;
+            }
+            (*values)[i] = future->result();
+            if (--*remaining == 0) result->resolve(Value(values));
+        });
+    }
+    return result;
+}
+
+std::shared_ptr<Future> EventLoop::offload(std::function<std::function<void(Future&)>()> job, WorkerPool& pool) {
+    auto future = std::make_shared<Future>(*this);
+    offloaded++;
+    pool.submit([this, future, job = std::move(job)]() mutable {
+        std::function<void(Future&)> settle;
+        try {
+            settle = job();
+        } catch (const std::exception& e) {
+            std::string message = e.what();
+            settle = [message](Future& failed) { failed.fail(message); };
+        }
+        // Moved, so that the future is never released on this thread
+        post([future = std::move(future), settle = std::move(settle)] { settle(*future); });
+    });
+    return future;
+}
+
+std::shared_ptr<Future> EventLoop::waitFor(int fd, bool write, std::function<bool(Future&)> attempt) {
+    auto future = std::make_shared<Future>(*this);
+    if (attempt(*future)) return future;
+    waits[fd].push_back({write, std::move(attempt), future});
+    watch(fd);
+    return future;
+}
+
+// Watches fd for what its waits need
+void EventLoop::watch(int fd) {
+    auto it = waits.find(fd);
+    if (it == waits.end()) return;
+    bool read = false;
+    bool write = false;
+    for (const IoWait& wait : it->second) {
+        (wait.write ? write : read) = true;
+    }
+    poller->watch(fd, read, write);
+}
+
+void EventLoop::retry(int fd) {
+    auto it = waits.find(fd);
+    if (it == waits.end()) return;
+    std::vector<IoWait> pending = std::move(it->second);
+    waits.erase(it);
+
+    std::vector<IoWait> left;
+    for (IoWait& wait : pending) {
+        if (!wait.attempt(*wait.future)) left.push_back(std::move(wait));
+    }
+    if (left.empty() && waits.count(fd) == 0) return;
+    auto& list = waits[fd];
+    list.insert(list.begin(), std::make_move_iterator(left.begin()), std::make_move_iterator(left.end()));
+    watch(fd);
+}
+
+void EventLoop::forget(int fd) {
+    poller->forget(fd);
+    auto it = waits.find(fd);
+    if (it == waits.end()) return;
+    std::vector<IoWait> pending = std::move(it->second);
+    waits.erase(it);
+    for (IoWait& wait : pending) {
+        wait.future->fail("Socket closed");
+    }
+}
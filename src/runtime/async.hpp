@@ -0,0 +1,225 @@
+#pragma once
+#include "value.hpp"
+#include "../lexer/token.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Coroutines. Calling an `async function` starts a task: the body runs
+// on a fiber, a stack of its own, and the call returns a future for its
+// result right away. `await future` inside a task suspends the task until
+// the future is done; anywhere else it runs the event loop of the thread
+// until then. Awaiting anything that is not a future gives it back as is.
+//
+// Tasks only run while somebody awaits, or once the script is done: a
+// script's tasks all finish before it returns, and tasks that are still
+// waiting then, on something that can no longer happen, are cancelled.
+//
+// Each thread has its own loop, and its tasks and futures stay on it.
+// Timers and non-blocking sockets wake the loop through epoll (poll where
+// there is no epoll); file reads and writes, which can't be waited for
+// that way, run on a few blocking worker threads.
+
+class EventLoop;
+class Fiber;
+
+// Result of a task, a timer or an I/O operation
+class Future : public std::enable_shared_from_this<Future> {
+public:
+    enum class State : uint8_t { Pending, Done, Failed };
+
+    explicit Future(EventLoop& loop) : loop(&loop) {}
+
+    State state() const { return state_; }
+    bool isDone() const { return state_ != State::Pending; }
+    const Value& result() const { return value; }
+    const std::string& error() const { return message; }
+    // The result of a future that is done; throws std::runtime_error
+    // with the error of a failed one
+    Value get();
+
+    // Only the first of resolve and fail counts
+    void resolve(Value result);
+    void fail(std::string error);
+    // Runs callback once the future is done, right away if it is
+    void onDone(std::function<void()> callback);
+
+    EventLoop& owner() const { return *loop; }
+    std::string toString() const;
+
+private:
+    friend class EventLoop;
+
+    EventLoop* loop;
+    State state_ = State::Pending;
+    Value value;
+    std::string message;
+    bool observed = false; // a failure was seen by an await
+    bool isTask = false;
+    std::vector<std::function<void()>> callbacks;
+
+    void finish(State state);
+};
+
+// Threads that run blocking jobs in the order they come, started with
+// the pool and living as long as the process
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads);
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void submit(std::function<void()> job);
+
+    // The pool file reads and writes run on
+    static WorkerPool& blocking();
+
+private:
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<std::function<void()>> jobs;
+
+    void work();
+};
+
+class EventLoop {
+public:
+    // The calling thread's loop
+    static EventLoop& local();
+
+    // Runs body as a new task, returning the future of what it returns.
+    // Runtime errors it throws fail the future. onSwitch, if given, runs
+    // right before the task is resumed and right after it stops again,
+    // for engines that keep the running task's state in themselves.
+    std::shared_ptr<Future> spawn(std::function<Value()> body, std::function<void()> onSwitch = nullptr);
+
+    // Returns once future is done: suspends the calling task, or runs the
+    // loop if the caller is not a task. Throws std::runtime_error if
+    // nothing is left that could complete the future.
+    void wait(Future& future);
+    // The result of awaited once it is done, or awaited itself if it is
+    // not a future. Errors are thrown as RuntimeErrors at where.
+    Value await(const Value& awaited, const Token& where);
+
+    // Whether the caller runs in a task
+    static bool inTask();
+    // Whether the running task is close to the end of its stack, leaving
+    // room for the natives it calls; never outside tasks
+    static bool stackLow() {
+        char here;
+        return reinterpret_cast<uintptr_t>(&here) < stackLimit;
+    }
+    // Throws a RuntimeError if stackLow(); every call of a script
+    // function checks it
+    static void checkStack() {
+        if (stackLow()) stackOverflow();
+    }
+
+    // Called when a script ends. Runs tasks until nothing is left to do
+    // (only cancels them unless runTasks), cancels the tasks still
+    // waiting, and reports the errors of tasks nobody awaited.
+    void finish(bool runTasks);
+
+    // Future resolved with nil after milliseconds
+    std::shared_ptr<Future> sleep(double milliseconds);
+    // Future of the list of the results of awaited, failing with the
+    // first of them that fails
+    std::shared_ptr<Future> gather(const std::vector<Value>& awaited);
+
+    // Runs job on a thread of pool. What it returns is then called on
+    // this loop to settle the future; job itself must not touch values.
+    std::shared_ptr<Future> offload(std::function<std::function<void(Future&)>()> job,
+                                    WorkerPool& pool = WorkerPool::blocking());
+
+    // Calls attempt whenever fd is readable (writable if write) until it
+    // returns true, by which time it has settled the future. It is tried
+    // once right away.
+    std::shared_ptr<Future> waitFor(int fd, bool write, std::function<bool(Future&)> attempt);
+    // Fails what waits for fd, which is about to be closed
+    void forget(int fd);
+
+private:
+    struct Timer {
+        double deadline; // steady clock, in milliseconds
+        uint64_t sequence;
+        std::shared_ptr<Future> future;
+        bool operator>(const Timer& other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    struct IoWait {
+        bool write;
+        std::function<bool(Future&)> attempt;
+        std::shared_ptr<Future> future;
+    };
+
+    class Poller;
+
+    std::deque<Fiber*> ready;
+    std::unordered_set<Fiber*> suspended; // tasks waiting, cancelled by finish()
+    std::vector<Timer> timers;            // min-heap on deadline
+    uint64_t timerSequence = 0;
+    std::unordered_map<int, std::vector<IoWait>> waits;
+    std::unique_ptr<Poller> poller;
+    size_t offloaded = 0; // jobs whose result has not come back yet
+    std::mutex completedMutex;
+    std::vector<std::function<void()>> completed; // posted by workers
+    std::vector<std::shared_ptr<Future>> failedTasks;
+
+    // Lowest address the running task's script calls may reach, null
+    // outside tasks
+    static inline thread_local uintptr_t stackLimit = 0;
+    [[noreturn]] static void stackOverflow();
+
+    EventLoop();
+    ~EventLoop();
+
+    friend class Future;
+    friend class Fiber;
+    void schedule(Fiber* fiber);
+    void taskFailed(const std::shared_ptr<Future>& future);
+    // Runs what is ready, or waits until something is. False if nothing
+    // could ever become ready.
+    bool step();
+    void runReady();
+    void fireTimers();
+    void runCompleted();
+    void post(std::function<void()> completion);
+    void pollIo(int timeoutMs);
+    void retry(int fd);
+    void watch(int fd);
+    void cancel(Fiber* fiber);
+    static double now();
+};
+
+// Non-blocking primitives behind the I/O builtins. Sockets are plain
+// descriptors, handed to scripts as numbers.
+class AsyncIo {
+public:
+    // Contents of the file at path
+    static std::shared_ptr<Future> readFile(const std::string& path);
+    // Replaces the file's contents; resolves with the bytes written
+    static std::shared_ptr<Future> writeFile(const std::string& path, const std::string& text);
+
+    // Listening TCP socket; host "" listens on every interface. Throws
+    // std::runtime_error if it can't be opened.
+    static int listen(const std::string& host, int port);
+    // Port a socket is bound to, for listeners opened on port 0
+    static int localPort(int socket);
+    // Future of the next connection's socket
+    static std::shared_ptr<Future> accept(int listener);
+    static std::shared_ptr<Future> connect(const std::string& host, int port);
+    // Future of up to max bytes read, "" once the peer has closed
+    static std::shared_ptr<Future> read(int socket, size_t max);
+    // Resolves with the byte count once all of text is sent
+    static std::shared_ptr<Future> write(int socket, const std::string& text);
+    static void close(int socket);
+};
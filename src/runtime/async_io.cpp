@@ -0,0 +1,258 @@
+#include "async.hpp"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0 // a write to a closed peer fails with EPIPE either way
+#endif
+
+std::shared_ptr<Future> AsyncIo::readFile(const std::string& path) {
+    return EventLoop::local().offload([path] {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) throw std::runtime_error("Can't open file '" + path + "'");
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        if (file.bad()) throw std::runtime_error("Can't read file '" + path + "'");
+        return std::function<void(Future&)>([text = contents.str()](Future& future) {
+            future.resolve(Value(text));
+        });
+    });
+}
+
+std::shared_ptr<Future> AsyncIo::writeFile(const std::string& path, const std::string& text) {
+    return EventLoop::local().offload([path, text] {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::runtime_error("Can't open file '" + path + "'");
+        file << text;
+        file.close();
+        if (!file) throw std::runtime_error("Can't write file '" + path + "'");
+        double written = static_cast<double>(text.size());
+        return std::function<void(Future&)>([written](Future& future) { future.resolve(Value(written)); });
+    });
+}
+
+#if defined(_WIN32)
+
+namespace {
+
+[[noreturn]] void unsupported() {
+    throw std::runtime_error("Sockets are not supported on this platform");
+}
+
+} // namespace
+
+int AsyncIo::listen(const std::string&, int) { unsupported(); }
+int AsyncIo::localPort(int) { unsupported(); }
+std::shared_ptr<Future> AsyncIo::accept(int) { unsupported(); }
+std::shared_ptr<Future> AsyncIo::connect(const std::string&, int) { unsupported(); }
+std::shared_ptr<Future> AsyncIo::read(int, size_t) { unsupported(); }
+std::shared_ptr<Future> AsyncIo::write(int, const std::string&) { unsupported(); }
+void AsyncIo::close(int) { unsupported(); }
+
+#else
+
+namespace {
+
+std::string systemError(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+void makeNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+// First address of host:port; host "" is every interface when passive
+struct Address {
+    sockaddr_storage storage{};
+    socklen_t length = 0;
+    int family = AF_INET;
+};
+
+Address resolve(const std::string& host, int port, bool passive) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo* found = nullptr;
+    std::string service = std::to_string(port);
+    int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &found);
+    if (status != 0 || found == nullptr) {
+        throw std::runtime_error("Can't resolve '" + host + "': " + gai_strerror(status));
+    }
+    Address address;
+    std::memcpy(&address.storage, found->ai_addr, found->ai_addrlen);
+    address.length = static_cast<socklen_t>(found->ai_addrlen);
+    address.family = found->ai_family;
+    freeaddrinfo(found);
+    return address;
+}
+
+void checkPort(int port) {
+    if (port < 0 || port > 65535) throw std::runtime_error("Port must be between 0 and 65535");
+}
+
+// Connects a new socket to address; the future resolves with the socket
+void startConnect(const Address& address, const std::shared_ptr<Future>& connected) {
+    int fd = ::socket(address.family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        connected->fail(systemError("Can't open socket"));
+        return;
+    }
+    makeNonBlocking(fd);
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address.storage), address.length) == 0) {
+        connected->resolve(Value(static_cast<double>(fd)));
+        return;
+    }
+    if (errno != EINPROGRESS) {
+        connected->fail(systemError("Can't connect"));
+        ::close(fd);
+        return;
+    }
+
+    // Writable once the connection is made, or has failed
+    auto attempt = EventLoop::local().waitFor(fd, true, [fd](Future& future) {
+        pollfd writable{fd, POLLOUT, 0};
+        if (poll(&writable, 1, 0) == 0) return false;
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            errno = error;
+            future.fail(systemError("Can't connect"));
+        } else {
+            future.resolve(Value(static_cast<double>(fd)));
+        }
+        return true;
+    });
+    attempt->onDone([attempt, connected, fd] {
+        if (attempt->state() == Future::State::Failed) {
+            EventLoop::local().forget(fd);
+            ::close(fd);
+            connected->fail(attempt->error());
+        } else {
+            connected->resolve(attempt->result());
+        }
+    });
+}
+
+} // namespace
+
+int AsyncIo::listen(const std::string& host, int port) {
+    checkPort(port);
+    Address address = resolve(host, port, true);
+    int fd = ::socket(address.family, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error(systemError("Can't open socket"));
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&address.storage), address.length) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        std::string message = systemError("Can't listen on port " + std::to_string(port));
+        ::close(fd);
+        throw std::runtime_error(message);
+    }
+    makeNonBlocking(fd);
+    return fd;
+}
+
+int AsyncIo::localPort(int socket) {
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    if (getsockname(socket, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        throw std::runtime_error(systemError("Not a socket"));
+    }
+    if (address.ss_family == AF_INET6) return ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+    return ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+}
+
+std::shared_ptr<Future> AsyncIo::accept(int listener) {
+    return EventLoop::local().waitFor(listener, false, [listener](Future& future) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (wouldBlock() || errno == ECONNABORTED) return false;
+            future.fail(systemError("Can't accept"));
+            return true;
+        }
+        makeNonBlocking(fd);
+        future.resolve(Value(static_cast<double>(fd)));
+        return true;
+    });
+}
+
+std::shared_ptr<Future> AsyncIo::connect(const std::string& host, int port) {
+    checkPort(port);
+    EventLoop& loop = EventLoop::local();
+    auto connected = std::make_shared<Future>(loop);
+
+    // Name lookups block, so they run on a worker; only plain data
+    // crosses over
+    auto address = std::make_shared<Address>();
+    auto resolved = loop.offload([host, port, address] {
+        *address = resolve(host, port, false);
+        return std::function<void(Future&)>([](Future& future) { future.resolve(Value()); });
+    });
+    resolved->onDone([resolved, connected, address] {
+        if (resolved->state() == Future::State::Failed) {
+            connected->fail(resolved->error());
+        } else {
+            startConnect(*address, connected);
+        }
+    });
+    return connected;
+}
+
+std::shared_ptr<Future> AsyncIo::read(int socket, size_t max) {
+    return EventLoop::local().waitFor(socket, false, [socket, max](Future& future) {
+        std::string buffer(max, '\0');
+        ssize_t count = ::recv(socket, &buffer[0], max, 0);
+        if (count < 0) {
+            if (wouldBlock()) return false;
+            future.fail(systemError("Can't read from socket"));
+            return true;
+        }
+        buffer.resize(static_cast<size_t>(count));
+        future.resolve(Value(buffer));
+        return true;
+    });
+}
+
+std::shared_ptr<Future> AsyncIo::write(int socket, const std::string& text) {
+    auto sent = std::make_shared<size_t>(0);
+    return EventLoop::local().waitFor(socket, true, [socket, text, sent](Future& future) {
+        while (*sent < text.size()) {
+            ssize_t count = ::send(socket, text.data() + *sent, text.size() - *sent, MSG_NOSIGNAL);
+            if (count < 0) {
+                if (wouldBlock()) return false;
+                future.fail(systemError("Can't write to socket"));
+                return true;
+            }
+            *sent += static_cast<size_t>(count);
+        }
+        future.resolve(Value(static_cast<double>(text.size())));
+        return true;
+    });
+}
+
+void AsyncIo::close(int socket) {
+    EventLoop::local().forget(socket);
+    if (::close(socket) != 0) throw std::runtime_error(systemError("Can't close socket"));
+}
+
+#endif
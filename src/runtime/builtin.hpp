@@ -0,0 +1,166 @@
+#pragma once
+#include "callable.hpp"
+#include "metrics.hpp"
+#include "profiler.hpp"
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Builtins bound straight to C++ functions:
+//
+//   Builtin::bind<double(double, double)>("hypot", std::hypot)
+//
+// The signature is the builtin's arity, and each parameter type picks how
+// its argument is checked and converted, so all of that is settled at
+// compile time; a type without a BuiltinArgument doesn't compile. Calls
+// go to the function directly, not through a std::function the way they
+// do for a NativeFunction.
+//
+// Parameters can be double or float, any integer type (whole numbers in
+// its range only), bool, std::string_view (a slice stays a slice),
+// std::string, Value, and the shared_ptrs of lists and arrays, each by
+// value or const reference. Results can be any of those, void for nil, or anything else
+// a Value is made from.
+
+[[noreturn]] void builtinArgumentError(const std::string& name, const char* expected, const Value& value);
+
+template <typename T, typename = void>
+struct BuiltinArgument;
+
+template <typename T>
+struct BuiltinArgument<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static T from(const Value& value, const std::string& name) {
+        if (!value.isNumber()) builtinArgumentError(name, "a number", value);
+        return static_cast<T>(value.asNumber());
+    }
+};
+
+template <typename T>
+struct BuiltinArgument<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+    static T from(const Value& value, const std::string& name) {
+        // In range first: converting anything else to T is undefined
+        if (!value.isNumber() || !(value.asNumber() >= static_cast<double>(std::numeric_limits<T>::min()) &&
+                                   value.asNumber() < static_cast<double>(std::numeric_limits<T>::max()) + 1.0)) {
+            builtinArgumentError(name, "an integer", value);
+        }
+        T number = static_cast<T>(value.asNumber());
+        if (static_cast<double>(number) != value.asNumber()) builtinArgumentError(name, "an integer", value);
+        return number;
+    }
+};
+
+template <>
+struct BuiltinArgument<bool> {
+    static bool from(const Value& value, const std::string& name) {
+        if (!value.isBool()) builtinArgumentError(name, "a boolean", value);
+        return value.asBool();
+    }
+};
+
+template <>
+struct BuiltinArgument<std::string_view> {
+    static std::string_view from(const Value& value, const std::string& name) {
+        if (!value.isString()) builtinArgumentError(name, "a string", value);
+        return value.stringView();
+    }
+};
+
+template <>
+struct BuiltinArgument<std::string> {
+    static const std::string& from(const Value& value, const std::string& name) {
+        if (!value.isString()) builtinArgumentError(name, "a string", value);
+        return value.asString();
+    }
+};
+
+template <>
+struct BuiltinArgument<Value> {
+    static const Value& from(const Value& value, const std::string&) { return value; }
+};
+
+template <>
+struct BuiltinArgument<std::shared_ptr<std::vector<Value>>> {
+    static const std::shared_ptr<std::vector<Value>>& from(const Value& value, const std::string& name) {
+        if (!value.isList()) builtinArgumentError(name, "a list", value);
+        return value.asList();
+    }
+};
+
+template <>
+struct BuiltinArgument<std::shared_ptr<std::vector<double>>> {
+    static const std::shared_ptr<std::vector<double>>& from(const Value& value, const std::string& name) {
+        if (!value.isArray()) builtinArgumentError(name, "an array", value);
+        return value.asArray();
+    }
+};
+
+template <typename Signature, typename Function>
+class BoundBuiltin;
+
+template <typename Result, typename... Params, typename Function>
+class BoundBuiltin<Result(Params...), Function> final : public Callable {
+private:
+    static constexpr int kArity = static_cast<int>(sizeof...(Params));
+
+    Function function;
+    std::string name;
+
+    template <size_t... I>
+    Value invoke(Arguments arguments, std::index_sequence<I...>) {
+        if constexpr (std::is_void_v<Result>) {
+            function(BuiltinArgument<std::decay_t<Params>>::from(arguments[I], name)...);
+            return {};
+        } else if constexpr (std::is_arithmetic_v<Result> && !std::is_same_v<Result, bool>) {
+            auto result = function(BuiltinArgument<std::decay_t<Params>>::from(arguments[I], name)...);
+            return Value(static_cast<double>(result));
+        } else if constexpr (std::is_same_v<std::decay_t<Result>, std::string_view>) {
+            return Value(std::string(function(BuiltinArgument<std::decay_t<Params>>::from(arguments[I], name)...)));
+        } else {
+            return Value(function(BuiltinArgument<std::decay_t<Params>>::from(arguments[I], name)...));
+        }
+    }
+
+public:
+    BoundBuiltin(Function function, std::string name) : function(std::move(function)), name(std::move(name)) {}
+
+    int arity() override { return kArity; }
+
+    Value call(Interpreter&, Arguments arguments) override {
+        Metrics::count(Metrics::NativeCalls);
+        ProfileScope profile(this, "native", [this] { return name + " [native]"; });
+        // Both engines check the count before calling; this catches
+        // natives like map() calling it with the wrong one
+        if (arguments.size() != sizeof...(Params)) {
+            throw std::runtime_error(name + "() takes " + std::to_string(kArity) + " arguments, got " +
+                                     std::to_string(arguments.size()));
+        }
+        return invoke(arguments, std::index_sequence_for<Params...>{});
+    }
+
+    std::string toString() override { return "<native fn " + name + ">"; }
+    bool isThreadSafe() override { return true; }
+};
+
+// A class of its own, so calls are qualified: an unqualified bind() over
+// std:: types would find std::bind as well
+class Builtin {
+public:
+    // A function pointer, so an overloaded function like std::hypot
+    // resolves to the overload the signature names
+    template <typename Signature>
+    static std::shared_ptr<Callable> bind(std::string name, Signature* function) {
+        return std::make_shared<BoundBuiltin<Signature, Signature*>>(function, std::move(name));
+    }
+
+    // Lambdas and other function objects
+    template <typename Signature, typename Function>
+    static std::shared_ptr<Callable> bind(std::string name, Function function) {
+        return std::make_shared<BoundBuiltin<Signature, Function>>(std::move(function), std::move(name));
+    }
+};
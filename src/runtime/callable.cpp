@@ -1,45 +1,102 @@
 #include "callable.hpp"
+#include "builtin.hpp"
 
+#include <algorithm>
 #include <utility>
 #include "../parser/ast.hpp"
 #include "../interpreter.hpp"
 #include "environment.hpp"
 #include "../error/exceptions.hpp"
+#include "async.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "metrics.hpp"
+#include "numeric_tier.hpp"
+
+namespace {
+
+// Runs the body of an async function as a task, on an interpreter of its
+// own that shares the caller's globals, and returns the task's future
+Value startTask(Interpreter& interpreter, Environment* globals, FunctionStmt* declaration,
+                std::shared_ptr<Environment> environment) {
+    std::shared_ptr<Interpreter> task = interpreter.createWorker();
+    return Value(EventLoop::local().spawn([task, globals, declaration, environment = std::move(environment)]() mutable {
+        Interpreter::GlobalsScope scope(*task, globals);
+        return task->executeBody(declaration->body, std::move(environment));
+    }));
+}
+
+} // namespace
+
+Value Callable::callMethod(Interpreter& interpreter, const Value& instance, Arguments arguments) {
+    throw std::runtime_error(toString() + " cannot be called as a method");
+}
 
 Function::Function(FunctionStmt* declaration, std::shared_ptr<Environment> closure)
-    : declaration(declaration), closure(std::move(closure)) {}
+    : declaration(declaration), closure(std::move(closure)),
+      globals(this->closure != nullptr ? this->closure->root() : nullptr) {
+    // The frame may now hold the function, directly or not
+    if (this->closure != nullptr) this->closure->track();
+}
 
 int Function::arity() {
     return declaration->params.size();
 }
 
-Value Function::call(Interpreter& interpreter, std::vector<Value> arguments) {
-    auto environment = std::make_shared<Environment>(closure);
+Value Function::call(Interpreter& interpreter, Arguments arguments) {
+    Metrics::count(Metrics::Calls);
+#ifdef NUMERIC_TIER
+    Value result;
+    if (!declaration->isAsync && NumericTier::tryCall(*this, arguments, result)) return result;
+#endif
+    ProfileScope profile(declaration, "script", [this] { return profileName(); });
+    auto environment = Environment::create(closure, declaration->slotCount);
     
     for (size_t i = 0; i < declaration->params.size(); i++) {
-        environment->define(declaration->params[i].lexeme, arguments[i]);
+        environment->defineAt(static_cast<int>(i), arguments[i]);
     }
     
-    try {
-        interpreter.executeBlock(declaration->body, environment);
-    } catch (const ReturnValue& returnValue) {
-        return returnValue.value;
+    if (declaration->isAsync) return startTask(interpreter, globals, declaration, std::move(environment));
+    Interpreter::GlobalsScope scope(interpreter, globals);
+    return interpreter.executeBody(declaration->body, std::move(environment));
+}
+
+Value Function::callMethod(Interpreter& interpreter, const Value& instance, Arguments arguments) {
+    Metrics::count(Metrics::Calls);
+    ProfileScope profile(declaration, "script", [this] { return profileName(); });
+    auto environment = Environment::create(closure, declaration->slotCount);
+    environment->defineAt(0, instance);
+    
+    for (size_t i = 0; i < declaration->params.size(); i++) {
+        environment->defineAt(static_cast<int>(i) + 1, arguments[i]);
     }
     
-    return {}; // nil
+    if (declaration->isAsync) return startTask(interpreter, globals, declaration, std::move(environment));
+    Interpreter::GlobalsScope scope(interpreter, globals);
+    return interpreter.executeBody(declaration->body, std::move(environment));
 }
 
 std::string Function::toString() {
-    return "<fn " + declaration->name.lexeme + ">";
+    return "<fn " + declaration->name.text() + ">";
 }
 
-NativeFunction::NativeFunction(std::function<Value(Interpreter&, std::vector<Value>)> function, int arity, std::string name) : function(std::move(function)), arity_(arity), name(std::move(name)) {}
+void Function::trace(Tracer& tracer) const {
+    tracer.traced(closure);
+}
+
+std::string Function::profileName() const {
+    return declaration->name.text() + ":" + std::to_string(declaration->name.line);
+}
+
+NativeFunction::NativeFunction(std::function<Value(Interpreter&, Arguments)> function, int arity, std::string name) : function(std::move(function)), arity_(arity), name(std::move(name)) {}
 
 int NativeFunction::arity() {
     return arity_;
 }
 
-Value NativeFunction::call(Interpreter& interpreter, std::vector<Value> arguments) {
+Value NativeFunction::call(Interpreter& interpreter, Arguments arguments) {
+    Metrics::count(Metrics::NativeCalls);
+    ProfileScope profile(this, "native", [this] { return name + " [native]"; });
     return function(interpreter, arguments);
 }
 
@@ -47,122 +104,176 @@ std::string NativeFunction::toString() {
     return "<native fn " + name + ">";
 }
 
+void builtinArgumentError(const std::string& name, const char* expected, const Value& value) {
+    throw std::runtime_error(name + "() requires " + expected + ", got " + value.getType());
+}
+
 // FocusClass implementation
 FocusClass::FocusClass(std::string name, std::shared_ptr<FocusClass> superclass,
-                       std::unordered_map<std::string, std::shared_ptr<Function>> methods)
-    : name(std::move(name)), superclass(std::move(superclass)), methods(std::move(methods)) {}
+                       std::unordered_map<std::string, std::shared_ptr<Callable>> methods)
+    : name(std::move(name)), superclass(std::move(superclass)), methods(std::move(methods)) {
+    if (this->superclass != nullptr) {
+        // emplace keeps overriding methods
+        for (const auto& inherited : this->superclass->methods) {
+            this->methods.emplace(inherited.first, inherited.second);
+        }
+    }
+    initializer = findMethod("init");
+}
 
 int FocusClass::arity() {
-    auto initializer = findMethod("init");
     if (initializer == nullptr) return 0;
     return initializer->arity();
 }
 
-Value FocusClass::call(Interpreter& interpreter, std::vector<Value> arguments) {
-    auto instance = std::make_shared<FocusInstance>(shared_from_this());
-    auto initializer = findMethod("init");
+Value FocusClass::call(Interpreter& interpreter, Arguments arguments) {
+    Value instance(std::make_shared<FocusInstance>(shared_from_this()));
     if (initializer != nullptr) {
-        auto bound = std::make_shared<BoundMethod>(Value(instance), initializer);
-        bound->call(interpreter, arguments);
+        initializer->callMethod(interpreter, instance, arguments);
     }
-    return Value(instance);
+    return instance;
 }
 
 std::string FocusClass::toString() {
     return "<class " + name + ">";
 }
 
-std::shared_ptr<Function> FocusClass::findMethod(const std::string& name) {
+std::shared_ptr<Callable> FocusClass::findMethod(const std::string& name) {
     auto it = methods.find(name);
-    if (it != methods.end()) {
-        return it->second;
-    }
-    
-    if (superclass != nullptr) {
-        return superclass->findMethod(name);
+    return it != methods.end() ? it->second : nullptr;
+}
+
+void FocusClass::trace(Tracer& tracer) const {
+    tracer.callable(superclass);
+    for (const auto& method : methods) {
+        tracer.callable(method.second);
     }
-    
-    return nullptr;
+    tracer.callable(initializer);
+}
+
+Callable* FocusClass::lookupMethod(const std::string& name) const {
+    auto it = methods.find(name);
+    return it != methods.end() ? it->second.get() : nullptr;
 }
 
 // FocusInstance implementation
-FocusInstance::FocusInstance(std::shared_ptr<FocusClass> klass) : klass(std::move(klass)) {}
+FocusInstance::FocusInstance(std::shared_ptr<FocusClass> klass)
+    : klass(std::move(klass)), shape(this->klass->getRootShape()), task(currentParallelTask()) {}
 
-Value FocusInstance::get(const Token& name) {
-    auto it = fields.find(name.lexeme);
-    if (it != fields.end()) {
-        return it->second;
+FocusInstance::Property FocusInstance::lookup(const std::string& name, PropertyCache* cache) {
+    PropertyCache::Hit hit;
+    if (cache == nullptr || !cache->lookup(shape->id, hit)) {
+        hit.slot = shape->find(name);
+        hit.target = hit.slot < 0 ? klass->lookupMethod(name) : nullptr;
+        if (cache != nullptr) cache->store(shape->id, hit);
+    }
+
+    if (hit.slot >= 0) return {&fields[hit.slot], nullptr};
+    return {nullptr, static_cast<Callable*>(hit.target)};
+}
+
+Value FocusInstance::get(const Token& name, PropertyCache* cache) {
+    Property property = lookup(name.text(), cache);
+    if (property.field != nullptr) {
+        return *property.field;
     }
     
-    auto method = klass->findMethod(name.lexeme);
-    if (method != nullptr) {
-        return Value(std::make_shared<BoundMethod>(Value(shared_from_this()), method));
+    if (property.method != nullptr) {
+        return Value(std::make_shared<BoundMethod>(Value(shared_from_this()), klass->findMethod(name.text())));
     }
     
-    throw RuntimeError(name, "Undefined property '" + name.lexeme + "'");
+    throw RuntimeError(name, "Undefined property '" + name.text() + "'");
 }
 
-void FocusInstance::set(const Token& name, const Value& value) {
-    fields[name.lexeme] = value;
+void FocusInstance::set(const Token& name, const Value& value, PropertyCache* cache) {
+    PropertyCache::Hit hit;
+    if (cache == nullptr || !cache->lookup(shape->id, hit)) {
+        hit.slot = shape->find(name.text());
+        hit.target = nullptr;
+        if (hit.slot < 0) {
+            hit.slot = static_cast<int>(fields.size());
+            hit.target = shape->withField(name.text());
+        }
+        if (cache != nullptr) cache->store(shape->id, hit);
+    }
+
+    if (!isTracked() && mayCloseCycle(value)) track();
+    if (hit.target != nullptr) {
+        // New field: the transition appends it at the end
+        shape = static_cast<Shape*>(hit.target);
+        fields.push_back(value);
+    } else {
+        fields[hit.slot] = value;
+    }
 }
 
 std::string FocusInstance::toString() {
     return "<" + klass->getName() + " instance>";
 }
 
+void FocusInstance::trace(Tracer& tracer) const {
+    tracer.callable(klass);
+    for (const Value& field : fields) {
+        tracer.value(field);
+    }
+}
+
+void FocusInstance::clearReferences() {
+    std::fill(fields.begin(), fields.end(), Value());
+}
+
 // BoundMethod implementation
-BoundMethod::BoundMethod(Value instance, std::shared_ptr<Function> method)
+BoundMethod::BoundMethod(Value instance, std::shared_ptr<Callable> method)
     : instance(std::move(instance)), method(std::move(method)) {}
 
 int BoundMethod::arity() {
     return method->arity();
 }
 
-Value BoundMethod::call(Interpreter& interpreter, std::vector<Value> arguments) {
-    auto environment = std::make_shared<Environment>(method->getClosure());
-    environment->define("this", instance);
-    
-    for (size_t i = 0; i < method->declaration->params.size(); i++) {
-        environment->define(method->declaration->params[i].lexeme, arguments[i]);
-    }
-    
-    try {
-        interpreter.executeBlock(method->declaration->body, environment);
-    } catch (const ReturnValue& returnValue) {
-        return returnValue.value;
-    }
-    
-    return {};
+Value BoundMethod::call(Interpreter& interpreter, Arguments arguments) {
+    return method->callMethod(interpreter, instance, arguments);
 }
 
 std::string BoundMethod::toString() {
     return "<bound method>";
 }
 
+void BoundMethod::trace(Tracer& tracer) const {
+    tracer.value(instance);
+    tracer.callable(method);
+}
+
 // Lambda implementation
-Lambda::Lambda(std::vector<Token> params, std::vector<StmtPtr> body, std::shared_ptr<Environment> closure)
-    : params(std::move(params)), body(std::move(body)), closure(std::move(closure)) {}
+Lambda::Lambda(LambdaExpr* declaration, std::shared_ptr<Environment> closure)
+    : declaration(declaration), closure(std::move(closure)),
+      globals(this->closure != nullptr ? this->closure->root() : nullptr) {
+    if (this->closure != nullptr) this->closure->track();
+}
 
 int Lambda::arity() {
-    return params.size();
+    return declaration->params.size();
 }
 
-Value Lambda::call(Interpreter& interpreter, std::vector<Value> arguments) {
-    auto environment = std::make_shared<Environment>(closure);
+Value Lambda::call(Interpreter& interpreter, Arguments arguments) {
+    Metrics::count(Metrics::Calls);
+    ProfileScope profile(declaration, "script", [this] {
+        int line = declaration->body.empty() ? 0 : declaration->body.front()->line;
+        return "lambda:" + std::to_string(line);
+    });
+    auto environment = Environment::create(closure, declaration->slotCount);
     
-    for (size_t i = 0; i < params.size(); i++) {
-        environment->define(params[i].lexeme, arguments[i]);
-    }
-    
-    try {
-        interpreter.executeBlock(body, environment);
-    } catch (const ReturnValue& returnValue) {
-        return returnValue.value;
+    for (size_t i = 0; i < declaration->params.size(); i++) {
+        environment->defineAt(static_cast<int>(i), arguments[i]);
     }
     
-    return {};
+    Interpreter::GlobalsScope scope(interpreter, globals);
+    return interpreter.executeBody(declaration->body, std::move(environment));
 }
 
 std::string Lambda::toString() {
     return "<lambda>";
-}
\ No newline at end of file
+}
+
+void Lambda::trace(Tracer& tracer) const {
+    tracer.traced(closure);
+}
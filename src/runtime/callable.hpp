@@ -2,107 +2,155 @@
 #include <functional>
 #include <unordered_map>
 
+#include "gc.hpp"
 #include "value.hpp"
+#include "shape.hpp"
+#include "arguments.hpp"
 #include <vector>
 
 class Interpreter;
 struct Token;
 class Stmt;
-using StmtPtr = std::unique_ptr<Stmt>;
 
 class Callable {
 public:
     virtual ~Callable() = default;
     virtual int arity() = 0;
-    virtual Value call(Interpreter& interpreter, std::vector<Value> arguments) = 0;
+    virtual Value call(Interpreter& interpreter, Arguments arguments) = 0;
     virtual std::string toString() = 0;
+
+    // Runs the callable with `this` bound to instance. Only callables that
+    // can be stored as FocusClass methods support it.
+    virtual Value callMethod(Interpreter& interpreter, const Value& instance, Arguments arguments);
+
+    // Whether call() may run on a parallel worker's Interpreter
+    virtual bool isThreadSafe() { return false; }
+
+    // Reports the references the callable holds to the cycle collector.
+    // Callables that report none are opaque: what they hold stays alive.
+    virtual void trace(Tracer& tracer) const {}
 };
 
 class Function : public Callable {
 public:
     class FunctionStmt* declaration;
     std::shared_ptr<class Environment> closure;
+    class Environment* globals; // of the module it was declared in
 
     Function(class FunctionStmt* declaration, std::shared_ptr<class Environment> closure);
 
     int arity() override;
-    Value call(Interpreter& interpreter, std::vector<Value> arguments) override;
+    Value call(Interpreter& interpreter, Arguments arguments) override;
+    Value callMethod(Interpreter& interpreter, const Value& instance, Arguments arguments) override;
     std::string toString() override;
+    bool isThreadSafe() override { return true; }
+    void trace(Tracer& tracer) const override;
+    // "name:line", as shown by --profile
+    std::string profileName() const;
 
     std::shared_ptr<class Environment> getClosure() const { return closure; }
 };
 
 class NativeFunction : public Callable {
 private:
-    std::function<Value(Interpreter&, std::vector<Value>)> function;
+    std::function<Value(Interpreter&, Arguments)> function;
     int arity_;
     std::string name;
 
 public:
-    NativeFunction(std::function<Value(Interpreter&, std::vector<Value>)> function, 
+    NativeFunction(std::function<Value(Interpreter&, Arguments)> function, 
                    int arity, std::string name);
     
     int arity() override;
-    Value call(Interpreter& interpreter, std::vector<Value> arguments) override;
+    Value call(Interpreter& interpreter, Arguments arguments) override;
     std::string toString() override;
+    bool isThreadSafe() override { return true; }
 };
 
 class FocusClass : public Callable, public std::enable_shared_from_this<FocusClass> {
 private:
     std::string name;
     std::shared_ptr<FocusClass> superclass;
-    std::unordered_map<std::string, std::shared_ptr<Function>> methods;
+    // Own methods merged over the inherited ones, so a lookup never walks
+    // the superclass chain
+    std::unordered_map<std::string, std::shared_ptr<Callable>> methods;
+    std::shared_ptr<Callable> initializer;
+    Shape rootShape;
 
 public:
     FocusClass(std::string name, std::shared_ptr<FocusClass> superclass,
-               std::unordered_map<std::string, std::shared_ptr<Function>> methods);
+               std::unordered_map<std::string, std::shared_ptr<Callable>> methods);
     
     int arity() override;
-    Value call(Interpreter& interpreter, std::vector<Value> arguments) override;
+    Value call(Interpreter& interpreter, Arguments arguments) override;
     std::string toString() override;
     
-    std::shared_ptr<Function> findMethod(const std::string& name);
+    std::shared_ptr<Callable> findMethod(const std::string& name);
+    // Unowned lookup; the method lives as long as the class
+    Callable* lookupMethod(const std::string& name) const;
     std::string getName() const { return name; }
+    Shape* getRootShape() { return &rootShape; }
+    void trace(Tracer& tracer) const override;
 };
 
-class FocusInstance : public std::enable_shared_from_this<FocusInstance> {
+class FocusInstance final : public Traced, public std::enable_shared_from_this<FocusInstance> {
 private:
     std::shared_ptr<FocusClass> klass;
-    std::unordered_map<std::string, Value> fields;
+    Shape* shape;
+    std::vector<Value> fields; // indexed by shape slot
+    uint64_t task;             // parallel task that created the instance
 
 public:
+    // Result of a property lookup: a field, an unbound method, or neither
+    struct Property {
+        const Value* field = nullptr;
+        Callable* method = nullptr;
+    };
+
     explicit FocusInstance(std::shared_ptr<FocusClass> klass);
     
-    Value get(const Token& name);
-    void set(const Token& name, const Value& value);
+    // The cache is optional; call sites that have one pass it to skip the
+    // hash lookups on a hit.
+    Property lookup(const std::string& name, PropertyCache* cache = nullptr);
+    Value get(const Token& name, PropertyCache* cache = nullptr);
+    void set(const Token& name, const Value& value, PropertyCache* cache = nullptr);
     std::string toString();
+    uint64_t ownerTask() const { return task; }
+
+    void trace(Tracer& tracer) const override;
+    void clearReferences() override;
+    std::weak_ptr<const void> self() const override { return weak_from_this(); }
 };
 
 class BoundMethod : public Callable {
 private:
     Value instance;
-    std::shared_ptr<Function> method;
+    std::shared_ptr<Callable> method;
 
 public:
-    BoundMethod(Value instance, std::shared_ptr<Function> method);
+    BoundMethod(Value instance, std::shared_ptr<Callable> method);
     
     int arity() override;
-    Value call(Interpreter& interpreter, std::vector<Value> arguments) override;
+    Value call(Interpreter& interpreter, Arguments arguments) override;
     std::string toString() override;
+    bool isThreadSafe() override { return method->isThreadSafe(); }
+    void trace(Tracer& tracer) const override;
 };
 
 class Lambda : public Callable {
 private:
-    std::vector<Token> params;
-    std::vector<StmtPtr> body;
+    class LambdaExpr* declaration;
     std::shared_ptr<class Environment> closure;
+    class Environment* globals;
 
 public:
-    Lambda(std::vector<Token> params, std::vector<StmtPtr> body, std::shared_ptr<class Environment> closure);
+    Lambda(class LambdaExpr* declaration, std::shared_ptr<class Environment> closure);
     
     int arity() override;
-    Value call(Interpreter& interpreter, std::vector<Value> arguments) override;
+    Value call(Interpreter& interpreter, Arguments arguments) override;
     std::string toString() override;
+    bool isThreadSafe() override { return true; }
+    void trace(Tracer& tracer) const override;
     
     std::shared_ptr<Environment> getClosure() const { return closure; }
 };
\ No newline at end of file
@@ -1,18 +1,140 @@
 #include "environment.hpp"
+#include "metrics.hpp"
 
+#include <algorithm>
+#include <new>
+#include <type_traits>
 #include <utility>
 #include "../error/exceptions.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+constexpr size_t kMaxPooled = 1024;
+
+// Per-thread free list of raw blocks. A block released on another thread
+// joins that thread's list; once the list itself is gone (thread exit)
+// blocks go straight back to the heap.
+template <typename T>
+struct FreeList {
+    std::vector<T*> items;
+    static thread_local bool destroyed;
+
+    ~FreeList() {
+        destroyed = true;
+        for (T* item : items) dispose(item);
+    }
+
+    static void dispose(T* item) {
+        if constexpr (std::is_same_v<T, Environment>) {
+            delete item;
+        } else {
+            ::operator delete(item);
+        }
+    }
+
+    // Null once the calling thread's list has been torn down
+    static FreeList* local() {
+        if (destroyed) return nullptr;
+        static thread_local FreeList list;
+        return &list;
+    }
+};
+
+template <typename T>
+thread_local bool FreeList<T>::destroyed = false;
+
+// Recycles the shared_ptr control blocks of pooled frames
+template <typename T>
+struct ControlBlockAllocator {
+    using value_type = T;
+
+    ControlBlockAllocator() = default;
+    template <typename U>
+    ControlBlockAllocator(const ControlBlockAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        auto* list = FreeList<T>::local();
+        if (n == 1 && list != nullptr && !list->items.empty()) {
+            T* block = list->items.back();
+            list->items.pop_back();
+            return block;
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t n) {
+        auto* list = FreeList<T>::local();
+        if (n == 1 && list != nullptr && list->items.size() < kMaxPooled) {
+            list->items.push_back(block);
+            return;
+        }
+        ::operator delete(block);
+    }
+
+    template <typename U>
+    bool operator==(const ControlBlockAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const ControlBlockAllocator<U>&) const { return false; }
+};
+
+} // namespace
 
 Environment::Environment() : enclosing(nullptr) {}
 
-Environment::Environment(std::shared_ptr<Environment> enclosing) : enclosing(std::move(enclosing)) {}
+Environment::Environment(std::shared_ptr<Environment> enclosing, size_t slotCount)
+    : enclosing(std::move(enclosing)), slots(slotCount) {}
+
+std::shared_ptr<Environment> Environment::create(std::shared_ptr<Environment> enclosing, size_t slotCount) {
+    Metrics::count(Metrics::Environments);
+    Environment* environment = nullptr;
+    auto* pool = FreeList<Environment>::local();
+    if (pool != nullptr && !pool->items.empty()) {
+        environment = pool->items.back();
+        pool->items.pop_back();
+    }
+
+    if (environment == nullptr) {
+        environment = new Environment(std::move(enclosing), slotCount);
+    } else {
+        environment->enclosing = std::move(enclosing);
+        environment->slots.resize(slotCount);
+    }
+    environment->task = currentParallelTask();
+    return std::shared_ptr<Environment>(environment, Recycler{}, ControlBlockAllocator<Environment>{});
+}
+
+void Environment::Recycler::operator()(Environment* environment) const {
+    // Drop everything the frame references now rather than on reuse, so
+    // captured values are released at the same point as before pooling
+    environment->untrack();
+    environment->enclosing.reset();
+    environment->values.clear();
+    environment->slots.clear();
+
+    auto* pool = FreeList<Environment>::local();
+    if (pool != nullptr && pool->items.size() < kMaxPooled) {
+        pool->items.push_back(environment);
+    } else {
+        delete environment;
+    }
+}
 
 void Environment::define(const std::string& name, const Value& value) {
+    define(SymbolTable::intern(name), value);
+}
+
+void Environment::define(Symbol name, const Value& value) {
     values[name] = value;
 }
 
+const Value* Environment::find(Symbol name) const {
+    auto it = values.find(name);
+    return it != values.end() ? &it->second : nullptr;
+}
+
 Value Environment::get(const Token& name) {
-    auto it = values.find(name.lexeme);
+    auto it = values.find(name.symbol);
     if (it != values.end()) {
         return it->second;
     }
@@ -21,11 +143,11 @@ Value Environment::get(const Token& name) {
         return enclosing->get(name);
     }
 
-    throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'");
+    throw RuntimeError(name, "Undefined variable '" + name.text() + "'");
 }
 
 void Environment::assign(const Token& name, const Value& value) {
-    auto it = values.find(name.lexeme);
+    auto it = values.find(name.symbol);
     if (it != values.end()) {
         it->second = value;
         return;
@@ -36,21 +158,44 @@ void Environment::assign(const Token& name, const Value& value) {
         return;
     }
 
-    throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'");
+    throw RuntimeError(name, "Undefined variable '" + name.text() + "'");
 }
 
-Value Environment::getAt(int distance, const std::string& name) {
-    return ancestor(distance)->values[name];
+const Value& Environment::getAt(int distance, int slot) {
+    return ancestor(distance)->slots[slot];
 }
 
-void Environment::assignAt(int distance, const Token& name, const Value& value) {
-    ancestor(distance)->values[name.lexeme] = value;
+void Environment::assignAt(int distance, int slot, const Value& value) {
+    ancestor(distance)->slots[slot] = value;
 }
 
-std::shared_ptr<Environment> Environment::ancestor(int distance) {
-    std::shared_ptr<Environment> environment = shared_from_this();
+Environment* Environment::ancestor(int distance) {
+    Environment* environment = this;
     for (int i = 0; i < distance; i++) {
-        environment = environment->enclosing;
+        environment = environment->enclosing.get();
     }
     return environment;
-}
\ No newline at end of file
+}
+
+Environment* Environment::root() {
+    Environment* environment = this;
+    while (environment->enclosing != nullptr) {
+        environment = environment->enclosing.get();
+    }
+    return environment;
+}
+
+void Environment::trace(Tracer& tracer) const {
+    tracer.traced(enclosing);
+    for (const auto& entry : values) {
+        tracer.value(entry.second);
+    }
+    for (const Value& value : slots) {
+        tracer.value(value);
+    }
+}
+
+void Environment::clearReferences() {
+    values.clear();
+    std::fill(slots.begin(), slots.end(), Value());
+}
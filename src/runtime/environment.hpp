@@ -1,23 +1,50 @@
 #pragma once
+#include "gc.hpp"
 #include "value.hpp"
 #include "../lexer/token.hpp"
 #include <unordered_map>
 #include <memory>
+#include <vector>
 
-class Environment : public std::enable_shared_from_this<Environment> {
+// Frames register with the collector once a closure captures them, see
+// Function and Lambda
+class Environment final : public Traced, public std::enable_shared_from_this<Environment> {
 private:
     std::shared_ptr<Environment> enclosing;
-    std::unordered_map<std::string, Value> values;
+    std::unordered_map<Symbol, Value> values; // globals, by interned name
+    std::vector<Value> slots; // resolved locals, indexed by VarSlot::index
+    uint64_t task = 0;        // parallel task that created the frame
+
+    struct Recycler {
+        void operator()(Environment* environment) const;
+    };
 
 public:
     Environment();
-    explicit Environment(std::shared_ptr<Environment> enclosing);
+    explicit Environment(std::shared_ptr<Environment> enclosing, size_t slotCount = 0);
+
+    // Hands out a frame from the calling thread's pool. Frames go back to
+    // the pool once the last reference is dropped, so a block, loop or call
+    // whose frame was never captured by a closure costs no allocation.
+    static std::shared_ptr<Environment> create(std::shared_ptr<Environment> enclosing, size_t slotCount);
 
     void define(const std::string& name, const Value& value);
+    void define(Symbol name, const Value& value);
     Value get(const Token& name);
+    // Defined by name in this frame itself, or null
+    const Value* find(Symbol name) const;
     void assign(const Token& name, const Value& value);
-    Value getAt(int distance, const std::string& name);
-    void assignAt(int distance, const Token& name, const Value& value);
 
-    std::shared_ptr<Environment> ancestor(int distance);
-};
\ No newline at end of file
+    void defineAt(int slot, const Value& value) { slots[slot] = value; }
+    const Value& getAt(int distance, int slot);
+    void assignAt(int distance, int slot, const Value& value);
+
+    Environment* ancestor(int distance);
+    // The globals at the end of the chain
+    Environment* root();
+    uint64_t ownerTask() const { return task; }
+
+    void trace(Tracer& tracer) const override;
+    void clearReferences() override;
+    std::weak_ptr<const void> self() const override { return weak_from_this(); }
+};
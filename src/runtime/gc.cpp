@@ -0,0 +1,325 @@
+#include "gc.hpp"
+#include "callable.hpp"
+#include "hash_map.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> configuredThreshold{Heap::kDefaultThreshold};
+std::atomic<bool> configuredEnabled{true};
+
+// Node number of every object in a collection. Addresses are unique
+// and never removed, so plain linear probing does.
+class NodeIndex {
+public:
+    explicit NodeIndex(size_t expected) {
+        size_t capacity = 64;
+        while (capacity < expected * 2) capacity *= 2;
+        slots.assign(capacity, {nullptr, 0});
+    }
+
+    // The node of object, or fresh if there was none yet
+    std::pair<size_t, bool> insert(const void* object, size_t fresh) {
+        if ((used + 1) * 2 > slots.size()) grow();
+        size_t slot = find(object);
+        if (slots[slot].first != nullptr) return {slots[slot].second, false};
+        slots[slot] = {object, fresh};
+        used++;
+        return {fresh, true};
+    }
+
+private:
+    std::vector<std::pair<const void*, size_t>> slots;
+    size_t used = 0;
+
+    size_t find(const void* object) const {
+        size_t mask = slots.size() - 1;
+        size_t slot = (reinterpret_cast<uintptr_t>(object) >> 4) * 0x9e3779b97f4a7c15ULL >> 20 & mask;
+        while (slots[slot].first != nullptr && slots[slot].first != object) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void grow() {
+        std::vector<std::pair<const void*, size_t>> old = std::move(slots);
+        slots.assign(old.size() * 2, {nullptr, 0});
+        for (const auto& entry : old) {
+            if (entry.first != nullptr) slots[find(entry.first)] = entry;
+        }
+    }
+};
+
+} // namespace
+
+// One collection: the graph reachable from the registered objects, with
+// a node per object and the trial reference count of each
+class CycleCollection {
+public:
+    // Most graphs hold about a box per registered object on top of it
+    explicit CycleCollection(const std::vector<Traced*>& seeds) : index(seeds.size() * 2) {
+        nodes.reserve(seeds.size() * 2);
+        for (Traced* seed : seeds) {
+            long references = seed->self().use_count();
+            // Not owned by a shared_ptr: nothing to tell from its count
+            if (references == 0) continue;
+            add(Tracer::Edge::Traced, seed, references);
+        }
+    }
+
+    // Returns the garbage objects that hold the references to clear, and
+    // counts every garbage object in freed
+    std::vector<Traced*> run(size_t& freed) {
+        // Every node is expanded once, and subtracts one reference from
+        // each node it holds
+        for (size_t i = 0; i < nodes.size(); i++) {
+            expand(i);
+        }
+
+        // References left over come from outside the graph. Counts below
+        // zero would mean an edge reported twice; those nodes are kept too.
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i].references != 0) {
+                nodes[i].live = true;
+                pending.push_back(i);
+            }
+        }
+        while (!pending.empty()) {
+            const Node& node = nodes[pending.back()];
+            pending.pop_back();
+            for (size_t e = node.firstEdge; e < node.lastEdge; e++) {
+                Node& target = nodes[edges[e]];
+                if (!target.live) {
+                    target.live = true;
+                    pending.push_back(edges[e]);
+                }
+            }
+        }
+
+        std::vector<Traced*> garbage;
+        freed = 0;
+        for (const Node& node : nodes) {
+            if (node.live) continue;
+            // Boxes only go with the object they hold
+            if (node.kind != Tracer::Edge::Box) freed++;
+            if (node.kind == Tracer::Edge::Traced) {
+                garbage.push_back(const_cast<Traced*>(static_cast<const Traced*>(node.object)));
+            }
+        }
+        return garbage;
+    }
+
+private:
+    friend class Tracer;
+
+    struct Node {
+        Tracer::Edge kind;
+        const void* object;
+        long references;
+        bool live = false;
+        size_t firstEdge = 0; // this node's range in edges
+        size_t lastEdge = 0;
+    };
+
+    std::vector<Node> nodes;
+    NodeIndex index;
+    std::vector<size_t> edges; // targets, grouped by holding node
+
+    size_t add(Tracer::Edge kind, const void* object, long references) {
+        auto [node, inserted] = index.insert(object, nodes.size());
+        if (inserted) nodes.push_back({kind, object, references});
+        return node;
+    }
+
+    void edge(Tracer::Edge kind, const void* object, long references) {
+        size_t target = add(kind, object, references);
+        nodes[target].references--;
+        edges.push_back(target);
+    }
+
+    void expand(size_t i) {
+        Tracer tracer(*this);
+        nodes[i].firstEdge = edges.size();
+        const void* object = nodes[i].object;
+        switch (nodes[i].kind) {
+            case Tracer::Edge::Box: {
+                const auto* box = static_cast<const HeapObject*>(object);
+                switch (box->kind) {
+                    case HeapObject::Kind::Callable:
+                        tracer.callable(static_cast<const CallableObject*>(box)->pointer);
+                        break;
+                    case HeapObject::Kind::Class:
+                        tracer.callable(static_cast<const ClassObject*>(box)->pointer);
+                        break;
+                    case HeapObject::Kind::Instance:
+                        tracer.traced(static_cast<const InstanceObject*>(box)->pointer);
+                        break;
+                    case HeapObject::Kind::Map:
+                        tracer.traced(static_cast<const MapObject*>(box)->pointer);
+                        break;
+                    case HeapObject::Kind::List: {
+                        const auto& list = static_cast<const ListObject*>(box)->pointer;
+                        if (list) edge(Tracer::Edge::List, list.get(), list.use_count());
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                break;
+            }
+            case Tracer::Edge::Traced:
+                static_cast<const Traced*>(object)->trace(tracer);
+                break;
+            case Tracer::Edge::Callable:
+                static_cast<const Callable*>(object)->trace(tracer);
+                break;
+            case Tracer::Edge::List:
+                for (const Value& item : *static_cast<const std::vector<Value>*>(object)) {
+                    tracer.value(item);
+                }
+                break;
+        }
+        nodes[i].lastEdge = edges.size();
+    }
+};
+
+void Tracer::value(const Value& value) {
+    if (!value.isObject()) return;
+    HeapObject* box = value.asObject();
+    switch (box->kind) {
+        // Strings and numeric arrays hold no values, iterables are opaque:
+        // whatever they hold is kept alive by them, and so are the
+        // members of modules, which are never freed, and the results of
+        // futures
+        case HeapObject::Kind::String:
+        case HeapObject::Kind::Rope:
+        case HeapObject::Kind::Slice:
+        case HeapObject::Kind::Array:
+        case HeapObject::Kind::Iterable:
+        case HeapObject::Kind::Module:
+        case HeapObject::Kind::Future:
+            return;
+        default:
+            edge(Edge::Box, box, box->references());
+    }
+}
+
+void Tracer::edge(Edge kind, const void* object, long references) {
+    collection->edge(kind, object, references);
+}
+
+void Traced::track() {
+    if (heap != nullptr || currentParallelTask() != 0) return;
+    Heap::local().link(this);
+}
+
+void Traced::untrack() {
+    if (heap != nullptr) heap->unlink(this);
+}
+
+Heap::Heap()
+    : threshold(configuredThreshold.load()), nextCollection(threshold), enabled(configuredEnabled.load()) {}
+
+Heap& Heap::local() {
+    // Never destroyed: objects may outlive the thread that registered
+    // them and still unlink themselves when they go
+    static thread_local Heap* heap = new Heap();
+    return *heap;
+}
+
+void Heap::configure(size_t threshold, bool enabled) {
+    configuredThreshold = std::max<size_t>(threshold, 1);
+    configuredEnabled = enabled;
+}
+
+void Heap::collectAtSafePoint() {
+    if (currentParallelTask() != 0) return;
+    local().collect();
+}
+
+void Heap::link(Traced* object) {
+    std::lock_guard<std::mutex> lock(mutex);
+    object->heap = this;
+    object->previous = nullptr;
+    object->next = head;
+    if (head != nullptr) head->previous = object;
+    head = object;
+    count++;
+    if (++registrations >= nextCollection && enabled) collectionPending = true;
+}
+
+void Heap::unlink(Traced* object) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (object->previous != nullptr) {
+        object->previous->next = object->next;
+    } else {
+        head = object->next;
+    }
+    if (object->next != nullptr) object->next->previous = object->previous;
+    object->heap = nullptr;
+    object->previous = nullptr;
+    object->next = nullptr;
+    count--;
+}
+
+size_t Heap::collect() {
+    // Clearing runs destructors, which never reach a safe point, but an
+    // explicit gc() from a native callback could
+    if (collecting) return 0;
+    collecting = true;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Traced*> seeds;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        seeds.reserve(count);
+        for (Traced* object = head; object != nullptr; object = object->next) {
+            seeds.push_back(object);
+        }
+    }
+
+    size_t freed = 0;
+    {
+        CycleCollection collection(seeds);
+        std::vector<Traced*> garbage = collection.run(freed);
+
+        // Clearing one object may free another before its turn, so all of
+        // them are kept until every cycle is broken
+        std::vector<std::shared_ptr<const void>> keep;
+        keep.reserve(garbage.size());
+        for (Traced* object : garbage) {
+            keep.push_back(object->self().lock());
+        }
+        for (Traced* object : garbage) {
+            object->clearReferences();
+        }
+    }
+
+    double pause = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    totals.collections++;
+    totals.freed += freed;
+    totals.lastPauseMs = pause;
+    totals.maxPauseMs = std::max(totals.maxPauseMs, pause);
+    totals.totalPauseMs += pause;
+    // Survivors are walked again by every collection, so the next one
+    // waits until as many objects again were registered
+    registrations = 0;
+    nextCollection = std::max(threshold, count);
+    collectionPending = false;
+    collecting = false;
+    return freed;
+}
+
+GcStats Heap::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    GcStats result = totals;
+    result.tracked = count;
+    result.threshold = nextCollection;
+    return result;
+}
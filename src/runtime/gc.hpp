@@ -0,0 +1,139 @@
+#pragma once
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Cycle collector. Values are still reference counted, which frees
+// everything promptly except cycles: a closure stored in a variable of
+// the frame it captured, instances pointing at each other, a map holding
+// itself. The collector finds those by trial deletion, as CPython does.
+//
+// Objects that can close a cycle register with the heap of the thread
+// that made them (see Traced). A collection walks everything reachable
+// from them and subtracts the references found along the way from each
+// object's reference count. An object with references left over is held
+// from outside the walked graph (a C++ local, the interpreter, a VM
+// stack slot, a native function) and is live, and so is everything it
+// reaches. The rest is garbage only held by itself: its mutable slots
+// are cleared, which breaks the cycles, and reference counting frees it.
+//
+// Objects made by parallel tasks are never registered; heaps are not
+// shared between threads, and a collection only runs outside of tasks.
+
+class Callable;
+class CycleCollection;
+class Heap;
+class Traced;
+
+// Handed to Traced::trace and Callable::trace, which report every
+// reference the object holds exactly once
+class Tracer {
+public:
+    void value(const Value& value);
+    template <typename T>
+    void traced(const std::shared_ptr<T>& object) {
+        if (object) edge(Edge::Traced, static_cast<const Traced*>(object.get()), object.use_count());
+    }
+    template <typename T>
+    void callable(const std::shared_ptr<T>& callable) {
+        if (callable) edge(Edge::Callable, static_cast<const Callable*>(callable.get()), callable.use_count());
+    }
+
+private:
+    enum class Edge : uint8_t { Box, Traced, Callable, List };
+
+    friend class CycleCollection;
+    CycleCollection* collection;
+
+    explicit Tracer(CycleCollection& collection) : collection(&collection) {}
+    void edge(Edge kind, const void* object, long references);
+};
+
+// Object the collector starts its walks from. Subclasses are owned by
+// shared_ptrs and call track() once they may be part of a cycle.
+class Traced {
+public:
+    Traced() = default;
+    Traced(const Traced&) = delete;
+    Traced& operator=(const Traced&) = delete;
+
+    // Registers with the calling thread's heap; no-op inside a parallel
+    // task or when already registered
+    void track();
+    void untrack();
+    bool isTracked() const { return heap != nullptr; }
+
+    virtual void trace(Tracer& tracer) const = 0;
+    // Drops the references a cycle can run through
+    virtual void clearReferences() = 0;
+    // Expired if the object is not owned by a shared_ptr (yet)
+    virtual std::weak_ptr<const void> self() const = 0;
+
+protected:
+    ~Traced() { untrack(); }
+
+private:
+    friend class Heap;
+    Heap* heap = nullptr;
+    Traced* previous = nullptr;
+    Traced* next = nullptr;
+};
+
+// Whether storing value in an object can make the object part of a cycle
+inline bool mayCloseCycle(const Value& value) {
+    return value.isCallable() || value.isList() || value.isInstance() || value.isMap() || value.isClass();
+}
+
+struct GcStats {
+    uint64_t collections = 0;
+    uint64_t freed = 0;    // objects collected, over all collections
+    size_t tracked = 0;    // objects registered now
+    size_t threshold = 0;  // registrations that trigger the next collection
+    double lastPauseMs = 0;
+    double maxPauseMs = 0;
+    double totalPauseMs = 0;
+};
+
+// The objects registered by one thread
+class Heap {
+public:
+    static constexpr size_t kDefaultThreshold = 10000;
+
+    // The calling thread's heap
+    static Heap& local();
+
+    // Settings of heaps created from now on (--gc-threshold, --no-gc)
+    static void configure(size_t threshold, bool enabled);
+
+    // Called where the interpreters hold no unowned references into the
+    // heap: collects if enough objects were registered since the last time
+    static void safePoint() {
+        if (collectionPending) collectAtSafePoint();
+    }
+
+    // Returns the number of objects freed
+    size_t collect();
+    GcStats stats();
+
+private:
+    static inline thread_local bool collectionPending = false;
+
+    std::mutex mutex;
+    Traced* head = nullptr;
+    size_t count = 0;
+    size_t registrations = 0; // since the last collection
+    size_t threshold;         // configured minimum between collections
+    size_t nextCollection;
+    bool enabled;
+    bool collecting = false;
+    GcStats totals;
+
+    Heap();
+    static void collectAtSafePoint();
+
+    friend class Traced;
+    void link(Traced* object);
+    void unlink(Traced* object);
+};
@@ -0,0 +1,216 @@
+#include "hash_map.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <sstream>
+
+#if defined(__SSE2__)
+#define FOCUS_MAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Control bytes: a full slot stores the low 7 bits of its hash, so the
+// sign bit alone tells empty and deleted slots from full ones
+constexpr int8_t kEmpty = -128;
+constexpr int8_t kDeleted = -2;
+
+constexpr size_t kGroupWidth = 16;
+constexpr size_t kMinCapacity = 16;
+
+// Identity hashes are aligned pointers, so the bits are mixed before the
+// low ones become control bytes
+size_t mix(size_t hash) {
+    uint64_t h = hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
+
+size_t probeStart(size_t hash) { return hash >> 7; }
+int8_t controlByte(size_t hash) { return static_cast<int8_t>(hash & 0x7f); }
+
+// Limit on entries (and so on used slots) before the table grows: 7/8
+size_t maxLoad(size_t capacity) { return capacity - capacity / 8; }
+
+// The control bytes of kGroupWidth consecutive slots, matched together.
+// Every result is a bit mask with bit i set for slot start + i.
+class Group {
+public:
+#if FOCUS_MAP_SSE2
+    explicit Group(const int8_t* start) : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(start))) {}
+
+    uint32_t match(int8_t byte) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(byte), bytes)));
+    }
+    uint32_t matchEmptyOrDeleted() const { return static_cast<uint32_t>(_mm_movemask_epi8(bytes)); }
+
+private:
+    __m128i bytes;
+#else
+    explicit Group(const int8_t* start) : bytes(start) {}
+
+    uint32_t match(int8_t byte) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupWidth; i++) {
+            mask |= static_cast<uint32_t>(bytes[i] == byte) << i;
+        }
+        return mask;
+    }
+    uint32_t matchEmptyOrDeleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupWidth; i++) {
+            mask |= static_cast<uint32_t>(bytes[i] < 0) << i;
+        }
+        return mask;
+    }
+
+private:
+    const int8_t* bytes;
+#endif
+
+public:
+    uint32_t matchEmpty() const { return match(kEmpty); }
+};
+
+size_t lowestBit(uint32_t mask) {
+    return static_cast<size_t>(__builtin_ctz(mask));
+}
+
+} // namespace
+
+FocusMap::FocusMap() : task(currentParallelTask()) {}
+
+FocusMap::FocusMap(size_t expected) : FocusMap() {
+    if (expected > 0) rehash(expected);
+}
+
+// Groups are probed triangularly (offsets 0, 16, 48, 96, ...), which
+// visits every group of a power-of-two table before repeating one
+size_t FocusMap::findSlot(const Value& key, size_t hash) const {
+    if (live == 0) return kNotFound;
+    size_t mask = capacity() - 1;
+    size_t position = probeStart(hash) & mask;
+    for (size_t step = kGroupWidth;; step += kGroupWidth) {
+        Group group(&control[position]);
+        for (uint32_t match = group.match(controlByte(hash)); match != 0; match &= match - 1) {
+            size_t slot = (position + lowestBit(match)) & mask;
+            const Entry& entry = entryList[slots[slot]];
+            if (entry.hash == hash && entry.key == key) return slot;
+        }
+        if (group.matchEmpty() != 0) return kNotFound;
+        position = (position + step) & mask;
+    }
+}
+
+size_t FocusMap::findInsertSlot(size_t hash) const {
+    size_t mask = capacity() - 1;
+    size_t position = probeStart(hash) & mask;
+    for (size_t step = kGroupWidth;; step += kGroupWidth) {
+        uint32_t free = Group(&control[position]).matchEmptyOrDeleted();
+        if (free != 0) return (position + lowestBit(free)) & mask;
+        position = (position + step) & mask;
+    }
+}
+
+void FocusMap::setControl(size_t slot, int8_t byte) {
+    control[slot] = byte;
+    // The first bytes are repeated past the end, so a group read near the
+    // end of the table wraps around without a bounds check
+    if (slot < kGroupWidth - 1) control[capacity() + slot] = byte;
+}
+
+const Value* FocusMap::find(const Value& key) const {
+    size_t slot = findSlot(key, mix(key.hash()));
+    return slot == kNotFound ? nullptr : &entryList[slots[slot]].value;
+}
+
+void FocusMap::set(const Value& key, const Value& value) {
+    if (!isTracked() && (mayCloseCycle(key) || mayCloseCycle(value))) track();
+    size_t hash = mix(key.hash());
+    size_t slot = findSlot(key, hash);
+    if (slot != kNotFound) {
+        entryList[slots[slot]].value = value;
+        return;
+    }
+
+    // Every used slot, deleted ones included, has an entry, so bounding
+    // the entries bounds the load of the table too
+    if (entryList.size() >= maxLoad(capacity())) rehash(live + 1);
+    slot = findInsertSlot(hash);
+    setControl(slot, controlByte(hash));
+    slots[slot] = static_cast<uint32_t>(entryList.size());
+    entryList.push_back({key, value, hash});
+    live++;
+}
+
+bool FocusMap::erase(const Value& key, Value* removed) {
+    size_t slot = findSlot(key, mix(key.hash()));
+    if (slot == kNotFound) return false;
+
+    Entry& entry = entryList[slots[slot]];
+    if (removed != nullptr) *removed = std::move(entry.value);
+    entry.key = Value();
+    entry.value = Value();
+    entry.erased = true;
+    setControl(slot, kDeleted);
+    live--;
+
+    if (live == 0) {
+        // Nothing left to keep, so start over without rehashing
+        entryList.clear();
+        std::fill(control.begin(), control.end(), kEmpty);
+    }
+    return true;
+}
+
+void FocusMap::rehash(size_t expected) {
+    // Half as much room again as needed, so growing one at a time rehashes
+    // only every so often
+    size_t wanted = expected + expected / 2;
+    size_t newCapacity = kMinCapacity;
+    while (maxLoad(newCapacity) < wanted) newCapacity *= 2;
+
+    control.assign(newCapacity + kGroupWidth - 1, kEmpty);
+    slots.assign(newCapacity, 0);
+
+    // Erased entries are dropped here, which keeps the entries dense
+    std::vector<Entry> kept;
+    kept.reserve(maxLoad(newCapacity));
+    for (Entry& entry : entryList) {
+        if (entry.erased) continue;
+        size_t slot = findInsertSlot(entry.hash);
+        setControl(slot, controlByte(entry.hash));
+        slots[slot] = static_cast<uint32_t>(kept.size());
+        kept.push_back(std::move(entry));
+    }
+    entryList = std::move(kept);
+}
+
+void FocusMap::trace(Tracer& tracer) const {
+    for (const Entry& entry : entryList) {
+        tracer.value(entry.key);
+        tracer.value(entry.value);
+    }
+}
+
+void FocusMap::clearReferences() {
+    entryList.clear();
+    std::fill(control.begin(), control.end(), kEmpty);
+    live = 0;
+}
+
+std::string FocusMap::toString() const {
+    std::ostringstream oss;
+    oss << "{";
+    bool first = true;
+    for (const Entry& entry : entryList) {
+        if (entry.erased) continue;
+        if (!first) oss << ", ";
+        first = false;
+        oss << entry.key.toString() << ": " << entry.value.toString();
+    }
+    oss << "}";
+    return oss.str();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "gc.hpp"
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Map value: an open-addressing hash table in the SwissTable style. Every
+// slot has a control byte holding 7 bits of its key's hash, or marking it
+// empty or deleted, and a probe compares the control bytes of 16 slots at
+// once. Keys are therefore only compared on a likely hit, and most lookups
+// touch a single cache line of control bytes.
+//
+// Slots hold indices into a dense vector of entries, so iteration and
+// printing follow insertion order. Keys hash and compare with Value::hash
+// and ==: strings and numbers by content, everything else by identity.
+class FocusMap final : public Traced, public std::enable_shared_from_this<FocusMap> {
+public:
+    struct Entry {
+        Value key;
+        Value value;
+        size_t hash;
+        bool erased = false; // removed; dropped on the next rehash
+    };
+
+    FocusMap();
+    explicit FocusMap(size_t expected);
+
+    size_t size() const { return live; }
+    // Null if key is absent; valid until the map is next changed
+    const Value* find(const Value& key) const;
+    void set(const Value& key, const Value& value);
+    // Stores the removed value in removed if it is given
+    bool erase(const Value& key, Value* removed = nullptr);
+
+    // In insertion order, erased entries included
+    const std::vector<Entry>& entries() const { return entryList; }
+
+    std::string toString() const;
+    uint64_t ownerTask() const { return task; }
+
+    void trace(Tracer& tracer) const override;
+    void clearReferences() override;
+    std::weak_ptr<const void> self() const override { return weak_from_this(); }
+
+private:
+    static constexpr size_t kNotFound = SIZE_MAX;
+
+    std::vector<int8_t> control; // capacity bytes, then the first 15 repeated
+    std::vector<uint32_t> slots; // entry index of each full slot
+    std::vector<Entry> entryList;
+    size_t live = 0;
+    uint64_t task; // parallel task that created the map
+
+    size_t capacity() const { return slots.size(); }
+    size_t findSlot(const Value& key, size_t hash) const;
+    size_t findInsertSlot(size_t hash) const;
+    void setControl(size_t slot, int8_t byte);
+    void rehash(size_t expected);
+};
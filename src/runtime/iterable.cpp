@@ -0,0 +1,256 @@
+#include "iterable.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "callable.hpp"
+#include "hash_map.hpp"
+#include "../utils/file_utils.hpp"
+
+namespace {
+
+class RangeIterator final : public Iterator {
+private:
+    double start;
+    double step;
+    long long index = 0;
+    long long count;
+
+public:
+    RangeIterator(double start, double step, long long count) : start(start), step(step), count(count) {}
+
+    bool next(Interpreter&, Value& out) override {
+        if (index >= count) return false;
+        out = Value(start + static_cast<double>(index++) * step);
+        return true;
+    }
+};
+
+class ListIterator final : public Iterator {
+private:
+    std::shared_ptr<std::vector<Value>> list;
+    size_t index = 0;
+
+public:
+    explicit ListIterator(std::shared_ptr<std::vector<Value>> list) : list(std::move(list)) {}
+
+    bool next(Interpreter&, Value& out) override {
+        if (index >= list->size()) return false;
+        out = (*list)[index++];
+        return true;
+    }
+};
+
+class ArrayIterator final : public Iterator {
+private:
+    std::shared_ptr<std::vector<double>> array;
+    size_t index = 0;
+
+public:
+    explicit ArrayIterator(std::shared_ptr<std::vector<double>> array) : array(std::move(array)) {}
+
+    bool next(Interpreter&, Value& out) override {
+        if (index >= array->size()) return false;
+        out = Value((*array)[index++]);
+        return true;
+    }
+};
+
+// Keys of a map in insertion order. Adding or removing keys during the
+// loop is an error, since it may move the entries not yet visited.
+class MapKeyIterator final : public Iterator {
+private:
+    std::shared_ptr<FocusMap> map;
+    size_t index = 0;
+    size_t size;
+
+public:
+    explicit MapKeyIterator(std::shared_ptr<FocusMap> map) : map(std::move(map)), size(this->map->size()) {}
+
+    bool next(Interpreter&, Value& out) override {
+        if (map->size() != size) {
+            throw std::runtime_error("Map changed size during iteration");
+        }
+        const auto& entries = map->entries();
+        while (index < entries.size() && entries[index].erased) index++;
+        if (index >= entries.size()) return false;
+        out = entries[index++].key;
+        return true;
+    }
+};
+
+class StringIterator final : public Iterator {
+private:
+    Value string; // keeps the interned text alive
+    size_t index = 0;
+
+public:
+    explicit StringIterator(Value string) : string(std::move(string)) {}
+
+    bool next(Interpreter&, Value& out) override {
+        std::string_view text = string.stringView();
+        if (index >= text.size()) return false;
+        out = Value(std::string(1, text[index++]));
+        return true;
+    }
+};
+
+class MapIterator final : public Iterator {
+private:
+    std::shared_ptr<Callable> function;
+    std::shared_ptr<Iterator> source;
+    Value item;
+
+public:
+    MapIterator(std::shared_ptr<Callable> function, std::shared_ptr<Iterator> source)
+        : function(std::move(function)), source(std::move(source)) {}
+
+    bool next(Interpreter& interpreter, Value& out) override {
+        if (!source->next(interpreter, item)) return false;
+        out = function->call(interpreter, Arguments(&item, 1));
+        return true;
+    }
+};
+
+class FilterIterator final : public Iterator {
+private:
+    std::shared_ptr<Callable> predicate;
+    std::shared_ptr<Iterator> source;
+
+public:
+    FilterIterator(std::shared_ptr<Callable> predicate, std::shared_ptr<Iterator> source)
+        : predicate(std::move(predicate)), source(std::move(source)) {}
+
+    bool next(Interpreter& interpreter, Value& out) override {
+        while (source->next(interpreter, out)) {
+            if (predicate->call(interpreter, Arguments(&out, 1)).isTruthy()) return true;
+        }
+        return false;
+    }
+};
+
+// Takes the next line off text, without its "\n" or "\r\n"
+std::string_view takeLine(std::string_view& text, size_t end) {
+    std::string_view line = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return line;
+}
+
+class MappedLineIterator final : public Iterator {
+private:
+    std::shared_ptr<MappedFile> file;
+    std::string_view rest;
+
+public:
+    explicit MappedLineIterator(std::shared_ptr<MappedFile> file) : file(std::move(file)), rest(this->file->contents()) {}
+
+    bool next(Interpreter&, Value& out) override {
+        if (rest.empty()) return false;
+        std::string_view line = takeLine(rest, rest.find('\n'));
+        out = Value::slice(file, line);
+        return true;
+    }
+};
+
+// Lines share the chunk they were read into. A line that runs past the
+// end of a chunk starts the next one, which grows to hold it if need be.
+class ChunkedLineIterator final : public Iterator {
+private:
+    static constexpr size_t kChunkSize = 1 << 20;
+
+    std::ifstream stream;
+    std::shared_ptr<std::string> chunk;
+    std::string_view rest;
+    bool done = false;
+
+    void refill() {
+        auto next = std::make_shared<std::string>();
+        size_t carried = rest.size();
+        next->resize(std::max(kChunkSize, carried * 2));
+        std::memcpy(&(*next)[0], rest.data(), carried);
+        stream.read(&(*next)[carried], static_cast<std::streamsize>(next->size() - carried));
+        next->resize(carried + static_cast<size_t>(stream.gcount()));
+        done = !stream;
+        chunk = std::move(next);
+        rest = *chunk;
+    }
+
+public:
+    explicit ChunkedLineIterator(std::ifstream stream) : stream(std::move(stream)) {}
+
+    bool next(Interpreter&, Value& out) override {
+        size_t end;
+        while ((end = rest.find('\n')) == std::string_view::npos && !done) refill();
+        if (rest.empty()) return false;
+        std::string_view line = takeLine(rest, end);
+        out = Value::slice(chunk, line);
+        return true;
+    }
+};
+
+} // namespace
+
+std::shared_ptr<Iterator> Iterator::iterate() {
+    return std::static_pointer_cast<Iterator>(shared_from_this());
+}
+
+RangeIterable::RangeIterable(double start, double stop, double step) : start(start), stop(stop), step(step) {
+    if (step == 0) {
+        throw std::runtime_error("range() step must not be zero");
+    }
+}
+
+std::shared_ptr<Iterator> RangeIterable::iterate() {
+    return std::make_shared<RangeIterator>(start, step, size());
+}
+
+long long RangeIterable::size() const {
+    double count = std::ceil((stop - start) / step);
+    return count > 0 ? static_cast<long long>(count) : 0;
+}
+
+std::string RangeIterable::toString() const {
+    std::string text = "range(" + Value(start).toString() + ", " + Value(stop).toString();
+    if (step != 1) {
+        text += ", " + Value(step).toString();
+    }
+    return text + ")";
+}
+
+std::shared_ptr<Iterator> MapIterable::iterate() {
+    return std::make_shared<MapIterator>(function, source->iterate());
+}
+
+std::shared_ptr<Iterator> FilterIterable::iterate() {
+    return std::make_shared<FilterIterator>(predicate, source->iterate());
+}
+
+std::shared_ptr<Iterator> LinesIterable::iterate() {
+#ifndef _WIN32
+    std::error_code error;
+    if (std::filesystem::is_regular_file(path, error)) {
+        return std::make_shared<MappedLineIterator>(std::make_shared<MappedFile>(path));
+    }
+#endif
+    // Pipes and devices can't be mapped, and neither can anything on Windows
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        throw std::runtime_error("lines() could not open " + path);
+    }
+    return std::make_shared<ChunkedLineIterator>(std::move(stream));
+}
+
+std::shared_ptr<Iterator> makeIterator(const Value& value) {
+    if (value.isList()) return std::make_shared<ListIterator>(value.asList());
+    if (value.isArray()) return std::make_shared<ArrayIterator>(value.asArray());
+    if (value.isString()) return std::make_shared<StringIterator>(value);
+    if (value.isMap()) return std::make_shared<MapKeyIterator>(value.asMap());
+    if (value.isIterable()) return value.asIterable()->iterate();
+    return nullptr;
+}
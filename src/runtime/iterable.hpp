@@ -0,0 +1,94 @@
+#pragma once
+#include "value.hpp"
+#include <memory>
+#include <string>
+
+class Callable;
+class Interpreter;
+class Iterator;
+
+// Lazily produced sequence. Every iterate() call starts a new pass, so a
+// value like range(10) can be looped over more than once.
+class Iterable : public std::enable_shared_from_this<Iterable> {
+public:
+    virtual ~Iterable() = default;
+
+    virtual std::shared_ptr<Iterator> iterate() = 0;
+    // Element count if it is known without iterating, otherwise -1
+    virtual long long size() const { return -1; }
+    virtual std::string toString() const = 0;
+};
+
+// Cursor over a sequence. An iterator is itself iterable: iterating it
+// continues from where it stopped.
+class Iterator : public Iterable {
+public:
+    // Stores the next element in out; false once the sequence is exhausted
+    virtual bool next(Interpreter& interpreter, Value& out) = 0;
+
+    std::shared_ptr<Iterator> iterate() override;
+    std::string toString() const override { return "<iterator>"; }
+};
+
+// range(start, stop, step); elements are computed on demand
+class RangeIterable final : public Iterable {
+private:
+    double start;
+    double stop;
+    double step;
+
+public:
+    RangeIterable(double start, double stop, double step);
+
+    std::shared_ptr<Iterator> iterate() override;
+    long long size() const override;
+    std::string toString() const override;
+};
+
+// map(function, source) over a lazy source
+class MapIterable final : public Iterable {
+private:
+    std::shared_ptr<Callable> function;
+    std::shared_ptr<Iterable> source;
+
+public:
+    MapIterable(std::shared_ptr<Callable> function, std::shared_ptr<Iterable> source)
+        : function(std::move(function)), source(std::move(source)) {}
+
+    std::shared_ptr<Iterator> iterate() override;
+    long long size() const override { return source->size(); }
+    std::string toString() const override { return "<map>"; }
+};
+
+// filter(predicate, source) over a lazy source
+class FilterIterable final : public Iterable {
+private:
+    std::shared_ptr<Callable> predicate;
+    std::shared_ptr<Iterable> source;
+
+public:
+    FilterIterable(std::shared_ptr<Callable> predicate, std::shared_ptr<Iterable> source)
+        : predicate(std::move(predicate)), source(std::move(source)) {}
+
+    std::shared_ptr<Iterator> iterate() override;
+    std::string toString() const override { return "<filter>"; }
+};
+
+// lines(path): the lines of a file without their line breaks, read as
+// the loop asks for them. Each line is a slice of what was read, so no
+// line is copied; regular files are memory-mapped, anything else is read
+// in chunks.
+class LinesIterable final : public Iterable {
+private:
+    std::string path;
+
+public:
+    explicit LinesIterable(std::string path) : path(std::move(path)) {}
+
+    std::shared_ptr<Iterator> iterate() override;
+    std::string toString() const override { return "<lines " + path + ">"; }
+};
+
+// Iterator over a list, an array, a string (one character per element),
+// the keys of a map or an iterable; null for any other value
+std::shared_ptr<Iterator> makeIterator(const Value& value);
@@ -1,7 +1,14 @@
 #include "library_manager.hpp"
 #include "../error/exceptions.hpp"
+#include "profiler.hpp"
+#include "metrics.hpp"
+#include "hash_map.hpp"
+#include "async.hpp"
+#include "parallel.hpp"
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <type_traits>
 
 #ifdef PYTHON_SUPPORT
 #include <Python.h>
@@ -12,21 +19,111 @@
 #endif
 
 // Static member initialization
-std::unique_ptr<LibraryManager> LibraryManager::instance = nullptr;
 bool PythonLibraryInterface::pythonInitialized = false;
+std::mutex PythonLibraryInterface::initMutex;
 bool JavaLibraryInterface::jvmInitialized = false;
+std::mutex JavaLibraryInterface::initMutex;
 
 #ifdef JNI_SUPPORT
 JavaVM* JavaLibraryInterface::jvm = nullptr;
-JNIEnv* JavaLibraryInterface::env = nullptr;
 #endif
 
+namespace {
+
+// The registry this thread last saw. depth counts the library calls in
+// progress on the thread: while it is above zero the view is not replaced,
+// so the library being called can't be freed from under its caller.
+struct RegistryView {
+    uint64_t generation = 0;
+    std::shared_ptr<const LibraryManager::Registry> libraries;
+    int depth = 0;
+};
+
+thread_local RegistryView registryView;
+
+class CallDepth {
+public:
+    CallDepth() { registryView.depth++; }
+    ~CallDepth() { registryView.depth--; }
+};
+
+// Spawned calls run on workers of their library's bridge, so a backlog
+// of slow Python calls never holds up Java ones, and Java workers stay
+// attached to the JVM from their first call on. Python calls take the
+// GIL on the worker, so they only overlap where the Python code lets go
+// of it, as I/O and most native extensions do. Libraries that aren't
+// thread safe share a single worker of their bridge, which runs their
+// calls one at a time.
+WorkerPool& bridgeWorkers(const LibraryInterface& target) {
+    static std::mutex mutex;
+    static auto* pools = new std::unordered_map<std::string, std::unique_ptr<WorkerPool>>(); // threads never stop
+    bool threadSafe = target.isThreadSafe();
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<WorkerPool>& pool = (*pools)[target.getType() + (threadSafe ? "" : " serial")];
+    if (!pool) pool = std::make_unique<WorkerPool>(threadSafe ? std::max(2u, std::thread::hardware_concurrency()) : 1);
+    return *pool;
+}
+
+// value with every map in it copied, so a spawned call never sees the
+// script change its arguments. Lists and arrays can't be changed and are
+// only copied when they hold a map. copies keeps a map that appears more
+// than once, cycles included, shared the same way in the copy.
+Value detached(const Value& value, std::unordered_map<const FocusMap*, Value>& copies) {
+    if (value.isList()) {
+        const std::vector<Value>& source = *value.asList();
+        std::shared_ptr<std::vector<Value>> items;
+        for (size_t i = 0; i < source.size(); i++) {
+            Value item = detached(source[i], copies);
+            bool copied = item.isMap() || (item.isList() && item.asList() != source[i].asList());
+            if (!items && !copied) continue;
+            if (!items) {
+                items = std::make_shared<std::vector<Value>>(source.begin(), source.begin() + static_cast<std::ptrdiff_t>(i));
+                items->reserve(source.size());
+            }
+            items->push_back(std::move(item));
+        }
+        return items ? Value(items) : value;
+    }
+    if (!value.isMap()) return value;
+
+    const FocusMap* source = value.asMap().get();
+    auto known = copies.find(source);
+    if (known != copies.end()) return known->second;
+    auto map = std::make_shared<FocusMap>(source->size());
+    Value copy(map);
+    copies.emplace(source, copy);
+    for (const FocusMap::Entry& entry : source->entries()) {
+        if (!entry.erased) map->set(detached(entry.key, copies), detached(entry.value, copies));
+    }
+    return copy;
+}
+
+} // namespace
+
 // LibraryManager Implementation
 LibraryManager& LibraryManager::getInstance() {
-    if (!instance) {
-        instance = std::make_unique<LibraryManager>();
+    static LibraryManager manager;
+    return manager;
+}
+
+const LibraryManager::Registry& LibraryManager::libraries() const {
+    RegistryView& view = registryView;
+    if (view.depth == 0 && view.generation != generation.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        view.libraries = registry;
+        view.generation = generation.load(std::memory_order_relaxed);
     }
-    return *instance;
+    return *view.libraries;
+}
+
+uint64_t LibraryManager::viewGeneration() const {
+    libraries();
+    return registryView.generation;
+}
+
+void LibraryManager::publish(std::shared_ptr<const Registry> next) {
+    registry = std::move(next);
+    generation.fetch_add(1, std::memory_order_release);
 }
 
 bool LibraryManager::loadLibrary(const std::string& alias, const std::string& path, const std::string& type) {
@@ -46,7 +143,10 @@ bool LibraryManager::loadLibrary(const std::string& alias, const std::string& pa
             return false;
         }
         
-        libraries[alias] = library;
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto next = std::make_shared<Registry>(*registry);
+        (*next)[alias] = std::move(library);
+        publish(std::move(next));
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Failed to load library " << alias << ": " << e.what() << std::endl;
@@ -54,45 +154,140 @@ bool LibraryManager::loadLibrary(const std::string& alias, const std::string& pa
     }
 }
 
-Value LibraryManager::callFunction(const std::string& library, const std::string& function, const std::vector<Value>& args) {
-    auto it = libraries.find(library);
-    if (it == libraries.end()) {
+LibraryInterface& LibraryManager::find(const std::string& library) const {
+    const Registry& loaded = libraries();
+    auto it = loaded.find(library);
+    if (it == loaded.end()) {
         throw RuntimeError(Token(TokenType::IDENTIFIER, library, "", 0, 0), 
                           "Library '" + library + "' not loaded");
     }
+    return *it->second;
+}
+
+Value LibraryManager::callFunction(const std::string& library, const std::string& function, const std::vector<Value>& args) {
+    LibraryCallScope metrics(library);
+    LibraryInterface& target = find(library);
+    return profiledCall(library, function, target, target.binding(function), args);
+}
+
+Value LibraryManager::callFunction(NativeCallSite& site, const std::string& library, const std::string& function, Arguments args) {
+    LibraryCallScope metrics(library);
+    // Checked against this thread's view, so the library a cached binding
+    // belongs to is one the view keeps alive
+    uint64_t current = viewGeneration();
+    if (!Profiler::enabled()) {
+        if (const NativeBinding* binding = site.lookup(current)) {
+            return binding->call(args);
+        }
+    }
+
+    LibraryInterface& target = find(library);
+    const NativeBinding* binding = target.binding(function);
+    if (binding) site.store(current, binding);
+    return profiledCall(library, function, target, binding, args);
+}
+
+std::shared_ptr<Future> LibraryManager::spawnFunction(const std::string& library, const std::string& function,
+                                                      std::vector<Value> args) {
+    WorkerPool& workers = bridgeWorkers(find(library));
+    std::unordered_map<const FocusMap*, Value> copies;
+    for (Value& arg : args) {
+        arg = detached(arg, copies);
+    }
+    return EventLoop::local().offload([this, library, function, args = std::move(args)]() mutable {
+        // Everything the call holds goes back to the loop with the result,
+        // so no value is released on the worker
+        std::vector<Value> arguments = std::move(args);
+        Value result;
+        std::string error;
+        bool failed = false;
+        try {
+            ParallelTaskScope task; // what the call makes stays off the worker's heap
+            result = callFunction(library, function, arguments);
+        } catch (const std::exception& e) {
+            error = "External function call failed: " + std::string(e.what());
+            failed = true;
+        }
+        return std::function<void(Future&)>([arguments = std::move(arguments), result = std::move(result),
+                                             error = std::move(error), failed](Future& future) {
+            if (failed) future.fail(error);
+            else future.resolve(result);
+        });
+    }, workers);
+}
+
+Value LibraryManager::profiledCall(const std::string& library, const std::string& function, LibraryInterface& target,
+                                   const NativeBinding* binding, Arguments args) {
+    CallDepth depth;
+    auto call = [&] {
+        if (binding) return binding->call(args);
+        return target.callFunction(function, std::vector<Value>(args.begin(), args.end()));
+    };
+    if (!Profiler::enabled()) {
+        return call();
+    }
     
-    return it->second->callFunction(function, args);
+    // Each library type gets its own category, so time spent in Python,
+    // Java or native code shows up separately
+    const std::string& name = Profiler::intern(library + "." + function + " [" + target.getType() + "]");
+    const std::string& category = Profiler::intern(target.getType());
+    ProfileScope profile(&name, category.c_str(), [&name] { return name; });
+    return call();
+}
+
+void LibraryManager::bindFunction(const std::string& library, const std::string& function, const NativeSignature& signature) {
+    find(library).bindFunction(function, signature);
+    std::lock_guard<std::mutex> lock(writeMutex);
+    generation.fetch_add(1, std::memory_order_release); // sites re-resolve to the new binding
 }
 
 bool LibraryManager::hasLibrary(const std::string& alias) const {
-    return libraries.find(alias) != libraries.end();
+    return libraries().count(alias) != 0;
 }
 
 bool LibraryManager::hasFunction(const std::string& library, const std::string& function) const {
-    auto it = libraries.find(library);
-    if (it == libraries.end()) return false;
+    const Registry& loaded = libraries();
+    auto it = loaded.find(library);
+    if (it == loaded.end()) return false;
     return it->second->hasFunction(function);
 }
 
 void LibraryManager::unloadLibrary(const std::string& alias) {
-    libraries.erase(alias);
+    std::lock_guard<std::mutex> lock(writeMutex);
+    auto next = std::make_shared<Registry>(*registry);
+    next->erase(alias);
+    publish(std::move(next));
 }
 
 void LibraryManager::unloadAllLibraries() {
-    libraries.clear();
+    std::lock_guard<std::mutex> lock(writeMutex);
+    publish(std::make_shared<Registry>());
+    // Let go of this thread's view now so the libraries are actually
+    // unloaded here, unless a call into one of them is still running
+    RegistryView& view = registryView;
+    if (view.depth == 0) {
+        view.libraries = registry;
+        view.generation = generation.load(std::memory_order_relaxed);
+    }
+}
+
+// LibraryInterface Implementation
+void LibraryInterface::bindFunction(const std::string& functionName, const NativeSignature& signature) {
+    throw std::runtime_error("Function signatures can't be declared for " + getType() + " libraries");
 }
 
 std::vector<std::string> LibraryManager::getLoadedLibraries() const {
     std::vector<std::string> result;
-    for (const auto& pair : libraries) {
+    for (const auto& pair : libraries()) {
         result.push_back(pair.first);
     }
     return result;
 }
 
 std::string LibraryManager::getLibraryType(const std::string& alias) const {
-    auto it = libraries.find(alias);
-    if (it == libraries.end()) return "";
+    const Registry& loaded = libraries();
+    auto it = loaded.find(alias);
+    if (it == loaded.end()) return "";
     return it->second->getType();
 }
 
@@ -122,30 +317,53 @@ CppLibraryInterface::~CppLibraryInterface() {
     }
 }
 
-Value CppLibraryInterface::callFunction(const std::string& functionName, const std::vector<Value>& args) {
-    void* funcPtr = nullptr;
-    
-    // Try to get cached function pointer
-    auto it = functions.find(functionName);
-    if (it != functions.end()) {
-        funcPtr = it->second;
-    } else {
-        // Load the function
+void* CppLibraryInterface::lookupFunction(const std::string& functionName) const {
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        auto it = functions.find(functionName);
+        if (it != functions.end()) {
+            return it->second;
+        }
+    }
+
 #ifdef _WIN32
-        funcPtr = reinterpret_cast<void*>(GetProcAddress(handle, functionName.c_str()));
+    void* funcPtr = reinterpret_cast<void*>(GetProcAddress(handle, functionName.c_str()));
 #else
-        funcPtr = dlsym(handle, functionName.c_str());
+    void* funcPtr = dlsym(handle, functionName.c_str());
 #endif
-        
-        if (!funcPtr) {
-            throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
-                              "Function '" + functionName + "' not found in C++ library");
-        }
-        
-        functions[functionName] = funcPtr;
+    
+    if (!funcPtr) {
+        throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
+                          "Function '" + functionName + "' not found in C++ library");
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(cacheMutex);
+    functions[functionName] = funcPtr;
+    return funcPtr;
+}
+
+void CppLibraryInterface::bindFunction(const std::string& functionName, const NativeSignature& signature) {
+    auto made = std::make_unique<NativeBinding>(functionName, lookupFunction(functionName), signature);
+    std::unique_lock<std::shared_mutex> lock(cacheMutex);
+    auto& slot = bindings[functionName];
+    if (slot) retiredBindings.push_back(std::move(slot));
+    slot = std::move(made);
+}
+
+const NativeBinding* CppLibraryInterface::binding(const std::string& functionName) const {
+    std::shared_lock<std::shared_mutex> lock(cacheMutex);
+    auto it = bindings.find(functionName);
+    return it != bindings.end() ? it->second.get() : nullptr;
+}
+
+Value CppLibraryInterface::callFunction(const std::string& functionName, const std::vector<Value>& args) {
+    if (const NativeBinding* declared = binding(functionName)) {
+        return declared->call(args);
     }
+    void* funcPtr = lookupFunction(functionName);
     
-    // Handle different function signatures based on argument count and types
+    // Undeclared functions are called with one of a few common signatures
+    // picked from the arguments
     if (args.empty()) {
         // No arguments - double func()
         typedef double (*NoArgFunc)();
@@ -187,31 +405,16 @@ Value CppLibraryInterface::callFunction(const std::string& functionName, const s
         }
     }
     
-    // Fallback: try to call as variadic function with up to 5 arguments
-    typedef double (*VariadicFunc)(double, double, double, double, double);
-    auto func = reinterpret_cast<VariadicFunc>(funcPtr);
-    
-    std::vector<double> doubleArgs;
-    for (const auto& arg : args) {
-        if (arg.isNumber()) {
-            doubleArgs.push_back(arg.asNumber());
-        } else {
-            doubleArgs.push_back(0.0);
-        }
-    }
-    
-    // Pad with zeros if needed
-    while (doubleArgs.size() < 5) {
-        doubleArgs.push_back(0.0);
-    }
-    
-    double result = func(doubleArgs[0], doubleArgs[1], doubleArgs[2], doubleArgs[3], doubleArgs[4]);
-    return Value(result);
+    throw std::runtime_error("No default signature fits the arguments of '" + functionName +
+                             "'; declare its signature in the extern statement");
 }
 
 bool CppLibraryInterface::hasFunction(const std::string& functionName) const {
-    if (functions.find(functionName) != functions.end()) {
-        return true;
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        if (functions.find(functionName) != functions.end()) {
+            return true;
+        }
     }
 
 #ifdef _WIN32
@@ -224,16 +427,38 @@ bool CppLibraryInterface::hasFunction(const std::string& functionName) const {
 }
 
 void CppLibraryInterface::registerFunction(const std::string& name, void* funcPtr) {
+    std::unique_lock<std::shared_mutex> lock(cacheMutex);
     functions[name] = funcPtr;
 }
 
 // PythonLibraryInterface Implementation
+#ifdef PYTHON_SUPPORT
+namespace {
+
+// Holds the GIL for its lifetime, on whichever thread it is made. The
+// interpreter releases the GIL right after initializing Python, so every
+// call into Python goes through one of these.
+class PythonLock {
+private:
+    PyGILState_STATE state;
+
+public:
+    PythonLock() : state(PyGILState_Ensure()) {}
+    ~PythonLock() { PyGILState_Release(state); }
+    PythonLock(const PythonLock&) = delete;
+    PythonLock& operator=(const PythonLock&) = delete;
+};
+
+PyThreadState* initialThread = nullptr; // saved while the GIL is released
+
+} // namespace
+#endif
+
 PythonLibraryInterface::PythonLibraryInterface(const std::string& modulePath) 
     : moduleName(modulePath), pythonModule(nullptr) {
 #ifdef PYTHON_SUPPORT
-    if (!pythonInitialized) {
-        initializePython();
-    }
+    initializePython();
+    PythonLock gil;
     
     // Extract module name from path
     std::string modName = modulePath;
@@ -262,12 +487,200 @@ PythonLibraryInterface::PythonLibraryInterface(const std::string& modulePath)
 
 PythonLibraryInterface::~PythonLibraryInterface() {
 #ifdef PYTHON_SUPPORT
+    if (!Py_IsInitialized()) return;
+    PythonLock gil;
+    for (const auto& function : functions) {
+        Py_DECREF(static_cast<PyObject*>(function.second));
+    }
     if (pythonModule) {
         Py_DECREF(static_cast<PyObject*>(pythonModule));
     }
 #endif
 }
 
+#ifdef PYTHON_SUPPORT
+namespace {
+
+// A list of numbers or an array is handed to Python as a memoryview of
+// doubles filled in one pass, rather than as one float object per element
+template <typename Numbers>
+PyObject* numberBuffer(const Numbers& numbers) {
+    PyObject* bytes = PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(numbers.size() * sizeof(double)));
+    if (!bytes) return nullptr;
+    double* data = reinterpret_cast<double*>(PyBytes_AS_STRING(bytes));
+    if constexpr (std::is_same_v<Numbers, std::vector<double>>) {
+        std::copy(numbers.begin(), numbers.end(), data);
+    } else {
+        for (size_t i = 0; i < numbers.size(); i++) {
+            data[i] = numbers[i].asNumber();
+        }
+    }
+
+    PyObject* view = PyMemoryView_FromObject(bytes);
+    Py_DECREF(bytes);
+    if (!view) return nullptr;
+    PyObject* doubles = PyObject_CallMethod(view, "cast", "s", "d");
+    Py_DECREF(view);
+    return doubles;
+}
+
+// New reference, or null with a Python error set
+PyObject* toPython(const Value& value) {
+    if (value.isNumber()) return PyFloat_FromDouble(value.asNumber());
+    if (value.isString()) {
+        const std::string& text = value.asString();
+        return PyUnicode_FromStringAndSize(text.data(), static_cast<Py_ssize_t>(text.size()));
+    }
+    if (value.isBool()) return PyBool_FromLong(value.asBool() ? 1 : 0);
+    if (value.isArray()) return numberBuffer(*value.asArray());
+    if (value.isList()) {
+        const std::vector<Value>& items = *value.asList();
+        bool numeric = !items.empty();
+        for (const auto& item : items) {
+            if (!item.isNumber()) {
+                numeric = false;
+                break;
+            }
+        }
+        if (numeric) return numberBuffer(items);
+
+        PyObject* list = PyList_New(static_cast<Py_ssize_t>(items.size()));
+        if (!list) return nullptr;
+        for (size_t i = 0; i < items.size(); i++) {
+            PyObject* item = toPython(items[i]);
+            if (!item) {
+                Py_DECREF(list);
+                return nullptr;
+            }
+            PyList_SET_ITEM(list, static_cast<Py_ssize_t>(i), item);
+        }
+        return list;
+    }
+    if (value.isMap()) {
+        PyObject* dict = PyDict_New();
+        if (!dict) return nullptr;
+        for (const auto& entry : value.asMap()->entries()) {
+            if (entry.erased) continue;
+            PyObject* key = toPython(entry.key);
+            PyObject* item = key ? toPython(entry.value) : nullptr;
+            int stored = item ? PyDict_SetItem(dict, key, item) : -1;
+            Py_XDECREF(key);
+            Py_XDECREF(item);
+            if (stored != 0) {
+                Py_DECREF(dict);
+                return nullptr;
+            }
+        }
+        return dict;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+// Objects exposing a contiguous buffer of doubles (memoryview, array('d'),
+// numpy arrays) are copied straight out of it
+bool fromDoubleBuffer(PyObject* object, Value& result) {
+    if (PyBytes_Check(object) || PyByteArray_Check(object) || !PyObject_CheckBuffer(object)) return false;
+    Py_buffer view;
+    if (PyObject_GetBuffer(object, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) != 0) {
+        PyErr_Clear();
+        return false;
+    }
+    bool doubles = view.itemsize == sizeof(double) && view.format &&
+                   (view.format == std::string("d") || view.format == std::string("<d") ||
+                    view.format == std::string("@d") || view.format == std::string("=d"));
+    if (doubles) {
+        const double* data = static_cast<const double*>(view.buf);
+        auto list = std::make_shared<std::vector<Value>>();
+        list->reserve(static_cast<size_t>(view.len) / sizeof(double));
+        for (Py_ssize_t i = 0; i < view.len / static_cast<Py_ssize_t>(sizeof(double)); i++) {
+            list->push_back(Value(data[i]));
+        }
+        result = Value(list);
+    }
+    PyBuffer_Release(&view);
+    return doubles;
+}
+
+Value fromPython(PyObject* object) {
+    if (object == Py_None) return Value(); // nil
+    if (PyBool_Check(object)) return Value(object == Py_True); // before PyLong: bool is an int
+    if (PyFloat_Check(object)) return Value(PyFloat_AS_DOUBLE(object));
+    if (PyLong_Check(object)) {
+        double number = PyLong_AsDouble(object);
+        if (number == -1.0 && PyErr_Occurred()) PyErr_Clear();
+        return Value(number);
+    }
+    if (PyUnicode_Check(object)) {
+        Py_ssize_t size = 0;
+        const char* str = PyUnicode_AsUTF8AndSize(object, &size);
+        return Value(str ? std::string(str, static_cast<size_t>(size)) : std::string());
+    }
+    if (PyList_Check(object) || PyTuple_Check(object)) {
+        // Convert Python list to Focus Nexus list
+        PyObject* items = PySequence_Fast(object, "expected a sequence");
+        Py_ssize_t size = PySequence_Fast_GET_SIZE(items);
+        auto list = std::make_shared<std::vector<Value>>();
+        list->reserve(static_cast<size_t>(size));
+        for (Py_ssize_t i = 0; i < size; i++) {
+            list->push_back(fromPython(PySequence_Fast_GET_ITEM(items, i)));
+        }
+        Py_DECREF(items);
+        return Value(list);
+    }
+    if (PyDict_Check(object)) {
+        auto map = std::make_shared<FocusMap>(static_cast<size_t>(PyDict_Size(object)));
+        PyObject* key = nullptr;
+        PyObject* item = nullptr;
+        Py_ssize_t position = 0;
+        while (PyDict_Next(object, &position, &key, &item)) {
+            map->set(fromPython(key), fromPython(item));
+        }
+        return Value(map);
+    }
+
+    Value result;
+    if (fromDoubleBuffer(object, result)) return result;
+
+    // Try to convert to string as fallback
+    PyObject* pStr = PyObject_Str(object);
+    if (!pStr) {
+        PyErr_Clear();
+        return Value(); // nil
+    }
+    const char* str = PyUnicode_AsUTF8(pStr);
+    result = Value(std::string(str ? str : ""));
+    Py_DECREF(pStr);
+    return result;
+}
+
+} // namespace
+#endif
+
+void* PythonLibraryInterface::lookupFunction(const std::string& functionName) const {
+#ifdef PYTHON_SUPPORT
+    PythonLock gil;
+    auto it = functions.find(functionName);
+    if (it != functions.end()) {
+        return it->second;
+    }
+    if (!pythonModule) return nullptr;
+
+    PyObject* pFunc = PyObject_GetAttrString(static_cast<PyObject*>(pythonModule), functionName.c_str());
+    if (!pFunc || !PyCallable_Check(pFunc)) {
+        PyErr_Clear();
+        Py_XDECREF(pFunc);
+        return nullptr;
+    }
+
+    // The reference is kept until the library is unloaded
+    functions[functionName] = pFunc;
+    return pFunc;
+#else
+    return nullptr;
+#endif
+}
+
 Value PythonLibraryInterface::callFunction(const std::string& functionName, const std::vector<Value>& args) {
 #ifdef PYTHON_SUPPORT
     if (!pythonModule) {
@@ -275,38 +688,43 @@ Value PythonLibraryInterface::callFunction(const std::string& functionName, cons
                           "Python module not loaded");
     }
     
-    PyObject* pModule = static_cast<PyObject*>(pythonModule);
-    PyObject* pFunc = PyObject_GetAttrString(pModule, functionName.c_str());
-    
-    if (!pFunc || !PyCallable_Check(pFunc)) {
-        Py_XDECREF(pFunc);
+    PythonLock gil;
+    PyObject* pFunc = static_cast<PyObject*>(lookupFunction(functionName));
+    if (!pFunc) {
         throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
                           "Function '" + functionName + "' not found or not callable in Python module");
     }
     
     // Convert arguments to Python objects
-    PyObject* pArgs = PyTuple_New(args.size());
-    for (size_t i = 0; i < args.size(); i++) {
-        PyObject* pValue = nullptr;
-        
-        if (args[i].isNumber()) {
-            pValue = PyFloat_FromDouble(args[i].asNumber());
-        } else if (args[i].isString()) {
-            pValue = PyUnicode_FromString(args[i].asString().c_str());
-        } else if (args[i].isBool()) {
-            pValue = PyBool_FromLong(args[i].asBool() ? 1 : 0);
-        } else {
-            pValue = Py_None;
-            Py_INCREF(Py_None);
+    std::vector<PyObject*> pArgs;
+    pArgs.reserve(args.size());
+    auto releaseArgs = [&pArgs] {
+        for (PyObject* arg : pArgs) Py_DECREF(arg);
+    };
+    for (const auto& arg : args) {
+        PyObject* pValue = toPython(arg);
+        if (!pValue) {
+            PyErr_Print();
+            releaseArgs();
+            throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
+                              "Can't convert arguments for Python function '" + functionName + "'");
         }
-        
-        PyTuple_SetItem(pArgs, i, pValue);
+        pArgs.push_back(pValue);
     }
     
     // Call the function
-    PyObject* pResult = PyObject_CallObject(pFunc, pArgs);
-    Py_DECREF(pArgs);
-    Py_DECREF(pFunc);
+#if PY_VERSION_HEX >= 0x03090000
+    PyObject* pResult = PyObject_Vectorcall(pFunc, pArgs.data(), pArgs.size(), nullptr);
+#else
+    PyObject* pTuple = PyTuple_New(static_cast<Py_ssize_t>(pArgs.size()));
+    for (size_t i = 0; i < pArgs.size(); i++) {
+        Py_INCREF(pArgs[i]);
+        PyTuple_SET_ITEM(pTuple, static_cast<Py_ssize_t>(i), pArgs[i]);
+    }
+    PyObject* pResult = PyObject_CallObject(pFunc, pTuple);
+    Py_DECREF(pTuple);
+#endif
+    releaseArgs();
     
     if (!pResult) {
         PyErr_Print();
@@ -315,48 +733,7 @@ Value PythonLibraryInterface::callFunction(const std::string& functionName, cons
     }
     
     // Convert result back to Focus Nexus Value
-    Value result;
-    if (PyFloat_Check(pResult)) {
-        result = Value(PyFloat_AsDouble(pResult));
-    } else if (PyLong_Check(pResult)) {
-        result = Value(static_cast<double>(PyLong_AsLong(pResult)));
-    } else if (PyUnicode_Check(pResult)) {
-        const char* str = PyUnicode_AsUTF8(pResult);
-        result = Value(std::string(str ? str : ""));
-    } else if (PyBool_Check(pResult)) {
-        result = Value(PyObject_IsTrue(pResult) == 1);
-    } else if (pResult == Py_None) {
-        result = Value(); // nil
-    } else if (PyList_Check(pResult)) {
-        // Convert Python list to Focus Nexus list
-        auto list = std::make_shared<std::vector<Value>>();
-        Py_ssize_t size = PyList_Size(pResult);
-        for (Py_ssize_t i = 0; i < size; i++) {
-            PyObject* item = PyList_GetItem(pResult, i);
-            if (PyFloat_Check(item)) {
-                list->push_back(Value(PyFloat_AsDouble(item)));
-            } else if (PyLong_Check(item)) {
-                list->push_back(Value(static_cast<double>(PyLong_AsLong(item))));
-            } else if (PyUnicode_Check(item)) {
-                const char* str = PyUnicode_AsUTF8(item);
-                list->push_back(Value(std::string(str ? str : "")));
-            } else {
-                list->push_back(Value()); // nil for unknown types
-            }
-        }
-        result = Value(list);
-    } else {
-        // Try to convert to string as fallback
-        PyObject* pStr = PyObject_Str(pResult);
-        if (pStr) {
-            const char* str = PyUnicode_AsUTF8(pStr);
-            result = Value(std::string(str ? str : ""));
-            Py_DECREF(pStr);
-        } else {
-            result = Value(); // nil
-        }
-    }
-    
+    Value result = fromPython(pResult);
     Py_DECREF(pResult);
     return result;
 #else
@@ -365,26 +742,12 @@ Value PythonLibraryInterface::callFunction(const std::string& functionName, cons
 }
 
 bool PythonLibraryInterface::hasFunction(const std::string& functionName) const {
-#ifdef PYTHON_SUPPORT
-    if (!pythonModule) return false;
-    
-    PyObject* pModule = static_cast<PyObject*>(pythonModule);
-    PyObject* pFunc = PyObject_GetAttrString(pModule, functionName.c_str());
-    
-    if (pFunc && PyCallable_Check(pFunc)) {
-        Py_DECREF(pFunc);
-        return true;
-    }
-    
-    Py_XDECREF(pFunc);
-    return false;
-#else
-    return false;
-#endif
+    return lookupFunction(functionName) != nullptr;
 }
 
 void PythonLibraryInterface::initializePython() {
 #ifdef PYTHON_SUPPORT
+    std::lock_guard<std::mutex> lock(initMutex);
     if (!pythonInitialized) {
         Py_Initialize();
         if (!Py_IsInitialized()) {
@@ -396,6 +759,8 @@ void PythonLibraryInterface::initializePython() {
         PyRun_SimpleString("sys.path.append('.')");
         PyRun_SimpleString("sys.path.append('./examples/python_library')");
         
+        // Let go of the GIL so any thread can take it for a call
+        initialThread = PyEval_SaveThread();
         pythonInitialized = true;
         std::cout << "Python interpreter initialized" << std::endl;
     }
@@ -404,7 +769,10 @@ void PythonLibraryInterface::initializePython() {
 
 void PythonLibraryInterface::finalizePython() {
 #ifdef PYTHON_SUPPORT
+    std::lock_guard<std::mutex> lock(initMutex);
     if (pythonInitialized) {
+        PyEval_RestoreThread(initialThread);
+        initialThread = nullptr;
         Py_Finalize();
         pythonInitialized = false;
         std::cout << "Python interpreter finalized" << std::endl;
@@ -413,11 +781,35 @@ void PythonLibraryInterface::finalizePython() {
 }
 
 // JavaLibraryInterface Implementation
+#ifdef JNI_SUPPORT
+JNIEnv* JavaLibraryInterface::currentEnv() {
+    if (!jvm) return nullptr;
+    JNIEnv* env = nullptr;
+    if (jvm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_8) == JNI_EDETACHED) {
+        // Detaches the thread when it exits
+        struct Attachment {
+            JavaVM* vm = nullptr;
+            ~Attachment() {
+                if (vm) vm->DetachCurrentThread();
+            }
+        };
+        thread_local Attachment attachment;
+        if (jvm->AttachCurrentThread(reinterpret_cast<void**>(&env), nullptr) != JNI_OK) {
+            return nullptr;
+        }
+        attachment.vm = jvm;
+    }
+    return env;
+}
+#endif
+
 JavaLibraryInterface::JavaLibraryInterface(const std::string& classPath) 
     : className(classPath), javaClass(nullptr) {
 #ifdef JNI_SUPPORT
-    if (!jvmInitialized) {
-        initializeJVM();
+    initializeJVM();
+    JNIEnv* env = currentEnv();
+    if (!env) {
+        throw std::runtime_error("Can't attach thread to the Java VM");
     }
     
     // Find the class
@@ -440,126 +832,192 @@ JavaLibraryInterface::JavaLibraryInterface(const std::string& classPath)
 
 JavaLibraryInterface::~JavaLibraryInterface() {
 #ifdef JNI_SUPPORT
+    JNIEnv* env = currentEnv();
     if (javaClass && env) {
         env->DeleteGlobalRef(static_cast<jobject>(javaClass));
     }
 #endif
 }
 
+#ifdef JNI_SUPPORT
+namespace {
+
+// JNI descriptor of each argument kind in a call's shape
+const char* javaDescriptor(char kind) {
+    switch (kind) {
+        case 'D': return "D";
+        case 'Z': return "Z";
+        case 'S': return "Ljava/lang/String;";
+        case 'A': return "[D";
+        default: return "Ljava/lang/Object;";
+    }
+}
+
+// One character per argument: lists holding only numbers are passed as
+// double[], so they get a kind of their own
+char argumentKind(const Value& arg) {
+    if (arg.isNumber()) return 'D';
+    if (arg.isBool()) return 'Z';
+    if (arg.isString()) return 'S';
+    if (arg.isList()) {
+        for (const auto& item : *arg.asList()) {
+            if (!item.isNumber()) return 'O';
+        }
+        return 'A';
+    }
+    return 'O';
+}
+
+} // namespace
+#endif
+
+const JavaLibraryInterface::ResolvedMethod& JavaLibraryInterface::resolveMethod(const std::string& functionName,
+                                                                               const std::string& shape) const {
+    std::string key = functionName + "(" + shape + ")";
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        auto it = methods.find(key);
+        if (it != methods.end()) {
+            return it->second;
+        }
+    }
+
+    ResolvedMethod resolved{nullptr, 'V'};
+#ifdef JNI_SUPPORT
+    JNIEnv* env = currentEnv();
+    std::string parameters = "(";
+    for (char kind : shape) {
+        parameters += javaDescriptor(kind);
+    }
+    parameters += ")";
+
+    // A Java method can't be overloaded on its return type alone, so the
+    // first one that exists is the only one
+    static const std::pair<char, const char*> returnTypes[] = {
+        {'D', "D"}, {'S', "Ljava/lang/String;"}, {'Z', "Z"}, {'J', "J"}, {'I', "I"}, {'A', "[D"}, {'V', "V"}
+    };
+    jclass cls = static_cast<jclass>(javaClass);
+    for (const auto& returnType : returnTypes) {
+        std::string signature = parameters + returnType.second;
+        jmethodID method = env->GetStaticMethodID(cls, functionName.c_str(), signature.c_str());
+        if (method) {
+            resolved = {method, returnType.first};
+            break;
+        }
+        env->ExceptionClear(); // NoSuchMethodError from the failed lookup
+    }
+#endif
+    // Another thread may have resolved it meanwhile; either answer is the same
+    std::unique_lock<std::shared_mutex> lock(cacheMutex);
+    return methods.emplace(std::move(key), resolved).first->second;
+}
+
 Value JavaLibraryInterface::callFunction(const std::string& functionName, const std::vector<Value>& args) {
 #ifdef JNI_SUPPORT
+    JNIEnv* env = currentEnv();
     if (!javaClass || !env) {
         throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
                           "Java class not loaded");
     }
     
     jclass cls = static_cast<jclass>(javaClass);
-    
-    // Build method signature based on arguments
-    std::string signature = "(";
-    std::vector<jvalue> jArgs;
-    jArgs.reserve(args.size());
-    
+
+    std::string shape;
+    shape.reserve(args.size());
     for (const auto& arg : args) {
-        if (arg.isNumber()) {
-            signature += "D"; // double
-            jvalue jVal;
-            jVal.d = arg.asNumber();
-            jArgs.push_back(jVal);
-        } else if (arg.isString()) {
-            signature += "Ljava/lang/String;";
-            jvalue jVal;
-            jVal.l = env->NewStringUTF(arg.asString().c_str());
-            jArgs.push_back(jVal);
-        } else if (arg.isBool()) {
-            signature += "Z"; // boolean
-            jvalue jVal;
-            jVal.z = arg.asBool() ? JNI_TRUE : JNI_FALSE;
-            jArgs.push_back(jVal);
-        } else {
-            signature += "Ljava/lang/Object;";
-            jvalue jVal;
-            jVal.l = nullptr;
-            jArgs.push_back(jVal);
-        }
+        shape += argumentKind(arg);
     }
+
+    const ResolvedMethod& resolved = resolveMethod(functionName, shape);
+    if (!resolved.method) {
+        throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
+                          "Java method '" + functionName + "' not found with compatible signature");
+    }
+    jmethodID method = static_cast<jmethodID>(resolved.method);
     
-    // Try different return types
-    std::vector<std::string> returnTypes = {"D", "Ljava/lang/String;", "Z", "J", "I", "V"};
-    
-    for (const std::string& returnType : returnTypes) {
-        std::string fullSignature = signature + ")" + returnType;
-        
-        jmethodID method = env->GetStaticMethodID(cls, functionName.c_str(), fullSignature.c_str());
-        if (method) {
-            if (returnType == "D") {
-                // double return
-                jdouble result = env->CallStaticDoubleMethodA(cls, method, jArgs.data());
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                    continue;
-                }
-                return Value(static_cast<double>(result));
-            } else if (returnType == "Ljava/lang/String;") {
-                // String return
-                jobject result = env->CallStaticObjectMethodA(cls, method, jArgs.data());
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                    continue;
-                }
-                if (result) {
-                    const char* str = env->GetStringUTFChars(static_cast<jstring>(result), nullptr);
-                    std::string cppStr(str);
-                    env->ReleaseStringUTFChars(static_cast<jstring>(result), str);
-                    env->DeleteLocalRef(result);
-                    return Value(cppStr);
-                }
-                return Value("");
-            } else if (returnType == "Z") {
-                // boolean return
-                jboolean result = env->CallStaticBooleanMethodA(cls, method, jArgs.data());
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                    continue;
-                }
-                return Value(result == JNI_TRUE);
-            } else if (returnType == "J") {
-                // long return
-                jlong result = env->CallStaticLongMethodA(cls, method, jArgs.data());
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                    continue;
-                }
-                return Value(static_cast<double>(result));
-            } else if (returnType == "I") {
-                // int return
-                jint result = env->CallStaticIntMethodA(cls, method, jArgs.data());
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                    continue;
-                }
-                return Value(static_cast<double>(result));
-            } else if (returnType == "V") {
-                // void return
-                env->CallStaticVoidMethodA(cls, method, jArgs.data());
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                    continue;
+    // Convert the arguments; every object made here is a local reference,
+    // which has to be deleted since no Java frame will release it
+    std::vector<jvalue> jArgs(args.size());
+    std::vector<jobject> localRefs;
+    for (size_t i = 0; i < args.size(); i++) {
+        switch (shape[i]) {
+            case 'D': jArgs[i].d = args[i].asNumber(); break;
+            case 'Z': jArgs[i].z = args[i].asBool() ? JNI_TRUE : JNI_FALSE; break;
+            case 'S':
+                jArgs[i].l = env->NewStringUTF(args[i].asString().c_str());
+                localRefs.push_back(jArgs[i].l);
+                break;
+            case 'A': {
+                const std::vector<Value>& items = *args[i].asList();
+                jsize length = static_cast<jsize>(items.size());
+                jdoubleArray array = env->NewDoubleArray(length);
+                if (array) {
+                    // Filled in place; nothing may call into the JVM until it is released
+                    auto* data = static_cast<jdouble*>(env->GetPrimitiveArrayCritical(array, nullptr));
+                    if (data) {
+                        for (jsize j = 0; j < length; j++) {
+                            data[j] = items[j].asNumber();
+                        }
+                        env->ReleasePrimitiveArrayCritical(array, data, 0);
+                    }
                 }
-                return Value(); // nil
+                jArgs[i].l = array;
+                localRefs.push_back(array);
+                break;
             }
+            default: jArgs[i].l = nullptr; break;
         }
     }
-    
-    // Clean up string arguments
-    for (size_t i = 0; i < args.size(); i++) {
-        if (args[i].isString() && jArgs[i].l) {
-            env->DeleteLocalRef(jArgs[i].l);
+
+    Value result;
+    switch (resolved.returnKind) {
+        case 'D': result = Value(static_cast<double>(env->CallStaticDoubleMethodA(cls, method, jArgs.data()))); break;
+        case 'Z': result = Value(env->CallStaticBooleanMethodA(cls, method, jArgs.data()) == JNI_TRUE); break;
+        case 'J': result = Value(static_cast<double>(env->CallStaticLongMethodA(cls, method, jArgs.data()))); break;
+        case 'I': result = Value(static_cast<double>(env->CallStaticIntMethodA(cls, method, jArgs.data()))); break;
+        case 'V': env->CallStaticVoidMethodA(cls, method, jArgs.data()); break;
+        case 'S': {
+            jobject object = env->CallStaticObjectMethodA(cls, method, jArgs.data());
+            result = Value("");
+            if (object && !env->ExceptionCheck()) {
+                const char* str = env->GetStringUTFChars(static_cast<jstring>(object), nullptr);
+                result = Value(std::string(str ? str : ""));
+                env->ReleaseStringUTFChars(static_cast<jstring>(object), str);
+            }
+            if (object) localRefs.push_back(object);
+            break;
+        }
+        case 'A': {
+            jobject object = env->CallStaticObjectMethodA(cls, method, jArgs.data());
+            if (object && !env->ExceptionCheck()) {
+                auto array = static_cast<jdoubleArray>(object);
+                jsize length = env->GetArrayLength(array);
+                auto list = std::make_shared<std::vector<Value>>();
+                list->reserve(static_cast<size_t>(length));
+                auto* data = static_cast<jdouble*>(env->GetPrimitiveArrayCritical(array, nullptr));
+                if (data) {
+                    for (jsize j = 0; j < length; j++) {
+                        list->push_back(Value(static_cast<double>(data[j])));
+                    }
+                    env->ReleasePrimitiveArrayCritical(array, data, JNI_ABORT);
+                }
+                result = Value(list);
+            }
+            if (object) localRefs.push_back(object);
+            break;
         }
     }
-    
-    throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
-                      "Java method '" + functionName + "' not found with compatible signature");
+
+    for (jobject ref : localRefs) {
+        if (ref) env->DeleteLocalRef(ref);
+    }
+
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
+                          "Java method '" + functionName + "' threw an exception");
+    }
+    return result;
 #else
     throw std::runtime_error("Java support not compiled in");
 #endif
@@ -567,26 +1025,40 @@ Value JavaLibraryInterface::callFunction(const std::string& functionName, const
 
 bool JavaLibraryInterface::hasFunction(const std::string& functionName) const {
 #ifdef JNI_SUPPORT
+    JNIEnv* env = currentEnv();
     if (!javaClass || !env) return false;
+
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        auto known = knownFunctions.find(functionName);
+        if (known != knownFunctions.end()) {
+            return known->second;
+        }
+    }
     
     jclass cls = static_cast<jclass>(javaClass);
     
     // Try to find method with common signatures
-    std::vector<std::string> signatures = {
+    static const char* const signatures[] = {
         "()D", "()Ljava/lang/String;", "()Z", "()I", "()J", "()V",
         "(D)D", "(Ljava/lang/String;)Ljava/lang/String;", "(I)Z",
-        "(DD)D", "(II)I", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;"
+        "(DD)D", "(II)I", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;",
+        "([D)D", "([D)[D"
     };
     
-    for (const std::string& sig : signatures) {
-        jmethodID method = env->GetStaticMethodID(cls, functionName.c_str(), sig.c_str());
+    bool found = false;
+    for (const char* sig : signatures) {
+        jmethodID method = env->GetStaticMethodID(cls, functionName.c_str(), sig);
         if (method) {
-            return true;
+            found = true;
+            break;
         }
         env->ExceptionClear(); // Clear any exceptions from failed lookups
     }
     
-    return false;
+    std::unique_lock<std::shared_mutex> lock(cacheMutex);
+    knownFunctions[functionName] = found;
+    return found;
 #else
     return false;
 #endif
@@ -594,6 +1066,7 @@ bool JavaLibraryInterface::hasFunction(const std::string& functionName) const {
 
 void JavaLibraryInterface::initializeJVM() {
 #ifdef JNI_SUPPORT
+    std::lock_guard<std::mutex> lock(initMutex);
     if (!jvmInitialized) {
         JavaVMInitArgs vm_args;
         JavaVMOption options[3];
@@ -607,6 +1080,8 @@ void JavaLibraryInterface::initializeJVM() {
         vm_args.options = options;
         vm_args.ignoreUnrecognized = JNI_FALSE;
         
+        // The creating thread is attached; others attach on first use
+        JNIEnv* env = nullptr;
         jint result = JNI_CreateJavaVM(&jvm, reinterpret_cast<void**>(&env), &vm_args);
         if (result != JNI_OK) {
             throw std::runtime_error("Failed to create Java Virtual Machine");
@@ -620,10 +1095,10 @@ void JavaLibraryInterface::initializeJVM() {
 
 void JavaLibraryInterface::destroyJVM() {
 #ifdef JNI_SUPPORT
+    std::lock_guard<std::mutex> lock(initMutex);
     if (jvmInitialized && jvm) {
         jvm->DestroyJavaVM();
         jvm = nullptr;
-        env = nullptr;
         jvmInitialized = false;
         std::cout << "JVM destroyed" << std::endl;
     }
@@ -631,6 +1106,109 @@ void JavaLibraryInterface::destroyJVM() {
 }
 
 // CustomPluginInterface Implementation
+namespace {
+
+// A list of numbers already is an array of doubles: a Value holding a
+// number is that number's bit pattern
+static_assert(sizeof(Value) == sizeof(double), "Value must be NaN-boxed");
+
+bool allNumbers(const std::vector<Value>& items) {
+    for (const Value& item : items) {
+        if (!item.isNumber()) return false;
+    }
+    return true;
+}
+
+const double* numbersOf(const std::vector<Value>& items) {
+    return reinterpret_cast<const double*>(items.data());
+}
+
+// The arguments of one call in the plugin ABI, borrowing from the values
+// they were made from
+class PluginArguments {
+private:
+    static constexpr size_t kInline = 8;
+    FnValue inlineValues[kInline];
+    std::vector<FnValue> spilled;
+    std::vector<std::unique_ptr<FnValue[]>> lists;
+    size_t count;
+
+    FnValue convert(const Value& value) {
+        if (value.isNil()) return fn_nil();
+        if (value.isBool()) return fn_bool(value.asBool());
+        if (value.isNumber()) return fn_number(value.asNumber());
+        if (value.isString()) {
+            const std::string& text = value.asString();
+            return fn_string(text.data(), text.size());
+        }
+        if (value.isArray()) {
+            const std::vector<double>& numbers = *value.asArray();
+            return fn_numbers(numbers.data(), numbers.size());
+        }
+        if (value.isList()) {
+            const std::vector<Value>& items = *value.asList();
+            if (allNumbers(items)) return fn_numbers(numbersOf(items), items.size());
+            auto converted = std::make_unique<FnValue[]>(items.size());
+            for (size_t i = 0; i < items.size(); i++) {
+                converted[i] = convert(items[i]);
+            }
+            lists.push_back(std::move(converted));
+            return fn_list(lists.back().get(), items.size());
+        }
+        throw std::runtime_error("A " + value.getType() + " can't be passed to a plugin");
+    }
+
+public:
+    explicit PluginArguments(const std::vector<Value>& args) : count(args.size()) {
+        FnValue* values = inlineValues;
+        if (count > kInline) {
+            spilled.resize(count);
+            values = spilled.data();
+        }
+        for (size_t i = 0; i < count; i++) {
+            values[i] = convert(args[i]);
+        }
+    }
+
+    const FnValue* data() const { return count > kInline ? spilled.data() : inlineValues; }
+    size_t size() const { return count; }
+};
+
+Value fromPlugin(const FnValue& value) {
+    switch (value.type) {
+        case FN_NIL: return Value();
+        case FN_BOOL: return Value(value.as.boolean != 0);
+        case FN_NUMBER: return Value(value.as.number);
+        case FN_STRING: return Value(std::string(value.as.string.data, value.as.string.length));
+        case FN_NUMBERS: {
+            auto list = std::make_shared<std::vector<Value>>();
+            list->reserve(value.as.numbers.length);
+            for (size_t i = 0; i < value.as.numbers.length; i++) {
+                list->emplace_back(value.as.numbers.data[i]);
+            }
+            return Value(list);
+        }
+        case FN_LIST: {
+            auto list = std::make_shared<std::vector<Value>>();
+            list->reserve(value.as.list.length);
+            for (size_t i = 0; i < value.as.list.length; i++) {
+                list->push_back(fromPlugin(value.as.list.items[i]));
+            }
+            return Value(list);
+        }
+        default:
+            throw std::runtime_error("Plugin returned a value of unknown type " + std::to_string(value.type));
+    }
+}
+
+[[noreturn]] void pluginFailed(const std::string& functionName, const FnValue& error) {
+    std::string message = error.type == FN_STRING ? std::string(error.as.string.data, error.as.string.length)
+                                                  : "failed";
+    throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0), functionName + ": " + message);
+}
+
+} // namespace
+
 CustomPluginInterface::CustomPluginInterface(const std::string& pluginPath) {
 #ifdef _WIN32
     handle = LoadLibraryA(pluginPath.c_str());
@@ -645,25 +1223,32 @@ CustomPluginInterface::CustomPluginInterface(const std::string& pluginPath) {
     }
 #endif
 
-    // Call plugin initialization function
+    // Plugins from before the C ABI don't say which one they use
+    auto abiFunc = reinterpret_cast<FnPluginAbiFunc>(symbol("focus_nexus_plugin_abi"));
+    abiVersion = abiFunc ? abiFunc() : 1;
+    if (abiVersion < 1 || abiVersion > FN_PLUGIN_ABI_VERSION) {
 #ifdef _WIN32
-    auto initFunc = reinterpret_cast<PluginInitFunc>(GetProcAddress(handle, "focus_nexus_plugin_init"));
+        FreeLibrary(handle);
 #else
-    auto initFunc = reinterpret_cast<PluginInitFunc>(dlsym(handle, "focus_nexus_plugin_init"));
+        dlclose(handle);
 #endif
-    
+        throw std::runtime_error("Custom plugin " + pluginPath + " uses plugin ABI version " +
+                                 std::to_string(abiVersion) + " but at most version " +
+                                 std::to_string(FN_PLUGIN_ABI_VERSION) + " is supported");
+    }
+
+    auto threadSafeFunc = reinterpret_cast<FnPluginThreadSafeFunc>(symbol("focus_nexus_plugin_thread_safe"));
+    threadSafe = threadSafeFunc && threadSafeFunc() != 0;
+
+    // Call plugin initialization function
+    auto initFunc = reinterpret_cast<PluginInitFunc>(symbol("focus_nexus_plugin_init"));
     if (initFunc) {
         initFunc();
         std::cout << "Custom plugin initialized: " << pluginPath << std::endl;
     }
-    
+
     // Get plugin info
-#ifdef _WIN32
-    auto infoFunc = reinterpret_cast<PluginInfoFunc>(GetProcAddress(handle, "focus_nexus_plugin_info"));
-#else
-    auto infoFunc = reinterpret_cast<PluginInfoFunc>(dlsym(handle, "focus_nexus_plugin_info"));
-#endif
-    
+    auto infoFunc = reinterpret_cast<PluginInfoFunc>(symbol("focus_nexus_plugin_info"));
     if (infoFunc) {
         std::cout << "Plugin info: " << infoFunc() << std::endl;
     }
@@ -672,12 +1257,7 @@ CustomPluginInterface::CustomPluginInterface(const std::string& pluginPath) {
 CustomPluginInterface::~CustomPluginInterface() {
     if (handle) {
         // Call plugin cleanup function
-#ifdef _WIN32
-        auto cleanupFunc = reinterpret_cast<PluginCleanupFunc>(GetProcAddress(handle, "focus_nexus_plugin_cleanup"));
-#else
-        auto cleanupFunc = reinterpret_cast<PluginCleanupFunc>(dlsym(handle, "focus_nexus_plugin_cleanup"));
-#endif
-        
+        auto cleanupFunc = reinterpret_cast<PluginCleanupFunc>(symbol("focus_nexus_plugin_cleanup"));
         if (cleanupFunc) {
             cleanupFunc();
         }
@@ -690,44 +1270,112 @@ CustomPluginInterface::~CustomPluginInterface() {
     }
 }
 
-Value CustomPluginInterface::callFunction(const std::string& functionName, const std::vector<Value>& args) {
-    auto it = functions.find(functionName);
-    if (it != functions.end()) {
-        return it->second(args);
-    }
-    
-    // Try to load the function from the plugin
-    std::string symbolName = "focus_nexus_" + functionName;
+void* CustomPluginInterface::symbol(const std::string& name) const {
 #ifdef _WIN32
-    auto funcPtr = reinterpret_cast<PluginFunction>(GetProcAddress(handle, symbolName.c_str()));
+    return reinterpret_cast<void*>(GetProcAddress(handle, name.c_str()));
 #else
-    auto funcPtr = reinterpret_cast<PluginFunction>(dlsym(handle, symbolName.c_str()));
+    return dlsym(handle, name.c_str());
 #endif
-    
-    if (!funcPtr) {
+}
+
+const CustomPluginInterface::PluginEntry& CustomPluginInterface::resolveFunction(const std::string& functionName) const {
+    {
+        std::shared_lock<std::shared_mutex> lock(cacheMutex);
+        auto it = functions.find(functionName);
+        if (it != functions.end()) {
+            return it->second;
+        }
+    }
+
+    // Try to load the function from the plugin
+    PluginEntry entry{nullptr, nullptr, nullptr};
+    void* function = symbol("focus_nexus_" + functionName);
+    if (abiVersion == 1) {
+        entry.legacy = reinterpret_cast<PluginFunction>(function);
+    } else {
+        entry.function = reinterpret_cast<FnPluginFunction>(function);
+        entry.batch = reinterpret_cast<FnPluginBatchFunction>(symbol("focus_nexus_batch_" + functionName));
+    }
+
+    // Cache the lookup for future calls, even if nothing was found
+    std::unique_lock<std::shared_mutex> lock(cacheMutex);
+    return functions.emplace(functionName, entry).first->second;
+}
+
+Value CustomPluginInterface::callFunction(const std::string& functionName, const std::vector<Value>& args) {
+    const PluginEntry& entry = resolveFunction(functionName);
+
+    if (entry.legacy) {
+        return entry.legacy(args);
+    }
+
+    if (entry.batch) {
+        for (const Value& arg : args) {
+            if (arg.isList() || arg.isArray()) return callBatch(functionName, entry.batch, args);
+        }
+    }
+
+    if (!entry.function) {
         throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
                           "Function '" + functionName + "' not found in custom plugin");
     }
-    
-    // Cache the function for future calls
-    functions[functionName] = [funcPtr](const std::vector<Value>& args) -> Value {
-        return funcPtr(args);
-    };
-    
-    return funcPtr(args);
+
+    PluginArguments arguments(args);
+    FnValue result = fn_nil();
+    if (entry.function(arguments.data(), arguments.size(), &result) != FN_OK) {
+        pluginFailed(functionName, result);
+    }
+    return fromPlugin(result);
 }
 
-bool CustomPluginInterface::hasFunction(const std::string& functionName) const {
-    if (functions.find(functionName) != functions.end()) {
-        return true;
+Value CustomPluginInterface::callBatch(const std::string& functionName, FnPluginBatchFunction batch,
+                                       const std::vector<Value>& args) {
+    // Every list or array is a column of numbers, one per row
+    size_t rows = 0;
+    bool sized = false;
+    bool anyArray = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        size_t length;
+        if (args[i].isArray()) {
+            length = args[i].asArray()->size();
+            anyArray = true;
+        } else if (args[i].isList()) {
+            const std::vector<Value>& column = *args[i].asList();
+            if (!allNumbers(column)) {
+                throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
+                                  "Argument " + std::to_string(i + 1) + " of '" + functionName +
+                                  "' must be a list of numbers to map over");
+            }
+            length = column.size();
+        } else {
+            continue;
+        }
+        if (sized && length != rows) {
+            throw RuntimeError(Token(TokenType::IDENTIFIER, functionName, "", 0, 0),
+                              "Lists passed to '" + functionName + "' must all have the same length");
+        }
+        rows = length;
+        sized = true;
     }
-    
-    std::string symbolName = "focus_nexus_" + functionName;
-#ifdef _WIN32
-    void* funcPtr = reinterpret_cast<void*>(GetProcAddress(handle, symbolName.c_str()));
-#else
-    void* funcPtr = dlsym(handle, symbolName.c_str());
-#endif
 
-    return funcPtr != nullptr;
-}
\ No newline at end of file
+    PluginArguments arguments(args);
+    auto out = std::make_shared<std::vector<double>>(rows);
+    FnValue error = fn_nil();
+    if (batch(arguments.data(), arguments.size(), rows, out->data(), &error) != FN_OK) {
+        pluginFailed(functionName, error);
+    }
+
+    // Arrays in, array out
+    if (anyArray) return Value(out);
+    auto results = std::make_shared<std::vector<Value>>();
+    results->reserve(rows);
+    for (double number : *out) {
+        results->emplace_back(number);
+    }
+    return Value(results);
+}
+
+bool CustomPluginInterface::hasFunction(const std::string& functionName) const {
+    const PluginEntry& entry = resolveFunction(functionName);
+    return entry.legacy || entry.function || entry.batch;
+}
@@ -1,10 +1,16 @@
 #pragma once
 #include "value.hpp"
+#include "arguments.hpp"
+#include "native_binding.hpp"
+#include "plugin_abi.h"
 #include "../lexer/token.hpp"
+#include <atomic>
 #include <string>
 #include <unordered_map>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <shared_mutex>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -18,6 +24,7 @@
 
 // Forward declarations
 class Interpreter;
+class Future;
 
 // Base class for library interfaces
 class LibraryInterface {
@@ -26,6 +33,15 @@ public:
     virtual Value callFunction(const std::string& functionName, const std::vector<Value>& args) = 0;
     virtual bool hasFunction(const std::string& functionName) const = 0;
     virtual std::string getType() const = 0;
+
+    // Resolves a function against the signature it was declared with.
+    // Only native libraries can do this; the others throw.
+    virtual void bindFunction(const std::string& functionName, const NativeSignature& signature);
+    // The binding made for a function, or null if it was declared untyped
+    virtual const NativeBinding* binding(const std::string& functionName) const { return nullptr; }
+    // Whether spawned calls may run on several threads at once. Native
+    // code can't be assumed to be, so its calls are run one at a time.
+    virtual bool isThreadSafe() const { return false; }
 };
 
 // C++ Library Interface
@@ -36,7 +52,14 @@ private:
 #else
     void* handle;
 #endif
+    // Both guarded by cacheMutex. A binding that is replaced is retired
+    // rather than freed, as other threads may still be calling through it.
+    mutable std::shared_mutex cacheMutex;
     mutable std::unordered_map<std::string, void*> functions;
+    std::unordered_map<std::string, std::unique_ptr<NativeBinding>> bindings;
+    std::vector<std::unique_ptr<NativeBinding>> retiredBindings;
+
+    void* lookupFunction(const std::string& functionName) const;
 
 public:
     explicit CppLibraryInterface(const std::string& libraryPath);
@@ -45,6 +68,9 @@ public:
     Value callFunction(const std::string& functionName, const std::vector<Value>& args) override;
     bool hasFunction(const std::string& functionName) const override;
     std::string getType() const override { return "cpp"; }
+
+    void bindFunction(const std::string& functionName, const NativeSignature& signature) override;
+    const NativeBinding* binding(const std::string& functionName) const override;
     
     void registerFunction(const std::string& name, void* funcPtr);
 };
@@ -54,7 +80,13 @@ class PythonLibraryInterface : public LibraryInterface {
 private:
     std::string moduleName;
     void* pythonModule; // PyObject* in disguise
+    // Callables resolved so far, each holding a reference (PyObject*).
+    // Only touched with the GIL held.
+    mutable std::unordered_map<std::string, void*> functions;
     static bool pythonInitialized;
+    static std::mutex initMutex;
+
+    void* lookupFunction(const std::string& functionName) const;
 
 public:
     explicit PythonLibraryInterface(const std::string& modulePath);
@@ -63,6 +95,7 @@ public:
     Value callFunction(const std::string& functionName, const std::vector<Value>& args) override;
     bool hasFunction(const std::string& functionName) const override;
     std::string getType() const override { return "python"; }
+    bool isThreadSafe() const override { return true; } // each call holds the GIL
     
     static void initializePython();
     static void finalizePython();
@@ -75,9 +108,25 @@ private:
     void* javaClass; // jclass in disguise
     static bool jvmInitialized;
 
+    // A static method resolved for one shape of arguments, e.g. "sum(A)"
+    // for a list of numbers; method is null if none matched
+    struct ResolvedMethod {
+        void* method; // jmethodID in disguise
+        char returnKind; // 'D', 'S', 'Z', 'J', 'I', 'A' (double[]) or 'V'
+    };
+    // Both guarded by cacheMutex; entries are never removed
+    mutable std::shared_mutex cacheMutex;
+    mutable std::unordered_map<std::string, ResolvedMethod> methods;
+    mutable std::unordered_map<std::string, bool> knownFunctions;
+    static std::mutex initMutex;
+
+    const ResolvedMethod& resolveMethod(const std::string& functionName, const std::string& shape) const;
+
 #ifdef JNI_SUPPORT
     static JavaVM* jvm;
-    static JNIEnv* env;
+    // The calling thread's JNIEnv, attaching the thread to the JVM the
+    // first time; it is detached again when the thread exits
+    static JNIEnv* currentEnv();
 #endif
 
 public:
@@ -87,11 +136,27 @@ public:
     Value callFunction(const std::string& functionName, const std::vector<Value>& args) override;
     bool hasFunction(const std::string& functionName) const override;
     std::string getType() const override { return "java"; }
+    bool isThreadSafe() const override { return true; }
     
     static void initializeJVM();
     static void destroyJVM();
 };
 
+// Plugin API for custom plugins
+extern "C" {
+    // Function signature for plugin initialization
+    typedef void (*PluginInitFunc)(void);
+    
+    // Function signature for plugin cleanup
+    typedef void (*PluginCleanupFunc)(void);
+    
+    // Function signature for getting plugin info
+    typedef const char* (*PluginInfoFunc)(void);
+    
+    // Function signature for version 1 plugin functions
+    typedef Value (*PluginFunction)(const std::vector<Value>& args);
+}
+
 // Custom Plugin Interface
 class CustomPluginInterface : public LibraryInterface {
 private:
@@ -100,7 +165,24 @@ private:
 #else
     void* handle;
 #endif
-    mutable std::unordered_map<std::string, std::function<Value(const std::vector<Value>&)>> functions;
+    // 1 for plugins built against the old C++ interface, which exchange
+    // std::vector<Value> and so must match our compiler and STL exactly
+    uint32_t abiVersion;
+    bool threadSafe; // exports focus_nexus_plugin_thread_safe() returning nonzero
+
+    // A function's entry points; all null if the plugin has no such
+    // function. Only one of legacy and function is set.
+    struct PluginEntry {
+        PluginFunction legacy;
+        FnPluginFunction function;
+        FnPluginBatchFunction batch;
+    };
+    mutable std::shared_mutex cacheMutex; // guards functions; entries are never removed
+    mutable std::unordered_map<std::string, PluginEntry> functions;
+
+    void* symbol(const std::string& name) const;
+    const PluginEntry& resolveFunction(const std::string& functionName) const;
+    Value callBatch(const std::string& functionName, FnPluginBatchFunction batch, const std::vector<Value>& args);
 
 public:
     explicit CustomPluginInterface(const std::string& pluginPath);
@@ -109,19 +191,52 @@ public:
     Value callFunction(const std::string& functionName, const std::vector<Value>& args) override;
     bool hasFunction(const std::string& functionName) const override;
     std::string getType() const override { return "custom"; }
+    bool isThreadSafe() const override { return threadSafe; }
 };
 
-// Library Manager
+// Library Manager, shared by every interpreter in the process.
+//
+// The registry is copied on write: loading or unloading publishes a new
+// immutable map and bumps the generation. Each thread keeps its own
+// reference to the map it last saw and only takes the lock to refresh it
+// once the generation has moved on, so lookups never contend. A library
+// stays alive until every thread has moved past it.
 class LibraryManager {
+public:
+    using Registry = std::unordered_map<std::string, std::shared_ptr<LibraryInterface>>;
+
 private:
-    std::unordered_map<std::string, std::shared_ptr<LibraryInterface>> libraries;
-    static std::unique_ptr<LibraryManager> instance;
+    std::shared_ptr<const Registry> registry = std::make_shared<Registry>(); // guarded by writeMutex
+    mutable std::mutex writeMutex;
+    // Bumped whenever the registry or a binding changes, which invalidates
+    // every NativeCallSite; 0 is never current
+    std::atomic<uint64_t> generation{1};
+
+    LibraryManager() = default;
+
+    // This thread's view of the registry, refreshed if it is stale
+    const Registry& libraries() const;
+    uint64_t viewGeneration() const;
+    void publish(std::shared_ptr<const Registry> next);
+
+    LibraryInterface& find(const std::string& library) const;
+    Value profiledCall(const std::string& library, const std::string& function, LibraryInterface& target,
+                       const NativeBinding* binding, Arguments args);
 
 public:
     static LibraryManager& getInstance();
     
     bool loadLibrary(const std::string& alias, const std::string& path, const std::string& type);
     Value callFunction(const std::string& library, const std::string& function, const std::vector<Value>& args);
+    // Same, for a call site that remembers the binding it resolved to so
+    // later calls skip both lookups
+    Value callFunction(NativeCallSite& site, const std::string& library, const std::string& function, Arguments args);
+    // Same, on a worker thread of the library's bridge, returning a future
+    // on this thread's loop right away. Lists, arrays and maps among the
+    // arguments are copied first, so the script may change them meanwhile.
+    std::shared_ptr<Future> spawnFunction(const std::string& library, const std::string& function,
+                                          std::vector<Value> args);
+    void bindFunction(const std::string& library, const std::string& function, const NativeSignature& signature);
     bool hasLibrary(const std::string& alias) const;
     bool hasFunction(const std::string& library, const std::string& function) const;
     
@@ -132,23 +247,6 @@ public:
     std::string getLibraryType(const std::string& alias) const;
 };
 
-// Plugin API for custom plugins
-extern "C" {
-    // Function signature for plugin initialization
-    typedef void (*PluginInitFunc)(void);
-    
-    // Function signature for plugin cleanup
-    typedef void (*PluginCleanupFunc)(void);
-    
-    // Function signature for getting plugin info
-    typedef const char* (*PluginInfoFunc)(void);
-    
-    // Function signature for plugin functions
-    typedef Value (*PluginFunction)(const std::vector<Value>& args);
-}
-
-// Helper macros for plugin development
-#define FOCUS_NEXUS_PLUGIN_INIT(func) extern "C" void focus_nexus_plugin_init() { func(); }
-#define FOCUS_NEXUS_PLUGIN_CLEANUP(func) extern "C" void focus_nexus_plugin_cleanup() { func(); }
-#define FOCUS_NEXUS_PLUGIN_INFO(info) extern "C" const char* focus_nexus_plugin_info() { return info; }
+// Version 1 of the plugin API, still loaded for plugins that don't export
+// focus_nexus_plugin_abi. New plugins should use plugin_abi.h instead.
 #define FOCUS_NEXUS_EXPORT_FUNCTION(name, func) extern "C" Value focus_nexus_##name(const std::vector<Value>& args) { return func(args); }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "metrics.hpp"
+#include "value.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static_assert(static_cast<size_t>(HeapObject::Kind::Future) + 1 == Metrics::kKinds,
+              "Metrics::kKinds must cover every HeapObject::Kind");
+
+std::atomic<bool> Metrics::timingOn{false};
+
+// Kept after its thread retires, for anything timed while it winds down
+struct Metrics::Libraries {
+    std::mutex mutex;
+    std::unordered_map<std::string, Histogram> histograms;
+};
+
+// The blocks of running threads and the totals of finished ones
+struct Metrics::Registry {
+    std::mutex mutex;
+    std::vector<Block*> blocks;
+    Snapshot retired;
+
+    // Never destroyed: threads may retire after static destructors ran
+    static Registry& get() {
+        static Registry* instance = new Registry();
+        return *instance;
+    }
+};
+
+// Retires the thread's block when the thread exits
+struct Metrics::Enrollment {
+    Block* block = nullptr;
+
+    ~Enrollment() {
+        if (block != nullptr) retire(*block);
+    }
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point started = Clock::now();
+
+struct Dumper {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+    std::string path;
+    bool stopping = false;
+};
+
+Dumper dumper;
+
+void writeFile(const std::string& path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (out) Metrics::writeJson(out, Metrics::snapshot());
+}
+
+const char* const kCounterNames[Metrics::kCounters] = {
+    "calls", "native_calls", "environments", "exceptions", "extern_calls",
+};
+
+const char* const kKindNames[Metrics::kKinds] = {
+    "string", "rope", "slice", "callable", "list", "class", "instance",
+    "iterable", "array", "map", "module", "future",
+};
+
+} // namespace
+
+void Metrics::Histogram::record(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (bucket + 1 < kBuckets && us >= (uint64_t{1} << bucket)) bucket++;
+    buckets[bucket]++;
+    calls++;
+    totalNs += ns;
+    if (ns > maxNs) maxNs = ns;
+}
+
+void Metrics::Histogram::add(const Histogram& other) {
+    for (size_t i = 0; i < kBuckets; i++) buckets[i] += other.buckets[i];
+    calls += other.calls;
+    totalNs += other.totalNs;
+    if (other.maxNs > maxNs) maxNs = other.maxNs;
+}
+
+double Metrics::Histogram::quantileUs(double q) const {
+    if (calls == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(calls - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            // The slowest bucket is open-ended; the maximum bounds it
+            if (i + 1 == kBuckets) return static_cast<double>(maxNs) / 1000.0;
+            return static_cast<double>(uint64_t{1} << i);
+        }
+    }
+    return static_cast<double>(maxNs) / 1000.0;
+}
+
+void Metrics::enroll() {
+    static thread_local Enrollment enrollment;
+    local.enrolled = true;
+    local.libraries = new Libraries();
+    {
+        Registry& all = Registry::get();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        all.blocks.push_back(&local);
+    }
+    enrollment.block = &local;
+}
+
+// Folds a finished thread's counts into the totals. The block stays
+// enrolled, so anything counted while the thread winds down is dropped
+// rather than enrolling it again.
+void Metrics::retire(Block& block) {
+    Registry& all = Registry::get();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    for (size_t i = 0; i < kCounters; i++) all.retired.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < kKinds; i++) all.retired.allocations[i] += block.allocations[i].load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> libraryLock(block.libraries->mutex);
+        for (const auto& entry : block.libraries->histograms) all.retired.libraries[entry.first].add(entry.second);
+        block.libraries->histograms.clear();
+    }
+    all.blocks.erase(std::find(all.blocks.begin(), all.blocks.end(), &block));
+}
+
+void Metrics::recordLatency(const std::string& alias, uint64_t ns) {
+    if (!local.enrolled) enroll();
+    std::lock_guard<std::mutex> lock(local.libraries->mutex);
+    local.libraries->histograms[alias].record(ns);
+}
+
+Metrics::Snapshot Metrics::snapshot() {
+    Registry& all = Registry::get();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    Snapshot total = all.retired;
+    for (Block* block : all.blocks) {
+        for (size_t i = 0; i < kCounters; i++) total.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kKinds; i++) total.allocations[i] += block->allocations[i].load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> libraryLock(block->libraries->mutex);
+        for (const auto& entry : block->libraries->histograms) total.libraries[entry.first].add(entry.second);
+    }
+    total.uptimeMs = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+    return total;
+}
+
+const char* Metrics::counterName(Counter counter) {
+    return kCounterNames[counter];
+}
+
+const char* Metrics::kindName(size_t kind) {
+    return kKindNames[kind];
+}
+
+void Metrics::writeJson(std::ostream& out, const Snapshot& snapshot) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"uptime_ms\": " << snapshot.uptimeMs;
+    for (size_t i = 0; i < kCounters; i++) {
+        out << ",\n  \"" << kCounterNames[i] << "\": " << snapshot.counters[i];
+    }
+    out << ",\n  \"allocations\": {";
+    for (size_t i = 0; i < kKinds; i++) {
+        out << (i == 0 ? "" : ", ") << "\"" << kKindNames[i] << "\": " << snapshot.allocations[i];
+    }
+    out << "},\n  \"libraries\": {";
+    bool first = true;
+    for (const auto& entry : snapshot.libraries) {
+        const Histogram& histogram = entry.second;
+        out << (first ? "\n" : ",\n") << "    \"" << entry.first << "\": {\"calls\": " << histogram.calls
+            << ", \"mean_us\": " << (histogram.calls == 0 ? 0.0 : histogram.totalNs / 1000.0 / histogram.calls)
+            << ", \"p50_us\": " << histogram.quantileUs(0.5) << ", \"p99_us\": " << histogram.quantileUs(0.99)
+            << ", \"max_us\": " << histogram.maxNs / 1000.0 << ", \"buckets\": [";
+        for (size_t i = 0; i < Histogram::kBuckets; i++) out << (i == 0 ? "" : ", ") << histogram.buckets[i];
+        out << "]}";
+        first = false;
+    }
+    out << (first ? "}" : "\n  }") << "\n}\n";
+}
+
+void Metrics::startDumping(const std::string& path, size_t intervalMs) {
+    setTiming(true);
+    dumper.path = path;
+    dumper.stopping = false;
+    dumper.thread = std::thread([intervalMs] {
+        std::unique_lock<std::mutex> lock(dumper.mutex);
+        while (!dumper.wake.wait_for(lock, std::chrono::milliseconds(intervalMs), [] { return dumper.stopping; })) {
+            writeFile(dumper.path);
+        }
+    });
+}
+
+void Metrics::stopDumping() {
+    if (!dumper.thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(dumper.mutex);
+        dumper.stopping = true;
+    }
+    dumper.wake.notify_all();
+    dumper.thread.join();
+    writeFile(dumper.path);
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+
+// Runtime counters behind stats() and --metrics-out. Each thread, and so
+// each interpreter, counts into a block of its own that only it writes,
+// so counting is a plain increment; readers sum the blocks of the running
+// threads and what finished threads left behind.
+//
+// Counters are always kept. Latencies of external library calls take two
+// clock reads per call and are only recorded once timing is turned on,
+// by --metrics or --metrics-out.
+class Metrics {
+public:
+    enum Counter : uint8_t {
+        Calls,        // script functions and lambdas, on either engine
+        NativeCalls,  // builtins
+        Environments, // frames created by the tree-walker
+        Exceptions,   // runtime errors raised, thrown values included
+        ExternCalls,  // external library functions
+        kCounters
+    };
+
+    // One per HeapObject::Kind
+    static constexpr size_t kKinds = 12;
+
+    // Microseconds in power-of-two buckets: bucket i counts calls that
+    // took under 2^i us, the last one everything slower
+    struct Histogram {
+        static constexpr size_t kBuckets = 24;
+
+        uint64_t buckets[kBuckets] = {};
+        uint64_t calls = 0;
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+
+        void record(uint64_t ns);
+        void add(const Histogram& other);
+        // Upper bound of the bucket holding quantile q, in microseconds
+        double quantileUs(double q) const;
+    };
+
+    struct Snapshot {
+        uint64_t counters[kCounters] = {};
+        uint64_t allocations[kKinds] = {};
+        std::map<std::string, Histogram> libraries; // by alias
+        double uptimeMs = 0;
+    };
+
+    static void count(Counter counter) { bump(local.counters[counter]); }
+    static void allocated(uint8_t kind) { bump(local.allocations[kind]); }
+
+    static bool timing() { return timingOn.load(std::memory_order_relaxed); }
+    static void setTiming(bool enabled) { timingOn.store(enabled, std::memory_order_relaxed); }
+    // A finished call of the library loaded as alias
+    static void recordLatency(const std::string& alias, uint64_t ns);
+
+    // Totals over all threads so far
+    static Snapshot snapshot();
+    static const char* counterName(Counter counter);
+    static const char* kindName(size_t kind);
+    static void writeJson(std::ostream& out, const Snapshot& snapshot);
+
+    // Rewrites path with the JSON snapshot every intervalMs until
+    // stopDumping(), which writes the final one. Turns timing on.
+    static void startDumping(const std::string& path, size_t intervalMs);
+    static void stopDumping();
+
+private:
+    struct Libraries; // per thread histograms, locked for readers
+    struct Registry;
+    struct Enrollment;
+
+    struct Block {
+        std::atomic<uint64_t> counters[kCounters];
+        std::atomic<uint64_t> allocations[kKinds];
+        Libraries* libraries;
+        bool enrolled;
+    };
+
+    // Zero-initialized, so using it needs no guard on first access
+    inline static thread_local Block local;
+    static std::atomic<bool> timingOn;
+
+    // Only the owning thread writes, so there is no need for an atomic add
+    static void bump(std::atomic<uint64_t>& counter) {
+        if (!local.enrolled) enroll();
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    static void enroll();
+    static void retire(Block& block);
+};
+
+// Times an external library call when timing is on. Calls are counted
+// either way; a call that throws is timed too.
+class LibraryCallScope {
+private:
+    const std::string& alias;
+    std::chrono::steady_clock::time_point start;
+    bool timed;
+
+public:
+    explicit LibraryCallScope(const std::string& alias) : alias(alias), timed(Metrics::timing()) {
+        Metrics::count(Metrics::ExternCalls);
+        if (timed) start = std::chrono::steady_clock::now();
+    }
+    LibraryCallScope(const LibraryCallScope&) = delete;
+    LibraryCallScope& operator=(const LibraryCallScope&) = delete;
+    ~LibraryCallScope() {
+        if (!timed) return;
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        Metrics::recordLatency(alias, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+};
@@ -0,0 +1,179 @@
+#include "module.hpp"
+#include "../error/error_handler.hpp"
+#include "../error/exceptions.hpp"
+#include "../interpreter.hpp"
+#include "../parser/ast_arena.hpp"
+#include "../session.hpp"
+#include "../utils/file_utils.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Directory of the module the calling thread is loading, if any
+thread_local const std::string* loadingDirectory = nullptr;
+
+class LoadingScope {
+public:
+    explicit LoadingScope(const std::string* directory) : previous(loadingDirectory) {
+        loadingDirectory = directory;
+    }
+    ~LoadingScope() { loadingDirectory = previous; }
+
+private:
+    const std::string* previous;
+};
+
+} // namespace
+
+// A module file parsed once for the whole process. Its tree is only read
+// while it runs, so every session's module of the file shares it.
+struct ModuleSource {
+    AstArena tree;
+    NodeList<StmtPtr> statements;
+    std::string failure; // why it couldn't be read or parsed
+};
+
+namespace {
+
+struct Table {
+    std::mutex mutex;
+    std::vector<std::string> hostDirectories;
+    std::vector<std::string> pathDirectories; // from FOCUS_PATH
+    std::unordered_map<std::string, std::shared_ptr<const ModuleSource>> sources;
+
+    Table() {
+        const char* focusPath = std::getenv("FOCUS_PATH");
+        std::string list = focusPath != nullptr ? focusPath : "";
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t end = list.find(':', start);
+            if (end == std::string::npos) end = list.size();
+            if (end > start) pathDirectories.push_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+};
+
+// Never destroyed: modules may be loaded until the process exits
+Table& table() {
+    static Table* modules = new Table();
+    return *modules;
+}
+
+// Canonical path of directory/name.fn, empty if there is no such file
+std::string findIn(const std::string& directory, const std::string& name) {
+    std::error_code error;
+    std::filesystem::path candidate = std::filesystem::path(directory) / (name + ".fn");
+    if (!std::filesystem::is_regular_file(candidate, error)) return "";
+    std::filesystem::path resolved = std::filesystem::canonical(candidate, error);
+    return error ? "" : resolved.string();
+}
+
+// The parsed file at path, parsing it on first use
+std::shared_ptr<const ModuleSource> parsed(const std::string& path) {
+    Table& modules = table();
+    std::lock_guard<std::mutex> lock(modules.mutex);
+    auto& source = modules.sources[path];
+    if (source != nullptr) return source;
+
+    auto parsing = std::make_shared<ModuleSource>();
+    try {
+        MappedFile file(path);
+        parsing->statements = Session::parse(file.contents(), parsing->tree, true);
+        if (ErrorHandler::getHadError()) parsing->failure = "it doesn't parse";
+    } catch (const std::exception& e) {
+        parsing->failure = e.what();
+    }
+    source = std::move(parsing);
+    return source;
+}
+
+} // namespace
+
+Module::Module(std::string name, std::string path, std::weak_ptr<Modules> owner)
+    : name(std::move(name)), path(std::move(path)), owner(std::move(owner)) {}
+
+Module::~Module() = default;
+
+Value Module::get(const Token& member) {
+    if (!isLoaded()) load(member);
+    const Value* value = members->find(member.symbol);
+    if (value == nullptr) {
+        throw RuntimeError(member, "Module '" + name + "' has no member '" + member.text() + "'");
+    }
+    return *value;
+}
+
+void Module::load(const Token& where) {
+    std::shared_ptr<Modules> modules = owner.lock();
+    if (modules == nullptr) {
+        throw RuntimeError(where, "Can't load module '" + name + "': its session has ended");
+    }
+    std::lock_guard<std::recursive_mutex> lock(modules->loading);
+    if (isLoaded() || loading) return;
+    if (failure.empty() && path.empty()) failure = "No module named '" + name + "'";
+    if (!failure.empty()) throw RuntimeError(where, failure);
+
+    source = parsed(path);
+    if (!source->failure.empty()) {
+        failure = "Can't load module '" + name + "': " + source->failure;
+        throw RuntimeError(where, failure);
+    }
+
+    loading = true;
+    try {
+        interpreter = std::make_unique<Interpreter>(modules);
+        members = interpreter->getGlobals();
+        std::string directory = std::filesystem::path(path).parent_path().string();
+        LoadingScope scope(&directory);
+        interpreter->run(source->statements);
+    } catch (const RuntimeError& e) {
+        loading = false;
+        failure = "Can't load module '" + name + "': [line " + std::to_string(e.token.line) + "] " + e.what();
+        throw RuntimeError(where, failure);
+    } catch (const std::exception& e) {
+        loading = false;
+        failure = "Can't load module '" + name + "': " + e.what();
+        throw RuntimeError(where, failure);
+    }
+    loading = false;
+    loaded.store(true, std::memory_order_release);
+}
+
+void Modules::addSearchDirectory(const std::string& directory) {
+    Table& modules = table();
+    std::lock_guard<std::mutex> lock(modules.mutex);
+    modules.hostDirectories.push_back(directory);
+}
+
+std::shared_ptr<Module> Modules::import(const std::string& name) {
+    std::string path;
+    {
+        Table& table = ::table();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        if (loadingDirectory != nullptr) path = findIn(*loadingDirectory, name);
+        for (const auto* directories : {&table.hostDirectories, &table.pathDirectories}) {
+            for (size_t i = 0; i < directories->size() && path.empty(); i++) {
+                path = findIn((*directories)[i], name);
+            }
+        }
+    }
+    if (path.empty()) path = findIn(".", name);
+    if (path.empty()) return std::make_shared<Module>(name, "", weak_from_this());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& module = modules[path];
+    if (module == nullptr) module = std::make_shared<Module>(name, path, weak_from_this());
+    return module;
+}
+
+void Modules::clear() {
+    std::unordered_map<std::string, std::shared_ptr<Module>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        dropped.swap(modules);
+    }
+}
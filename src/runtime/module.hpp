@@ -0,0 +1,86 @@
+#pragma once
+#include "environment.hpp"
+#include "value.hpp"
+#include "../lexer/token.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class Interpreter;
+class Modules;
+struct ModuleSource;
+
+// A .fn file bound by `import name`. Importing only finds the file; it is
+// parsed and run the first time one of its members is read, and its
+// globals are then the module's members for as long as the session that
+// imported it lives.
+//
+// Modules always run on the tree-walking interpreter, which both engines
+// call into: their functions run on the caller's interpreter (or VM's
+// interpreter) with the module's globals made current, so a module loaded
+// once serves every engine in its session. Each session has modules of
+// its own; only the parsed tree of a file is shared between them.
+class Module {
+public:
+    Module(std::string name, std::string path, std::weak_ptr<Modules> owner);
+    ~Module();
+
+    const std::string& getName() const { return name; }
+    // Resolved path of the file, empty if none was found on import
+    const std::string& getPath() const { return path; }
+    bool isLoaded() const { return loaded.load(std::memory_order_acquire); }
+
+    // The member name of the module, loading it first if needed. Throws
+    // RuntimeError at name if it can't be loaded or has no such member.
+    Value get(const Token& name);
+
+private:
+    std::string name;
+    std::string path;
+    std::weak_ptr<Modules> owner;
+    std::atomic<bool> loaded{false};
+    // Guarded by the owner's loading lock. A module read again while its
+    // top level runs (a cycle of imports) sees the members defined so far.
+    bool loading = false;
+    std::string failure; // why loading failed, reported on every later read
+    std::shared_ptr<const ModuleSource> source; // functions declared in it point into it
+    std::unique_ptr<Interpreter> interpreter;
+    std::shared_ptr<Environment> members;
+
+    void load(const Token& where);
+};
+
+// The modules one session imported, keyed by resolved path, so every
+// import of a file in the session shares one module. The session's
+// interpreters, its parallel workers and the modules' own interpreters
+// all import through it.
+//
+// `import name` looks for name.fn in the directory of the module being
+// loaded, if any, then in the search directories: those added by the
+// host (the running script's directory), then each of FOCUS_PATH
+// (separated by ':'), then the working directory.
+class Modules : public std::enable_shared_from_this<Modules> {
+public:
+    // For every session in the process
+    static void addSearchDirectory(const std::string& directory);
+
+    // The module import name binds; one that was not found still binds
+    // and fails on its first read
+    std::shared_ptr<Module> import(const std::string& name);
+
+    // Drops every module, ending the cycle through their interpreters,
+    // which import through this table too
+    void clear();
+
+private:
+    friend class Module;
+
+    std::mutex mutex; // guards modules
+    std::unordered_map<std::string, std::shared_ptr<Module>> modules;
+    // Held while any module of the session loads. A single lock, so two
+    // threads loading a cycle of modules from opposite ends can't each
+    // hold one the other needs.
+    std::recursive_mutex loading;
+};
@@ -0,0 +1,250 @@
+#include "native_binding.hpp"
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#ifdef FFI_SUPPORT
+#include <ffi.h>
+#endif
+
+namespace {
+
+// Whether number is a whole number T can hold, checked before converting
+// as converting anything else to T is undefined
+template <typename T>
+bool isInteger(double number) {
+    return number >= static_cast<double>(std::numeric_limits<T>::min()) &&
+           number < static_cast<double>(std::numeric_limits<T>::max()) + 1.0 &&
+           static_cast<double>(static_cast<T>(number)) == number;
+}
+
+template <typename R>
+Value fromNative(R result) {
+    if constexpr (std::is_same_v<R, const char*>) {
+        return Value(std::string(result ? result : ""));
+    } else if constexpr (std::is_same_v<R, bool>) {
+        return Value(result);
+    } else {
+        return Value(static_cast<double>(result));
+    }
+}
+
+template <size_t>
+using DoubleParam = double;
+
+// R f(double, ...) with one double per index
+template <typename R, size_t... I>
+Value callDoubles(void* function, Arguments args, std::index_sequence<I...>) {
+    auto target = reinterpret_cast<R (*)(DoubleParam<I>...)>(function);
+    if constexpr (std::is_void_v<R>) {
+        target(args[I].asNumber()...);
+        return Value();
+    } else {
+        return fromNative(target(args[I].asNumber()...));
+    }
+}
+
+template <typename R, size_t N>
+Value doubleThunk(void* function, Arguments args) {
+    return callDoubles<R>(function, args, std::make_index_sequence<N>());
+}
+
+template <typename R>
+Value stringThunk(void* function, Arguments args) {
+    auto target = reinterpret_cast<R (*)(const char*)>(function);
+    if constexpr (std::is_void_v<R>) {
+        target(args[0].asString().c_str());
+        return Value();
+    } else {
+        return fromNative(target(args[0].asString().c_str()));
+    }
+}
+
+template <typename R>
+NativeBinding::Thunk thunkReturning(const NativeSignature& signature) {
+    bool allDoubles = true;
+    for (int i = 0; i < signature.arity; i++) {
+        allDoubles = allDoubles && signature.params[i] == NativeType::Double;
+    }
+    if (allDoubles) {
+        switch (signature.arity) {
+            case 0: return doubleThunk<R, 0>;
+            case 1: return doubleThunk<R, 1>;
+            case 2: return doubleThunk<R, 2>;
+            case 3: return doubleThunk<R, 3>;
+            case 4: return doubleThunk<R, 4>;
+            case 5: return doubleThunk<R, 5>;
+            case 6: return doubleThunk<R, 6>;
+            default: return nullptr;
+        }
+    }
+    if (signature.arity == 1 && signature.params[0] == NativeType::String) {
+        return stringThunk<R>;
+    }
+    return nullptr;
+}
+
+NativeBinding::Thunk thunkFor(const NativeSignature& signature) {
+    switch (signature.result) {
+        case NativeType::Void: return thunkReturning<void>(signature);
+        case NativeType::Bool: return thunkReturning<bool>(signature);
+        case NativeType::Int: return thunkReturning<int32_t>(signature);
+        case NativeType::Long: return thunkReturning<int64_t>(signature);
+        case NativeType::Double: return thunkReturning<double>(signature);
+        case NativeType::String: return thunkReturning<const char*>(signature);
+    }
+    return nullptr;
+}
+
+} // namespace
+
+// NativeSignature
+
+bool NativeSignature::typeFromName(std::string_view name, NativeType& type) {
+    if (name == "void") type = NativeType::Void;
+    else if (name == "bool") type = NativeType::Bool;
+    else if (name == "int") type = NativeType::Int;
+    else if (name == "long") type = NativeType::Long;
+    else if (name == "double") type = NativeType::Double;
+    else if (name == "string") type = NativeType::String;
+    else return false;
+    return true;
+}
+
+const char* NativeSignature::typeName(NativeType type) {
+    switch (type) {
+        case NativeType::Void: return "void";
+        case NativeType::Bool: return "bool";
+        case NativeType::Int: return "int";
+        case NativeType::Long: return "long";
+        case NativeType::Double: return "double";
+        case NativeType::String: return "string";
+    }
+    return "?";
+}
+
+std::string NativeSignature::toString() const {
+    std::string text = "(";
+    for (int i = 0; i < arity; i++) {
+        if (i > 0) text += ", ";
+        text += typeName(params[i]);
+    }
+    return text + ") -> " + typeName(result);
+}
+
+// NativeBinding
+
+#ifdef FFI_SUPPORT
+struct NativeBinding::FfiCall {
+    ffi_cif cif;
+    ffi_type* argTypes[NativeSignature::kMaxParams];
+
+    static ffi_type* typeOf(NativeType type) {
+        switch (type) {
+            case NativeType::Void: return &ffi_type_void;
+            case NativeType::Bool: return &ffi_type_uint8;
+            case NativeType::Int: return &ffi_type_sint32;
+            case NativeType::Long: return &ffi_type_sint64;
+            case NativeType::Double: return &ffi_type_double;
+            case NativeType::String: return &ffi_type_pointer;
+        }
+        return &ffi_type_void;
+    }
+};
+#else
+struct NativeBinding::FfiCall {};
+#endif
+
+NativeBinding::NativeBinding(std::string name, void* function, const NativeSignature& signature)
+    : name_(std::move(name)), function(function), signature_(signature), thunk(thunkFor(signature)) {
+    if (thunk) return;
+
+#ifdef FFI_SUPPORT
+    ffi = std::make_unique<FfiCall>();
+    for (int i = 0; i < signature.arity; i++) {
+        ffi->argTypes[i] = FfiCall::typeOf(signature.params[i]);
+    }
+    if (ffi_prep_cif(&ffi->cif, FFI_DEFAULT_ABI, signature.arity,
+                     FfiCall::typeOf(signature.result), ffi->argTypes) != FFI_OK) {
+        throw std::runtime_error("Can't prepare a call to '" + name_ + "' with signature " + signature.toString());
+    }
+#else
+    throw std::runtime_error("Calling '" + name_ + "' with signature " + signature.toString() +
+                             " needs a build with FFI_SUPPORT");
+#endif
+}
+
+NativeBinding::~NativeBinding() = default;
+
+void NativeBinding::checkArguments(Arguments args) const {
+    if (args.size() != signature_.arity) {
+        throw std::runtime_error("'" + name_ + "' expects " + std::to_string(signature_.arity) +
+                                 " arguments but got " + std::to_string(args.size()));
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        const Value& arg = args[i];
+        bool fits = false;
+        switch (signature_.params[i]) {
+            case NativeType::Void: break;
+            case NativeType::Bool: fits = arg.isBool(); break;
+            case NativeType::Double: fits = arg.isNumber(); break;
+            case NativeType::Int: fits = arg.isNumber() && isInteger<int32_t>(arg.asNumber()); break;
+            case NativeType::Long: fits = arg.isNumber() && isInteger<int64_t>(arg.asNumber()); break;
+            case NativeType::String: fits = arg.isString(); break;
+        }
+        if (!fits) {
+            throw std::runtime_error("Argument " + std::to_string(i + 1) + " of '" + name_ + "' must be " +
+                                     NativeSignature::typeName(signature_.params[i]) + ", got " +
+                                     (arg.isNumber() ? arg.toString() : arg.getType()));
+        }
+    }
+}
+
+Value NativeBinding::call(Arguments args) const {
+    checkArguments(args);
+    if (thunk) return thunk(function, args);
+
+#ifdef FFI_SUPPORT
+    union Slot {
+        uint8_t b;
+        int32_t i;
+        int64_t l;
+        double d;
+        const char* s;
+    };
+    Slot slots[NativeSignature::kMaxParams];
+    void* pointers[NativeSignature::kMaxParams];
+    for (size_t i = 0; i < args.size(); i++) {
+        switch (signature_.params[i]) {
+            case NativeType::Void: break;
+            case NativeType::Bool: slots[i].b = args[i].asBool(); break;
+            case NativeType::Int: slots[i].i = static_cast<int32_t>(args[i].asNumber()); break;
+            case NativeType::Long: slots[i].l = static_cast<int64_t>(args[i].asNumber()); break;
+            case NativeType::Double: slots[i].d = args[i].asNumber(); break;
+            case NativeType::String: slots[i].s = args[i].asString().c_str(); break;
+        }
+        pointers[i] = &slots[i];
+    }
+
+    // Integer results narrower than a register come back widened to ffi_arg
+    union {
+        ffi_arg word;
+        int64_t l;
+        double d;
+        const char* s;
+    } result;
+    ffi_call(&ffi->cif, FFI_FN(function), &result, pointers);
+
+    switch (signature_.result) {
+        case NativeType::Void: return Value();
+        case NativeType::Bool: return Value(static_cast<uint8_t>(result.word) != 0);
+        case NativeType::Int: return Value(static_cast<double>(static_cast<int32_t>(result.word)));
+        case NativeType::Long: return Value(static_cast<double>(result.l));
+        case NativeType::Double: return Value(result.d);
+        case NativeType::String: return fromNative(result.s);
+    }
+#endif
+    return Value();
+}
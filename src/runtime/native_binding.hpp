@@ -0,0 +1,87 @@
+#pragma once
+#include "arguments.hpp"
+#include "value.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// C types a native function can take or return
+enum class NativeType : uint8_t { Void, Bool, Int, Long, Double, String };
+
+// C signature of a native function, stated once in its extern declaration:
+//   extern "libmath.so" as mathlib { add_numbers(double, double) -> double }
+// Trivially destructible so the parser can keep it in the AST arena.
+struct NativeSignature {
+    static constexpr int kMaxParams = 8;
+
+    NativeType result = NativeType::Void;
+    uint8_t arity = 0;
+    bool declared = false; // false for names listed without a signature
+    NativeType params[kMaxParams] = {};
+
+    // Maps "double", "int", "long", "bool", "string" and "void"
+    static bool typeFromName(std::string_view name, NativeType& type);
+    static const char* typeName(NativeType type);
+
+    // As it would be declared, e.g. "(double, double) -> double"
+    std::string toString() const;
+};
+
+// A native function resolved against its declared signature. Each call
+// converts the arguments straight to their C types and goes through a
+// trampoline chosen when the binding was made: a template thunk for the
+// common all-double and single-string shapes, libffi for the rest.
+class NativeBinding {
+public:
+    // Throws std::runtime_error if no trampoline can call the signature
+    NativeBinding(std::string name, void* function, const NativeSignature& signature);
+    ~NativeBinding();
+    NativeBinding(const NativeBinding&) = delete;
+    NativeBinding& operator=(const NativeBinding&) = delete;
+
+    // Throws std::runtime_error if the arguments don't fit the signature
+    Value call(Arguments args) const;
+
+    const std::string& name() const { return name_; }
+    const NativeSignature& signature() const { return signature_; }
+
+    using Thunk = Value (*)(void* function, Arguments args);
+
+private:
+    struct FfiCall;
+
+    std::string name_;
+    void* function;
+    NativeSignature signature_;
+    Thunk thunk = nullptr;
+    std::unique_ptr<FfiCall> ffi; // used when there is no thunk
+
+    void checkArguments(Arguments args) const;
+};
+
+// Cache for one call_native site: the binding it last resolved to, valid
+// while the library generation it was resolved in is current. Written
+// like a seqlock since threads running the same code share the site.
+class NativeCallSite {
+public:
+    const NativeBinding* lookup(uint64_t currentGeneration) const {
+        if (generation.load(std::memory_order_acquire) != currentGeneration) return nullptr;
+        const NativeBinding* cached = binding.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (generation.load(std::memory_order_relaxed) != currentGeneration) return nullptr;
+        return cached;
+    }
+
+    void store(uint64_t currentGeneration, const NativeBinding* resolved) {
+        generation.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        binding.store(resolved, std::memory_order_relaxed);
+        generation.store(currentGeneration, std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint64_t> generation{0}; // 0 is never current
+    std::atomic<const NativeBinding*> binding{nullptr};
+};
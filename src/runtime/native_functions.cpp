@@ -1,16 +1,32 @@
+#include "native_functions.hpp"
+#include "async.hpp"
+#include "builtin.hpp"
 #include "callable.hpp"
+#include "gc.hpp"
+#include "hash_map.hpp"
+#include "metrics.hpp"
+#include "iterable.hpp"
+#include "parallel.hpp"
+#include "numeric_array.hpp"
+#include "output.hpp"
 #include "../interpreter.hpp"
+#include "../utils/file_utils.hpp"
+#include "../utils/string_utils.hpp"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <chrono>
 
 std::shared_ptr<Callable> createPrintFunction() {
     return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            std::string line;
             for (size_t i = 0; i < arguments.size(); ++i) {
-                if (i > 0) std::cout << " ";
-                std::cout << arguments[i].toString();
+                if (i > 0) line += ' ';
+                arguments[i].appendTo(line);
             }
-            std::cout << std::endl;
+            line += '\n';
+            Output::write(line);
             return {}; // nil
         },
         -1, // variadic
@@ -20,10 +36,12 @@ std::shared_ptr<Callable> createPrintFunction() {
 
 std::shared_ptr<Callable> createInputFunction() {
     return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
             if (!arguments.empty()) {
-                std::cout << arguments[0].toString();
+                Output::write(arguments[0].toString());
             }
+            // The prompt, and whatever was printed before it, shows first
+            Output::flush();
             std::string input;
             std::getline(std::cin, input);
             return Value(input);
@@ -34,42 +52,30 @@ std::shared_ptr<Callable> createInputFunction() {
 }
 
 std::shared_ptr<Callable> createLenFunction() {
-    return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
-            if (arguments.size() != 1) {
-                throw std::runtime_error("len() takes exactly one argument");
-            }
-            
-            const Value& arg = arguments[0];
-            if (arg.isString()) {
-                return Value(static_cast<double>(arg.asString().length()));
-            } else if (arg.isList()) {
-                return Value(static_cast<double>(arg.asList()->size()));
-            } else {
-                throw std::runtime_error("Object of type '" + arg.getType() + "' has no len()");
-            }
-        },
-        1,
-        "len"
-    );
+    return Builtin::bind<double(const Value&)>("len", [](const Value& arg) -> double {
+        if (arg.isString()) {
+            return static_cast<double>(arg.stringLength());
+        } else if (arg.isList()) {
+            return static_cast<double>(arg.asList()->size());
+        } else if (arg.isArray()) {
+            return static_cast<double>(arg.asArray()->size());
+        } else if (arg.isMap()) {
+            return static_cast<double>(arg.asMap()->size());
+        } else if (arg.isIterable() && arg.asIterable()->size() >= 0) {
+            return static_cast<double>(arg.asIterable()->size());
+        } else {
+            throw std::runtime_error("Object of type '" + arg.getType() + "' has no len()");
+        }
+    });
 }
 
 std::shared_ptr<Callable> createStrFunction() {
-    return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
-            if (arguments.size() != 1) {
-                throw std::runtime_error("str() takes exactly one argument");
-            }
-            return Value(arguments[0].toString());
-        },
-        1,
-        "str"
-    );
+    return Builtin::bind<std::string(const Value&)>("str", [](const Value& value) { return value.toString(); });
 }
 
 std::shared_ptr<Callable> createNumFunction() {
     return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
             if (arguments.size() != 1) {
                 throw std::runtime_error("num() takes exactly one argument");
             }
@@ -79,9 +85,9 @@ std::shared_ptr<Callable> createNumFunction() {
                 return arg;
             } else if (arg.isString()) {
                 try {
-                    return Value(std::stod(arg.asString()));
+                    return Value(std::stod(arg.toString()));
                 } catch (const std::exception&) {
-                    throw std::runtime_error("Cannot convert '" + arg.asString() + "' to number");
+                    throw std::runtime_error("Cannot convert '" + arg.toString() + "' to number");
                 }
             } else {
                 throw std::runtime_error("Cannot convert " + arg.getType() + " to number");
@@ -93,34 +99,21 @@ std::shared_ptr<Callable> createNumFunction() {
 }
 
 std::shared_ptr<Callable> createTypeFunction() {
-    return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
-            if (arguments.size() != 1) {
-                throw std::runtime_error("type() takes exactly one argument");
-            }
-            return Value(arguments[0].getType());
-        },
-        1,
-        "type"
-    );
+    return Builtin::bind<std::string(const Value&)>("type", [](const Value& value) { return value.getType(); });
 }
 
 std::shared_ptr<Callable> createClockFunction() {
-    return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, const std::vector<Value>& arguments) -> Value {
-            auto now = std::chrono::high_resolution_clock::now();
-            auto duration = now.time_since_epoch();
-            auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-            return Value(static_cast<double>(millis) / 1000.0);
-        },
-        0,
-        "clock"
-    );
+    return Builtin::bind<double()>("clock", [] {
+        auto now = std::chrono::high_resolution_clock::now();
+        auto duration = now.time_since_epoch();
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+        return static_cast<double>(millis) / 1000.0;
+    });
 }
 
 std::shared_ptr<Callable> createRangeFunction() {
     return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
             if (arguments.size() < 1 || arguments.size() > 3) {
                 throw std::runtime_error("range() takes 1 to 3 arguments");
             }
@@ -138,12 +131,8 @@ std::shared_ptr<Callable> createRangeFunction() {
                 step = arguments[2].asNumber();
             }
             
-            auto list = std::make_shared<std::vector<Value>>();
-            for (double i = start; (step > 0 ? i < stop : i > stop); i += step) {
-                list->push_back(Value(i));
-            }
-            
-            return Value(list);
+            // Lazy: elements are produced as the range is iterated
+            return Value(std::static_pointer_cast<Iterable>(std::make_shared<RangeIterable>(start, stop, step)));
         },
         -1,
         "range"
@@ -152,22 +141,46 @@ std::shared_ptr<Callable> createRangeFunction() {
 
 std::shared_ptr<Callable> createMapFunction() {
     return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
             if (arguments.size() != 2) {
                 throw std::runtime_error("map() takes exactly 2 arguments");
             }
             
-            if (!arguments[0].isCallable() || !arguments[1].isList()) {
-                throw std::runtime_error("map() requires a function and a list");
+            if (!arguments[0].isCallable() ||
+                !(arguments[1].isList() || arguments[1].isArray() || arguments[1].isIterable())) {
+                throw std::runtime_error("map() requires a function and a list, array or iterable");
+            }
+            
+            // Lazy sources stay lazy, so chained calls never build a list
+            if (arguments[1].isIterable()) {
+                return Value(std::static_pointer_cast<Iterable>(
+                    std::make_shared<MapIterable>(arguments[0].asCallable(), arguments[1].asIterable())));
+            }
+            
+            const auto& func = arguments[0].asCallable();
+            
+            // Arrays map to arrays, so the function must return numbers
+            if (arguments[1].isArray()) {
+                const auto& array = arguments[1].asArray();
+                auto result = std::make_shared<std::vector<double>>();
+                result->reserve(array->size());
+                for (double element : *array) {
+                    Value item(element);
+                    Value mapped = func->call(interpreter, Arguments(&item, 1));
+                    if (!mapped.isNumber()) {
+                        throw std::runtime_error("map() over an array must return numbers, got " + mapped.getType());
+                    }
+                    result->push_back(mapped.asNumber());
+                }
+                return Value(result);
             }
             
-            auto func = arguments[0].asCallable();
-            auto list = arguments[1].asList();
+            const auto& list = arguments[1].asList();
             auto result = std::make_shared<std::vector<Value>>();
+            result->reserve(list->size());
             
             for (const auto& item : *list) {
-                std::vector<Value> args = {item};
-                result->push_back(func->call(interpreter, args));
+                result->push_back(func->call(interpreter, Arguments(&item, 1)));
             }
             
             return Value(result);
@@ -179,22 +192,26 @@ std::shared_ptr<Callable> createMapFunction() {
 
 std::shared_ptr<Callable> createFilterFunction() {
     return std::make_shared<NativeFunction>(
-        [](Interpreter& interpreter, std::vector<Value> arguments) -> Value {
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
             if (arguments.size() != 2) {
                 throw std::runtime_error("filter() takes exactly 2 arguments");
             }
             
-            if (!arguments[0].isCallable() || !arguments[1].isList()) {
-                throw std::runtime_error("filter() requires a function and a list");
+            if (!arguments[0].isCallable() || !(arguments[1].isList() || arguments[1].isIterable())) {
+                throw std::runtime_error("filter() requires a function and a list or iterable");
+            }
+            
+            if (arguments[1].isIterable()) {
+                return Value(std::static_pointer_cast<Iterable>(
+                    std::make_shared<FilterIterable>(arguments[0].asCallable(), arguments[1].asIterable())));
             }
             
-            auto func = arguments[0].asCallable();
-            auto list = arguments[1].asList();
+            const auto& func = arguments[0].asCallable();
+            const auto& list = arguments[1].asList();
             auto result = std::make_shared<std::vector<Value>>();
             
             for (const auto& item : *list) {
-                std::vector<Value> args = {item};
-                if (func->call(interpreter, args).isTruthy()) {
+                if (func->call(interpreter, Arguments(&item, 1)).isTruthy()) {
                     result->push_back(item);
                 }
             }
@@ -204,4 +221,873 @@ std::shared_ptr<Callable> createFilterFunction() {
         2,
         "filter"
     );
-}
\ No newline at end of file
+}
+
+std::shared_ptr<Callable> createListFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            auto iterator = makeIterator(arguments[0]);
+            if (iterator == nullptr) {
+                throw std::runtime_error("Object of type '" + arguments[0].getType() + "' is not iterable");
+            }
+            
+            auto list = std::make_shared<std::vector<Value>>();
+            Value item;
+            while (iterator->next(interpreter, item)) {
+                list->push_back(std::move(item));
+            }
+            return Value(list);
+        },
+        1,
+        "list"
+    );
+}
+
+namespace {
+
+// Elements of a list, or of an iterable run to completion
+std::shared_ptr<std::vector<Value>> collectElements(Interpreter& interpreter, const Value& source) {
+    if (source.isList()) return source.asList();
+
+    auto elements = std::make_shared<std::vector<Value>>();
+    auto iterator = makeIterator(source);
+    Value item;
+    while (iterator->next(interpreter, item)) {
+        elements->push_back(std::move(item));
+    }
+    return elements;
+}
+
+void checkParallelArguments(Arguments arguments, const std::string& name, int functionArity) {
+    if (!arguments[0].isCallable() ||
+        !(arguments[1].isList() || arguments[1].isArray() || arguments[1].isIterable())) {
+        throw std::runtime_error(name + "() requires a function and a list, array or iterable");
+    }
+    int arity = arguments[0].asCallable()->arity();
+    if (arity >= 0 && arity != functionArity) {
+        throw std::runtime_error(name + "() requires a function taking " + std::to_string(functionArity) +
+                                 (functionArity == 1 ? " argument" : " arguments"));
+    }
+}
+
+// Splits [0, count) into chunks and calls body(interpreter, begin, end)
+// for each one on the thread pool, every chunk with its own worker
+// interpreter, so the same purity rules apply however many cores there
+// are. Callables that can't leave the calling thread (VM closures) run
+// as one chunk on the caller's interpreter instead.
+void forEachChunk(Interpreter& interpreter, Callable& function, size_t count,
+                  const std::function<void(Interpreter&, size_t, size_t)>& body) {
+    if (count == 0) return;
+    ThreadPool& pool = ThreadPool::instance();
+    if (!function.isThreadSafe()) {
+        body(interpreter, 0, count);
+        return;
+    }
+
+    // A few chunks per thread, so stealing can even out uneven elements
+    size_t chunkSize = std::max<size_t>(1, count / (pool.concurrency() * 4));
+    size_t chunks = (count + chunkSize - 1) / chunkSize;
+    pool.run(chunks, [&](size_t chunk) {
+        ParallelTaskScope task;
+        auto worker = interpreter.createWorker();
+        size_t begin = chunk * chunkSize;
+        body(*worker, begin, std::min(count, begin + chunkSize));
+    });
+}
+
+} // namespace
+
+std::shared_ptr<Callable> createPmapFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            checkParallelArguments(arguments, "pmap", 1);
+            
+            auto& func = *arguments[0].asCallable();
+            auto items = collectElements(interpreter, arguments[1]);
+            auto result = std::make_shared<std::vector<Value>>(items->size());
+            
+            forEachChunk(interpreter, func, items->size(), [&](Interpreter& worker, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    (*result)[i] = func.call(worker, Arguments(&(*items)[i], 1));
+                }
+            });
+            
+            return Value(result);
+        },
+        2,
+        "pmap"
+    );
+}
+
+std::shared_ptr<Callable> createPfilterFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            checkParallelArguments(arguments, "pfilter", 1);
+            
+            auto& func = *arguments[0].asCallable();
+            auto items = collectElements(interpreter, arguments[1]);
+            std::vector<char> keep(items->size());
+            
+            forEachChunk(interpreter, func, items->size(), [&](Interpreter& worker, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    keep[i] = func.call(worker, Arguments(&(*items)[i], 1)).isTruthy();
+                }
+            });
+            
+            auto result = std::make_shared<std::vector<Value>>();
+            for (size_t i = 0; i < items->size(); i++) {
+                if (keep[i]) result->push_back((*items)[i]);
+            }
+            return Value(result);
+        },
+        2,
+        "pfilter"
+    );
+}
+
+std::shared_ptr<Callable> createPreduceFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            checkParallelArguments(arguments, "preduce", 2);
+            
+            auto& func = *arguments[0].asCallable();
+            auto items = collectElements(interpreter, arguments[1]);
+            
+            // Each chunk is folded on its own, starting from its first
+            // element; the partial results are then folded in order onto
+            // the initial value. That only matches a left fold when func
+            // is associative.
+            std::vector<Value> partials(items->size());
+            std::vector<char> hasPartial(items->size());
+            forEachChunk(interpreter, func, items->size(), [&](Interpreter& worker, size_t begin, size_t end) {
+                Value pair[2] = {(*items)[begin], Value()};
+                for (size_t i = begin + 1; i < end; i++) {
+                    pair[1] = (*items)[i];
+                    pair[0] = func.call(worker, Arguments(pair, 2));
+                }
+                partials[begin] = pair[0];
+                hasPartial[begin] = 1;
+            });
+            
+            Value pair[2] = {arguments[2], Value()};
+            for (size_t i = 0; i < items->size(); i++) {
+                if (!hasPartial[i]) continue;
+                pair[1] = partials[i];
+                pair[0] = func.call(interpreter, Arguments(pair, 2));
+            }
+            return pair[0];
+        },
+        3,
+        "preduce"
+    );
+}
+
+namespace {
+
+// The numbers of an array as they are, or of a list or iterable copied
+// into storage
+const std::vector<double>& numbersOf(Interpreter& interpreter, const Value& source, const std::string& name,
+                                     std::vector<double>& storage) {
+    if (source.isArray()) return *source.asArray();
+
+    auto iterator = source.isNumber() ? nullptr : makeIterator(source);
+    if (iterator == nullptr) {
+        throw std::runtime_error(name + "() requires an array or a list of numbers, got " + source.getType());
+    }
+    if (source.isList()) storage.reserve(source.asList()->size());
+    Value item;
+    while (iterator->next(interpreter, item)) {
+        if (!item.isNumber()) {
+            throw std::runtime_error(name + "() requires numbers, got " + item.getType());
+        }
+        storage.push_back(item.asNumber());
+    }
+    return storage;
+}
+
+// min() and max(): of one array or list, or of several numbers
+Value extremum(Interpreter& interpreter, Arguments arguments, const std::string& name,
+               double (*reduce)(const double*, size_t)) {
+    std::vector<double> storage;
+    if (arguments.size() == 1) {
+        const std::vector<double>& numbers = numbersOf(interpreter, arguments[0], name, storage);
+        if (numbers.empty()) {
+            throw std::runtime_error(name + "() of an empty sequence");
+        }
+        return Value(reduce(numbers.data(), numbers.size()));
+    }
+    if (arguments.empty()) {
+        throw std::runtime_error(name + "() takes an array or at least two numbers");
+    }
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (!arguments[i].isNumber()) {
+            throw std::runtime_error(name + "() requires numbers, got " + arguments[i].getType());
+        }
+        storage.push_back(arguments[i].asNumber());
+    }
+    return Value(reduce(storage.data(), storage.size()));
+}
+
+} // namespace
+
+std::shared_ptr<Callable> createArrayFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (arguments.empty() || arguments.size() > 2) {
+                throw std::runtime_error("array() takes 1 or 2 arguments");
+            }
+            
+            // array(count) or array(count, fill)
+            if (arguments[0].isNumber()) {
+                double count = arguments[0].asNumber();
+                if (count < 0 || count != static_cast<double>(static_cast<size_t>(count))) {
+                    throw std::runtime_error("array() size must be a non-negative integer");
+                }
+                double fill = 0;
+                if (arguments.size() == 2) {
+                    if (!arguments[1].isNumber()) {
+                        throw std::runtime_error("array() fill value must be a number");
+                    }
+                    fill = arguments[1].asNumber();
+                }
+                return Value(std::make_shared<std::vector<double>>(static_cast<size_t>(count), fill));
+            }
+            
+            if (arguments.size() != 1) {
+                throw std::runtime_error("array() takes a size and a fill value, or one sequence");
+            }
+            // Arrays are immutable, so one can stand for its copy
+            if (arguments[0].isArray()) return arguments[0];
+            
+            auto array = std::make_shared<std::vector<double>>();
+            numbersOf(interpreter, arguments[0], "array", *array);
+            return Value(array);
+        },
+        -1,
+        "array"
+    );
+}
+
+std::shared_ptr<Callable> createSumFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            std::vector<double> storage;
+            const std::vector<double>& numbers = numbersOf(interpreter, arguments[0], "sum", storage);
+            return Value(arraySum(numbers.data(), numbers.size()));
+        },
+        1,
+        "sum"
+    );
+}
+
+std::shared_ptr<Callable> createMeanFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            std::vector<double> storage;
+            const std::vector<double>& numbers = numbersOf(interpreter, arguments[0], "mean", storage);
+            if (numbers.empty()) {
+                throw std::runtime_error("mean() of an empty sequence");
+            }
+            return Value(arraySum(numbers.data(), numbers.size()) / static_cast<double>(numbers.size()));
+        },
+        1,
+        "mean"
+    );
+}
+
+std::shared_ptr<Callable> createDotFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            std::vector<double> leftStorage;
+            std::vector<double> rightStorage;
+            const std::vector<double>& left = numbersOf(interpreter, arguments[0], "dot", leftStorage);
+            const std::vector<double>& right = numbersOf(interpreter, arguments[1], "dot", rightStorage);
+            if (left.size() != right.size()) {
+                throw std::runtime_error("dot() requires sequences of the same length, got " +
+                                         std::to_string(left.size()) + " and " + std::to_string(right.size()));
+            }
+            return Value(arrayDot(left.data(), right.data(), left.size()));
+        },
+        2,
+        "dot"
+    );
+}
+
+std::shared_ptr<Callable> createMinFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return extremum(interpreter, arguments, "min", arrayMin);
+        },
+        -1,
+        "min"
+    );
+}
+
+std::shared_ptr<Callable> createMaxFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return extremum(interpreter, arguments, "max", arrayMax);
+        },
+        -1,
+        "max"
+    );
+}
+
+namespace {
+
+const std::shared_ptr<FocusMap>& mapArgument(const Value& value, const std::string& name) {
+    if (!value.isMap()) {
+        throw std::runtime_error(name + "() requires a map, got " + value.getType());
+    }
+    return value.asMap();
+}
+
+// Keys or values of a map as a list, in insertion order
+Value mapColumn(const Value& value, const std::string& name, bool keys) {
+    const auto& map = mapArgument(value, name);
+    auto list = std::make_shared<std::vector<Value>>();
+    list->reserve(map->size());
+    for (const auto& entry : map->entries()) {
+        if (!entry.erased) list->push_back(keys ? entry.key : entry.value);
+    }
+    return Value(list);
+}
+
+} // namespace
+
+std::shared_ptr<Callable> createKeysFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return mapColumn(arguments[0], "keys", true);
+        },
+        1,
+        "keys"
+    );
+}
+
+std::shared_ptr<Callable> createValuesFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return mapColumn(arguments[0], "values", false);
+        },
+        1,
+        "values"
+    );
+}
+
+std::shared_ptr<Callable> createHasFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return Value(mapArgument(arguments[0], "has")->find(arguments[1]) != nullptr);
+        },
+        2,
+        "has"
+    );
+}
+
+std::shared_ptr<Callable> createGetFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (arguments.size() < 2 || arguments.size() > 3) {
+                throw std::runtime_error("get() takes a map, a key and an optional default");
+            }
+            // get(map, key, default): default (or nil) when key is absent
+            const Value* value = mapArgument(arguments[0], "get")->find(arguments[1]);
+            if (value != nullptr) return *value;
+            return arguments.size() == 3 ? arguments[2] : Value();
+        },
+        -1,
+        "get"
+    );
+}
+
+std::shared_ptr<Callable> createRemoveFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            const auto& map = mapArgument(arguments[0], "remove");
+            uint64_t task = currentParallelTask();
+            if (task != 0 && map->ownerTask() != task) {
+                throw std::runtime_error("Parallel callables can only change maps they created");
+            }
+            // The removed value, or nil if the key was absent
+            Value removed;
+            map->erase(arguments[1], &removed);
+            return removed;
+        },
+        2,
+        "remove"
+    );
+}
+
+std::shared_ptr<Callable> createGcFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            // Parallel tasks share the heap of the thread that started them
+            if (currentParallelTask() != 0) return Value(0.0);
+            // The number of objects freed
+            return Value(static_cast<double>(Heap::local().collect()));
+        },
+        0,
+        "gc"
+    );
+}
+
+std::shared_ptr<Callable> createGcStatsFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            GcStats stats = Heap::local().stats();
+            auto map = std::make_shared<FocusMap>(7);
+            map->set(Value("collections"), Value(static_cast<double>(stats.collections)));
+            map->set(Value("freed"), Value(static_cast<double>(stats.freed)));
+            map->set(Value("tracked"), Value(static_cast<double>(stats.tracked)));
+            map->set(Value("threshold"), Value(static_cast<double>(stats.threshold)));
+            map->set(Value("last_pause_ms"), Value(stats.lastPauseMs));
+            map->set(Value("max_pause_ms"), Value(stats.maxPauseMs));
+            map->set(Value("total_pause_ms"), Value(stats.totalPauseMs));
+            return Value(std::move(map));
+        },
+        0,
+        "gc_stats"
+    );
+}
+
+std::shared_ptr<Callable> createStatsFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            Metrics::Snapshot snapshot = Metrics::snapshot();
+            auto map = std::make_shared<FocusMap>(Metrics::kCounters + 3);
+            for (size_t i = 0; i < Metrics::kCounters; i++) {
+                map->set(Value(Metrics::counterName(static_cast<Metrics::Counter>(i))),
+                         Value(static_cast<double>(snapshot.counters[i])));
+            }
+            map->set(Value("uptime_ms"), Value(snapshot.uptimeMs));
+
+            auto allocations = std::make_shared<FocusMap>(Metrics::kKinds);
+            for (size_t i = 0; i < Metrics::kKinds; i++) {
+                allocations->set(Value(Metrics::kindName(i)), Value(static_cast<double>(snapshot.allocations[i])));
+            }
+            map->set(Value("allocations"), Value(std::move(allocations)));
+
+            // Latencies by alias, once timing is on
+            auto libraries = std::make_shared<FocusMap>(snapshot.libraries.size());
+            for (const auto& entry : snapshot.libraries) {
+                const Metrics::Histogram& histogram = entry.second;
+                auto latency = std::make_shared<FocusMap>(5);
+                latency->set(Value("calls"), Value(static_cast<double>(histogram.calls)));
+                latency->set(Value("mean_us"), Value(histogram.calls == 0 ? 0.0 : histogram.totalNs / 1000.0 / histogram.calls));
+                latency->set(Value("p50_us"), Value(histogram.quantileUs(0.5)));
+                latency->set(Value("p99_us"), Value(histogram.quantileUs(0.99)));
+                latency->set(Value("max_us"), Value(histogram.maxNs / 1000.0));
+                libraries->set(Value(entry.first), Value(std::move(latency)));
+            }
+            map->set(Value("libraries"), Value(std::move(libraries)));
+            return Value(std::move(map));
+        },
+        0,
+        "stats"
+    );
+}
+
+namespace {
+
+const std::string& stringArgument(const Value& value, const std::string& name) {
+    if (!value.isString()) {
+        throw std::runtime_error(name + "() requires a string, got " + value.getType());
+    }
+    return value.asString();
+}
+
+// Unlike stringArgument, leaves a slice as it is
+std::string_view textArgument(const Value& value, const std::string& name) {
+    if (!value.isString()) {
+        throw std::runtime_error(name + "() requires a string, got " + value.getType());
+    }
+    return value.stringView();
+}
+
+// The part of string that view, which points into its text, covers
+Value sliceOf(const Value& string, std::string_view text, std::string_view view) {
+    return Value::slice(string, static_cast<size_t>(view.data() - text.data()), view.size());
+}
+
+int integerArgument(const Value& value, const std::string& name, const std::string& what) {
+    if (!value.isNumber() || value.asNumber() != std::floor(value.asNumber())) {
+        throw std::runtime_error(name + "() requires " + what + ", got " + value.toString());
+    }
+    return static_cast<int>(value.asNumber());
+}
+
+int socketArgument(const Value& value, const std::string& name) {
+    return integerArgument(value, name, "a socket");
+}
+
+} // namespace
+
+std::shared_ptr<Callable> createWriteFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            // write(fd, ...): the values as print() shows them, with
+            // nothing between or after them; returns the bytes written
+            if (arguments.empty()) throw std::runtime_error("write() requires a file descriptor");
+            int fd = integerArgument(arguments[0], "write", "a file descriptor");
+            std::string text;
+            for (size_t i = 1; i < arguments.size(); ++i) {
+                arguments[i].appendTo(text);
+            }
+            Output::write(fd, text);
+            return Value(static_cast<double>(text.size()));
+        },
+        -1, // the descriptor and any number of values
+        "write"
+    );
+}
+
+std::shared_ptr<Callable> createSleepFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (!arguments[0].isNumber()) {
+                throw std::runtime_error("sleep() requires milliseconds, got " + arguments[0].getType());
+            }
+            // A future: await it to wait without blocking other tasks
+            return Value(EventLoop::local().sleep(arguments[0].asNumber()));
+        },
+        1,
+        "sleep"
+    );
+}
+
+std::shared_ptr<Callable> createGatherFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (!arguments[0].isList()) {
+                throw std::runtime_error("gather() requires a list, got " + arguments[0].getType());
+            }
+            return Value(EventLoop::local().gather(*arguments[0].asList()));
+        },
+        1,
+        "gather"
+    );
+}
+
+std::shared_ptr<Callable> createWaitAllFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (!arguments[0].isList()) {
+                throw std::runtime_error("wait_all() requires a list, got " + arguments[0].getType());
+            }
+            // await gather(...) for code that isn't async: blocks until
+            // every future is done, running the loop meanwhile, and a
+            // failure is a RuntimeError a try can catch, as with await
+            EventLoop& loop = EventLoop::local();
+            return loop.await(Value(loop.gather(*arguments[0].asList())),
+                              Token(TokenType::IDENTIFIER, "wait_all", "", 0, 0));
+        },
+        1,
+        "wait_all"
+    );
+}
+
+std::shared_ptr<Callable> createReadFileFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return Value(AsyncIo::readFile(stringArgument(arguments[0], "read_file")));
+        },
+        1,
+        "read_file"
+    );
+}
+
+std::shared_ptr<Callable> createWriteFileFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            const std::string& path = stringArgument(arguments[0], "write_file");
+            return Value(AsyncIo::writeFile(path, arguments[1].toString()));
+        },
+        2,
+        "write_file"
+    );
+}
+
+std::shared_ptr<Callable> createTcpListenFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            // tcp_listen(host, port): port 0 picks a free one, see socket_port()
+            const std::string& host = stringArgument(arguments[0], "tcp_listen");
+            int port = integerArgument(arguments[1], "tcp_listen", "a port");
+            return Value(static_cast<double>(AsyncIo::listen(host, port)));
+        },
+        2,
+        "tcp_listen"
+    );
+}
+
+std::shared_ptr<Callable> createTcpAcceptFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return Value(AsyncIo::accept(socketArgument(arguments[0], "tcp_accept")));
+        },
+        1,
+        "tcp_accept"
+    );
+}
+
+std::shared_ptr<Callable> createTcpConnectFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            const std::string& host = stringArgument(arguments[0], "tcp_connect");
+            int port = integerArgument(arguments[1], "tcp_connect", "a port");
+            return Value(AsyncIo::connect(host, port));
+        },
+        2,
+        "tcp_connect"
+    );
+}
+
+std::shared_ptr<Callable> createSocketPortFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            return Value(static_cast<double>(AsyncIo::localPort(socketArgument(arguments[0], "socket_port"))));
+        },
+        1,
+        "socket_port"
+    );
+}
+
+std::shared_ptr<Callable> createSocketReadFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (arguments.empty() || arguments.size() > 2) {
+                throw std::runtime_error("socket_read() takes a socket and an optional byte count");
+            }
+            // socket_read(socket, max): "" once the peer has closed
+            int socket = socketArgument(arguments[0], "socket_read");
+            int max = arguments.size() == 2 ? integerArgument(arguments[1], "socket_read", "a byte count") : 65536;
+            if (max <= 0) throw std::runtime_error("socket_read() requires a positive byte count");
+            return Value(AsyncIo::read(socket, static_cast<size_t>(max)));
+        },
+        -1,
+        "socket_read"
+    );
+}
+
+std::shared_ptr<Callable> createSocketWriteFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            int socket = socketArgument(arguments[0], "socket_write");
+            return Value(AsyncIo::write(socket, arguments[1].toString()));
+        },
+        2,
+        "socket_write"
+    );
+}
+
+std::shared_ptr<Callable> createSocketCloseFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            AsyncIo::close(socketArgument(arguments[0], "socket_close"));
+            return {};
+        },
+        1,
+        "socket_close"
+    );
+}
+
+std::shared_ptr<Callable> createLinesFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            const std::string& path = stringArgument(arguments[0], "lines");
+            if (!FileUtils::fileExists(path)) {
+                throw std::runtime_error("lines() could not open " + path);
+            }
+            return Value(std::shared_ptr<Iterable>(std::make_shared<LinesIterable>(path)));
+        },
+        1,
+        "lines"
+    );
+}
+
+std::shared_ptr<Callable> createSplitFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (arguments.empty() || arguments.size() > 2) {
+                throw std::runtime_error("split() takes a string and an optional separator");
+            }
+            // split(text, separator), or on runs of whitespace without one
+            std::string_view text = textArgument(arguments[0], "split");
+            std::vector<std::string_view> parts;
+            if (arguments.size() == 2) {
+                std::string_view separator = textArgument(arguments[1], "split");
+                if (separator.empty()) throw std::runtime_error("split() requires a non-empty separator");
+                parts = StringUtils::split(text, separator);
+            } else {
+                parts = StringUtils::splitWhitespace(text);
+            }
+            auto list = std::make_shared<std::vector<Value>>();
+            list->reserve(parts.size());
+            for (std::string_view part : parts) list->push_back(sliceOf(arguments[0], text, part));
+            return Value(std::move(list));
+        },
+        -1,
+        "split"
+    );
+}
+
+std::shared_ptr<Callable> createJoinFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (!arguments[0].isList()) {
+                throw std::runtime_error("join() requires a list, got " + arguments[0].getType());
+            }
+            std::string_view separator = textArgument(arguments[1], "join");
+            std::string text;
+            const auto& list = *arguments[0].asList();
+            for (size_t i = 0; i < list.size(); ++i) {
+                if (i > 0) text += separator;
+                list[i].appendTo(text);
+            }
+            return Value(std::move(text));
+        },
+        2,
+        "join"
+    );
+}
+
+std::shared_ptr<Callable> createTrimFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            std::string_view text = textArgument(arguments[0], "trim");
+            return sliceOf(arguments[0], text, StringUtils::trim(text));
+        },
+        1,
+        "trim"
+    );
+}
+
+std::shared_ptr<Callable> createStartsWithFunction() {
+    return Builtin::bind<bool(std::string_view, std::string_view)>("starts_with", StringUtils::startsWith);
+}
+
+std::shared_ptr<Callable> createEndsWithFunction() {
+    return Builtin::bind<bool(std::string_view, std::string_view)>("ends_with", StringUtils::endsWith);
+}
+
+std::shared_ptr<Callable> createFindFunction() {
+    // find(text, part): where part first starts, -1 if nowhere
+    return Builtin::bind<double(std::string_view, std::string_view)>(
+        "find", [](std::string_view text, std::string_view part) {
+            size_t index = text.find(part);
+            return index == std::string_view::npos ? -1.0 : static_cast<double>(index);
+        });
+}
+
+std::shared_ptr<Callable> createSubstringFunction() {
+    return std::make_shared<NativeFunction>(
+        [](Interpreter& interpreter, Arguments arguments) -> Value {
+            if (arguments.size() < 2 || arguments.size() > 3) {
+                throw std::runtime_error("substring() takes a string, a start and an optional end");
+            }
+            // substring(text, start, end): end is exclusive and defaults to the end
+            std::string_view text = textArgument(arguments[0], "substring");
+            int start = integerArgument(arguments[1], "substring", "an index");
+            int end = arguments.size() == 3 ? integerArgument(arguments[2], "substring", "an index")
+                                            : static_cast<int>(text.size());
+            if (start < 0 || end < start || static_cast<size_t>(end) > text.size()) {
+                throw std::runtime_error("substring() range out of bounds");
+            }
+            return Value::slice(arguments[0], static_cast<size_t>(start), static_cast<size_t>(end - start));
+        },
+        -1,
+        "substring"
+    );
+}
+
+std::shared_ptr<Callable> createLowerFunction() {
+    return Builtin::bind<std::string(std::string_view)>("lower", StringUtils::toLower);
+}
+
+std::shared_ptr<Callable> createUpperFunction() {
+    return Builtin::bind<std::string(std::string_view)>("upper", StringUtils::toUpper);
+}
+
+std::shared_ptr<Callable> createReplaceFunction() {
+    return Builtin::bind<std::string(std::string_view, std::string_view, std::string_view)>(
+        "replace", StringUtils::replace);
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<Callable>>> createMathFunctions() {
+    return {
+        {"sqrt", Builtin::bind<double(double)>("sqrt", std::sqrt)},
+        {"abs", Builtin::bind<double(double)>("abs", std::fabs)},
+        {"floor", Builtin::bind<double(double)>("floor", std::floor)},
+        {"ceil", Builtin::bind<double(double)>("ceil", std::ceil)},
+        {"round", Builtin::bind<double(double)>("round", std::round)},
+        {"exp", Builtin::bind<double(double)>("exp", std::exp)},
+        {"log", Builtin::bind<double(double)>("log", std::log)},
+        {"sin", Builtin::bind<double(double)>("sin", std::sin)},
+        {"cos", Builtin::bind<double(double)>("cos", std::cos)},
+        {"tan", Builtin::bind<double(double)>("tan", std::tan)},
+        {"pow", Builtin::bind<double(double, double)>("pow", std::pow)},
+        {"atan2", Builtin::bind<double(double, double)>("atan2", std::atan2)},
+        {"hypot", Builtin::bind<double(double, double)>("hypot", std::hypot)},
+    };
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<Callable>>> createNativeFunctions() {
+    std::vector<std::pair<std::string, std::shared_ptr<Callable>>> functions = {
+        {"print", createPrintFunction()},
+        {"input", createInputFunction()},
+        {"write", createWriteFunction()},
+        {"len", createLenFunction()},
+        {"str", createStrFunction()},
+        {"num", createNumFunction()},
+        {"type", createTypeFunction()},
+        {"clock", createClockFunction()},
+        {"range", createRangeFunction()},
+        {"map", createMapFunction()},
+        {"filter", createFilterFunction()},
+        {"list", createListFunction()},
+        {"pmap", createPmapFunction()},
+        {"pfilter", createPfilterFunction()},
+        {"preduce", createPreduceFunction()},
+        {"array", createArrayFunction()},
+        {"sum", createSumFunction()},
+        {"mean", createMeanFunction()},
+        {"dot", createDotFunction()},
+        {"min", createMinFunction()},
+        {"max", createMaxFunction()},
+        {"keys", createKeysFunction()},
+        {"values", createValuesFunction()},
+        {"has", createHasFunction()},
+        {"get", createGetFunction()},
+        {"remove", createRemoveFunction()},
+        {"gc", createGcFunction()},
+        {"gc_stats", createGcStatsFunction()},
+        {"stats", createStatsFunction()},
+        {"sleep", createSleepFunction()},
+        {"gather", createGatherFunction()},
+        {"wait_all", createWaitAllFunction()},
+        {"read_file", createReadFileFunction()},
+        {"write_file", createWriteFileFunction()},
+        {"tcp_listen", createTcpListenFunction()},
+        {"tcp_accept", createTcpAcceptFunction()},
+        {"tcp_connect", createTcpConnectFunction()},
+        {"socket_port", createSocketPortFunction()},
+        {"socket_read", createSocketReadFunction()},
+        {"socket_write", createSocketWriteFunction()},
+        {"socket_close", createSocketCloseFunction()},
+        {"lines", createLinesFunction()},
+        {"split", createSplitFunction()},
+        {"join", createJoinFunction()},
+        {"trim", createTrimFunction()},
+        {"starts_with", createStartsWithFunction()},
+        {"ends_with", createEndsWithFunction()},
+        {"find", createFindFunction()},
+        {"substring", createSubstringFunction()},
+        {"lower", createLowerFunction()},
+        {"upper", createUpperFunction()},
+        {"replace", createReplaceFunction()},
+    };
+    auto math = createMathFunctions();
+    functions.insert(functions.end(), math.begin(), math.end());
+    return functions;
+}
@@ -2,6 +2,9 @@
 
 #include "callable.hpp"
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 // Forward declaration
 class Interpreter;
@@ -9,6 +12,8 @@ class Interpreter;
 // Function declarations for creating native functions
 std::shared_ptr<Callable> createPrintFunction();
 std::shared_ptr<Callable> createInputFunction();
+// write(fd, ...) for bulk output, see output.hpp
+std::shared_ptr<Callable> createWriteFunction();
 std::shared_ptr<Callable> createLenFunction();
 std::shared_ptr<Callable> createStrFunction();
 std::shared_ptr<Callable> createNumFunction();
@@ -16,4 +21,57 @@ std::shared_ptr<Callable> createTypeFunction();
 std::shared_ptr<Callable> createClockFunction();
 std::shared_ptr<Callable> createRangeFunction();
 std::shared_ptr<Callable> createMapFunction();
-std::shared_ptr<Callable> createFilterFunction();
\ No newline at end of file
+std::shared_ptr<Callable> createFilterFunction();
+std::shared_ptr<Callable> createListFunction();
+std::shared_ptr<Callable> createPmapFunction();
+std::shared_ptr<Callable> createPfilterFunction();
+std::shared_ptr<Callable> createPreduceFunction();
+std::shared_ptr<Callable> createArrayFunction();
+std::shared_ptr<Callable> createSumFunction();
+std::shared_ptr<Callable> createMeanFunction();
+std::shared_ptr<Callable> createDotFunction();
+std::shared_ptr<Callable> createMinFunction();
+std::shared_ptr<Callable> createMaxFunction();
+std::shared_ptr<Callable> createKeysFunction();
+std::shared_ptr<Callable> createValuesFunction();
+std::shared_ptr<Callable> createHasFunction();
+std::shared_ptr<Callable> createGetFunction();
+std::shared_ptr<Callable> createRemoveFunction();
+std::shared_ptr<Callable> createGcFunction();
+std::shared_ptr<Callable> createGcStatsFunction();
+// Counters and library latencies, see metrics.hpp
+std::shared_ptr<Callable> createStatsFunction();
+// Timers, files and sockets for async functions, see async.hpp
+std::shared_ptr<Callable> createSleepFunction();
+std::shared_ptr<Callable> createGatherFunction();
+// Results of a list of futures, such as spawned library calls
+std::shared_ptr<Callable> createWaitAllFunction();
+std::shared_ptr<Callable> createReadFileFunction();
+std::shared_ptr<Callable> createWriteFileFunction();
+std::shared_ptr<Callable> createTcpListenFunction();
+std::shared_ptr<Callable> createTcpAcceptFunction();
+std::shared_ptr<Callable> createTcpConnectFunction();
+std::shared_ptr<Callable> createSocketPortFunction();
+std::shared_ptr<Callable> createSocketReadFunction();
+std::shared_ptr<Callable> createSocketWriteFunction();
+std::shared_ptr<Callable> createSocketCloseFunction();
+// Streaming file lines and string helpers that return slices where they
+// can, see Value::slice
+std::shared_ptr<Callable> createLinesFunction();
+std::shared_ptr<Callable> createSplitFunction();
+std::shared_ptr<Callable> createJoinFunction();
+std::shared_ptr<Callable> createTrimFunction();
+std::shared_ptr<Callable> createStartsWithFunction();
+std::shared_ptr<Callable> createEndsWithFunction();
+std::shared_ptr<Callable> createFindFunction();
+std::shared_ptr<Callable> createSubstringFunction();
+std::shared_ptr<Callable> createLowerFunction();
+std::shared_ptr<Callable> createUpperFunction();
+std::shared_ptr<Callable> createReplaceFunction();
+
+// sqrt(), floor(), pow(), hypot() and the rest of the math builtins,
+// bound straight to <cmath>, see builtin.hpp
+std::vector<std::pair<std::string, std::shared_ptr<Callable>>> createMathFunctions();
+
+// All of the above, paired with their global names
+std::vector<std::pair<std::string, std::shared_ptr<Callable>>> createNativeFunctions();
@@ -0,0 +1,385 @@
+#include "numeric_array.hpp"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FOCUS_ARRAY_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define FOCUS_ARRAY_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// One implementation of every kernel. In elementwise, at most one of a
+// and b is a scalar (a single double applied to every element).
+struct Kernels {
+    const char* name;
+    void (*elementwise)(ArrayOp op, const double* a, bool aScalar, const double* b, bool bScalar,
+                        double* out, size_t count);
+    double (*sum)(const double* data, size_t count);
+    double (*dot)(const double* a, const double* b, size_t count);
+    double (*min)(const double* data, size_t count);
+    double (*max)(const double* data, size_t count);
+};
+
+// Portable loops, also the tails of the SIMD kernels
+
+template <typename Combine>
+void combineLoop(const double* a, bool aScalar, const double* b, bool bScalar, double* out, size_t count,
+                 Combine combine) {
+    if (aScalar) {
+        double x = a[0];
+        for (size_t i = 0; i < count; i++) out[i] = combine(x, b[i]);
+    } else if (bScalar) {
+        double y = b[0];
+        for (size_t i = 0; i < count; i++) out[i] = combine(a[i], y);
+    } else {
+        for (size_t i = 0; i < count; i++) out[i] = combine(a[i], b[i]);
+    }
+}
+
+void elementwiseScalar(ArrayOp op, const double* a, bool aScalar, const double* b, bool bScalar,
+                       double* out, size_t count) {
+    switch (op) {
+        case ArrayOp::Add:
+            combineLoop(a, aScalar, b, bScalar, out, count, [](double x, double y) { return x + y; });
+            break;
+        case ArrayOp::Subtract:
+            combineLoop(a, aScalar, b, bScalar, out, count, [](double x, double y) { return x - y; });
+            break;
+        case ArrayOp::Multiply:
+            combineLoop(a, aScalar, b, bScalar, out, count, [](double x, double y) { return x * y; });
+            break;
+        case ArrayOp::Divide:
+            combineLoop(a, aScalar, b, bScalar, out, count, [](double x, double y) { return x / y; });
+            break;
+    }
+}
+
+// Four independent sums, so the loop isn't bound by the latency of one add
+double sumScalar(const double* data, size_t count) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        s0 += data[i];
+        s1 += data[i + 1];
+        s2 += data[i + 2];
+        s3 += data[i + 3];
+    }
+    for (; i < count; i++) s0 += data[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+double dotScalar(const double* a, const double* b, size_t count) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < count; i++) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+double minScalar(const double* data, size_t count) {
+    double result = data[0];
+    for (size_t i = 1; i < count; i++) result = data[i] < result ? data[i] : result;
+    return result;
+}
+
+double maxScalar(const double* data, size_t count) {
+    double result = data[0];
+    for (size_t i = 1; i < count; i++) result = data[i] > result ? data[i] : result;
+    return result;
+}
+
+const Kernels scalarKernels = {"scalar", elementwiseScalar, sumScalar, dotScalar, minScalar, maxScalar};
+
+#if FOCUS_ARRAY_AVX2
+// Compiled for AVX2 whatever the target, and only called once cpuid says
+// the CPU has it. Intrinsics can't be passed around as functors into
+// these, hence the macros.
+
+#define FOCUS_AVX2_LOOP(vectorOp, scalarOp) \
+    do { \
+        size_t i = 0; \
+        if (aScalar) { \
+            __m256d x = _mm256_set1_pd(a[0]); \
+            for (; i + 4 <= count; i += 4) _mm256_storeu_pd(out + i, vectorOp(x, _mm256_loadu_pd(b + i))); \
+            for (; i < count; i++) out[i] = a[0] scalarOp b[i]; \
+        } else if (bScalar) { \
+            __m256d y = _mm256_set1_pd(b[0]); \
+            for (; i + 4 <= count; i += 4) _mm256_storeu_pd(out + i, vectorOp(_mm256_loadu_pd(a + i), y)); \
+            for (; i < count; i++) out[i] = a[i] scalarOp b[0]; \
+        } else { \
+            for (; i + 4 <= count; i += 4) { \
+                _mm256_storeu_pd(out + i, vectorOp(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i))); \
+            } \
+            for (; i < count; i++) out[i] = a[i] scalarOp b[i]; \
+        } \
+    } while (0)
+
+__attribute__((target("avx2,fma")))
+void elementwiseAvx2(ArrayOp op, const double* a, bool aScalar, const double* b, bool bScalar,
+                     double* out, size_t count) {
+    switch (op) {
+        case ArrayOp::Add: FOCUS_AVX2_LOOP(_mm256_add_pd, +); break;
+        case ArrayOp::Subtract: FOCUS_AVX2_LOOP(_mm256_sub_pd, -); break;
+        case ArrayOp::Multiply: FOCUS_AVX2_LOOP(_mm256_mul_pd, *); break;
+        case ArrayOp::Divide: FOCUS_AVX2_LOOP(_mm256_div_pd, /); break;
+    }
+}
+
+#undef FOCUS_AVX2_LOOP
+
+__attribute__((target("avx2,fma")))
+inline double horizontalSum(__m256d v) {
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+__attribute__((target("avx2,fma")))
+double sumAvx2(const double* data, size_t count) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(data + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(data + i + 4));
+        s2 = _mm256_add_pd(s2, _mm256_loadu_pd(data + i + 8));
+        s3 = _mm256_add_pd(s3, _mm256_loadu_pd(data + i + 12));
+    }
+    for (; i + 4 <= count; i += 4) s0 = _mm256_add_pd(s0, _mm256_loadu_pd(data + i));
+    double result = horizontalSum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    for (; i < count; i++) result += data[i];
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+double dotAvx2(const double* a, const double* b, size_t count) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+        s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+        s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8), s2);
+        s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12), s3);
+    }
+    for (; i + 4 <= count; i += 4) s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+    double result = horizontalSum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    for (; i < count; i++) result += a[i] * b[i];
+    return result;
+}
+
+// _mm256_min_pd(x, m) is x < m ? x : m, the same as minScalar
+__attribute__((target("avx2,fma")))
+double minAvx2(const double* data, size_t count) {
+    if (count < 4) return minScalar(data, count);
+    __m256d m = _mm256_loadu_pd(data);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4) m = _mm256_min_pd(_mm256_loadu_pd(data + i), m);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double result = minScalar(lanes, 4);
+    for (; i < count; i++) result = data[i] < result ? data[i] : result;
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+double maxAvx2(const double* data, size_t count) {
+    if (count < 4) return maxScalar(data, count);
+    __m256d m = _mm256_loadu_pd(data);
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4) m = _mm256_max_pd(_mm256_loadu_pd(data + i), m);
+    double lanes[4];
+    _mm256_storeu_pd(lanes, m);
+    double result = maxScalar(lanes, 4);
+    for (; i < count; i++) result = data[i] > result ? data[i] : result;
+    return result;
+}
+
+const Kernels avx2Kernels = {"avx2", elementwiseAvx2, sumAvx2, dotAvx2, minAvx2, maxAvx2};
+#endif
+
+#if FOCUS_ARRAY_NEON
+// NEON is always there on AArch64, so these need no runtime check
+
+#define FOCUS_NEON_LOOP(vectorOp, scalarOp) \
+    do { \
+        size_t i = 0; \
+        if (aScalar) { \
+            float64x2_t x = vdupq_n_f64(a[0]); \
+            for (; i + 2 <= count; i += 2) vst1q_f64(out + i, vectorOp(x, vld1q_f64(b + i))); \
+            for (; i < count; i++) out[i] = a[0] scalarOp b[i]; \
+        } else if (bScalar) { \
+            float64x2_t y = vdupq_n_f64(b[0]); \
+            for (; i + 2 <= count; i += 2) vst1q_f64(out + i, vectorOp(vld1q_f64(a + i), y)); \
+            for (; i < count; i++) out[i] = a[i] scalarOp b[0]; \
+        } else { \
+            for (; i + 2 <= count; i += 2) vst1q_f64(out + i, vectorOp(vld1q_f64(a + i), vld1q_f64(b + i))); \
+            for (; i < count; i++) out[i] = a[i] scalarOp b[i]; \
+        } \
+    } while (0)
+
+void elementwiseNeon(ArrayOp op, const double* a, bool aScalar, const double* b, bool bScalar,
+                     double* out, size_t count) {
+    switch (op) {
+        case ArrayOp::Add: FOCUS_NEON_LOOP(vaddq_f64, +); break;
+        case ArrayOp::Subtract: FOCUS_NEON_LOOP(vsubq_f64, -); break;
+        case ArrayOp::Multiply: FOCUS_NEON_LOOP(vmulq_f64, *); break;
+        case ArrayOp::Divide: FOCUS_NEON_LOOP(vdivq_f64, /); break;
+    }
+}
+
+#undef FOCUS_NEON_LOOP
+
+double sumNeon(const double* data, size_t count) {
+    float64x2_t s0 = vdupq_n_f64(0), s1 = vdupq_n_f64(0), s2 = vdupq_n_f64(0), s3 = vdupq_n_f64(0);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        s0 = vaddq_f64(s0, vld1q_f64(data + i));
+        s1 = vaddq_f64(s1, vld1q_f64(data + i + 2));
+        s2 = vaddq_f64(s2, vld1q_f64(data + i + 4));
+        s3 = vaddq_f64(s3, vld1q_f64(data + i + 6));
+    }
+    for (; i + 2 <= count; i += 2) s0 = vaddq_f64(s0, vld1q_f64(data + i));
+    double result = vaddvq_f64(vaddq_f64(vaddq_f64(s0, s1), vaddq_f64(s2, s3)));
+    for (; i < count; i++) result += data[i];
+    return result;
+}
+
+double dotNeon(const double* a, const double* b, size_t count) {
+    float64x2_t s0 = vdupq_n_f64(0), s1 = vdupq_n_f64(0), s2 = vdupq_n_f64(0), s3 = vdupq_n_f64(0);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        s0 = vfmaq_f64(s0, vld1q_f64(a + i), vld1q_f64(b + i));
+        s1 = vfmaq_f64(s1, vld1q_f64(a + i + 2), vld1q_f64(b + i + 2));
+        s2 = vfmaq_f64(s2, vld1q_f64(a + i + 4), vld1q_f64(b + i + 4));
+        s3 = vfmaq_f64(s3, vld1q_f64(a + i + 6), vld1q_f64(b + i + 6));
+    }
+    for (; i + 2 <= count; i += 2) s0 = vfmaq_f64(s0, vld1q_f64(a + i), vld1q_f64(b + i));
+    double result = vaddvq_f64(vaddq_f64(vaddq_f64(s0, s1), vaddq_f64(s2, s3)));
+    for (; i < count; i++) result += a[i] * b[i];
+    return result;
+}
+
+double minNeon(const double* data, size_t count) {
+    if (count < 2) return minScalar(data, count);
+    float64x2_t m = vld1q_f64(data);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2) m = vminq_f64(m, vld1q_f64(data + i));
+    double result = vminvq_f64(m);
+    for (; i < count; i++) result = data[i] < result ? data[i] : result;
+    return result;
+}
+
+double maxNeon(const double* data, size_t count) {
+    if (count < 2) return maxScalar(data, count);
+    float64x2_t m = vld1q_f64(data);
+    size_t i = 2;
+    for (; i + 2 <= count; i += 2) m = vmaxq_f64(m, vld1q_f64(data + i));
+    double result = vmaxvq_f64(m);
+    for (; i < count; i++) result = data[i] > result ? data[i] : result;
+    return result;
+}
+
+const Kernels neonKernels = {"neon", elementwiseNeon, sumNeon, dotNeon, minNeon, maxNeon};
+#endif
+
+const Kernels& selectKernels() {
+#if FOCUS_ARRAY_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return avx2Kernels;
+#endif
+#if FOCUS_ARRAY_NEON
+    return neonKernels;
+#else
+    return scalarKernels;
+#endif
+}
+
+const Kernels& kernels() {
+    static const Kernels& selected = selectKernels();
+    return selected;
+}
+
+const char* opName(ArrayOp op) {
+    switch (op) {
+        case ArrayOp::Add: return "+";
+        case ArrayOp::Subtract: return "-";
+        case ArrayOp::Multiply: return "*";
+        case ArrayOp::Divide: return "/";
+    }
+    return "?";
+}
+
+} // namespace
+
+bool arrayArithmetic(ArrayOp op, const Value& left, const Value& right, Value& result) {
+    bool leftArray = left.isArray();
+    bool rightArray = right.isArray();
+    if (!leftArray && !rightArray) return false;
+
+    const Value& other = leftArray ? right : left;
+    if (!other.isArray() && !other.isNumber()) {
+        throw std::runtime_error(std::string("Can't apply '") + opName(op) + "' to an array and a " + other.getType());
+    }
+
+    double leftNumber = 0;
+    double rightNumber = 0;
+    const double* a = &leftNumber;
+    const double* b = &rightNumber;
+    size_t count = 0;
+    if (leftArray) {
+        a = left.asArray()->data();
+        count = left.asArray()->size();
+    } else {
+        leftNumber = left.asNumber();
+    }
+    if (rightArray) {
+        size_t rightCount = right.asArray()->size();
+        if (leftArray && rightCount != count) {
+            throw std::runtime_error("Arrays must have the same length, got " + std::to_string(count) +
+                                     " and " + std::to_string(rightCount));
+        }
+        b = right.asArray()->data();
+        count = rightCount;
+    } else {
+        rightNumber = right.asNumber();
+    }
+
+    auto out = std::make_shared<std::vector<double>>(count);
+    if (count > 0) {
+        kernels().elementwise(op, a, !leftArray, b, !rightArray, out->data(), count);
+    }
+    result = Value(out);
+    return true;
+}
+
+double arraySum(const double* data, size_t count) {
+    return kernels().sum(data, count);
+}
+
+double arrayDot(const double* a, const double* b, size_t count) {
+    return kernels().dot(a, b, count);
+}
+
+double arrayMin(const double* data, size_t count) {
+    return kernels().min(data, count);
+}
+
+double arrayMax(const double* data, size_t count) {
+    return kernels().max(data, count);
+}
+
+const char* arrayKernelName() {
+    return kernels().name;
+}
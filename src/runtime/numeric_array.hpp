@@ -0,0 +1,28 @@
+#pragma once
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Arrays are contiguous doubles (Value's array kind), so arithmetic and
+// reductions on them run as SIMD kernels: AVX2 when the CPU has it, NEON
+// on ARM, plain loops otherwise.
+
+enum class ArrayOp : uint8_t { Add, Subtract, Multiply, Divide };
+
+// left op right element by element, when at least one side is an array;
+// a number on the other side applies to every element. Division follows
+// IEEE rules, so dividing by zero gives an infinity or NaN rather than an
+// error. Returns false if neither operand is an array, and throws
+// std::runtime_error if the other is neither a number nor an array of the
+// same length.
+bool arrayArithmetic(ArrayOp op, const Value& left, const Value& right, Value& result);
+
+// Reductions. Partial sums are kept per SIMD lane, so a sum can differ
+// from a left-to-right loop in the last bits. min and max need count > 0.
+double arraySum(const double* data, size_t count);
+double arrayDot(const double* a, const double* b, size_t count);
+double arrayMin(const double* data, size_t count);
+double arrayMax(const double* data, size_t count);
+
+// The kernels in use: "avx2", "neon" or "scalar"
+const char* arrayKernelName();
@@ -0,0 +1,650 @@
+#include "numeric_tier.hpp"
+#include "async.hpp"
+#include "callable.hpp"
+#include "environment.hpp"
+#include "profiler.hpp"
+#include "../parser/ast.hpp"
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+std::atomic<bool> tierEnabled{true};
+// Compiling is rare; one lock covers every slot and the callees compiled
+// along the way
+std::mutex compileMutex;
+
+// Registers of the calls running on this thread: NumericCode never calls
+// back into the interpreter, so the calls nest and a frame starts right
+// where its caller's arguments are
+struct RegisterStack {
+    static constexpr size_t kSize = 1 << 18;
+    static constexpr int kMaxDepth = 10000;
+
+    std::unique_ptr<double[]> values;
+    double* end = nullptr;
+    int depth = 0;
+
+    double* base() {
+        if (values == nullptr) {
+            values.reset(new double[kSize]);
+            end = values.get() + kSize;
+        }
+        return values.get();
+    }
+};
+
+thread_local RegisterStack registers;
+
+} // namespace
+
+bool NumericCode::run(double* frame, double& result) const {
+    double* r = frame;
+    std::copy(constants.begin(), constants.end(), r + arity);
+
+    const Instruction* ip = code.data();
+    while (true) {
+        const Instruction& in = *ip++;
+        switch (in.op) {
+            case Op::Add: r[in.a] = r[in.b] + r[in.c]; break;
+            case Op::Subtract: r[in.a] = r[in.b] - r[in.c]; break;
+            case Op::Multiply: r[in.a] = r[in.b] * r[in.c]; break;
+            case Op::Divide:
+                if (r[in.c] == 0) return false; // the interpreter reports it
+                r[in.a] = r[in.b] / r[in.c];
+                break;
+            case Op::Modulo:
+                if (r[in.c] == 0) return false;
+                r[in.a] = std::fmod(r[in.b], r[in.c]);
+                break;
+            case Op::Power: r[in.a] = std::pow(r[in.b], r[in.c]); break;
+            // The same conversions as the interpreter's
+            case Op::ShiftLeft:
+                r[in.a] = static_cast<double>(static_cast<int>(r[in.b]) << static_cast<int>(r[in.c]));
+                break;
+            case Op::ShiftRight:
+                r[in.a] = static_cast<double>(static_cast<int>(r[in.b]) >> static_cast<int>(r[in.c]));
+                break;
+            case Op::BitAnd:
+                r[in.a] = static_cast<double>(static_cast<int>(r[in.b]) & static_cast<int>(r[in.c]));
+                break;
+            case Op::BitOr:
+                r[in.a] = static_cast<double>(static_cast<int>(r[in.b]) | static_cast<int>(r[in.c]));
+                break;
+            case Op::BitXor:
+                r[in.a] = static_cast<double>(static_cast<int>(r[in.b]) ^ static_cast<int>(r[in.c]));
+                break;
+            case Op::Less: r[in.a] = r[in.b] < r[in.c]; break;
+            case Op::LessEqual: r[in.a] = r[in.b] <= r[in.c]; break;
+            case Op::Greater: r[in.a] = r[in.b] > r[in.c]; break;
+            case Op::GreaterEqual: r[in.a] = r[in.b] >= r[in.c]; break;
+            case Op::Equal: r[in.a] = r[in.b] == r[in.c]; break;
+            case Op::NotEqual: r[in.a] = r[in.b] != r[in.c]; break;
+            // A number is truthy unless it is zero, so NaN is truthy
+            case Op::And: r[in.a] = r[in.b] != 0.0 ? r[in.c] : r[in.b]; break;
+            case Op::Or: r[in.a] = r[in.b] != 0.0 ? r[in.b] : r[in.c]; break;
+            case Op::Negate: r[in.a] = -r[in.b]; break;
+            case Op::BitNot: r[in.a] = static_cast<double>(~static_cast<int>(r[in.b])); break;
+            case Op::Not: r[in.a] = r[in.b] == 0.0; break;
+            case Op::Move: r[in.a] = r[in.b]; break;
+            case Op::LoadGlobal: {
+                const Value& value = *globalSlots[in.b];
+                if (!value.isNumber()) return false;
+                r[in.a] = value.asNumber();
+                break;
+            }
+            case Op::Jump: ip = code.data() + in.a; break;
+            case Op::JumpIfFalse:
+                if (r[in.a] == 0.0) ip = code.data() + in.b;
+                break;
+            case Op::Call: {
+                const CallTarget& target = calls[in.c];
+                const Value& global = *target.global;
+                if (!global.isCallable() || global.asCallable().get() != target.function ||
+                    target.alive.expired()) {
+                    return false;
+                }
+                const NumericCode* callee = target.slot->ready.load(std::memory_order_acquire);
+                double* calleeFrame = r + in.b;
+                if (callee == nullptr || callee->globals != target.globals ||
+                    calleeFrame + callee->frameSize > registers.end ||
+                    registers.depth >= RegisterStack::kMaxDepth || EventLoop::stackLow()) {
+                    return false;
+                }
+                registers.depth++;
+                bool finished = callee->run(calleeFrame, r[in.a]);
+                registers.depth--;
+                if (!finished) return false;
+                break;
+            }
+            case Op::Return: result = r[in.a]; return true;
+            case Op::Bail: return false;
+        }
+    }
+}
+
+// Compiles one declaration. A statement that can't be compiled becomes a
+// bailout in place, so only the paths that really need the interpreter
+// leave the tier.
+class TierCompiler {
+public:
+    using Op = NumericCode::Op;
+
+    enum class Type : uint8_t { Number, Bool, None };
+
+    // A value in a register; None when the expression can't be compiled
+    struct Operand {
+        int reg = 0;
+        Type type = Type::None;
+    };
+
+    TierCompiler(FunctionStmt& declaration, Environment* globals, NumericCode& target,
+                 std::unordered_set<FunctionStmt*>& compiling)
+        : declaration(declaration), globals(globals), target(target), compiling(compiling) {}
+
+    // False if nothing worth running is left
+    bool compile() {
+        int arity = static_cast<int>(declaration.params.size());
+        target.arity = arity;
+        target.globals = globals;
+        scopes.emplace_back(declaration.slotCount);
+        for (int i = 0; i < arity; i++) scopes.back()[i] = {i, Type::Number};
+        localTop = nextReg = maxReg = arity;
+
+        for (StmtPtr statement : declaration.body) compileStatement(*statement);
+        emit(Op::Bail); // falling off the end returns nil
+        if (returns == 0 || target.code.front().op == Op::Bail) return false;
+
+        relocate();
+        return true;
+    }
+
+    // Compiles function, and the functions it calls, into their slots.
+    // Called with compileMutex held.
+    static NumericCode* compileLocked(Function& function, std::unordered_set<FunctionStmt*>& compiling);
+
+private:
+    struct Local {
+        int reg = -1;
+        Type type = Type::None;
+    };
+
+    struct Loop {
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+
+    // Constants get their registers once the count is known
+    static constexpr int kConstantBase = 1 << 24;
+
+    FunctionStmt& declaration;
+    Environment* globals;
+    NumericCode& target;
+    std::unordered_set<FunctionStmt*>& compiling;
+
+    std::vector<std::vector<Local>> scopes; // one per environment the interpreter would make
+    std::vector<Loop> loops;
+    std::unordered_map<uint64_t, int> constantIndex;
+    std::unordered_map<const Value*, int> globalIndex;
+    int localTop = 0; // first register past the locals in scope
+    int nextReg = 0;  // first free temporary
+    int maxReg = 0;
+    int returns = 0;
+
+    size_t emit(Op op, int a = 0, int b = 0, int c = 0) {
+        target.code.push_back({op, a, b, c});
+        return target.code.size() - 1;
+    }
+
+    void patch(size_t jump, size_t destination) {
+        NumericCode::Instruction& in = target.code[jump];
+        (in.op == Op::Jump ? in.a : in.b) = static_cast<int>(destination);
+    }
+
+    int temporary() {
+        int reg = nextReg++;
+        if (nextReg > maxReg) maxReg = nextReg;
+        return reg;
+    }
+
+    int constant(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto found = constantIndex.find(bits);
+        if (found != constantIndex.end()) return found->second;
+        int reg = kConstantBase + static_cast<int>(target.constants.size());
+        target.constants.push_back(value);
+        constantIndex.emplace(bits, reg);
+        return reg;
+    }
+
+    Local* local(const VarSlot& slot) {
+        if (slot.depth >= static_cast<int>(scopes.size())) return nullptr; // captured from outside
+        auto& scope = scopes[scopes.size() - 1 - slot.depth];
+        if (slot.index < 0 || slot.index >= static_cast<int>(scope.size())) return nullptr;
+        Local& found = scope[slot.index];
+        return found.type == Type::None ? nullptr : &found;
+    }
+
+    // Statements
+
+    // Compiles statement, or a bailout in its place
+    void compileStatement(Stmt& statement) {
+        size_t start = target.code.size();
+        std::vector<std::pair<size_t, size_t>> loopMarks;
+        for (const Loop& loop : loops) loopMarks.emplace_back(loop.breaks.size(), loop.continues.size());
+        int savedLocalTop = localTop;
+        int savedReturns = returns;
+
+        bool compiled = statementBody(statement);
+        nextReg = localTop;
+        if (compiled) return;
+
+        target.code.resize(start);
+        for (size_t i = 0; i < loops.size(); i++) {
+            loops[i].breaks.resize(loopMarks[i].first);
+            loops[i].continues.resize(loopMarks[i].second);
+        }
+        localTop = nextReg = savedLocalTop;
+        returns = savedReturns;
+        emit(Op::Bail);
+    }
+
+    void pushScope(int slotCount) {
+        scopes.emplace_back(slotCount);
+    }
+
+    void popScope(int savedLocalTop) {
+        scopes.pop_back();
+        localTop = nextReg = savedLocalTop;
+    }
+
+    bool statementBody(Stmt& statement) {
+        if (auto* expression = dynamic_cast<ExpressionStmt*>(&statement)) {
+            return compileExpression(*expression->expression).type != Type::None;
+        }
+        if (auto* var = dynamic_cast<VarStmt*>(&statement)) return varStatement(*var);
+        if (auto* block = dynamic_cast<BlockStmt*>(&statement)) {
+            int savedLocalTop = localTop;
+            pushScope(block->slotCount);
+            for (StmtPtr inner : block->statements) compileStatement(*inner);
+            popScope(savedLocalTop);
+            return true;
+        }
+        if (auto* branch = dynamic_cast<IfStmt*>(&statement)) return ifStatement(*branch);
+        if (auto* loop = dynamic_cast<WhileStmt*>(&statement)) return whileStatement(*loop);
+        if (auto* loop = dynamic_cast<ForStmt*>(&statement)) return forStatement(*loop);
+        if (auto* ret = dynamic_cast<ReturnStmt*>(&statement)) {
+            if (ret->value == nullptr) return false;
+            Operand value = compileExpression(*ret->value);
+            if (value.type != Type::Number) return false;
+            emit(Op::Return, value.reg);
+            returns++;
+            return true;
+        }
+        if (dynamic_cast<BreakStmt*>(&statement) != nullptr) {
+            if (loops.empty()) return false;
+            loops.back().breaks.push_back(emit(Op::Jump));
+            return true;
+        }
+        if (dynamic_cast<ContinueStmt*>(&statement) != nullptr) {
+            if (loops.empty()) return false;
+            loops.back().continues.push_back(emit(Op::Jump));
+            return true;
+        }
+        return false;
+    }
+
+    bool varStatement(VarStmt& var) {
+        auto& scope = scopes.back();
+        if (var.slot < 0 || var.slot >= static_cast<int>(scope.size()) || var.initializer == nullptr) {
+            return false;
+        }
+        Operand value = compileExpression(*var.initializer);
+        if (value.type == Type::None) return false;
+        nextReg = localTop;
+        int reg = temporary();
+        localTop = nextReg;
+        if (value.reg != reg) emit(Op::Move, reg, value.reg);
+        scope[var.slot] = {reg, value.type};
+        return true;
+    }
+
+    bool ifStatement(IfStmt& branch) {
+        Operand condition = compileExpression(*branch.condition);
+        if (condition.type == Type::None) return false;
+        size_t skipThen = emit(Op::JumpIfFalse, condition.reg);
+        nextReg = localTop;
+        compileStatement(*branch.thenBranch);
+        if (branch.elseBranch == nullptr) {
+            patch(skipThen, target.code.size());
+            return true;
+        }
+        size_t skipElse = emit(Op::Jump);
+        patch(skipThen, target.code.size());
+        compileStatement(*branch.elseBranch);
+        patch(skipElse, target.code.size());
+        return true;
+    }
+
+    void finishLoop(size_t continueTarget) {
+        Loop loop = std::move(loops.back());
+        loops.pop_back();
+        for (size_t jump : loop.breaks) patch(jump, target.code.size());
+        for (size_t jump : loop.continues) patch(jump, continueTarget);
+    }
+
+    bool whileStatement(WhileStmt& loop) {
+        size_t start = target.code.size();
+        Operand condition = compileExpression(*loop.condition);
+        if (condition.type == Type::None) return false;
+        size_t exit = emit(Op::JumpIfFalse, condition.reg);
+        nextReg = localTop;
+
+        loops.emplace_back();
+        compileStatement(*loop.body);
+        emit(Op::Jump, static_cast<int>(start));
+        patch(exit, target.code.size());
+        finishLoop(start);
+        return true;
+    }
+
+    bool forStatement(ForStmt& loop) {
+        int savedLocalTop = localTop;
+        pushScope(loop.slotCount);
+        if (loop.initializer != nullptr) compileStatement(*loop.initializer);
+
+        size_t start = target.code.size();
+        size_t exit = 0;
+        bool hasExit = loop.condition != nullptr;
+        if (hasExit) {
+            Operand condition = compileExpression(*loop.condition);
+            if (condition.type == Type::None) {
+                popScope(savedLocalTop);
+                return false;
+            }
+            exit = emit(Op::JumpIfFalse, condition.reg);
+            nextReg = localTop;
+        }
+
+        loops.emplace_back();
+        compileStatement(*loop.body);
+        size_t increment = target.code.size();
+        if (loop.increment != nullptr && compileExpression(*loop.increment).type == Type::None) {
+            loops.pop_back();
+            popScope(savedLocalTop);
+            return false;
+        }
+        nextReg = localTop;
+        emit(Op::Jump, static_cast<int>(start));
+        if (hasExit) patch(exit, target.code.size());
+        finishLoop(increment);
+        popScope(savedLocalTop);
+        return true;
+    }
+
+    // Expressions
+
+    Operand compileExpression(Expr& expression) {
+        if (auto* literal = dynamic_cast<LiteralExpr*>(&expression)) {
+            if (literal->value.isNumber()) return {constant(literal->value.asNumber()), Type::Number};
+            if (literal->value.isBool()) return {constant(literal->value.asBool() ? 1 : 0), Type::Bool};
+            return {};
+        }
+        if (auto* grouping = dynamic_cast<GroupingExpr*>(&expression)) {
+            return compileExpression(*grouping->expression);
+        }
+        if (auto* variable = dynamic_cast<VariableExpr*>(&expression)) return variableExpression(*variable);
+        if (auto* assign = dynamic_cast<AssignExpr*>(&expression)) {
+            if (!assign->slot.isLocal()) return {};
+            Operand value = compileExpression(*assign->value);
+            Local* destination = local(assign->slot);
+            if (destination == nullptr || value.type != destination->type) return {};
+            if (value.reg != destination->reg) emit(Op::Move, destination->reg, value.reg);
+            return {destination->reg, value.type};
+        }
+        if (auto* unary = dynamic_cast<UnaryExpr*>(&expression)) return unaryExpression(*unary);
+        if (auto* binary = dynamic_cast<BinaryExpr*>(&expression)) return binaryExpression(*binary);
+        if (auto* ternary = dynamic_cast<TernaryExpr*>(&expression)) return ternaryExpression(*ternary);
+        if (auto* call = dynamic_cast<CallExpr*>(&expression)) return callExpression(*call);
+        return {};
+    }
+
+    Operand variableExpression(VariableExpr& variable) {
+        if (variable.slot.isLocal()) {
+            Local* found = local(variable.slot);
+            if (found == nullptr) return {};
+            return {found->reg, found->type};
+        }
+        // Globals are read each time, so only their kind is fixed here
+        const Value* global = globals->find(variable.name.symbol);
+        if (global == nullptr || !global->isNumber()) return {};
+        auto index = globalIndex.emplace(global, static_cast<int>(target.globalSlots.size()));
+        if (index.second) target.globalSlots.push_back(global);
+        int reg = temporary();
+        emit(Op::LoadGlobal, reg, index.first->second);
+        return {reg, Type::Number};
+    }
+
+    Operand unaryExpression(UnaryExpr& unary) {
+        Operand operand = compileExpression(*unary.right);
+        if (operand.type == Type::None) return {};
+        int reg = temporary();
+        switch (unary.operator_.type) {
+            case TokenType::BANG:
+                emit(Op::Not, reg, operand.reg);
+                return {reg, Type::Bool};
+            case TokenType::MINUS:
+                if (operand.type != Type::Number) return {};
+                emit(Op::Negate, reg, operand.reg);
+                return {reg, Type::Number};
+            case TokenType::TILDE:
+                if (operand.type != Type::Number) return {};
+                emit(Op::BitNot, reg, operand.reg);
+                return {reg, Type::Number};
+            default:
+                return {};
+        }
+    }
+
+    Operand binaryExpression(BinaryExpr& binary) {
+        if (!binary.feedback.onlyScalars()) return {};
+        // Both sides are always evaluated, as in the interpreter
+        Operand left = compileExpression(*binary.left);
+        Operand right = compileExpression(*binary.right);
+        if (left.type == Type::None || right.type == Type::None) return {};
+
+        Op op;
+        Type result = Type::Number;
+        switch (binary.operator_.type) {
+            case TokenType::PLUS: op = Op::Add; break;
+            case TokenType::MINUS: op = Op::Subtract; break;
+            case TokenType::STAR: op = Op::Multiply; break;
+            case TokenType::SLASH: op = Op::Divide; break;
+            case TokenType::PERCENT: op = Op::Modulo; break;
+            case TokenType::STAR_STAR: op = Op::Power; break;
+            case TokenType::LEFT_SHIFT: op = Op::ShiftLeft; break;
+            case TokenType::RIGHT_SHIFT: op = Op::ShiftRight; break;
+            case TokenType::AMPERSAND: op = Op::BitAnd; break;
+            case TokenType::PIPE: op = Op::BitOr; break;
+            case TokenType::CARET: op = Op::BitXor; break;
+            case TokenType::LESS: op = Op::Less; result = Type::Bool; break;
+            case TokenType::LESS_EQUAL: op = Op::LessEqual; result = Type::Bool; break;
+            case TokenType::GREATER: op = Op::Greater; result = Type::Bool; break;
+            case TokenType::GREATER_EQUAL: op = Op::GreaterEqual; result = Type::Bool; break;
+            // Equality and and/or take either kind, as long as both sides agree
+            case TokenType::EQUAL_EQUAL:
+            case TokenType::BANG_EQUAL:
+                if (left.type != right.type) return {};
+                op = binary.operator_.type == TokenType::EQUAL_EQUAL ? Op::Equal : Op::NotEqual;
+                result = Type::Bool;
+                break;
+            case TokenType::AND:
+            case TokenType::OR:
+                if (left.type != right.type) return {};
+                op = binary.operator_.type == TokenType::AND ? Op::And : Op::Or;
+                result = left.type;
+                break;
+            default:
+                return {};
+        }
+        if (result == Type::Number || op < Op::Equal) {
+            if (left.type != Type::Number || right.type != Type::Number) return {};
+        }
+
+        int reg = temporary();
+        emit(op, reg, left.reg, right.reg);
+        return {reg, result};
+    }
+
+    Operand ternaryExpression(TernaryExpr& ternary) {
+        Operand condition = compileExpression(*ternary.condition);
+        if (condition.type == Type::None) return {};
+        int reg = temporary();
+        size_t skipThen = emit(Op::JumpIfFalse, condition.reg);
+
+        int base = nextReg;
+        Operand thenValue = compileExpression(*ternary.thenExpr);
+        if (thenValue.type == Type::None) return {};
+        emit(Op::Move, reg, thenValue.reg);
+        size_t skipElse = emit(Op::Jump);
+
+        nextReg = base;
+        patch(skipThen, target.code.size());
+        Operand elseValue = compileExpression(*ternary.elseExpr);
+        if (elseValue.type != thenValue.type) return {};
+        emit(Op::Move, reg, elseValue.reg);
+        patch(skipElse, target.code.size());
+        nextReg = base;
+        return {reg, thenValue.type};
+    }
+
+    // f(...) where f is a global function that compiles too
+    Operand callExpression(CallExpr& call) {
+        auto* callee = dynamic_cast<VariableExpr*>(call.callee);
+        if (call.property != nullptr || callee == nullptr || callee->slot.isLocal() ||
+            !call.argumentTypes.onlyScalars()) {
+            return {};
+        }
+        const Value* global = globals->find(callee->name.symbol);
+        if (global == nullptr || !global->isCallable()) return {};
+        auto* function = dynamic_cast<Function*>(global->asCallable().get());
+        if (function == nullptr || function->declaration->isAsync ||
+            function->declaration->params.size() != call.arguments.size()) {
+            return {};
+        }
+        TierSlot& slot = function->declaration->tier;
+        if (compiling.count(function->declaration) == 0 && slot.ready.load(std::memory_order_relaxed) == nullptr) {
+            // Compiled now; it is the rest of this one
+            if (slot.rejected.load(std::memory_order_relaxed)) return {};
+            if (compileLocked(*function, compiling) == nullptr) return {};
+        }
+
+        // The arguments become the callee's first registers
+        int base = nextReg;
+        nextReg += static_cast<int>(call.arguments.size());
+        if (nextReg > maxReg) maxReg = nextReg;
+        for (size_t i = 0; i < call.arguments.size(); i++) {
+            Operand argument = compileExpression(*call.arguments[i]);
+            if (argument.type != Type::Number) return {};
+            int reg = base + static_cast<int>(i);
+            if (argument.reg != reg) emit(Op::Move, reg, argument.reg);
+            nextReg = base + static_cast<int>(call.arguments.size());
+        }
+
+        int index = static_cast<int>(target.calls.size());
+        target.calls.push_back({global, function, global->asCallable(), function->globals, &slot});
+        emit(Op::Call, base, base, index);
+        nextReg = base + 1;
+        if (nextReg > maxReg) maxReg = nextReg;
+        return {base, Type::Number};
+    }
+
+    // Moves locals past the constants and gives constants their registers
+    void relocate() {
+        int arity = target.arity;
+        int constantCount = static_cast<int>(target.constants.size());
+        auto move = [&](int32_t& reg) {
+            if (reg >= kConstantBase) reg = arity + (reg - kConstantBase);
+            else if (reg >= arity) reg += constantCount;
+        };
+        for (NumericCode::Instruction& in : target.code) {
+            switch (in.op) {
+                case Op::LoadGlobal: move(in.a); break;
+                case Op::Jump: case Op::Bail: break;
+                case Op::JumpIfFalse: case Op::Return: move(in.a); break;
+                case Op::Call: move(in.a); move(in.b); break;
+                case Op::Negate: case Op::BitNot: case Op::Not: case Op::Move: move(in.a); move(in.b); break;
+                default: move(in.a); move(in.b); move(in.c); break;
+            }
+        }
+        target.frameSize = maxReg + constantCount;
+    }
+
+};
+
+NumericCode* TierCompiler::compileLocked(Function& function, std::unordered_set<FunctionStmt*>& compiling) {
+    TierSlot& slot = function.declaration->tier;
+    if (NumericCode* ready = slot.ready.load(std::memory_order_relaxed)) return ready;
+    if (slot.rejected.load(std::memory_order_relaxed) || function.declaration->isAsync) return nullptr;
+
+    compiling.insert(function.declaration);
+    auto code = std::make_unique<NumericCode>();
+    TierCompiler compiler(*function.declaration, function.globals, *code, compiling);
+    bool compiled = function.globals != nullptr && compiler.compile();
+    compiling.erase(function.declaration);
+
+    if (!compiled) {
+        slot.rejected.store(true, std::memory_order_relaxed);
+        return nullptr;
+    }
+    slot.code = std::move(code);
+    slot.ready.store(slot.code.get(), std::memory_order_release);
+    return slot.code.get();
+}
+
+NumericCode* NumericTier::compile(Function& function) {
+    std::lock_guard<std::mutex> lock(compileMutex);
+    std::unordered_set<FunctionStmt*> compiling;
+    return TierCompiler::compileLocked(function, compiling);
+}
+
+bool NumericTier::tryCall(Function& function, Arguments arguments, Value& result) {
+    // Profiles are kept per line, which only the interpreter can tell
+    if (!tierEnabled.load(std::memory_order_relaxed) || Profiler::enabled()) return false;
+    for (const Value& argument : arguments) {
+        if (!argument.isNumber()) return false;
+    }
+
+    TierSlot& slot = function.declaration->tier;
+    NumericCode* code = slot.ready.load(std::memory_order_acquire);
+    if (code == nullptr) {
+        if (slot.rejected.load(std::memory_order_relaxed)) return false;
+        if (slot.calls.fetch_add(1, std::memory_order_relaxed) + 1 < kHotCalls) return false;
+        code = compile(function);
+        if (code == nullptr) return false;
+    }
+    if (code->globals != function.globals) return false;
+
+    double* frame = registers.base();
+    if (frame + code->frameSize > registers.end) return false;
+    for (size_t i = 0; i < arguments.size(); i++) frame[i] = arguments[i].asNumber();
+
+    double value;
+    if (code->run(frame, value)) {
+        result = Value(value);
+        return true;
+    }
+    if (slot.bailouts.fetch_add(1, std::memory_order_relaxed) + 1 >= kMaxBailouts) {
+        slot.rejected.store(true, std::memory_order_relaxed);
+        slot.ready.store(nullptr, std::memory_order_release);
+    }
+    return false;
+}
+
+void NumericTier::setEnabled(bool enabled) {
+    tierEnabled.store(enabled, std::memory_order_relaxed);
+}
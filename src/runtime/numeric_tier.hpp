@@ -0,0 +1,136 @@
+#pragma once
+#include "arguments.hpp"
+#include "value.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Second tier of the tree-walking interpreter. Functions that are called
+// often with numbers only are compiled to NumericCode: register code over
+// plain doubles, checked once when compiled, so it does no per-operation
+// type checks, Value boxing or environment lookups.
+//
+// What can't be done on doubles alone (strings, objects, natives, printing,
+// a division by zero, a global that is no longer a number, ...) compiles
+// to a guard that bails out, and the call is then run by the interpreter
+// from the start. That is safe because NumericCode never has effects: it
+// only reads its arguments and globals, computes, and calls other
+// NumericCode. Functions that keep bailing out are left to the
+// interpreter for good.
+
+class Callable;
+class Environment;
+class Function;
+class FunctionStmt;
+class NumericCode;
+
+// Kinds of values seen at an expression, recorded by the interpreter for
+// the tier to compile against
+class TypeFeedback {
+public:
+    enum : uint8_t { Number = 1, Bool = 2, Other = 4 };
+
+    void record(const Value& value) { note(kind(value)); }
+    void record(const Value& left, const Value& right) { note(kind(left) | kind(right)); }
+    // Only what fits in a register, numbers and booleans, was seen. True
+    // before anything was recorded.
+    bool onlyScalars() const { return (seen.load(std::memory_order_relaxed) & Other) == 0; }
+
+private:
+    std::atomic<uint8_t> seen{0};
+
+    static uint8_t kind(const Value& value) {
+        return value.isNumber() ? Number : value.isBool() ? Bool : Other;
+    }
+    void note(uint8_t kinds) {
+        if ((seen.load(std::memory_order_relaxed) & kinds) != kinds) {
+            seen.fetch_or(kinds, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Tiering state of one function declaration, shared by its closures and
+// by the threads running them
+class TierSlot {
+private:
+    friend class NumericTier;
+    friend class NumericCode;
+    friend class TierCompiler;
+
+    std::atomic<uint32_t> calls{0};  // with numbers only, until compiled
+    std::atomic<uint32_t> bailouts{0};
+    std::atomic<bool> rejected{false};
+    std::atomic<NumericCode*> ready{nullptr}; // null once rejected
+    std::unique_ptr<NumericCode> code;       // kept after rejection: other threads may still run it
+};
+
+// A function compiled to register code. Registers hold doubles; booleans
+// are 0 and 1. A frame is [parameters][constants][locals and temporaries].
+class NumericCode {
+public:
+    enum class Op : uint8_t {
+        Add, Subtract, Multiply, Divide, Modulo, Power,
+        ShiftLeft, ShiftRight, BitAnd, BitOr, BitXor,
+        Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual,
+        And, Or,                 // a = b or c, as the interpreter picks them
+        Negate, BitNot, Not, Move,
+        LoadGlobal,              // a = globals[b], bailing out unless a number
+        Jump,                    // to a
+        JumpIfFalse,             // to b unless a is truthy
+        Call,                    // a = calls[c] run on the frame at b
+        Return,                  // a
+        Bail,
+    };
+
+    struct Instruction {
+        Op op;
+        int32_t a = 0, b = 0, c = 0;
+    };
+
+    // A direct call: taken while the global still holds the function that
+    // was there when compiling. alive tells that function from a later one
+    // at the same address.
+    struct CallTarget {
+        const Value* global;
+        const Callable* function;
+        std::weak_ptr<Callable> alive;
+        Environment* globals; // of the function
+        TierSlot* slot;
+    };
+
+    // Runs on frame, whose parameters are set; false if it bailed out
+    bool run(double* frame, double& result) const;
+
+private:
+    friend class TierCompiler;
+    friend class NumericTier;
+
+    Environment* globals = nullptr; // the code was compiled against
+    int arity = 0;
+    int frameSize = 0;
+    std::vector<Instruction> code;
+    std::vector<double> constants;
+    std::vector<const Value*> globalSlots;
+    std::vector<CallTarget> calls;
+};
+
+class NumericTier {
+public:
+    // Calls with numbers only before a function is compiled
+    static constexpr uint32_t kHotCalls = 1000;
+    // Bailouts before a function is left to the interpreter
+    static constexpr uint32_t kMaxBailouts = 64;
+
+    // Runs a call of function in the tier, compiling the function first
+    // once it is hot. False if the interpreter has to run the call: the
+    // function is not compiled, or the code bailed out, in which case it
+    // had no effect.
+    static bool tryCall(Function& function, Arguments arguments, Value& result);
+
+    // On by default; --no-tier turns it off
+    static void setEnabled(bool enabled);
+
+private:
+    static NumericCode* compile(Function& function);
+};
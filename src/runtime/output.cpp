@@ -0,0 +1,79 @@
+#include "output.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+namespace {
+
+constexpr size_t kBlockSize = 1 << 16;
+
+bool interactive() {
+#ifndef _WIN32
+    return ::isatty(STDOUT_FILENO) != 0;
+#else
+    return ::_isatty(_fileno(stdout)) != 0;
+#endif
+}
+
+void put(FILE* stream, std::string_view text) {
+    if (!text.empty()) std::fwrite(text.data(), 1, text.size(), stream);
+}
+
+} // namespace
+
+void Output::configure(Mode mode) {
+    if (mode == Mode::Default) mode = interactive() ? Mode::Line : Mode::Block;
+    switch (mode) {
+        case Mode::Line: std::setvbuf(stdout, nullptr, _IOLBF, kBlockSize); break;
+        case Mode::Block: std::setvbuf(stdout, nullptr, _IOFBF, kBlockSize); break;
+        default: std::setvbuf(stdout, nullptr, _IONBF, 0); break;
+    }
+}
+
+bool Output::parseMode(std::string_view text, Mode& mode) {
+    if (text == "line") mode = Mode::Line;
+    else if (text == "block") mode = Mode::Block;
+    else if (text == "unbuffered") mode = Mode::Unbuffered;
+    else return false;
+    return true;
+}
+
+void Output::write(std::string_view text) {
+    put(stdout, text);
+}
+
+void Output::write(int fd, std::string_view text) {
+    if (fd == 1) {
+        write(text);
+        return;
+    }
+    // Whatever stdout holds goes first, as it would on a terminal
+    std::fflush(stdout);
+    if (fd == 2) {
+        put(stderr, text);
+        return;
+    }
+#ifndef _WIN32
+    while (!text.empty()) {
+        ssize_t count = ::write(fd, text.data(), text.size());
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("write() to " + std::to_string(fd) + " failed: " + std::strerror(errno));
+        }
+        text.remove_prefix(static_cast<size_t>(count));
+    }
+#else
+    throw std::runtime_error("write() only supports 1 and 2 on this platform");
+#endif
+}
+
+void Output::flush() {
+    std::fflush(stdout);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Script output: print(), print statements and write() on either engine.
+// Everything goes through stdout's stdio buffer, so it stays in order with
+// whatever else writes std::cout, and a print is a single write, so lines
+// printed by parallel tasks don't interleave.
+//
+// Buffering follows --output: a line at a time, in blocks, or not at all.
+// By default stdout is line buffered on a terminal and block buffered
+// otherwise. Buffered output is flushed before input() reads, before an
+// error is reported and at exit.
+class Output {
+public:
+    enum class Mode { Default, Line, Block, Unbuffered };
+
+    // Before anything is written
+    static void configure(Mode mode);
+    // "line", "block" or "unbuffered"; false for anything else
+    static bool parseMode(std::string_view text, Mode& mode);
+
+    // In one piece, so a line written at once stays whole
+    static void write(std::string_view text);
+    // Writes to file descriptor fd: 1 and 2 are stdout and stderr, in
+    // order with the rest of the output. Throws if that fails.
+    static void write(int fd, std::string_view text);
+    static void flush();
+};
@@ -0,0 +1,153 @@
+#include "parallel.hpp"
+
+namespace {
+
+thread_local uint64_t runningTask = 0;
+thread_local size_t workerIndex = SIZE_MAX; // queue owned by this thread
+
+uint64_t nextTaskId() {
+    static std::atomic<uint64_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+} // namespace
+
+uint64_t currentParallelTask() {
+    return runningTask;
+}
+
+ParallelTaskScope::ParallelTaskScope() : previous(runningTask) {
+    runningTask = nextTaskId();
+}
+
+ParallelTaskScope::~ParallelTaskScope() {
+    runningTask = previous;
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool() {
+    unsigned hardware = std::thread::hardware_concurrency();
+    size_t workerCount = hardware > 1 ? hardware - 1 : 0;
+
+    for (size_t i = 0; i <= workerCount; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workerCount; i++) {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) return;
+
+    Job job;
+    job.body = &task;
+    job.remaining.store(count, std::memory_order_relaxed);
+
+    size_t self = queueOfCurrentThread();
+    {
+        Queue& queue = *queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (size_t i = 0; i < count; i++) {
+            queue.tasks.push_back({&job, i});
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued.fetch_add(count, std::memory_order_release);
+    }
+    wakeUp.notify_all();
+
+    // Help out until every task of this job is done; the tasks found may
+    // belong to other jobs when calls are nested
+    while (job.remaining.load(std::memory_order_acquire) != 0) {
+        Task next;
+        if (findTask(self, next)) {
+            execute(next);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void ThreadPool::workerLoop(size_t self) {
+    workerIndex = self;
+    for (;;) {
+        Task task;
+        if (findTask(self, task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) != 0; });
+        if (stopping) return;
+    }
+}
+
+bool ThreadPool::findTask(size_t self, Task& task) {
+    // Newest first from our own queue keeps nested work cache-warm
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Oldest first from the others: those are the largest pieces left
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        Queue& victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Task& task) {
+    Job& job = *task.job;
+    if (!job.failed.load(std::memory_order_relaxed)) {
+        try {
+            (*job.body)(task.index);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.errorMutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+            job.failed.store(true, std::memory_order_relaxed);
+        }
+    }
+    job.remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+size_t ThreadPool::queueOfCurrentThread() const {
+    // Threads outside the pool share the last queue
+    return workerIndex < workers.size() ? workerIndex : queues.size() - 1;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Id of the parallel task running on the calling thread, 0 outside of
+// one. Frames and instances record the task that created them, so a task
+// can tell its own state from state shared with other tasks.
+uint64_t currentParallelTask();
+
+// Marks the calling thread as running a fresh task until destroyed
+class ParallelTaskScope {
+private:
+    uint64_t previous;
+
+public:
+    ParallelTaskScope();
+    ParallelTaskScope(const ParallelTaskScope&) = delete;
+    ParallelTaskScope& operator=(const ParallelTaskScope&) = delete;
+    ~ParallelTaskScope();
+};
+
+// Work-stealing pool behind the parallel builtins. Every worker owns a
+// deque: it takes tasks from the back of its own and, when that is empty,
+// steals from the front of the others'. Threads that submit work help run
+// it while they wait, so parallel calls may nest without deadlocking.
+class ThreadPool {
+public:
+    static ThreadPool& instance();
+
+    ~ThreadPool();
+
+    // Threads that run tasks, the submitting thread included
+    size_t concurrency() const { return workers.size() + 1; }
+
+    // Runs task(i) for every i in [0, count) and returns when all have
+    // finished. If any task throws, tasks that have not started are
+    // skipped and the first exception is rethrown here.
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    struct Job {
+        const std::function<void(size_t)>* body;
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+    };
+
+    struct Task {
+        Job* job;
+        size_t index;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, plus one for outside threads
+    std::atomic<size_t> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    ThreadPool();
+
+    void workerLoop(size_t self);
+    bool findTask(size_t self, Task& task);
+    void execute(const Task& task);
+    size_t queueOfCurrentThread() const;
+};
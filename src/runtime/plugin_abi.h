@@ -0,0 +1,153 @@
+#pragma once
+
+/*
+ * Focus Nexus plugin ABI, version 2.
+ *
+ * Plain C so that a plugin depends on nothing but this header: no STL
+ * types or C++ layouts cross the boundary, and a plugin can be built with
+ * any compiler, in C or C++.
+ *
+ * A plugin opts in by exporting focus_nexus_plugin_abi() returning
+ * FN_PLUGIN_ABI_VERSION (FOCUS_NEXUS_PLUGIN_ABI() does that). Each function
+ * "name" is then exported as
+ *
+ *     int focus_nexus_name(const FnValue* args, size_t count, FnValue* result);
+ *
+ * returning FN_OK, or FN_ERROR with a message string in *result. It may
+ * also be exported as a batch entry point, which maps the function over
+ * whole lists of numbers in one call:
+ *
+ *     int focus_nexus_batch_name(const FnValue* args, size_t count, size_t rows,
+ *                                double* out, FnValue* error);
+ *
+ * The host calls it instead of focus_nexus_name when any argument is a
+ * list or an array. Each argument is then either FN_NUMBERS with exactly
+ * rows items or a scalar that applies to every row; out has room for rows
+ * results.
+ *
+ * Arguments are only valid during the call. Strings and arrays a plugin
+ * returns stay owned by the plugin and need only live until its next call
+ * on the same thread; the host copies them straight away.
+ *
+ * Spawned calls into a plugin run on a single worker thread, one after
+ * the other, unless the plugin exports focus_nexus_plugin_thread_safe()
+ * returning nonzero (FOCUS_NEXUS_PLUGIN_THREAD_SAFE() does that). Its
+ * functions may then be called from several threads at once.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FN_PLUGIN_ABI_VERSION 2u
+
+#define FN_OK 0
+#define FN_ERROR 1
+
+#ifdef __cplusplus
+#define FN_EXTERN_C extern "C"
+#else
+#define FN_EXTERN_C
+#endif
+
+#ifdef _WIN32
+#define FN_PLUGIN_EXPORT FN_EXTERN_C __declspec(dllexport)
+#else
+#define FN_PLUGIN_EXPORT FN_EXTERN_C __attribute__((visibility("default")))
+#endif
+
+typedef enum FnValueType {
+    FN_NIL = 0,
+    FN_BOOL = 1,
+    FN_NUMBER = 2,
+    FN_STRING = 3,
+    FN_NUMBERS = 4, /* a list whose items are all numbers */
+    FN_LIST = 5
+} FnValueType;
+
+typedef struct FnValue {
+    uint32_t type; /* an FnValueType */
+    uint32_t reserved;
+    union {
+        int32_t boolean;
+        double number;
+        struct { const char* data; size_t length; } string; /* not NUL terminated */
+        struct { const double* data; size_t length; } numbers;
+        struct { const struct FnValue* items; size_t length; } list;
+    } as;
+} FnValue;
+
+typedef uint32_t (*FnPluginAbiFunc)(void);
+typedef int (*FnPluginThreadSafeFunc)(void);
+typedef int (*FnPluginFunction)(const FnValue* args, size_t count, FnValue* result);
+typedef int (*FnPluginBatchFunction)(const FnValue* args, size_t count, size_t rows, double* out, FnValue* error);
+
+static inline FnValue fn_nil(void) {
+    FnValue value = {FN_NIL, 0, {0}};
+    return value;
+}
+
+static inline FnValue fn_bool(int boolean) {
+    FnValue value = fn_nil();
+    value.type = FN_BOOL;
+    value.as.boolean = boolean != 0;
+    return value;
+}
+
+static inline FnValue fn_number(double number) {
+    FnValue value = fn_nil();
+    value.type = FN_NUMBER;
+    value.as.number = number;
+    return value;
+}
+
+static inline FnValue fn_string(const char* data, size_t length) {
+    FnValue value = fn_nil();
+    value.type = FN_STRING;
+    value.as.string.data = data;
+    value.as.string.length = length;
+    return value;
+}
+
+static inline FnValue fn_numbers(const double* data, size_t length) {
+    FnValue value = fn_nil();
+    value.type = FN_NUMBERS;
+    value.as.numbers.data = data;
+    value.as.numbers.length = length;
+    return value;
+}
+
+static inline FnValue fn_list(const FnValue* items, size_t length) {
+    FnValue value = fn_nil();
+    value.type = FN_LIST;
+    value.as.list.items = items;
+    value.as.list.length = length;
+    return value;
+}
+
+/* Sets *result to message and returns FN_ERROR, for "return fn_error(...)" */
+static inline int fn_error(FnValue* result, const char* message) {
+    size_t length = 0;
+    while (message[length]) length++;
+    *result = fn_string(message, length);
+    return FN_ERROR;
+}
+
+/* Lifecycle hooks, all optional */
+#define FOCUS_NEXUS_PLUGIN_ABI() \
+    FN_PLUGIN_EXPORT uint32_t focus_nexus_plugin_abi(void) { return FN_PLUGIN_ABI_VERSION; }
+#define FOCUS_NEXUS_PLUGIN_INIT(func) FN_PLUGIN_EXPORT void focus_nexus_plugin_init(void) { func(); }
+#define FOCUS_NEXUS_PLUGIN_CLEANUP(func) FN_PLUGIN_EXPORT void focus_nexus_plugin_cleanup(void) { func(); }
+#define FOCUS_NEXUS_PLUGIN_INFO(info) FN_PLUGIN_EXPORT const char* focus_nexus_plugin_info(void) { return info; }
+/* Declares every function safe to call from several threads at once */
+#define FOCUS_NEXUS_PLUGIN_THREAD_SAFE() FN_PLUGIN_EXPORT int focus_nexus_plugin_thread_safe(void) { return 1; }
+
+/* Exports func as "name", and batch as its batch entry point */
+#define FOCUS_NEXUS_EXPORT(name, func) \
+    FN_PLUGIN_EXPORT int focus_nexus_##name(const FnValue* args, size_t count, FnValue* result) { \
+        return func(args, count, result); \
+    }
+#define FOCUS_NEXUS_EXPORT_BATCH(name, batch) \
+    FN_PLUGIN_EXPORT int focus_nexus_batch_##name(const FnValue* args, size_t count, size_t rows, \
+                                                  double* out, FnValue* error) { \
+        return batch(args, count, rows, out, error); \
+    }
@@ -0,0 +1,316 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+std::atomic<bool> Profiler::active{false};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int64_t elapsedSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+struct FunctionStats {
+    std::string name;
+    const char* category = "script";
+    uint64_t calls = 0;
+    int64_t inclusive = 0;
+    int64_t exclusive = 0;
+    int active = 0; // frames of this function open on the thread
+};
+
+// One call path; children are few, so they are searched linearly
+struct Node {
+    const void* id = nullptr;
+    std::string name;
+    FunctionStats* stats = nullptr;
+    int64_t inclusive = 0;
+    int64_t exclusive = 0;
+    std::vector<std::unique_ptr<Node>> children;
+};
+
+struct Frame {
+    Node* node;
+    Clock::time_point start;
+    int64_t childTime;
+};
+
+struct LineStats {
+    uint64_t count = 0;
+    int64_t inclusive = 0;
+    int64_t exclusive = 0;
+    int active = 0;
+};
+
+struct LineFrame {
+    LineStats* stats;
+    Clock::time_point start;
+    int64_t childTime;
+};
+
+struct ThreadProfile {
+    Node root;
+    std::vector<Frame> frames;
+    std::unordered_map<const void*, FunctionStats> functions;
+    std::unordered_map<int, LineStats> lines;
+    std::vector<LineFrame> lineFrames;
+};
+
+// Profiles of every thread that ran profiled code. They are only read
+// once profiling has stopped and the threads are idle.
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadProfile>> profiles;
+std::unordered_set<std::string> keys;
+std::thread::id mainThread;
+Clock::time_point startTime;
+int64_t wallTime = 0;
+
+thread_local ThreadProfile* localProfile = nullptr;
+
+ThreadProfile& local() {
+    if (localProfile == nullptr) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        profiles.push_back(std::make_unique<ThreadProfile>());
+        localProfile = profiles.back().get();
+        localProfile->root.name = std::this_thread::get_id() == mainThread ? "<script>" : "<worker>";
+    }
+    return *localProfile;
+}
+
+bool isExternal(const char* category) {
+    return std::strcmp(category, "script") != 0 && std::strcmp(category, "native") != 0;
+}
+
+std::string milliseconds(int64_t nanoseconds) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3) << static_cast<double>(nanoseconds) / 1e6 << "ms";
+    return text.str();
+}
+
+std::string percentOfWall(int64_t nanoseconds) {
+    std::ostringstream text;
+    double share = wallTime > 0 ? 100.0 * static_cast<double>(nanoseconds) / static_cast<double>(wallTime) : 0;
+    text << std::fixed << std::setprecision(1) << share << "%";
+    return text.str();
+}
+
+void collectStacks(const Node& node, const std::string& prefix, std::map<std::string, int64_t>& stacks) {
+    std::string path = prefix.empty() ? node.name : prefix + ";" + node.name;
+    if (node.exclusive > 0) {
+        stacks[path] += node.exclusive;
+    }
+    for (const auto& child : node.children) {
+        collectStacks(*child, path, stacks);
+    }
+}
+
+} // namespace
+
+void Profiler::start() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    mainThread = std::this_thread::get_id();
+    startTime = Clock::now();
+    active.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::stop() {
+    active.store(false, std::memory_order_relaxed);
+    wallTime = elapsedSince(startTime);
+
+    // Whatever the main thread ran outside of any call
+    ThreadProfile& main = local();
+    int64_t children = 0;
+    for (const auto& child : main.root.children) {
+        children += child->inclusive;
+    }
+    main.root.inclusive = wallTime;
+    main.root.exclusive = std::max<int64_t>(0, wallTime - children);
+}
+
+const std::string& Profiler::intern(const std::string& text) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return *keys.insert(text).first;
+}
+
+bool Profiler::enter(const void* id, const char* category) {
+    ThreadProfile& profile = local();
+    Node* parent = profile.frames.empty() ? &profile.root : profile.frames.back().node;
+
+    Node* node = nullptr;
+    for (const auto& child : parent->children) {
+        if (child->id == id) {
+            node = child.get();
+            break;
+        }
+    }
+    if (node == nullptr) {
+        parent->children.push_back(std::make_unique<Node>());
+        node = parent->children.back().get();
+        node->id = id;
+        node->stats = &profile.functions[id];
+        node->stats->category = category;
+    }
+
+    node->stats->calls++;
+    node->stats->active++;
+    profile.frames.push_back({node, Clock::now(), 0});
+    return node->name.empty();
+}
+
+void Profiler::nameCurrent(std::string name) {
+    ThreadProfile& profile = local();
+    Node* node = profile.frames.back().node;
+    node->name = std::move(name);
+    if (node->stats->name.empty()) {
+        node->stats->name = node->name;
+    }
+}
+
+void Profiler::leave() {
+    ThreadProfile& profile = local();
+    if (profile.frames.empty()) return;
+
+    Frame frame = profile.frames.back();
+    profile.frames.pop_back();
+
+    int64_t elapsed = elapsedSince(frame.start);
+    int64_t exclusive = elapsed - frame.childTime;
+    frame.node->inclusive += elapsed;
+    frame.node->exclusive += exclusive;
+
+    FunctionStats& stats = *frame.node->stats;
+    stats.exclusive += exclusive;
+    if (--stats.active == 0) {
+        stats.inclusive += elapsed;
+    }
+
+    if (!profile.frames.empty()) {
+        profile.frames.back().childTime += elapsed;
+    }
+}
+
+void Profiler::enterLine(int line) {
+    ThreadProfile& profile = local();
+    LineStats& stats = profile.lines[line];
+    stats.count++;
+    stats.active++;
+    profile.lineFrames.push_back({&stats, Clock::now(), 0});
+}
+
+void Profiler::leaveLine() {
+    ThreadProfile& profile = local();
+    if (profile.lineFrames.empty()) return;
+
+    LineFrame frame = profile.lineFrames.back();
+    profile.lineFrames.pop_back();
+
+    int64_t elapsed = elapsedSince(frame.start);
+    frame.stats->exclusive += elapsed - frame.childTime;
+    if (--frame.stats->active == 0) {
+        frame.stats->inclusive += elapsed;
+    }
+
+    if (!profile.lineFrames.empty()) {
+        profile.lineFrames.back().childTime += elapsed;
+    }
+}
+
+void Profiler::writeSummary(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    // Threads are merged; the same function keeps its id on every thread
+    std::unordered_map<const void*, FunctionStats> functions;
+    std::map<int, LineStats> lines;
+    for (const auto& profile : profiles) {
+        for (const auto& entry : profile->functions) {
+            FunctionStats& merged = functions[entry.first];
+            merged.name = entry.second.name;
+            merged.category = entry.second.category;
+            merged.calls += entry.second.calls;
+            merged.inclusive += entry.second.inclusive;
+            merged.exclusive += entry.second.exclusive;
+        }
+        for (const auto& entry : profile->lines) {
+            LineStats& merged = lines[entry.first];
+            merged.count += entry.second.count;
+            merged.inclusive += entry.second.inclusive;
+            merged.exclusive += entry.second.exclusive;
+        }
+    }
+
+    std::vector<const FunctionStats*> byTime;
+    std::map<std::string, FunctionStats> libraries;
+    for (const auto& entry : functions) {
+        byTime.push_back(&entry.second);
+        if (isExternal(entry.second.category)) {
+            FunctionStats& library = libraries[entry.second.category];
+            library.calls += entry.second.calls;
+            library.inclusive += entry.second.inclusive;
+        }
+    }
+    std::sort(byTime.begin(), byTime.end(), [](const FunctionStats* a, const FunctionStats* b) {
+        return a->exclusive > b->exclusive;
+    });
+
+    out << "Profile: " << milliseconds(wallTime) << " wall time\n\n";
+    out << std::setw(12) << "exclusive" << std::setw(8) << "" << std::setw(12) << "inclusive"
+        << std::setw(10) << "calls" << "  function\n";
+    for (const FunctionStats* stats : byTime) {
+        out << std::setw(12) << milliseconds(stats->exclusive) << std::setw(8) << percentOfWall(stats->exclusive)
+            << std::setw(12) << milliseconds(stats->inclusive) << std::setw(10) << stats->calls
+            << "  " << stats->name << "\n";
+    }
+
+    if (!libraries.empty()) {
+        out << "\nExternal libraries\n";
+        for (const auto& entry : libraries) {
+            out << std::setw(12) << milliseconds(entry.second.inclusive) << std::setw(8)
+                << percentOfWall(entry.second.inclusive) << std::setw(22) << entry.second.calls
+                << "  " << entry.first << "\n";
+        }
+    }
+
+    if (!lines.empty()) {
+        std::vector<std::pair<int, LineStats>> byLineTime(lines.begin(), lines.end());
+        std::stable_sort(byLineTime.begin(), byLineTime.end(), [](const auto& a, const auto& b) {
+            return a.second.exclusive > b.second.exclusive;
+        });
+
+        out << "\n" << std::setw(12) << "exclusive" << std::setw(8) << "" << std::setw(12) << "inclusive"
+            << std::setw(10) << "count" << "  line\n";
+        for (const auto& entry : byLineTime) {
+            out << std::setw(12) << milliseconds(entry.second.exclusive) << std::setw(8)
+                << percentOfWall(entry.second.exclusive) << std::setw(12) << milliseconds(entry.second.inclusive)
+                << std::setw(10) << entry.second.count << "  " << entry.first << "\n";
+        }
+    }
+}
+
+void Profiler::writeCollapsedStacks(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    std::map<std::string, int64_t> stacks;
+    for (const auto& profile : profiles) {
+        collectStacks(profile->root, "", stacks);
+    }
+    for (const auto& entry : stacks) {
+        int64_t microseconds = entry.second / 1000;
+        if (microseconds > 0) {
+            out << entry.first << " " << microseconds << "\n";
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Instrumenting profiler behind --profile. Every call into a script
+// function, a native or an external library opens a frame on the calling
+// thread's call tree; every statement the tree-walker executes opens a
+// line. Both record call counts and inclusive/exclusive wall time, and
+// recursive calls only count once towards inclusive time.
+//
+// Frames are identified by an id that stays the same for every call of
+// one function (a declaration, a native, an interned external name); the
+// name is only computed the first time an id shows up under a parent.
+class Profiler {
+public:
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static void start();
+    static void stop();
+
+    // A summary table of functions, external libraries and lines
+    static void writeSummary(std::ostream& out);
+    // One "root;caller;callee microseconds" line per call path, the
+    // collapsed format read by flamegraph.pl and speedscope
+    static void writeCollapsedStacks(std::ostream& out);
+
+    // Copy of text that lives until exit; its address serves as the id of
+    // frames with no declaration to point at, its c_str() as a category
+    static const std::string& intern(const std::string& text);
+
+    // Frames for callers whose calls don't follow C++ scopes (the VM);
+    // ProfileScope pairs them otherwise. category is "script", "native"
+    // or the library type, and must outlive the call.
+    template <typename NameFn>
+    static void enter(const void* id, const char* category, NameFn&& name) {
+        if (enter(id, category)) {
+            nameCurrent(name());
+        }
+    }
+    static void leave();
+
+    static void enterLine(int line);
+    static void leaveLine();
+
+private:
+    static std::atomic<bool> active;
+
+    // True when the frame's node is new and still needs a name
+    static bool enter(const void* id, const char* category);
+    static void nameCurrent(std::string name);
+};
+
+class ProfileScope {
+private:
+    bool open = false;
+
+public:
+    template <typename NameFn>
+    ProfileScope(const void* id, const char* category, NameFn&& name) {
+        if (Profiler::enabled()) {
+            Profiler::enter(id, category, name);
+            open = true;
+        }
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+    ~ProfileScope() {
+        if (open) Profiler::leave();
+    }
+};
+
+class ProfileLine {
+private:
+    bool open = false;
+
+public:
+    explicit ProfileLine(int line) {
+        if (Profiler::enabled()) {
+            Profiler::enterLine(line);
+            open = true;
+        }
+    }
+    ProfileLine(const ProfileLine&) = delete;
+    ProfileLine& operator=(const ProfileLine&) = delete;
+    ~ProfileLine() {
+        if (open) Profiler::leaveLine();
+    }
+};
@@ -0,0 +1,25 @@
+#include "shape.hpp"
+
+namespace {
+
+uint64_t nextShapeId() {
+    static std::atomic<uint64_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+} // namespace
+
+Shape::Shape() : id(nextShapeId()) {}
+
+Shape::Shape(const Shape& parent, const std::string& field) : slots(parent.slots), id(nextShapeId()) {
+    slots.emplace(field, static_cast<int>(slots.size()));
+}
+
+Shape* Shape::withField(const std::string& field) {
+    std::lock_guard<std::mutex> lock(transitionMutex);
+    auto& child = transitions[field];
+    if (child == nullptr) {
+        child.reset(new Shape(*this, field));
+    }
+    return child.get();
+}
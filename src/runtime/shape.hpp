@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Hidden class describing the field layout of an instance. Instances of a
+// class that gained the same fields in the same order share one Shape, so
+// a field lives at a fixed index in FocusInstance::fields. Each class owns
+// the root of its shape tree; shapes are never freed before their class.
+class Shape {
+private:
+    std::unordered_map<std::string, int> slots; // immutable once built
+    std::unordered_map<std::string, std::unique_ptr<Shape>> transitions;
+    std::mutex transitionMutex;
+
+    Shape(const Shape& parent, const std::string& field);
+
+public:
+    const uint64_t id; // unique for the process lifetime, used as cache key
+
+    Shape();
+
+    // Field index of name, or -1
+    int find(const std::string& name) const {
+        auto it = slots.find(name);
+        return it == slots.end() ? -1 : it->second;
+    }
+
+    // The shape reached by appending field to this one
+    Shape* withField(const std::string& field);
+
+    size_t fieldCount() const { return slots.size(); }
+};
+
+// Inline cache for one property access site. Entries are keyed by the
+// receiver's shape id; a hit yields the field index or the resolved
+// method without touching any hash table. Up to kEntries shapes are kept
+// (polymorphic); beyond that entries are replaced round-robin.
+//
+// The cache may be shared by threads running the same code, so an entry
+// is written like a seqlock: the key is cleared, the payload stored, then
+// the key published; readers re-check the key after copying the payload.
+class PropertyCache {
+public:
+    static constexpr int kEntries = 4;
+
+    // Payload of an entry. For reads `target` is the unbound method when
+    // slot is -1; for writes it is the shape after adding a new field, or
+    // null when the field already exists.
+    struct Hit {
+        int slot = -1;
+        void* target = nullptr;
+    };
+
+    bool lookup(uint64_t shapeId, Hit& hit) const {
+        for (const auto& entry : entries) {
+            if (entry.key.load(std::memory_order_acquire) != shapeId) continue;
+            hit.slot = entry.slot.load(std::memory_order_relaxed);
+            hit.target = entry.target.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.key.load(std::memory_order_relaxed) == shapeId) return true;
+        }
+        return false;
+    }
+
+    void store(uint64_t shapeId, const Hit& hit) {
+        Entry& entry = entries[next.fetch_add(1, std::memory_order_relaxed) % kEntries];
+        entry.key.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        entry.slot.store(hit.slot, std::memory_order_relaxed);
+        entry.target.store(hit.target, std::memory_order_relaxed);
+        entry.key.store(shapeId, std::memory_order_release);
+    }
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> key{0}; // 0 never names a shape
+        std::atomic<int> slot{-1};
+        std::atomic<void*> target{nullptr};
+    };
+
+    Entry entries[kEntries];
+    std::atomic<unsigned> next{0};
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include "value.hpp"
+#include <unordered_map>
+
+// Lookup for a switch whose cases are all literals, so a match costs one
+// hash instead of a comparison per case. Targets are case indices in the
+// tree-walker and jump offsets in the VM. A value listed in two cases
+// keeps its first one, as the chain of comparisons would.
+class SwitchTable {
+private:
+    std::unordered_map<Value, int, ValueHash> targets;
+
+public:
+    int otherwise = -1; // target when no case matches
+
+    void add(const Value& value, int target) { targets.emplace(value, target); }
+
+    int find(const Value& value) const {
+        auto it = targets.find(value);
+        return it == targets.end() ? otherwise : it->second;
+    }
+
+    const std::unordered_map<Value, int, ValueHash>& entries() const { return targets; }
+};
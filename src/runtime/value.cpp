@@ -1,101 +1,362 @@
 #include "value.hpp"
 #include "callable.hpp"
-#include <sstream>
+#include "iterable.hpp"
+#include "hash_map.hpp"
+#include "module.hpp"
+#include "async.hpp"
+#include <charconv>
+#include <climits>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 
-bool Value::isNil() const {
-    return std::holds_alternative<std::monostate>(value);
+namespace {
+
+struct InternKey {
+    std::string_view text;
+    size_t hash;
+
+    bool operator==(const InternKey& other) const { return hash == other.hash && text == other.text; }
+};
+
+struct InternKeyHash {
+    size_t operator()(const InternKey& key) const { return key.hash; }
+};
+
+// Interned strings keyed by a view of their own text. Entries are removed
+// when the last Value referring to a string goes away.
+struct InternTable {
+    std::mutex mutex;
+    std::unordered_map<InternKey, StringObject*, InternKeyHash> strings;
+};
+
+InternTable& internTable() {
+    static auto* table = new InternTable(); // outlives static Values
+    return *table;
+}
+
+// Concatenations shorter than this are interned straight away; a rope
+// only pays off once copying the text costs more than its bookkeeping
+constexpr size_t kMinRopeLength = 64;
+
+// Text that ropes share. A later concatenation appends to it in place
+// when it extends the whole buffer, so one buffer backs a chain of ropes.
+struct RopeBuffer {
+    std::mutex mutex;
+    std::string text;
+};
+
+} // namespace
+
+class RopeObject final : public HeapObject {
+public:
+    const std::shared_ptr<RopeBuffer> buffer;
+    const size_t length; // of the prefix of buffer this rope is
+
+    RopeObject(std::shared_ptr<RopeBuffer> buffer, size_t length)
+        : HeapObject(Kind::Rope), buffer(std::move(buffer)), length(length) {}
+
+    // The interned text, created on first use
+    StringObject* flatten() {
+        StringObject* string = flat.load(std::memory_order_acquire);
+        if (string) return string;
+
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        string = flat.load(std::memory_order_relaxed);
+        if (!string) {
+            string = StringObject::intern(buffer->text.substr(0, length));
+            flat.store(string, std::memory_order_release);
+        }
+        return string;
+    }
+
+private:
+    std::atomic<StringObject*> flat{nullptr};
+
+    ~RopeObject() override {
+        if (StringObject* string = flat.load(std::memory_order_relaxed)) string->release();
+    }
+};
+
+class SliceObject final : public HeapObject {
+public:
+    const std::shared_ptr<const void> owner; // of the memory text points into
+    const std::string_view text;
+
+    SliceObject(std::shared_ptr<const void> owner, std::string_view text)
+        : HeapObject(Kind::Slice), owner(std::move(owner)), text(text) {}
+
+    // The interned text, created on first use
+    StringObject* flatten() {
+        StringObject* string = flat.load(std::memory_order_acquire);
+        if (string) return string;
+
+        // Threads racing here intern the same object; one reference is kept
+        StringObject* created = StringObject::intern(std::string(text));
+        if (flat.compare_exchange_strong(string, created, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return created;
+        }
+        created->release();
+        return string;
+    }
+
+private:
+    std::atomic<StringObject*> flat{nullptr};
+
+    ~SliceObject() override {
+        if (StringObject* string = flat.load(std::memory_order_relaxed)) string->release();
+    }
+};
+
+template <typename Text>
+StringObject* StringObject::internText(Text&& text) {
+    InternKey key{text, std::hash<std::string_view>()(text)}; // hashed before taking the lock
+    InternTable& table = internTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+
+    auto it = table.strings.find(key);
+    if (it != table.strings.end()) {
+        // A string whose count already hit zero is being destroyed on
+        // another thread; it is replaced rather than revived.
+        StringObject* existing = it->second;
+        uint32_t count = existing->refCount.load(std::memory_order_relaxed);
+        while (count != 0) {
+            if (existing->refCount.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+                return existing;
+            }
+        }
+        table.strings.erase(it);
+    }
+
+    auto* object = new StringObject(std::forward<Text>(text), key.hash);
+    table.strings.emplace(InternKey{object->value, object->hash}, object);
+    return object;
+}
+
+StringObject* StringObject::intern(const std::string& text) {
+    return internText(text);
+}
+
+StringObject* StringObject::intern(std::string&& text) {
+    return internText(std::move(text));
 }
 
-bool Value::isBool() const {
-    return std::holds_alternative<bool>(value);
+size_t StringObject::internedCount() {
+    InternTable& table = internTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    return table.strings.size();
 }
 
-bool Value::isNumber() const {
-    return std::holds_alternative<double>(value);
+void StringObject::destroy() {
+    InternTable& table = internTable();
+    {
+        std::lock_guard<std::mutex> lock(table.mutex);
+        auto it = table.strings.find(InternKey{value, hash});
+        if (it != table.strings.end() && it->second == this) {
+            table.strings.erase(it);
+        }
+    }
+    delete this;
+}
+
+void Value::badAccess(const char* expected) {
+    throw std::runtime_error(std::string("Value is not a ") + expected);
+}
+
+const std::string& Value::asString() const {
+    if (isObjectOf(HeapObject::Kind::String)) return static_cast<StringObject*>(asObject())->value;
+    if (isObjectOf(HeapObject::Kind::Rope)) return static_cast<RopeObject*>(asObject())->flatten()->value;
+    if (isObjectOf(HeapObject::Kind::Slice)) return static_cast<SliceObject*>(asObject())->flatten()->value;
+    badAccess("string");
+}
+
+size_t Value::stringLength() const {
+    if (isObjectOf(HeapObject::Kind::Rope)) return static_cast<RopeObject*>(asObject())->length;
+    if (isObjectOf(HeapObject::Kind::Slice)) return static_cast<SliceObject*>(asObject())->text.size();
+    return asString().size();
+}
+
+std::string_view Value::stringView() const {
+    if (isObjectOf(HeapObject::Kind::Slice)) return static_cast<SliceObject*>(asObject())->text;
+    return asString();
 }
 
-bool Value::isString() const {
-    return std::holds_alternative<std::string>(value);
+Value Value::slice(std::shared_ptr<const void> owner, std::string_view text) {
+    return Value(static_cast<HeapObject*>(new SliceObject(std::move(owner), text)));
 }
 
-bool Value::isCallable() const {
-    return std::holds_alternative<std::shared_ptr<Callable>>(value);
+Value Value::slice(const Value& string, size_t offset, size_t length) {
+    if (offset == 0 && length >= string.stringLength()) return string;
+    if (string.isObjectOf(HeapObject::Kind::Slice)) {
+        auto* whole = static_cast<SliceObject*>(string.asObject());
+        return slice(whole->owner, whole->text.substr(offset, length));
+    }
+    if (!string.isString()) badAccess("string");
+    // An interned string owns its text; the slice holds a reference to it
+    StringObject* object = string.isObjectOf(HeapObject::Kind::Rope)
+                               ? static_cast<RopeObject*>(string.asObject())->flatten()
+                               : static_cast<StringObject*>(string.asObject());
+    object->retain();
+    std::shared_ptr<const void> owner(object, [](const void* text) {
+        static_cast<StringObject*>(const_cast<void*>(text))->release();
+    });
+    return slice(std::move(owner), std::string_view(object->value).substr(offset, length));
 }
 
-bool Value::isList() const {
-    return std::holds_alternative<std::shared_ptr<std::vector<Value>>>(value);
+Value Value::concat(const Value& left, const Value& right) {
+    // The right side is read first: it may be a rope sharing left's buffer
+    std::string rightConverted;
+    std::string_view rightText = right.isString() ? right.stringView() : (rightConverted = right.toString());
+
+    std::string text;
+    if (left.isObjectOf(HeapObject::Kind::Rope)) {
+        auto* rope = static_cast<RopeObject*>(left.asObject());
+        std::shared_ptr<RopeBuffer> buffer = rope->buffer;
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        if (buffer->text.size() == rope->length) {
+            buffer->text += rightText;
+            size_t length = buffer->text.size();
+            return Value(static_cast<HeapObject*>(new RopeObject(std::move(buffer), length)));
+        }
+        // Something else was already appended after left, so branch off
+        text.reserve(rope->length + rightText.size());
+        text.append(buffer->text, 0, rope->length);
+    } else if (left.isString()) {
+        text.reserve(left.stringLength() + rightText.size());
+        text += left.stringView();
+    } else {
+        text = left.toString();
+    }
+    text += rightText;
+
+    if (text.size() < kMinRopeLength) return Value(std::move(text));
+    auto buffer = std::make_shared<RopeBuffer>();
+    buffer->text = std::move(text);
+    size_t length = buffer->text.size();
+    return Value(static_cast<HeapObject*>(new RopeObject(std::move(buffer), length)));
 }
 
-bool Value::isClass() const {
-    return std::holds_alternative<std::shared_ptr<FocusClass>>(value);
+const std::shared_ptr<Callable>& Value::asCallable() const {
+    if (!isCallable()) badAccess("function");
+    return static_cast<CallableObject*>(asObject())->pointer;
 }
 
-bool Value::isInstance() const {
-    return std::holds_alternative<std::shared_ptr<FocusInstance>>(value);
+const std::shared_ptr<std::vector<Value>>& Value::asList() const {
+    if (!isList()) badAccess("list");
+    return static_cast<ListObject*>(asObject())->pointer;
 }
 
-bool Value::asBool() const {
-    return std::get<bool>(value);
+const std::shared_ptr<FocusClass>& Value::asClass() const {
+    if (!isClass()) badAccess("class");
+    return static_cast<ClassObject*>(asObject())->pointer;
 }
 
-double Value::asNumber() const {
-    return std::get<double>(value);
+const std::shared_ptr<FocusInstance>& Value::asInstance() const {
+    if (!isInstance()) badAccess("instance");
+    return static_cast<InstanceObject*>(asObject())->pointer;
 }
 
-std::string Value::asString() const {
-    return std::get<std::string>(value);
+const std::shared_ptr<Iterable>& Value::asIterable() const {
+    if (!isIterable()) badAccess("iterable");
+    return static_cast<IterableObject*>(asObject())->pointer;
 }
 
-std::shared_ptr<Callable> Value::asCallable() const {
-    return std::get<std::shared_ptr<Callable>>(value);
+const std::shared_ptr<std::vector<double>>& Value::asArray() const {
+    if (!isArray()) badAccess("array");
+    return static_cast<ArrayObject*>(asObject())->pointer;
 }
 
-std::shared_ptr<std::vector<Value>> Value::asList() const {
-    return std::get<std::shared_ptr<std::vector<Value>>>(value);
+const std::shared_ptr<FocusMap>& Value::asMap() const {
+    if (!isMap()) badAccess("map");
+    return static_cast<MapObject*>(asObject())->pointer;
 }
 
-std::shared_ptr<FocusClass> Value::asClass() const {
-    return std::get<std::shared_ptr<FocusClass>>(value);
+const std::shared_ptr<Module>& Value::asModule() const {
+    if (!isModule()) badAccess("module");
+    return static_cast<ModuleObject*>(asObject())->pointer;
 }
 
-std::shared_ptr<FocusInstance> Value::asInstance() const {
-    return std::get<std::shared_ptr<FocusInstance>>(value);
+const std::shared_ptr<Future>& Value::asFuture() const {
+    if (!isFuture()) badAccess("future");
+    return static_cast<FutureObject*>(asObject())->pointer;
 }
 
 bool Value::isTruthy() const {
     if (isNil()) return false;
     if (isBool()) return asBool();
     if (isNumber()) return asNumber() != 0.0;
-    if (isString()) return !asString().empty();
+    if (isString()) return stringLength() != 0;
     return true;
 }
 
-std::string Value::toString() const {
-    if (isNil()) return "nil";
-    if (isBool()) return asBool() ? "true" : "false";
-    if (isNumber()) {
-        double num = asNumber();
-        if (num == static_cast<int>(num)) {
-            return std::to_string(static_cast<int>(num));
-        }
-        return std::to_string(num);
+namespace {
+
+// Whole numbers in int range print as integers, anything else the way
+// std::to_string does ("%f"), without going through printf
+void appendNumber(std::string& out, double num) {
+    char digits[400]; // the longest "%f" result, -DBL_MAX
+    std::to_chars_result result;
+    if (num >= INT_MIN && num <= INT_MAX && num == static_cast<int>(num)) {
+        result = std::to_chars(digits, digits + sizeof(digits), static_cast<int>(num));
+    } else {
+        result = std::to_chars(digits, digits + sizeof(digits), num, std::chars_format::fixed, 6);
     }
-    if (isString()) return asString();
-    if (isCallable()) return "<function>";
-    if (isList()) {
-        std::ostringstream oss;
-        oss << "[";
-        auto list = asList();
+    out.append(digits, result.ptr);
+}
+
+} // namespace
+
+std::string Value::toString() const {
+    if (isString()) return std::string(stringView());
+    std::string text;
+    appendTo(text);
+    return text;
+}
+
+void Value::appendTo(std::string& out) const {
+    if (isNil()) {
+        out += "nil";
+    } else if (isBool()) {
+        out += asBool() ? "true" : "false";
+    } else if (isNumber()) {
+        appendNumber(out, asNumber());
+    } else if (isString()) {
+        out += stringView();
+    } else if (isCallable()) {
+        out += "<function>";
+    } else if (isList()) {
+        out += "[";
+        const auto& list = asList();
         for (size_t i = 0; i < list->size(); ++i) {
-            if (i > 0) oss << ", ";
-            oss << (*list)[i].toString();
+            if (i > 0) out += ", ";
+            (*list)[i].appendTo(out);
+        }
+        out += "]";
+    } else if (isClass()) {
+        out += "<class>";
+    } else if (isInstance()) {
+        out += "<instance>";
+    } else if (isIterable()) {
+        out += asIterable()->toString();
+    } else if (isArray()) {
+        out += "array([";
+        const auto& array = asArray();
+        for (size_t i = 0; i < array->size(); ++i) {
+            if (i > 0) out += ", ";
+            appendNumber(out, (*array)[i]);
         }
-        oss << "]";
-        return oss.str();
+        out += "])";
+    } else if (isMap()) {
+        out += asMap()->toString();
+    } else if (isModule()) {
+        out += "<module " + asModule()->getName() + ">";
+    } else if (isFuture()) {
+        out += asFuture()->toString();
+    } else {
+        out += "<unknown>";
     }
-    if (isClass()) return "<class>";
-    if (isInstance()) return "<instance>";
-    return "<unknown>";
 }
 
 std::string Value::getType() const {
@@ -107,24 +368,79 @@ std::string Value::getType() const {
     if (isList()) return "list";
     if (isClass()) return "class";
     if (isInstance()) return "instance";
+    if (isIterable()) return "iterable";
+    if (isArray()) return "array";
+    if (isMap()) return "map";
+    if (isModule()) return "module";
+    if (isFuture()) return "future";
     return "unknown";
 }
 
 bool Value::operator==(const Value& other) const {
-    if (value.index() != other.value.index()) return false;
-    
-    if (isNil()) return true;
-    if (isBool()) return asBool() == other.asBool();
-    if (isNumber()) return asNumber() == other.asNumber();
-    if (isString()) return asString() == other.asString();
-    if (isCallable()) return asCallable() == other.asCallable();
-    if (isList()) return asList() == other.asList();
-    if (isClass()) return asClass() == other.asClass();
-    if (isInstance()) return asInstance() == other.asInstance();
-    
+    if (isNumber() && other.isNumber()) return asNumber() == other.asNumber();
+    if (bits == other.bits) return true;
+
+    // Interned strings are equal only if they are the same object, and a
+    // rope is equal to the string it flattens to; slices are compared by
+    // their text, so they need not be interned. Boxes are compared by what
+    // they point to.
+    if (!isObject() || !other.isObject()) return false;
+    if (isString() && other.isString()) {
+        if (stringLength() != other.stringLength()) return false;
+        if (isObjectOf(HeapObject::Kind::Slice) || other.isObjectOf(HeapObject::Kind::Slice)) {
+            return stringView() == other.stringView();
+        }
+        return &asString() == &other.asString();
+    }
+    HeapObject* a = asObject();
+    HeapObject* b = other.asObject();
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+        case HeapObject::Kind::String:
+        case HeapObject::Kind::Rope:
+        case HeapObject::Kind::Slice: return false;
+        case HeapObject::Kind::Callable: return asCallable() == other.asCallable();
+        case HeapObject::Kind::List: return asList() == other.asList();
+        case HeapObject::Kind::Class: return asClass() == other.asClass();
+        case HeapObject::Kind::Instance: return asInstance() == other.asInstance();
+        case HeapObject::Kind::Iterable: return asIterable() == other.asIterable();
+        case HeapObject::Kind::Array: return asArray() == other.asArray();
+        case HeapObject::Kind::Map: return asMap() == other.asMap();
+        case HeapObject::Kind::Module: return asModule() == other.asModule();
+        case HeapObject::Kind::Future: return asFuture() == other.asFuture();
+    }
     return false;
 }
 
 bool Value::operator!=(const Value& other) const {
     return !(*this == other);
+}
+
+size_t Value::hash() const {
+    if (isNumber()) {
+        double number = asNumber();
+        return std::hash<double>()(number == 0 ? 0.0 : number); // -0 == 0
+    }
+    if (!isObject()) return std::hash<uint64_t>()(bits);
+    if (isObjectOf(HeapObject::Kind::String)) return static_cast<StringObject*>(asObject())->hash;
+    if (isObjectOf(HeapObject::Kind::Rope)) return static_cast<RopeObject*>(asObject())->flatten()->hash;
+    // The same hash the interned string would have
+    if (isObjectOf(HeapObject::Kind::Slice)) return std::hash<std::string_view>()(static_cast<SliceObject*>(asObject())->text);
+    // Boxes are equal when they point to the same thing
+    const void* target = nullptr;
+    switch (asObject()->kind) {
+        case HeapObject::Kind::String:
+        case HeapObject::Kind::Rope:
+        case HeapObject::Kind::Slice: break;
+        case HeapObject::Kind::Callable: target = asCallable().get(); break;
+        case HeapObject::Kind::List: target = asList().get(); break;
+        case HeapObject::Kind::Class: target = asClass().get(); break;
+        case HeapObject::Kind::Instance: target = asInstance().get(); break;
+        case HeapObject::Kind::Iterable: target = asIterable().get(); break;
+        case HeapObject::Kind::Array: target = asArray().get(); break;
+        case HeapObject::Kind::Map: target = asMap().get(); break;
+        case HeapObject::Kind::Module: target = asModule().get(); break;
+        case HeapObject::Kind::Future: target = asFuture().get(); break;
+    }
+    return std::hash<const void*>()(target);
 }
\ No newline at end of file
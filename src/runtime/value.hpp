@@ -1,64 +1,250 @@
 #pragma once
+#include "metrics.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
-#include <variant>
 
 class Callable;
 class FocusClass;
 class FocusInstance;
+class FocusMap;
+class Iterable;
+class Module;
+class Future;
+class Value;
 
-using ValueVariant = std::variant<
-    std::monostate,  // nil
-    bool,
-    double,
-    std::string,
-    std::shared_ptr<Callable>,
-    std::shared_ptr<std::vector<class Value>>,
-    std::shared_ptr<FocusClass>,
-    std::shared_ptr<FocusInstance>
->;
+// Heap part of a Value. Objects carry an intrusive reference count so a
+// Value itself stays a single 64-bit word.
+class HeapObject {
+public:
+    enum class Kind : uint8_t { String, Rope, Slice, Callable, List, Class, Instance, Iterable, Array, Map, Module, Future };
+
+    const Kind kind;
+
+    explicit HeapObject(Kind kind) : kind(kind) { Metrics::allocated(static_cast<uint8_t>(kind)); }
+    HeapObject(const HeapObject&) = delete;
+    HeapObject& operator=(const HeapObject&) = delete;
+
+    void retain() { refCount.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) destroy();
+    }
+    // Values holding the object; read by the cycle collector, see gc.hpp
+    uint32_t references() const { return refCount.load(std::memory_order_relaxed); }
+
+protected:
+    std::atomic<uint32_t> refCount{1};
+
+    virtual ~HeapObject() = default;
+    virtual void destroy() { delete this; }
+};
+
+// Immutable string. Every string that reaches a Value is interned, so
+// equal strings share one object and compare by pointer.
+class StringObject final : public HeapObject {
+public:
+    const std::string value;
+    const size_t hash; // of value, computed once when interned
 
+    // Returns a retained object for text, creating it if needed
+    static StringObject* intern(const std::string& text);
+    static StringObject* intern(std::string&& text);
+    static size_t internedCount();
+
+private:
+    template <typename Text>
+    static StringObject* internText(Text&& text);
+
+    StringObject(std::string value, size_t hash) : HeapObject(Kind::String), value(std::move(value)), hash(hash) {}
+    void destroy() override;
+};
+
+// String built by concatenation, see Value::concat. It is a prefix of a
+// buffer that later concatenations append to in place, and it is only
+// interned (flattened) once something needs its text.
+class RopeObject;
+
+// Part of a string, or of text something else owns, a mapped file say,
+// see Value::slice. Like a rope it is only interned once something needs
+// a std::string of it.
+class SliceObject;
+
+// Box holding one of the shared_ptr based runtime types
+template <typename T, HeapObject::Kind K>
+class SharedObject final : public HeapObject {
+public:
+    const std::shared_ptr<T> pointer;
+
+    explicit SharedObject(std::shared_ptr<T> pointer) : HeapObject(K), pointer(std::move(pointer)) {}
+};
+
+using CallableObject = SharedObject<Callable, HeapObject::Kind::Callable>;
+using ListObject = SharedObject<std::vector<Value>, HeapObject::Kind::List>;
+using ClassObject = SharedObject<FocusClass, HeapObject::Kind::Class>;
+using InstanceObject = SharedObject<FocusInstance, HeapObject::Kind::Instance>;
+using IterableObject = SharedObject<Iterable, HeapObject::Kind::Iterable>;
+// Array of numbers stored as plain doubles, see numeric_array.hpp
+using ArrayObject = SharedObject<std::vector<double>, HeapObject::Kind::Array>;
+// Hash map keyed by values, see hash_map.hpp
+using MapObject = SharedObject<FocusMap, HeapObject::Kind::Map>;
+// Imported module, see module.hpp
+using ModuleObject = SharedObject<Module, HeapObject::Kind::Module>;
+// Result of an async call, a timer or non-blocking I/O, see async.hpp
+using FutureObject = SharedObject<Future, HeapObject::Kind::Future>;
+
+// NaN-boxed value. Doubles are stored as themselves; nil, booleans and
+// object pointers live in the payload of a quiet NaN, objects with the
+// sign bit set. Non-canonical NaNs are folded into one canonical NaN on
+// construction so they can never be mistaken for a tagged value.
 class Value {
 private:
-    ValueVariant value;
+    static constexpr uint64_t kSignBit = 0x8000000000000000ULL;
+    static constexpr uint64_t kQuietNaN = 0x7ffc000000000000ULL;
+    static constexpr uint64_t kCanonicalNaN = 0x7ff8000000000000ULL;
+    static constexpr uint64_t kNil = kQuietNaN | 1;
+    static constexpr uint64_t kFalse = kQuietNaN | 2;
+    static constexpr uint64_t kTrue = kQuietNaN | 3;
+    static constexpr uint64_t kObjectTag = kSignBit | kQuietNaN;
+
+    uint64_t bits;
+
+    explicit Value(HeapObject* object)
+        : bits(kObjectTag | static_cast<uint64_t>(reinterpret_cast<uintptr_t>(object))) {}
+
+    [[nodiscard]] bool isObject() const { return (bits & kObjectTag) == kObjectTag; }
+    [[nodiscard]] HeapObject* asObject() const {
+        return reinterpret_cast<HeapObject*>(static_cast<uintptr_t>(bits & ~kObjectTag));
+    }
+    [[nodiscard]] bool isObjectOf(HeapObject::Kind kind) const { return isObject() && asObject()->kind == kind; }
+
+    [[noreturn]] static void badAccess(const char* expected);
+
+    friend class Tracer; // walks the boxes, see gc.hpp
 
 public:
     // Constructors
-    Value() : value(std::monostate{}) {}
-    explicit Value(bool b) : value(b) {}
-    explicit Value(double d) : value(d) {}
-    explicit Value(const std::string& s) : value(s) {}
-    explicit Value(std::shared_ptr<Callable> c) : value(c) {}
-    explicit Value(std::shared_ptr<std::vector<Value>> l) : value(l) {}
-    explicit Value(std::shared_ptr<FocusClass> c) : value(c) {}
-    explicit Value(std::shared_ptr<FocusInstance> i) : value(i) {}
+    Value() : bits(kNil) {}
+    explicit Value(bool b) : bits(b ? kTrue : kFalse) {}
+    explicit Value(double d) {
+        if (d != d) {
+            bits = kCanonicalNaN;
+        } else {
+            std::memcpy(&bits, &d, sizeof(bits));
+        }
+    }
+    explicit Value(const std::string& s) : Value(static_cast<HeapObject*>(StringObject::intern(s))) {}
+    explicit Value(std::string&& s) : Value(static_cast<HeapObject*>(StringObject::intern(std::move(s)))) {}
+    explicit Value(const char* s) : Value(std::string(s)) {}
+    explicit Value(std::shared_ptr<Callable> c) : Value(static_cast<HeapObject*>(new CallableObject(std::move(c)))) {}
+    explicit Value(std::shared_ptr<std::vector<Value>> l) : Value(static_cast<HeapObject*>(new ListObject(std::move(l)))) {}
+    explicit Value(std::shared_ptr<FocusClass> c) : Value(static_cast<HeapObject*>(new ClassObject(std::move(c)))) {}
+    explicit Value(std::shared_ptr<FocusInstance> i) : Value(static_cast<HeapObject*>(new InstanceObject(std::move(i)))) {}
+    explicit Value(std::shared_ptr<Iterable> i) : Value(static_cast<HeapObject*>(new IterableObject(std::move(i)))) {}
+    explicit Value(std::shared_ptr<std::vector<double>> a) : Value(static_cast<HeapObject*>(new ArrayObject(std::move(a)))) {}
+    explicit Value(std::shared_ptr<FocusMap> m) : Value(static_cast<HeapObject*>(new MapObject(std::move(m)))) {}
+    explicit Value(std::shared_ptr<Module> m) : Value(static_cast<HeapObject*>(new ModuleObject(std::move(m)))) {}
+    explicit Value(std::shared_ptr<Future> f) : Value(static_cast<HeapObject*>(new FutureObject(std::move(f)))) {}
+
+    Value(const Value& other) : bits(other.bits) {
+        if (isObject()) asObject()->retain();
+    }
+    Value(Value&& other) noexcept : bits(other.bits) {
+        other.bits = kNil;
+    }
+    Value& operator=(const Value& other) {
+        if (other.isObject()) other.asObject()->retain();
+        if (isObject()) asObject()->release();
+        bits = other.bits;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            if (isObject()) asObject()->release();
+            bits = other.bits;
+            other.bits = kNil;
+        }
+        return *this;
+    }
+    ~Value() {
+        if (isObject()) asObject()->release();
+    }
 
     // Type checking
-    [[nodiscard]] bool isNil() const;
-    [[nodiscard]] bool isBool() const;
-    [[nodiscard]] bool isNumber() const;
-    [[nodiscard]] bool isString() const;
-    [[nodiscard]] bool isCallable() const;
-    [[nodiscard]] bool isList() const;
-    [[nodiscard]] bool isClass() const;
-    [[nodiscard]] bool isInstance() const;
+    [[nodiscard]] bool isNil() const { return bits == kNil; }
+    [[nodiscard]] bool isBool() const { return (bits | 1) == kTrue; }
+    [[nodiscard]] bool isNumber() const { return (bits & kQuietNaN) != kQuietNaN; }
+    [[nodiscard]] bool isString() const {
+        // String, Rope and Slice come first in Kind
+        return isObject() && asObject()->kind <= HeapObject::Kind::Slice;
+    }
+    [[nodiscard]] bool isCallable() const { return isObjectOf(HeapObject::Kind::Callable); }
+    [[nodiscard]] bool isList() const { return isObjectOf(HeapObject::Kind::List); }
+    [[nodiscard]] bool isClass() const { return isObjectOf(HeapObject::Kind::Class); }
+    [[nodiscard]] bool isInstance() const { return isObjectOf(HeapObject::Kind::Instance); }
+    [[nodiscard]] bool isIterable() const { return isObjectOf(HeapObject::Kind::Iterable); }
+    [[nodiscard]] bool isArray() const { return isObjectOf(HeapObject::Kind::Array); }
+    [[nodiscard]] bool isMap() const { return isObjectOf(HeapObject::Kind::Map); }
+    [[nodiscard]] bool isModule() const { return isObjectOf(HeapObject::Kind::Module); }
+    [[nodiscard]] bool isFuture() const { return isObjectOf(HeapObject::Kind::Future); }
 
     // Value extraction
-    [[nodiscard]] bool asBool() const;
-    [[nodiscard]] double asNumber() const;
-    [[nodiscard]] std::string asString() const;
-    [[nodiscard]] std::shared_ptr<Callable> asCallable() const;
-    [[nodiscard]] std::shared_ptr<std::vector<Value>> asList() const;
-    [[nodiscard]] std::shared_ptr<FocusClass> asClass() const;
-    [[nodiscard]] std::shared_ptr<FocusInstance> asInstance() const;
+    [[nodiscard]] bool asBool() const {
+        if (!isBool()) badAccess("boolean");
+        return bits == kTrue;
+    }
+    [[nodiscard]] double asNumber() const {
+        if (!isNumber()) badAccess("number");
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+    // Flattens a string built by concatenation, which is then kept
+    [[nodiscard]] const std::string& asString() const;
+    // Length of a string without flattening it
+    [[nodiscard]] size_t stringLength() const;
+    // Text of a string, valid while the value is; a slice's is not copied
+    [[nodiscard]] std::string_view stringView() const;
+    [[nodiscard]] const std::shared_ptr<Callable>& asCallable() const;
+    [[nodiscard]] const std::shared_ptr<std::vector<Value>>& asList() const;
+    [[nodiscard]] const std::shared_ptr<FocusClass>& asClass() const;
+    [[nodiscard]] const std::shared_ptr<FocusInstance>& asInstance() const;
+    [[nodiscard]] const std::shared_ptr<Iterable>& asIterable() const;
+    [[nodiscard]] const std::shared_ptr<std::vector<double>>& asArray() const;
+    [[nodiscard]] const std::shared_ptr<FocusMap>& asMap() const;
+    [[nodiscard]] const std::shared_ptr<Module>& asModule() const;
+    [[nodiscard]] const std::shared_ptr<Future>& asFuture() const;
+
+    // left + right where either is a string, converting the other with
+    // toString. Appending to the result of an earlier concatenation reuses
+    // its buffer, so building a string piece by piece is linear overall.
+    static Value concat(const Value& left, const Value& right);
+
+    // String of text that owner keeps alive, without copying it
+    static Value slice(std::shared_ptr<const void> owner, std::string_view text);
+    // length characters of string from offset on, sharing its text
+    static Value slice(const Value& string, size_t offset, size_t length);
 
     // Utility methods
     [[nodiscard]] bool isTruthy() const;
     [[nodiscard]] std::string toString() const;
+    // Appends what toString() returns, without building it separately
+    void appendTo(std::string& out) const;
     [[nodiscard]] std::string getType() const;
 
     // Operators
     bool operator==(const Value& other) const;
     bool operator!=(const Value& other) const;
-};
\ No newline at end of file
+
+    // Consistent with ==: values that compare equal hash alike
+    [[nodiscard]] size_t hash() const;
+};
+
+struct ValueHash {
+    size_t operator()(const Value& value) const { return value.hash(); }
+};
+
+static_assert(sizeof(Value) == 8, "Value must stay a single machine word");
@@ -0,0 +1,52 @@
+#include "session.hpp"
+#include "lexer/lexer.hpp"
+#include "parser/parser.hpp"
+#include "parser/optimizer.hpp"
+#include "parser/resolver.hpp"
+#include "error/error_handler.hpp"
+#include "utils/file_utils.hpp"
+
+NodeList<StmtPtr> Session::parse(std::string_view source, AstArena& arena, bool optimize) {
+    Lexer lexer(source);
+    auto tokens = lexer.scanTokens();
+    if (ErrorHandler::getHadError()) return {};
+    
+    Parser parser(std::move(tokens), arena);
+    auto statements = parser.parse();
+    if (ErrorHandler::getHadError()) return {};
+    
+    if (optimize) {
+        Optimizer optimizer(arena);
+        optimizer.optimize(statements);
+    }
+    
+    Resolver resolver;
+    resolver.resolve(statements);
+    return statements;
+}
+
+bool Session::run(std::string_view source) {
+    ErrorHandler::reset();
+    trees.push_back(std::make_unique<AstArena>());
+    auto statements = parse(source, *trees.back(), optimize);
+    if (ErrorHandler::getHadError()) {
+        trees.pop_back();
+        return false;
+    }
+    
+    interpreter_.interpret(statements);
+    return !ErrorHandler::getHadRuntimeError();
+}
+
+bool Session::runFile(const std::string& path) {
+    MappedFile file(path);
+    return run(file.contents());
+}
+
+void Session::define(const std::string& name, const Value& value) {
+    interpreter_.getGlobals()->define(name, value);
+}
+
+Value Session::get(const std::string& name) {
+    return interpreter_.getGlobals()->get(Token(TokenType::IDENTIFIER, name, "", 0, 0));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "interpreter.hpp"
+#include "parser/ast_arena.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An embeddable Focus Nexus instance: a tree-walking interpreter, its
+// globals and the trees of everything it has run. Sessions share nothing
+// but interned strings, the library registry and the parsed trees of
+// imported modules, all safe to use from any thread, so a host can run
+// one session per thread; each has modules of its own. A single session
+// must only be used by one thread at a time.
+class Session {
+private:
+    Interpreter interpreter_;
+    // Every tree run so far is kept: functions declared in it point into it
+    std::vector<std::unique_ptr<AstArena>> trees;
+    bool optimize;
+
+public:
+    explicit Session(bool optimize = true) : optimize(optimize) {}
+
+    // Runs source in this session's globals. Returns false if it didn't
+    // parse or raised a runtime error; either has been reported on stderr.
+    bool run(std::string_view source);
+    // Same for a script file; throws if it can't be read
+    bool runFile(const std::string& path);
+
+    // Globals the host shares with scripts
+    void define(const std::string& name, const Value& value);
+    // Throws RuntimeError if name is not defined
+    Value get(const std::string& name);
+
+    Interpreter& interpreter() { return interpreter_; }
+
+    // Lexes, parses, optimizes and resolves source into arena; empty after
+    // a reported error
+    static NodeList<StmtPtr> parse(std::string_view source, AstArena& arena, bool optimize);
+};
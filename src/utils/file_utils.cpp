@@ -2,14 +2,69 @@
 #include <fstream>
 #include <sstream>
 #include <filesystem>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* address = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                // Read front to back, so the kernel may read ahead further
+                ::madvise(address, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+                data = static_cast<const char*>(address);
+                size = static_cast<size_t>(info.st_size);
+                mapped = true;
+            }
+        }
+        ::close(fd);
+        if (mapped) return;
+    }
+#endif
+
+    // Empty files, pipes and platforms without mmap are read instead
+    buffer = FileUtils::readFile(path);
+    data = buffer.data();
+    size = buffer.size();
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped) {
+        ::munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
 
 std::string FileUtils::readFile(const std::string& path) {
-    std::ifstream file(path);
+    std::ifstream file(path, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Could not open file: " + path);
     }
     
+    // Read straight into the result when the size is known up front
+    file.seekg(0, std::ios::end);
+    std::streamoff length = file.tellg();
+    if (length >= 0) {
+        std::string content(static_cast<size_t>(length), '\0');
+        file.seekg(0, std::ios::beg);
+        file.read(&content[0], length);
+        content.resize(static_cast<size_t>(file.gcount()));
+        return content;
+    }
+    
     std::ostringstream oss;
+    file.clear();
+    file.seekg(0, std::ios::beg);
     oss << file.rdbuf();
     return oss.str();
 }
@@ -1,7 +1,28 @@
 #pragma once
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Read-only contents of a whole file, memory-mapped where the platform
+// supports it so the data is never copied. The view stays valid for the
+// lifetime of the object.
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer; // fallback when the file can't be mapped
+
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view contents() const { return std::string_view(data, size); }
+};
+
 class FileUtils {
 public:
     static std::string readFile(const std::string& path);
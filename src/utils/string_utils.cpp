@@ -1,70 +1,96 @@
 #include "string_utils.hpp"
 #include <algorithm>
-#include <sstream>
 #include <cctype>
 
-std::string StringUtils::trim(const std::string& str) {
-    size_t start = str.find_first_not_of(" \t\n\r\f\v");
-    if (start == std::string::npos) return "";
+namespace {
+
+constexpr std::string_view kWhitespace = " \t\n\r\f\v";
+
+} // namespace
+
+std::string_view StringUtils::trim(std::string_view str) {
+    size_t start = str.find_first_not_of(kWhitespace);
+    if (start == std::string_view::npos) return str.substr(str.size());
     
-    size_t end = str.find_last_not_of(" \t\n\r\f\v");
+    size_t end = str.find_last_not_of(kWhitespace);
     return str.substr(start, end - start + 1);
 }
 
-std::vector<std::string> StringUtils::split(const std::string& str, char delimiter) {
-    std::vector<std::string> tokens;
-    std::stringstream ss(str);
-    std::string token;
+std::vector<std::string_view> StringUtils::split(std::string_view str, std::string_view delimiter) {
+    std::vector<std::string_view> tokens;
+    if (delimiter.empty()) {
+        tokens.push_back(str);
+        return tokens;
+    }
     
-    while (std::getline(ss, token, delimiter)) {
-        tokens.push_back(token);
+    size_t start = 0;
+    size_t end;
+    while ((end = str.find(delimiter, start)) != std::string_view::npos) {
+        tokens.push_back(str.substr(start, end - start));
+        start = end + delimiter.size();
     }
+    tokens.push_back(str.substr(start));
     
     return tokens;
 }
 
-std::string StringUtils::join(const std::vector<std::string>& strings, const std::string& delimiter) {
-    if (strings.empty()) return "";
+std::vector<std::string_view> StringUtils::splitWhitespace(std::string_view str) {
+    std::vector<std::string_view> tokens;
+    size_t start = str.find_first_not_of(kWhitespace);
+    while (start != std::string_view::npos) {
+        size_t end = str.find_first_of(kWhitespace, start);
+        if (end == std::string_view::npos) end = str.size();
+        tokens.push_back(str.substr(start, end - start));
+        start = str.find_first_not_of(kWhitespace, end);
+    }
     
-    std::ostringstream oss;
+    return tokens;
+}
+
+std::string StringUtils::join(const std::vector<std::string>& strings, std::string_view delimiter) {
+    std::string result;
     for (size_t i = 0; i < strings.size(); ++i) {
-        if (i > 0) oss << delimiter;
-        oss << strings[i];
+        if (i > 0) result += delimiter;
+        result += strings[i];
     }
     
-    return oss.str();
+    return result;
 }
 
-bool StringUtils::startsWith(const std::string& str, const std::string& prefix) {
-    return str.length() >= prefix.length() && 
-           str.compare(0, prefix.length(), prefix) == 0;
+bool StringUtils::startsWith(std::string_view str, std::string_view prefix) {
+    return str.substr(0, prefix.size()) == prefix;
 }
 
-bool StringUtils::endsWith(const std::string& str, const std::string& suffix) {
-    return str.length() >= suffix.length() && 
-           str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+bool StringUtils::endsWith(std::string_view str, std::string_view suffix) {
+    return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
 }
 
-std::string StringUtils::toLower(const std::string& str) {
-    std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+std::string StringUtils::toLower(std::string_view str) {
+    std::string result(str);
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
     return result;
 }
 
-std::string StringUtils::toUpper(const std::string& str) {
-    std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
+std::string StringUtils::toUpper(std::string_view str) {
+    std::string result(str);
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
     return result;
 }
 
-std::string StringUtils::replace(const std::string& str, const std::string& from, const std::string& to) {
-    std::string result = str;
-    size_t pos = 0;
+std::string StringUtils::replace(std::string_view str, std::string_view from, std::string_view to) {
+    if (from.empty()) return std::string(str);
     
-    while ((pos = result.find(from, pos)) != std::string::npos) {
-        result.replace(pos, from.length(), to);
-        pos += to.length();
+    std::string result;
+    size_t start = 0;
+    size_t pos;
+    while ((pos = str.find(from, start)) != std::string_view::npos) {
+        result.append(str, start, pos - start);
+        result += to;
+        start = pos + from.size();
     }
+    result.append(str, start);
     
     return result;
-}
\ No newline at end of file
+}
@@ -1,15 +1,20 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
+// The views returned point into the text passed in, nothing is copied
 class StringUtils {
 public:
-    static std::string trim(const std::string& str);
-    static std::vector<std::string> split(const std::string& str, char delimiter);
-    static std::string join(const std::vector<std::string>& strings, const std::string& delimiter);
-    static bool startsWith(const std::string& str, const std::string& prefix);
-    static bool endsWith(const std::string& str, const std::string& suffix);
-    static std::string toLower(const std::string& str);
-    static std::string toUpper(const std::string& str);
-    static std::string replace(const std::string& str, const std::string& from, const std::string& to);
-};
\ No newline at end of file
+    static std::string_view trim(std::string_view str);
+    // Every piece between delimiters, empty ones included
+    static std::vector<std::string_view> split(std::string_view str, std::string_view delimiter);
+    // Runs of whitespace separate the pieces; there are no empty ones
+    static std::vector<std::string_view> splitWhitespace(std::string_view str);
+    static std::string join(const std::vector<std::string>& strings, std::string_view delimiter);
+    static bool startsWith(std::string_view str, std::string_view prefix);
+    static bool endsWith(std::string_view str, std::string_view suffix);
+    static std::string toLower(std::string_view str);
+    static std::string toUpper(std::string_view str);
+    static std::string replace(std::string_view str, std::string_view from, std::string_view to);
+};
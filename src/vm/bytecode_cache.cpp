@@ -0,0 +1,768 @@
+#include "bytecode_cache.hpp"
+#include "vm.hpp"
+#include "../utils/file_utils.hpp"
+#include "../error/exceptions.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t kMagic = 0x43424e46; // "FNBC"; reads back wrong on other byte orders
+constexpr uint32_t kVersion = 7;        // bump whenever opcodes or this layout change
+
+enum class ConstantTag : uint8_t { Nil, False, True, Number, String };
+
+#define FOCUS_OPCODE_COUNT(name) +1
+constexpr int kOpCodeCount = 0 FOCUS_OPCODES(FOCUS_OPCODE_COUNT);
+#undef FOCUS_OPCODE_COUNT
+
+[[noreturn]] void corrupt(const std::string& what) {
+    throw std::runtime_error("bad " + what + " in bytecode cache");
+}
+
+class Writer {
+public:
+    std::string bytes;
+
+    void u8(uint8_t value) { bytes.push_back(static_cast<char>(value)); }
+    void u32(uint32_t value) { raw(&value, sizeof value); }
+    void i32(int32_t value) { raw(&value, sizeof value); }
+    void u64(uint64_t value) { raw(&value, sizeof value); }
+    void f64(double value) { raw(&value, sizeof value); }
+    void str(std::string_view text) {
+        u32(static_cast<uint32_t>(text.size()));
+        bytes.append(text.data(), text.size());
+    }
+
+private:
+    void raw(const void* data, size_t size) { bytes.append(static_cast<const char*>(data), size); }
+};
+
+// Every read is bounds-checked; a truncated or damaged file throws
+class Reader {
+private:
+    std::string_view bytes;
+    size_t position;
+
+public:
+    Reader(std::string_view bytes, size_t position) : bytes(bytes), position(position) {}
+
+    uint8_t u8() { return static_cast<uint8_t>(*take(1)); }
+    uint32_t u32() { return read<uint32_t>(); }
+    int32_t i32() { return read<int32_t>(); }
+    uint64_t u64() { return read<uint64_t>(); }
+    double f64() { return read<double>(); }
+    std::string_view str() {
+        uint32_t size = u32();
+        return std::string_view(take(size), size);
+    }
+    const uint8_t* block(size_t size) { return reinterpret_cast<const uint8_t*>(take(size)); }
+
+private:
+    template <typename T>
+    T read() {
+        T value;
+        std::memcpy(&value, take(sizeof value), sizeof value);
+        return value;
+    }
+
+    const char* take(size_t size) {
+        if (size > bytes.size() - position) {
+            throw std::runtime_error("truncated bytecode cache");
+        }
+        const char* data = bytes.data() + position;
+        position += size;
+        return data;
+    }
+};
+
+void writeConstant(Writer& out, const Value& value) {
+    if (value.isNil()) {
+        out.u8(static_cast<uint8_t>(ConstantTag::Nil));
+    } else if (value.isBool()) {
+        out.u8(static_cast<uint8_t>(value.asBool() ? ConstantTag::True : ConstantTag::False));
+    } else if (value.isNumber()) {
+        out.u8(static_cast<uint8_t>(ConstantTag::Number));
+        out.f64(value.asNumber());
+    } else if (value.isString()) {
+        out.u8(static_cast<uint8_t>(ConstantTag::String));
+        out.str(value.asString());
+    } else {
+        throw std::runtime_error("constant of type " + value.getType() + " can't be cached");
+    }
+}
+
+Value readConstant(Reader& in) {
+    switch (static_cast<ConstantTag>(in.u8())) {
+        case ConstantTag::Nil: return Value();
+        case ConstantTag::False: return Value(false);
+        case ConstantTag::True: return Value(true);
+        case ConstantTag::Number: return Value(in.f64());
+        case ConstantTag::String: return Value(std::string(in.str()));
+    }
+    throw std::runtime_error("bad constant in bytecode cache");
+}
+
+// Reads past a constant without making its value
+ConstantTag skipConstant(Reader& in) {
+    auto tag = static_cast<ConstantTag>(in.u8());
+    switch (tag) {
+        case ConstantTag::Nil:
+        case ConstantTag::False:
+        case ConstantTag::True: return tag;
+        case ConstantTag::Number: in.f64(); return tag;
+        case ConstantTag::String: in.str(); return tag;
+    }
+    corrupt("constant");
+}
+
+// The chunk of one function; nested functions are referenced by index
+void writeChunk(Writer& out, const Chunk& chunk,
+                const std::unordered_map<const VmFunction*, uint32_t>& indices) {
+    out.u32(static_cast<uint32_t>(chunk.code.size()));
+    out.bytes.append(reinterpret_cast<const char*>(chunk.code.data()), chunk.code.size());
+
+    // Positions repeat for every byte of an instruction, so runs are short
+    Writer runs;
+    uint32_t runCount = 0;
+    for (size_t i = 0; i < chunk.code.size();) {
+        size_t end = i + 1;
+        while (end < chunk.code.size() && chunk.lines[end] == chunk.lines[i] && chunk.columns[end] == chunk.columns[i]) {
+            end++;
+        }
+        runs.i32(chunk.lines[i]);
+        runs.i32(chunk.columns[i]);
+        runs.u32(static_cast<uint32_t>(end - i));
+        runCount++;
+        i = end;
+    }
+    out.u32(runCount);
+    out.bytes += runs.bytes;
+
+    out.u32(static_cast<uint32_t>(chunk.constants.size()));
+    for (const auto& constant : chunk.constants) {
+        writeConstant(out, constant);
+    }
+
+    out.u32(static_cast<uint32_t>(chunk.tokens.size()));
+    for (const auto& token : chunk.tokens) {
+        out.u32(static_cast<uint32_t>(token.type));
+        out.str(token.lexeme);
+        out.str(token.literal);
+        out.i32(token.line);
+        out.i32(token.column);
+    }
+
+    out.u32(static_cast<uint32_t>(chunk.functions.size()));
+    for (const auto& function : chunk.functions) {
+        out.u32(indices.at(function.get()));
+    }
+
+    out.u32(static_cast<uint32_t>(chunk.caches.size()));
+    out.u32(static_cast<uint32_t>(chunk.nativeSites.size()));
+
+    out.u32(static_cast<uint32_t>(chunk.switches.size()));
+    for (const auto& table : chunk.switches) {
+        out.i32(table.otherwise);
+        out.u32(static_cast<uint32_t>(table.entries().size()));
+        for (const auto& entry : table.entries()) {
+            writeConstant(out, entry.first);
+            out.i32(entry.second);
+        }
+    }
+}
+
+} // namespace
+
+uint64_t BytecodeCache::hash(std::string_view source) {
+    // 64-bit FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : source) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string BytecodeCache::pathFor(const std::string& sourcePath) {
+    return sourcePath + "c";
+}
+
+std::shared_ptr<VmFunction> BytecodeCache::load(const std::string& sourcePath, uint64_t sourceHash, VM& vm) {
+    std::string path = pathFor(sourcePath);
+    if (!FileUtils::fileExists(path)) return nullptr;
+
+    try {
+        auto image = std::make_shared<BytecodeImage>(path);
+        Reader in(image->bytes(), 0);
+        if (in.u32() != kMagic || in.u32() != kVersion || in.u64() != sourceHash) return nullptr;
+
+        // Global operands are only valid if this VM hands out the same slots
+        uint32_t globalCount = in.u32();
+        for (uint32_t slot = 0; slot < globalCount; slot++) {
+            if (vm.globalSlot(std::string(in.str())) != static_cast<int>(slot)) return nullptr;
+        }
+
+        uint32_t functionCount = in.u32();
+        for (uint32_t i = 0; i < functionCount; i++) {
+            BytecodeImage::Entry entry;
+            entry.name = std::string(in.str());
+            entry.line = in.i32();
+            entry.arity = in.i32();
+            entry.frameSlots = in.i32();
+            entry.upvalueCount = in.i32();
+            uint8_t flags = in.u8();
+            entry.isMethod = (flags & 1) != 0;
+            entry.isLambda = (flags & 2) != 0;
+            entry.isAsync = (flags & 4) != 0;
+            entry.offset = in.u64();
+            entry.size = in.u64();
+            if (entry.offset > image->bytes().size() || entry.size > image->bytes().size() - entry.offset ||
+                entry.arity < 0 || entry.frameSlots < 0 || entry.upvalueCount < 0) {
+                return nullptr;
+            }
+            image->entries.push_back(std::move(entry));
+        }
+        if (functionCount == 0) return nullptr;
+
+        // Chunks are checked now rather than when they are decoded, so a
+        // damaged one is rebuilt like a stale cache instead of failing the
+        // run the first time its function is called
+        for (uint32_t i = 0; i < functionCount; i++) {
+            image->verify(i, globalCount);
+        }
+
+        return image->function(0);
+    } catch (const std::exception&) {
+        return nullptr; // unreadable caches are rebuilt
+    }
+}
+
+bool BytecodeCache::store(const std::string& sourcePath, uint64_t sourceHash, const VmFunction& script, const VM& vm) {
+    // Number the functions breadth-first, the script first
+    std::vector<const VmFunction*> functions{&script};
+    std::unordered_map<const VmFunction*, uint32_t> indices{{&script, 0}};
+    for (size_t i = 0; i < functions.size(); i++) {
+        for (const auto& child : functions[i]->chunk.functions) {
+            if (indices.emplace(child.get(), static_cast<uint32_t>(functions.size())).second) {
+                functions.push_back(child.get());
+            }
+        }
+    }
+
+    Writer chunks;
+    std::vector<std::pair<uint64_t, uint64_t>> extents; // offset in chunks, size
+    try {
+        for (const VmFunction* function : functions) {
+            size_t start = chunks.bytes.size();
+            writeChunk(chunks, function->chunk, indices);
+            extents.emplace_back(start, chunks.bytes.size() - start);
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    Writer header;
+    header.u32(kMagic);
+    header.u32(kVersion);
+    header.u64(sourceHash);
+    std::vector<std::string> globals = vm.globalNames();
+    header.u32(static_cast<uint32_t>(globals.size()));
+    for (const auto& name : globals) {
+        header.str(name);
+    }
+
+    // Entries have a fixed size apart from the name, so the header size
+    // (and with it where the chunks start) is known before writing them
+    size_t headerSize = header.bytes.size() + sizeof(uint32_t);
+    for (const VmFunction* function : functions) {
+        headerSize += sizeof(uint32_t) + function->name.size() + 4 * sizeof(int32_t) + 1 + 2 * sizeof(uint64_t);
+    }
+
+    header.u32(static_cast<uint32_t>(functions.size()));
+    for (size_t i = 0; i < functions.size(); i++) {
+        const VmFunction& function = *functions[i];
+        header.str(function.name);
+        header.i32(function.line);
+        header.i32(function.arity);
+        header.i32(function.frameSlots);
+        header.i32(function.upvalueCount);
+        header.u8(static_cast<uint8_t>((function.isMethod ? 1 : 0) | (function.isLambda ? 2 : 0) |
+                                       (function.isAsync ? 4 : 0)));
+        header.u64(headerSize + extents[i].first);
+        header.u64(extents[i].second);
+    }
+
+    // Written aside and renamed, so concurrent runs never see half a file
+    std::string path = pathFor(sourcePath);
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(header.bytes.data(), static_cast<std::streamsize>(header.bytes.size()));
+        out.write(chunks.bytes.data(), static_cast<std::streamsize>(chunks.bytes.size()));
+        if (!out) {
+            out.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<VmFunction> BytecodeImage::function(uint32_t index) {
+    if (index >= entries.size()) {
+        throw std::runtime_error("bad function index in bytecode cache");
+    }
+    const Entry& entry = entries[index];
+    auto function = std::make_shared<VmFunction>();
+    function->name = entry.name;
+    function->line = entry.line;
+    function->arity = entry.arity;
+    function->frameSlots = entry.frameSlots;
+    function->upvalueCount = entry.upvalueCount;
+    function->isMethod = entry.isMethod;
+    function->isLambda = entry.isLambda;
+    function->isAsync = entry.isAsync;
+    function->image = shared_from_this();
+    function->imageIndex = index;
+    return function;
+}
+
+void BytecodeImage::decode(VmFunction& function) const {
+    const Entry& entry = entries[function.imageIndex];
+    Reader in(bytes().substr(0, entry.offset + entry.size), entry.offset);
+    Chunk& chunk = function.chunk;
+
+    uint32_t codeSize = in.u32();
+    const uint8_t* code = in.block(codeSize);
+    chunk.code.assign(code, code + codeSize);
+
+    uint32_t runCount = in.u32();
+    chunk.lines.reserve(codeSize);
+    chunk.columns.reserve(codeSize);
+    for (uint32_t i = 0; i < runCount; i++) {
+        int line = in.i32();
+        int column = in.i32();
+        uint32_t count = in.u32();
+        if (count > codeSize - chunk.lines.size()) {
+            throw std::runtime_error("bad positions in bytecode cache");
+        }
+        chunk.lines.insert(chunk.lines.end(), count, line);
+        chunk.columns.insert(chunk.columns.end(), count, column);
+    }
+    if (chunk.lines.size() != codeSize) {
+        throw std::runtime_error("bad positions in bytecode cache");
+    }
+
+    uint32_t constantCount = in.u32();
+    chunk.constants.reserve(constantCount);
+    for (uint32_t i = 0; i < constantCount; i++) {
+        chunk.constants.push_back(readConstant(in));
+    }
+
+    uint32_t tokenCount = in.u32();
+    chunk.tokens.reserve(tokenCount);
+    for (uint32_t i = 0; i < tokenCount; i++) {
+        auto type = static_cast<TokenType>(in.u32());
+        std::string_view lexeme = in.str();
+        std::string_view literal = in.str();
+        int line = in.i32();
+        int column = in.i32();
+        chunk.tokens.emplace_back(type, lexeme, literal, line, column);
+    }
+
+    uint32_t functionCount = in.u32();
+    chunk.functions.reserve(functionCount);
+    for (uint32_t i = 0; i < functionCount; i++) {
+        // const_cast: function() only reads the entries and shares ownership
+        chunk.functions.push_back(const_cast<BytecodeImage*>(this)->function(in.u32()));
+    }
+
+    uint32_t cacheCount = in.u32();
+    for (uint32_t i = 0; i < cacheCount; i++) {
+        chunk.addCache();
+    }
+
+    uint32_t nativeSiteCount = in.u32();
+    for (uint32_t i = 0; i < nativeSiteCount; i++) {
+        chunk.addNativeSite();
+    }
+
+    uint32_t switchCount = in.u32();
+    for (uint32_t i = 0; i < switchCount; i++) {
+        SwitchTable table;
+        table.otherwise = in.i32();
+        uint32_t entryCount = in.u32();
+        for (uint32_t j = 0; j < entryCount; j++) {
+            Value value = readConstant(in);
+            table.add(value, in.i32());
+        }
+        chunk.addSwitch(std::move(table));
+    }
+}
+
+void BytecodeImage::verify(uint32_t index, size_t globalCount) const {
+    const Entry& entry = entries[index];
+    Reader in(bytes().substr(0, entry.offset + entry.size), entry.offset);
+
+    uint32_t codeSize = in.u32();
+    const uint8_t* code = in.block(codeSize);
+    uint32_t runCount = in.u32();
+    in.block(static_cast<size_t>(runCount) * (2 * sizeof(int32_t) + sizeof(uint32_t))); // checked by decode()
+
+    std::vector<bool> strings; // whether each constant is a string
+    uint32_t constantCount = in.u32();
+    for (uint32_t i = 0; i < constantCount; i++) {
+        strings.push_back(skipConstant(in) == ConstantTag::String);
+    }
+
+    uint32_t tokenCount = in.u32();
+    for (uint32_t i = 0; i < tokenCount; i++) {
+        in.u32();
+        in.str();
+        in.str();
+        in.i32();
+        in.i32();
+    }
+
+    std::vector<uint32_t> functions; // entry index of each
+    uint32_t functionCount = in.u32();
+    for (uint32_t i = 0; i < functionCount; i++) {
+        functions.push_back(in.u32());
+        if (functions.back() >= entries.size()) corrupt("function index");
+    }
+
+    // Only counts are stored for these; every one belongs to an instruction
+    uint32_t cacheCount = in.u32();
+    uint32_t nativeSiteCount = in.u32();
+    if (cacheCount > codeSize || nativeSiteCount > codeSize) corrupt("table size");
+
+    std::vector<std::vector<int32_t>> switches; // the targets of each table
+    uint32_t switchCount = in.u32();
+    for (uint32_t i = 0; i < switchCount; i++) {
+        std::vector<int32_t> targets{in.i32()};
+        uint32_t entryCount = in.u32();
+        for (uint32_t j = 0; j < entryCount; j++) {
+            skipConstant(in);
+            targets.push_back(in.i32());
+        }
+        switches.push_back(std::move(targets));
+    }
+
+    // A frame starts with room for its slots and the headroom above them,
+    // so a stack this deep is always inside the stack
+    int64_t depthLimit = static_cast<int64_t>(entry.frameSlots) + static_cast<int64_t>(VM::kFrameHeadroom);
+    size_t upvalueCount = static_cast<size_t>(entry.upvalueCount);
+
+    // Each instruction, decoded once; the stack depth before each is
+    // worked out from them afterwards
+    struct Step {
+        size_t next = 0;       // offset of the instruction after it
+        int need = 0;          // values it reads off the stack
+        int effect = 0;        // on the depth when it falls through
+        int jumpEffect = 0;    // on the depth at each of its targets
+        int64_t locals = 0;    // one past the highest local slot it uses
+        size_t firstTarget = 0;
+        bool fallsThrough = true;
+    };
+    std::vector<Step> steps;
+    std::vector<size_t> targets; // of every step, in order
+    constexpr uint32_t kNoStep = UINT32_MAX;
+    std::vector<uint32_t> stepAt(codeSize, kNoStep);
+
+    size_t ip = 0;
+    auto byte = [&]() -> uint8_t {
+        if (ip >= codeSize) corrupt("instruction");
+        return code[ip++];
+    };
+    auto operand = [&]() -> uint16_t {
+        uint16_t high = byte();
+        return static_cast<uint16_t>((high << 8) | byte());
+    };
+    auto below = [&](size_t count, const char* what) -> uint16_t {
+        uint16_t value = operand();
+        if (value >= count) corrupt(what);
+        return value;
+    };
+    auto string = [&]() {
+        uint16_t constant = operand();
+        if (constant >= constantCount || !strings[constant]) corrupt("string constant");
+    };
+    auto nativeType = [&]() {
+        if (byte() > static_cast<uint8_t>(NativeType::String)) corrupt("native type");
+    };
+    auto jump = [&](int64_t target) {
+        if (target < 0 || target >= static_cast<int64_t>(codeSize)) corrupt("jump");
+        targets.push_back(static_cast<size_t>(target));
+    };
+
+    while (ip < codeSize) {
+        stepAt[ip] = static_cast<uint32_t>(steps.size());
+        Step step;
+        step.firstTarget = targets.size();
+        auto local = [&]() {
+            step.locals = std::max<int64_t>(step.locals, operand() + 1);
+        };
+        auto pops = [&](int count, int pushes) {
+            step.need = count;
+            step.effect = pushes - count;
+            step.jumpEffect = step.effect;
+        };
+
+        uint8_t op = byte();
+        if (op >= kOpCodeCount) corrupt("opcode");
+        switch (static_cast<OpCode>(op)) {
+            case OpCode::CONSTANT:
+                below(constantCount, "constant");
+                pops(0, 1);
+                break;
+            case OpCode::NIL:
+            case OpCode::TRUE:
+            case OpCode::FALSE: pops(0, 1); break;
+            case OpCode::POP: pops(1, 0); break;
+            case OpCode::DUP: pops(1, 2); break;
+            case OpCode::RESERVE: pops(0, operand()); break;
+            case OpCode::END_SCOPE: pops(operand(), 0); break;
+            case OpCode::GET_LOCAL:
+                local();
+                pops(0, 1);
+                break;
+            case OpCode::SET_LOCAL:
+                local();
+                pops(1, 1);
+                break;
+            case OpCode::GET_UPVALUE:
+                below(upvalueCount, "upvalue");
+                pops(0, 1);
+                break;
+            case OpCode::SET_UPVALUE:
+                below(upvalueCount, "upvalue");
+                pops(1, 1);
+                break;
+            case OpCode::GET_GLOBAL:
+                below(globalCount, "global");
+                pops(0, 1);
+                break;
+            case OpCode::SET_GLOBAL:
+                below(globalCount, "global");
+                pops(1, 1);
+                break;
+            case OpCode::DEFINE_GLOBAL:
+                below(globalCount, "global");
+                pops(1, 0);
+                break;
+            case OpCode::GET_PROPERTY:
+            case OpCode::SET_PROPERTY:
+                below(tokenCount, "token");
+                below(cacheCount, "property cache");
+                if (static_cast<OpCode>(op) == OpCode::GET_PROPERTY) {
+                    pops(1, 1);
+                } else {
+                    pops(2, 1);
+                }
+                break;
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+            case OpCode::GREATER:
+            case OpCode::GREATER_EQUAL:
+            case OpCode::LESS:
+            case OpCode::LESS_EQUAL:
+            case OpCode::ADD:
+            case OpCode::SUBTRACT:
+            case OpCode::MULTIPLY:
+            case OpCode::DIVIDE:
+            case OpCode::MODULO:
+            case OpCode::POWER:
+            case OpCode::SHIFT_LEFT:
+            case OpCode::SHIFT_RIGHT:
+            case OpCode::BIT_AND:
+            case OpCode::BIT_OR:
+            case OpCode::BIT_XOR:
+            case OpCode::AND:
+            case OpCode::OR:
+            case OpCode::INDEX: pops(2, 1); break;
+            case OpCode::NOT:
+            case OpCode::NEGATE:
+            case OpCode::BIT_NOT:
+            case OpCode::AWAIT:
+            case OpCode::ITERATE: pops(1, 1); break;
+            case OpCode::PRINT: pops(1, 0); break;
+            case OpCode::JUMP: {
+                uint16_t offset = operand();
+                jump(static_cast<int64_t>(ip) + offset);
+                step.fallsThrough = false;
+                break;
+            }
+            case OpCode::JUMP_IF_FALSE: {
+                uint16_t offset = operand();
+                jump(static_cast<int64_t>(ip) + offset);
+                pops(1, 0);
+                break;
+            }
+            case OpCode::LOOP: {
+                uint16_t offset = operand();
+                jump(static_cast<int64_t>(ip) - offset);
+                step.fallsThrough = false;
+                break;
+            }
+            case OpCode::FOR_ITER: {
+                local();
+                uint16_t offset = operand();
+                jump(static_cast<int64_t>(ip) + offset);
+                step.effect = 1; // the element, when there is one
+                break;
+            }
+            case OpCode::CALL: {
+                int argCount = byte();
+                pops(argCount + 1, 1);
+                break;
+            }
+            case OpCode::INVOKE: {
+                below(tokenCount, "token");
+                below(cacheCount, "property cache");
+                int argCount = byte();
+                pops(argCount + 2, 1); // with the receiver and the nil slot below it
+                break;
+            }
+            case OpCode::CLOSURE: {
+                uint16_t function = below(functions.size(), "function");
+                for (int i = 0; i < entries[functions[function]].upvalueCount; i++) {
+                    if (byte() != 0) {
+                        local();
+                    } else {
+                        below(upvalueCount, "upvalue");
+                    }
+                }
+                pops(0, 1);
+                break;
+            }
+            case OpCode::RETURN:
+                pops(1, 0);
+                step.fallsThrough = false;
+                break;
+            case OpCode::CLASS: {
+                string();
+                int methodCount = byte();
+                int superclass = byte() != 0 ? 1 : 0;
+                pops(methodCount + superclass, 1);
+                break;
+            }
+            case OpCode::LIST: pops(operand(), 1); break;
+            case OpCode::MAP: pops(2 * operand(), 1); break;
+            case OpCode::SET_INDEX: pops(3, 1); break;
+            case OpCode::EXTERN_CALL:
+            case OpCode::EXTERN_SPAWN: {
+                below(tokenCount, "token");
+                below(tokenCount, "token");
+                int argCount = byte();
+                if (static_cast<OpCode>(op) == OpCode::EXTERN_CALL) {
+                    below(nativeSiteCount, "native call site");
+                }
+                pops(argCount, 1);
+                break;
+            }
+            case OpCode::LOAD_LIBRARY:
+                string();
+                below(tokenCount, "token");
+                string();
+                string();
+                pops(0, 1);
+                break;
+            case OpCode::BIND_NATIVE: {
+                below(tokenCount, "token");
+                below(tokenCount, "token");
+                nativeType();
+                uint8_t arity = byte();
+                if (arity > NativeSignature::kMaxParams) corrupt("native arity");
+                for (uint8_t i = 0; i < arity; i++) {
+                    nativeType();
+                }
+                break;
+            }
+            case OpCode::IMPORT:
+                below(tokenCount, "token");
+                pops(0, 1);
+                break;
+            case OpCode::TRY_BEGIN: {
+                uint16_t offset = operand();
+                jump(static_cast<int64_t>(ip) + offset);
+                step.jumpEffect = 1; // the handler starts with the message pushed
+                break;
+            }
+            case OpCode::TRY_END: break;
+            case OpCode::THROW:
+                pops(1, 1);
+                step.fallsThrough = false;
+                break;
+            case OpCode::SUPER:
+                below(tokenCount, "token");
+                step.fallsThrough = false;
+                break;
+            case OpCode::SWITCH: {
+                uint16_t table = below(switches.size(), "switch table");
+                for (int32_t offset : switches[table]) {
+                    jump(static_cast<int64_t>(ip) + offset);
+                }
+                pops(1, 0);
+                step.fallsThrough = false;
+                break;
+            }
+        }
+        step.next = ip;
+        steps.push_back(step);
+    }
+    if (steps.empty()) corrupt("instruction");
+
+    // Every path into an instruction has to reach it with the same depth,
+    // deep enough for what it reads
+    int64_t start = static_cast<int64_t>(entry.frameSlots);
+    if (index != 0) {
+        start = std::max<int64_t>(start, entry.arity + 1); // a call's frame starts at the callee
+    }
+    std::vector<int64_t> depths(steps.size(), -1);
+    std::vector<uint32_t> pending;
+    auto reach = [&](size_t offset, int64_t depth) {
+        if (offset >= codeSize || stepAt[offset] == kNoStep) corrupt("jump");
+        if (depth > depthLimit) corrupt("stack depth");
+        int64_t& known = depths[stepAt[offset]];
+        if (known == -1) {
+            known = depth;
+            pending.push_back(stepAt[offset]);
+        } else if (known != depth) {
+            corrupt("stack depth");
+        }
+    };
+    reach(0, start);
+    while (!pending.empty()) {
+        uint32_t current = pending.back();
+        pending.pop_back();
+        const Step& step = steps[current];
+        int64_t depth = depths[current];
+        if (depth < step.need || depth < step.locals) corrupt("stack depth");
+
+        size_t lastTarget = current + 1 < steps.size() ? steps[current + 1].firstTarget : targets.size();
+        for (size_t i = step.firstTarget; i < lastTarget; i++) {
+            reach(targets[i], depth + step.jumpEffect);
+        }
+        if (step.fallsThrough) reach(step.next, depth + step.effect);
+    }
+}
+
+void VmFunction::loadFromImage() {
+    // Dropping the image last keeps it mapped while decoding
+    std::shared_ptr<BytecodeImage> source = std::move(image);
+    try {
+        source->decode(*this);
+    } catch (const std::exception& error) {
+        throw RuntimeError(Token(), std::string("Corrupt bytecode cache: ") + error.what());
+    }
+}
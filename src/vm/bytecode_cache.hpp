@@ -0,0 +1,66 @@
+#pragma once
+#include "chunk.hpp"
+#include "../utils/file_utils.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class VM;
+
+// Compiled form of a script stored next to it (script.fn -> script.fnc),
+// so later runs on the VM skip lexing, parsing and compiling. A cache is
+// only used when the hash of the source it was built from matches, the
+// VM lays out its globals the same way and every chunk passes verify().
+//
+// Layout: a header with the source hash, the global names by slot and
+// one entry per function (its VmFunction fields plus where its chunk
+// is), followed by the chunks. Function 0 is the script.
+class BytecodeCache {
+public:
+    static uint64_t hash(std::string_view source);
+    static std::string pathFor(const std::string& sourcePath);
+
+    // The cached script, or null if there is no usable cache
+    static std::shared_ptr<VmFunction> load(const std::string& sourcePath, uint64_t sourceHash, VM& vm);
+    // Best effort: returns false if the cache couldn't be written
+    static bool store(const std::string& sourcePath, uint64_t sourceHash, const VmFunction& script, const VM& vm);
+};
+
+// A mapped cache file. Functions that haven't run yet point at it and
+// decode their own chunk on first call.
+class BytecodeImage : public std::enable_shared_from_this<BytecodeImage> {
+public:
+    struct Entry {
+        std::string name;
+        int line = 0;
+        int arity = 0;
+        int frameSlots = 0;
+        int upvalueCount = 0;
+        bool isMethod = false;
+        bool isLambda = false;
+        bool isAsync = false;
+        uint64_t offset = 0; // of the chunk, from the start of the file
+        uint64_t size = 0;
+    };
+
+    explicit BytecodeImage(const std::string& path) : file(path) {}
+
+    std::string_view bytes() const { return file.contents(); }
+
+    // An undecoded function for entry index
+    std::shared_ptr<VmFunction> function(uint32_t index);
+    // Fills in the chunk of a function made by function()
+    void decode(VmFunction& function) const;
+    // Throws unless every instruction in the chunk of entry index is
+    // whole and only uses what the chunk, the entries and the VM's
+    // globalCount globals have, and every path through it jumps to the
+    // start of an instruction with the stack deep enough for it
+    void verify(uint32_t index, size_t globalCount) const;
+
+    std::vector<Entry> entries;
+
+private:
+    MappedFile file;
+};
@@ -0,0 +1,67 @@
+#include "chunk.hpp"
+
+void Chunk::write(uint8_t byte, int line, int column) {
+    code.push_back(byte);
+    lines.push_back(line);
+    columns.push_back(column);
+}
+
+void Chunk::writeShort(uint16_t value, int line, int column) {
+    write(static_cast<uint8_t>((value >> 8) & 0xff), line, column);
+    write(static_cast<uint8_t>(value & 0xff), line, column);
+}
+
+int Chunk::addConstant(const Value& value) {
+    // Numbers and strings are deduplicated so the pool stays small for
+    // literal-heavy code. Heap values are never deduplicated.
+    if (value.isNumber()) {
+        auto it = numberConstants.find(value.asNumber());
+        if (it != numberConstants.end()) return it->second;
+    } else if (value.isString()) {
+        auto it = stringConstants.find(value.asString());
+        if (it != stringConstants.end()) return it->second;
+    }
+
+    int index = static_cast<int>(constants.size());
+    constants.push_back(value);
+    if (value.isNumber()) {
+        numberConstants.emplace(value.asNumber(), index);
+    } else if (value.isString()) {
+        stringConstants.emplace(value.asString(), index);
+    }
+    return index;
+}
+
+int Chunk::addToken(const Token& token) {
+    tokens.push_back(token);
+    return static_cast<int>(tokens.size() - 1);
+}
+
+int Chunk::addFunction(std::shared_ptr<VmFunction> function) {
+    functions.push_back(std::move(function));
+    return static_cast<int>(functions.size() - 1);
+}
+
+int Chunk::addCache() {
+    caches.push_back(std::make_unique<PropertyCache>());
+    return static_cast<int>(caches.size() - 1);
+}
+
+int Chunk::addNativeSite() {
+    nativeSites.push_back(std::make_unique<NativeCallSite>());
+    return static_cast<int>(nativeSites.size() - 1);
+}
+
+int Chunk::addSwitch(SwitchTable table) {
+    switches.push_back(std::move(table));
+    return static_cast<int>(switches.size() - 1);
+}
+
+const char* Chunk::opName(OpCode op) {
+    switch (op) {
+#define FOCUS_OPCODE_NAME(name) case OpCode::name: return #name;
+        FOCUS_OPCODES(FOCUS_OPCODE_NAME)
+#undef FOCUS_OPCODE_NAME
+    }
+    return "UNKNOWN";
+}
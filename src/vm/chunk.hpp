@@ -0,0 +1,145 @@
+#pragma once
+#include "../runtime/value.hpp"
+#include "../runtime/shape.hpp"
+#include "../runtime/native_binding.hpp"
+#include "../runtime/switch_table.hpp"
+#include "../lexer/token.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Operand widths: "u8" and "u16" operands follow the opcode byte, u16 in
+// big-endian order. Jump offsets are u16 and relative to the byte after
+// the operand.
+#define FOCUS_OPCODES(X) \
+    X(CONSTANT)       /* u16 constant */                                \
+    X(NIL)                                                              \
+    X(TRUE)                                                             \
+    X(FALSE)                                                            \
+    X(POP)                                                              \
+    X(DUP)                                                              \
+    X(RESERVE)        /* u16 count: push count nils for a new scope */  \
+    X(END_SCOPE)      /* u16 count: close upvalues, pop count slots */  \
+    X(GET_LOCAL)      /* u16 slot */                                    \
+    X(SET_LOCAL)      /* u16 slot */                                    \
+    X(GET_UPVALUE)    /* u16 upvalue */                                 \
+    X(SET_UPVALUE)    /* u16 upvalue */                                 \
+    X(GET_GLOBAL)     /* u16 global */                                  \
+    X(SET_GLOBAL)     /* u16 global */                                  \
+    X(DEFINE_GLOBAL)  /* u16 global */                                  \
+    X(GET_PROPERTY)   /* u16 token, u16 cache */                        \
+    X(SET_PROPERTY)   /* u16 token, u16 cache */                        \
+    X(EQUAL)                                                            \
+    X(NOT_EQUAL)                                                        \
+    X(GREATER)                                                          \
+    X(GREATER_EQUAL)                                                    \
+    X(LESS)                                                             \
+    X(LESS_EQUAL)                                                       \
+    X(ADD)                                                              \
+    X(SUBTRACT)                                                         \
+    X(MULTIPLY)                                                         \
+    X(DIVIDE)                                                           \
+    X(MODULO)                                                           \
+    X(POWER)                                                            \
+    X(SHIFT_LEFT)                                                       \
+    X(SHIFT_RIGHT)                                                      \
+    X(BIT_AND)                                                          \
+    X(BIT_OR)                                                           \
+    X(BIT_XOR)                                                          \
+    X(AND)            /* both operands already evaluated */             \
+    X(OR)                                                               \
+    X(NOT)                                                              \
+    X(NEGATE)                                                           \
+    X(BIT_NOT)                                                          \
+    X(AWAIT)          /* replaces a future on top with its result */    \
+    X(PRINT)                                                            \
+    X(JUMP)           /* u16 offset */                                  \
+    X(JUMP_IF_FALSE)  /* u16 offset, pops the condition */              \
+    X(LOOP)           /* u16 offset backwards */                        \
+    X(ITERATE)        /* replaces the value on top with an iterator */  \
+    X(FOR_ITER)       /* u16 iterator slot, u16 offset taken when done; else pushes the element */ \
+    X(CALL)           /* u8 argc */                                     \
+    X(INVOKE)         /* u16 token, u16 cache, u8 argc; below the receiver is a nil slot */ \
+    X(CLOSURE)        /* u16 function, then u8 isLocal + u16 index per upvalue */ \
+    X(RETURN)                                                           \
+    X(CLASS)          /* u16 name, u8 methods, u8 hasSuperclass; pops them */ \
+    X(LIST)           /* u16 count */                                   \
+    X(INDEX)                                                            \
+    X(MAP)            /* u16 count: pops count key/value pairs */       \
+    X(SET_INDEX)      /* object, index, value: stores, leaves value */  \
+    X(EXTERN_CALL)    /* u16 library token, u16 function token, u8 argc, u16 native site */ \
+    X(EXTERN_SPAWN)   /* u16 library token, u16 function token, u8 argc: pushes a future */ \
+    X(LOAD_LIBRARY)   /* u16 path, u16 alias, u16 type, u16 message */  \
+    X(BIND_NATIVE)    /* u16 library token, u16 function token, u8 result, u8 arity, then u8 per param */ \
+    X(IMPORT)         /* u16 module token: pushes the module */          \
+    X(TRY_BEGIN)      /* u16 offset to the handler */                   \
+    X(TRY_END)                                                          \
+    X(THROW)                                                            \
+    X(SUPER)          /* u16 token */                                   \
+    X(SWITCH)         /* u16 table: pops the value, jumps to its case */
+
+enum class OpCode : uint8_t {
+#define FOCUS_OPCODE_ENUM(name) name,
+    FOCUS_OPCODES(FOCUS_OPCODE_ENUM)
+#undef FOCUS_OPCODE_ENUM
+};
+
+class VmFunction;
+class BytecodeImage;
+
+class Chunk {
+public:
+    std::vector<uint8_t> code;
+    std::vector<int> lines;   // source position of each code byte
+    std::vector<int> columns;
+    std::vector<Value> constants;
+    std::vector<Token> tokens; // names used by property and extern ops
+    std::vector<std::shared_ptr<VmFunction>> functions;
+    std::vector<std::unique_ptr<PropertyCache>> caches; // one per property site
+    std::vector<std::unique_ptr<NativeCallSite>> nativeSites; // one per call_native
+    std::vector<SwitchTable> switches; // jump offsets from the end of the SWITCH
+
+    void write(uint8_t byte, int line, int column);
+    void writeShort(uint16_t value, int line, int column);
+
+    int addConstant(const Value& value);
+    int addToken(const Token& token);
+    int addFunction(std::shared_ptr<VmFunction> function);
+    int addCache();
+    int addNativeSite();
+    int addSwitch(SwitchTable table);
+
+    static const char* opName(OpCode op);
+
+private:
+    std::unordered_map<double, int> numberConstants;
+    std::unordered_map<std::string, int> stringConstants;
+};
+
+// Compiled function prototype; instantiated at runtime as a VmClosure.
+class VmFunction {
+public:
+    std::string name;      // empty for lambdas and the top-level script
+    int line = 0;          // where the declaration starts
+    int arity = 0;
+    int frameSlots = 0;    // locals of the function scope, parameters included
+    int upvalueCount = 0;
+    bool isMethod = false; // slot 0 holds `this`
+    bool isLambda = false;
+    bool isAsync = false;  // calls start a task and return its future
+    Chunk chunk;
+
+    // Functions read from a bytecode cache get their chunk decoded the
+    // first time they run; until then image is set
+    std::shared_ptr<BytecodeImage> image;
+    uint32_t imageIndex = 0;
+
+    void ensureLoaded() {
+        if (image) loadFromImage();
+    }
+
+private:
+    void loadFromImage(); // bytecode_cache.cpp
+};
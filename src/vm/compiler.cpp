@@ -0,0 +1,856 @@
+#include "compiler.hpp"
+#include "vm.hpp"
+#include "../error/error_handler.hpp"
+
+Compiler::Compiler(VM& vm) : vm(vm) {}
+
+std::shared_ptr<VmFunction> Compiler::compile(const NodeList<StmtPtr>& statements) {
+    FunctionState script{nullptr, std::make_shared<VmFunction>()};
+    current = &script;
+    scopes.clear();
+
+    for (const auto& statement : statements) {
+        compile(*statement);
+    }
+    emitOp(OpCode::NIL);
+    emitOp(OpCode::RETURN);
+
+    current = nullptr;
+    return script.function;
+}
+
+void Compiler::compile(Stmt& stmt) {
+    stmt.accept(*this);
+}
+
+void Compiler::compile(Expr& expr) {
+    expr.accept(*this);
+}
+
+void Compiler::compileFunction(const std::string& name, int line, const NodeList<Token>& params,
+                               const NodeList<StmtPtr>& body, int slotCount, bool isMethod, bool isLambda,
+                               bool isAsync) {
+    FunctionState state{current, std::make_shared<VmFunction>()};
+    state.function->name = name;
+    state.function->line = line;
+    state.function->arity = static_cast<int>(params.size());
+    state.function->frameSlots = slotCount;
+    state.function->isMethod = isMethod;
+    state.function->isLambda = isLambda;
+    state.function->isAsync = isAsync;
+    state.localCount = slotCount;
+
+    // Parameters (and `this` for methods) are the first slots of the
+    // function scope, already on the stack when the frame starts.
+    current = &state;
+    scopes.push_back({&state, 0});
+
+    for (const auto& statement : body) {
+        compile(*statement);
+    }
+    emitOp(OpCode::NIL);
+    emitOp(OpCode::RETURN);
+
+    scopes.pop_back();
+    current = state.enclosing;
+    state.function->upvalueCount = static_cast<int>(state.upvalues.size());
+
+    emitOp(OpCode::CLOSURE);
+    emitShort(chunk().addFunction(state.function));
+    for (const auto& upvalue : state.upvalues) {
+        emitByte(upvalue.isLocal ? 1 : 0);
+        emitShort(upvalue.index);
+    }
+}
+
+// Emission helpers
+
+Chunk& Compiler::chunk() {
+    return current->function->chunk;
+}
+
+void Compiler::emitOp(OpCode op) {
+    emitOp(op, 0, 0);
+}
+
+void Compiler::emitOp(OpCode op, const Token& at) {
+    emitOp(op, at.line, at.column);
+}
+
+void Compiler::emitOp(OpCode op, int line, int column) {
+    // Operands share the position of their opcode
+    this->line = line;
+    this->column = column;
+    emitByte(static_cast<uint8_t>(op));
+}
+
+void Compiler::emitByte(uint8_t byte) {
+    chunk().write(byte, line, column);
+}
+
+void Compiler::emitShort(int value) {
+    if (value > UINT16_MAX) {
+        compileError("Operand does not fit in 16 bits");
+    }
+    chunk().writeShort(static_cast<uint16_t>(value), line, column);
+}
+
+void Compiler::emitConstant(const Value& value) {
+    emitOp(OpCode::CONSTANT);
+    emitShort(makeConstant(value));
+}
+
+int Compiler::makeConstant(const Value& value) {
+    int index = chunk().addConstant(value);
+    if (index > UINT16_MAX) {
+        compileError("Too many constants in one chunk");
+        return 0;
+    }
+    return index;
+}
+
+int Compiler::makeToken(const Token& token) {
+    int index = chunk().addToken(token);
+    if (index > UINT16_MAX) {
+        compileError("Too many names in one chunk");
+        return 0;
+    }
+    return index;
+}
+
+int Compiler::makeNativeSite() {
+    int index = chunk().addNativeSite();
+    if (index > UINT16_MAX) {
+        compileError("Too many native calls in one chunk");
+        return 0;
+    }
+    return index;
+}
+
+int Compiler::makeCache() {
+    int index = chunk().addCache();
+    if (index > UINT16_MAX) {
+        compileError("Too many property accesses in one chunk");
+        return 0;
+    }
+    return index;
+}
+
+int Compiler::emitJump(OpCode op) {
+    emitOp(op);
+    emitByte(0xff);
+    emitByte(0xff);
+    return static_cast<int>(chunk().code.size()) - 2;
+}
+
+void Compiler::patchJump(int offset) {
+    int jump = static_cast<int>(chunk().code.size()) - offset - 2;
+    if (jump > UINT16_MAX) {
+        compileError("Too much code to jump over");
+    }
+    chunk().code[offset] = static_cast<uint8_t>((jump >> 8) & 0xff);
+    chunk().code[offset + 1] = static_cast<uint8_t>(jump & 0xff);
+}
+
+void Compiler::emitLoop(int loopStart) {
+    emitOp(OpCode::LOOP);
+    int offset = static_cast<int>(chunk().code.size()) - loopStart + 2;
+    if (offset > UINT16_MAX) {
+        compileError("Loop body too large");
+    }
+    emitShort(offset);
+}
+
+void Compiler::compileError(const std::string& message) {
+    ErrorHandler::error(line, column, message);
+}
+
+// Scopes and variables
+
+void Compiler::beginScope(int slotCount) {
+    if (slotCount > 0) {
+        emitOp(OpCode::RESERVE);
+        emitShort(slotCount);
+    }
+    // A record is pushed even for empty scopes so depths stay aligned
+    // with the resolver's.
+    scopes.push_back({current, current->localCount});
+    current->localCount += slotCount;
+}
+
+void Compiler::endScope(int slotCount) {
+    scopes.pop_back();
+    current->localCount -= slotCount;
+    if (slotCount > 0) {
+        emitOp(OpCode::END_SCOPE);
+        emitShort(slotCount);
+    }
+}
+
+void Compiler::beginLoop(bool isSwitch) {
+    current->loops.push_back({isSwitch, current->localCount, current->tryDepth, {}, {}});
+}
+
+// Emits the back edge of the innermost loop; continue lands just before
+// it and break just after.
+void Compiler::endLoop(int loopStart) {
+    LoopState loop = std::move(current->loops.back());
+    current->loops.pop_back();
+
+    for (int jump : loop.continueJumps) {
+        patchJump(jump);
+    }
+    emitLoop(loopStart);
+    for (int jump : loop.breakJumps) {
+        patchJump(jump);
+    }
+}
+
+void Compiler::emitLoopExit(LoopState& loop, std::vector<int>& jumps) {
+    // Leave every try block and scope opened inside the loop body
+    for (int i = current->tryDepth; i > loop.tryDepth; i--) {
+        emitOp(OpCode::TRY_END);
+    }
+    int count = current->localCount - loop.localCount;
+    if (count > 0) {
+        emitOp(OpCode::END_SCOPE);
+        emitShort(count);
+    }
+    jumps.push_back(emitJump(OpCode::JUMP));
+}
+
+void Compiler::loadVariable(const Token& name, const VarSlot& slot) {
+    if (!slot.isLocal()) {
+        emitOp(OpCode::GET_GLOBAL, name);
+        emitShort(vm.globalSlot(name.text()));
+        return;
+    }
+
+    const ScopeRecord& scope = scopes[scopes.size() - 1 - slot.depth];
+    int stackSlot = scope.base + slot.index;
+    if (scope.owner == current) {
+        emitOp(OpCode::GET_LOCAL, name);
+        emitShort(stackSlot);
+    } else {
+        emitOp(OpCode::GET_UPVALUE, name);
+        emitShort(resolveUpvalue(current, scope.owner, stackSlot));
+    }
+}
+
+void Compiler::storeVariable(const Token& name, const VarSlot& slot) {
+    if (!slot.isLocal()) {
+        emitOp(OpCode::SET_GLOBAL, name);
+        emitShort(vm.globalSlot(name.text()));
+        return;
+    }
+
+    const ScopeRecord& scope = scopes[scopes.size() - 1 - slot.depth];
+    int stackSlot = scope.base + slot.index;
+    if (scope.owner == current) {
+        emitOp(OpCode::SET_LOCAL, name);
+        emitShort(stackSlot);
+    } else {
+        emitOp(OpCode::SET_UPVALUE, name);
+        emitShort(resolveUpvalue(current, scope.owner, stackSlot));
+    }
+}
+
+void Compiler::defineVariable(const Token& name, int slot) {
+    if (slot >= 0) {
+        emitOp(OpCode::SET_LOCAL, name);
+        emitShort(scopes.back().base + slot);
+        emitOp(OpCode::POP);
+    } else {
+        emitOp(OpCode::DEFINE_GLOBAL, name);
+        emitShort(vm.globalSlot(name.text()));
+    }
+}
+
+int Compiler::resolveUpvalue(FunctionState* function, FunctionState* owner, int stackSlot) {
+    if (function->enclosing == owner) {
+        return addUpvalue(function, true, stackSlot);
+    }
+    int index = resolveUpvalue(function->enclosing, owner, stackSlot);
+    return addUpvalue(function, false, index);
+}
+
+int Compiler::addUpvalue(FunctionState* function, bool isLocal, int index) {
+    for (size_t i = 0; i < function->upvalues.size(); i++) {
+        const UpvalueRef& upvalue = function->upvalues[i];
+        if (upvalue.isLocal == isLocal && upvalue.index == index) {
+            return static_cast<int>(i);
+        }
+    }
+    function->upvalues.push_back({isLocal, index});
+    return static_cast<int>(function->upvalues.size() - 1);
+}
+
+// Expressions
+
+Value Compiler::visitLambdaExpr(LambdaExpr& expr) {
+    int line = expr.body.empty() ? 0 : expr.body.front()->line;
+    compileFunction("", line, expr.params, expr.body, expr.slotCount, false, true);
+    return {};
+}
+
+Value Compiler::visitTernaryExpr(TernaryExpr& expr) {
+    compile(*expr.condition);
+    int elseJump = emitJump(OpCode::JUMP_IF_FALSE);
+    compile(*expr.thenExpr);
+    int endJump = emitJump(OpCode::JUMP);
+    patchJump(elseJump);
+    compile(*expr.elseExpr);
+    patchJump(endJump);
+    return {};
+}
+
+Value Compiler::visitSetExpr(SetExpr& expr) {
+    compile(*expr.object);
+    compile(*expr.value);
+    emitOp(OpCode::SET_PROPERTY, expr.name);
+    emitShort(makeToken(expr.name));
+    emitShort(makeCache());
+    return {};
+}
+
+Value Compiler::visitSuperExpr(SuperExpr& expr) {
+    emitOp(OpCode::SUPER, expr.keyword);
+    emitShort(makeToken(expr.keyword));
+    return {};
+}
+
+Value Compiler::visitThisExpr(ThisExpr& expr) {
+    loadVariable(expr.keyword, expr.slot);
+    return {};
+}
+
+Value Compiler::visitBinaryExpr(BinaryExpr& expr) {
+    // Both operands are evaluated first, as the tree-walker does
+    compile(*expr.left);
+    compile(*expr.right);
+
+    OpCode op;
+    switch (expr.operator_.type) {
+        case TokenType::GREATER: op = OpCode::GREATER; break;
+        case TokenType::GREATER_EQUAL: op = OpCode::GREATER_EQUAL; break;
+        case TokenType::LESS: op = OpCode::LESS; break;
+        case TokenType::LESS_EQUAL: op = OpCode::LESS_EQUAL; break;
+        case TokenType::BANG_EQUAL: op = OpCode::NOT_EQUAL; break;
+        case TokenType::EQUAL_EQUAL: op = OpCode::EQUAL; break;
+        case TokenType::MINUS: op = OpCode::SUBTRACT; break;
+        case TokenType::PLUS: op = OpCode::ADD; break;
+        case TokenType::SLASH: op = OpCode::DIVIDE; break;
+        case TokenType::STAR: op = OpCode::MULTIPLY; break;
+        case TokenType::PERCENT: op = OpCode::MODULO; break;
+        case TokenType::STAR_STAR: op = OpCode::POWER; break;
+        case TokenType::LEFT_SHIFT: op = OpCode::SHIFT_LEFT; break;
+        case TokenType::RIGHT_SHIFT: op = OpCode::SHIFT_RIGHT; break;
+        case TokenType::AMPERSAND: op = OpCode::BIT_AND; break;
+        case TokenType::PIPE: op = OpCode::BIT_OR; break;
+        case TokenType::CARET: op = OpCode::BIT_XOR; break;
+        case TokenType::AND: op = OpCode::AND; break;
+        case TokenType::OR: op = OpCode::OR; break;
+        default:
+            // The tree-walker yields nil for operators it does not know
+            emitOp(OpCode::POP);
+            emitOp(OpCode::POP);
+            emitOp(OpCode::NIL);
+            return {};
+    }
+
+    emitOp(op, expr.operator_);
+    return {};
+}
+
+Value Compiler::visitUnaryExpr(UnaryExpr& expr) {
+    compile(*expr.right);
+
+    switch (expr.operator_.type) {
+        case TokenType::BANG:
+            emitOp(OpCode::NOT, expr.operator_);
+            break;
+        case TokenType::MINUS:
+            emitOp(OpCode::NEGATE, expr.operator_);
+            break;
+        case TokenType::TILDE:
+            emitOp(OpCode::BIT_NOT, expr.operator_);
+            break;
+        case TokenType::AWAIT:
+            emitOp(OpCode::AWAIT, expr.operator_);
+            break;
+        default:
+            emitOp(OpCode::POP);
+            emitOp(OpCode::NIL);
+            break;
+    }
+    return {};
+}
+
+Value Compiler::visitLiteralExpr(LiteralExpr& expr) {
+    if (expr.value.isNil()) {
+        emitOp(OpCode::NIL);
+    } else if (expr.value.isBool()) {
+        emitOp(expr.value.asBool() ? OpCode::TRUE : OpCode::FALSE);
+    } else {
+        emitConstant(expr.value);
+    }
+    return {};
+}
+
+Value Compiler::visitGroupingExpr(GroupingExpr& expr) {
+    compile(*expr.expression);
+    return {};
+}
+
+Value Compiler::visitVariableExpr(VariableExpr& expr) {
+    loadVariable(expr.name, expr.slot);
+    return {};
+}
+
+Value Compiler::visitAssignExpr(AssignExpr& expr) {
+    compile(*expr.value);
+    storeVariable(expr.name, expr.slot);
+    return {};
+}
+
+Value Compiler::visitCallExpr(CallExpr& expr) {
+    if (expr.property != nullptr) {
+        // The nil takes the callee slot a method frame sits above
+        emitOp(OpCode::NIL);
+        compile(*expr.property->object);
+    } else {
+        compile(*expr.callee);
+    }
+    for (const auto& argument : expr.arguments) {
+        compile(*argument);
+    }
+
+    if (expr.arguments.size() > UINT8_MAX) {
+        compileError("Can't have more than 255 arguments");
+    }
+    if (expr.property != nullptr) {
+        emitOp(OpCode::INVOKE, expr.property->name);
+        emitShort(makeToken(expr.property->name));
+        emitShort(makeCache());
+        // Arity errors point at the parenthesis, as they do for CALL
+        line = expr.paren.line;
+        column = expr.paren.column;
+    } else {
+        emitOp(OpCode::CALL, expr.paren);
+    }
+    emitByte(static_cast<uint8_t>(expr.arguments.size()));
+    return {};
+}
+
+Value Compiler::visitGetExpr(GetExpr& expr) {
+    compile(*expr.object);
+    emitOp(OpCode::GET_PROPERTY, expr.name);
+    emitShort(makeToken(expr.name));
+    emitShort(makeCache());
+    return {};
+}
+
+Value Compiler::visitListExpr(ListExpr& expr) {
+    for (const auto& element : expr.elements) {
+        compile(*element);
+    }
+    emitOp(OpCode::LIST);
+    emitShort(static_cast<int>(expr.elements.size()));
+    return {};
+}
+
+Value Compiler::visitIndexExpr(IndexExpr& expr) {
+    compile(*expr.object);
+    compile(*expr.index);
+    emitOp(OpCode::INDEX, expr.bracket);
+    return {};
+}
+
+Value Compiler::visitMapExpr(MapExpr& expr) {
+    for (const auto& entry : expr.entries) {
+        compile(*entry.first);
+        compile(*entry.second);
+    }
+    emitOp(OpCode::MAP);
+    emitShort(static_cast<int>(expr.entries.size()));
+    return {};
+}
+
+Value Compiler::visitSetIndexExpr(SetIndexExpr& expr) {
+    compile(*expr.object);
+    compile(*expr.index);
+    compile(*expr.value);
+    emitOp(OpCode::SET_INDEX, expr.bracket);
+    return {};
+}
+
+Value Compiler::visitExternExpr(ExternExpr& expr) {
+    for (const auto& argument : expr.arguments) {
+        compile(*argument);
+    }
+
+    if (expr.arguments.size() > UINT8_MAX) {
+        compileError("Can't have more than 255 arguments");
+    }
+    if (expr.spawned) {
+        emitOp(OpCode::EXTERN_SPAWN, expr.function);
+        emitShort(makeToken(expr.library));
+        emitShort(makeToken(expr.function));
+        emitByte(static_cast<uint8_t>(expr.arguments.size()));
+        return {};
+    }
+    emitOp(OpCode::EXTERN_CALL, expr.function);
+    emitShort(makeToken(expr.library));
+    emitShort(makeToken(expr.function));
+    emitByte(static_cast<uint8_t>(expr.arguments.size()));
+    emitShort(makeNativeSite());
+    return {};
+}
+
+Value Compiler::visitLoadLibraryExpr(LoadLibraryExpr& expr) {
+    emitOp(OpCode::LOAD_LIBRARY, expr.alias);
+    emitShort(makeConstant(Value(std::string(expr.libraryPath.literal))));
+    emitShort(makeToken(expr.alias));
+    emitShort(makeConstant(Value(expr.libraryType)));
+    emitShort(makeConstant(Value(std::string("Failed to load library: "))));
+    return {};
+}
+
+// Statements
+
+void Compiler::visitClassStmt(ClassStmt& stmt) {
+    if (stmt.superclass != nullptr) {
+        compile(*stmt.superclass);
+    }
+
+    // The name is bound before the methods are created, as in the
+    // tree-walker, so methods may refer to their own class.
+    emitOp(OpCode::NIL);
+    defineVariable(stmt.name, stmt.slot);
+
+    int methodCount = 0;
+    for (const auto& method : stmt.methods) {
+        auto functionStmt = dynamic_cast<FunctionStmt*>(method);
+        if (functionStmt) {
+            compileFunction(functionStmt->name.text(), functionStmt->name.line, functionStmt->params,
+                            functionStmt->body, functionStmt->slotCount, true, false, functionStmt->isAsync);
+            methodCount++;
+        }
+    }
+
+    if (methodCount > UINT8_MAX) {
+        compileError("Too many methods in one class");
+    }
+    emitOp(OpCode::CLASS);
+    emitShort(makeConstant(Value(stmt.name.text())));
+    emitByte(static_cast<uint8_t>(methodCount));
+    emitByte(stmt.superclass != nullptr ? 1 : 0);
+    defineVariable(stmt.name, stmt.slot);
+}
+
+void Compiler::visitImportStmt(ImportStmt& stmt) {
+    emitOp(OpCode::IMPORT, stmt.module);
+    emitShort(makeToken(stmt.module));
+    defineVariable(stmt.module, stmt.moduleSlot);
+
+    if (!stmt.alias.lexeme.empty()) {
+        emitOp(OpCode::IMPORT, stmt.module);
+        emitShort(makeToken(stmt.module));
+        defineVariable(stmt.alias, stmt.aliasSlot);
+    }
+}
+
+void Compiler::visitTryStmt(TryStmt& stmt) {
+    int handlerJump = emitJump(OpCode::TRY_BEGIN);
+    current->tryDepth++;
+    compile(*stmt.tryBlock);
+    current->tryDepth--;
+    emitOp(OpCode::TRY_END);
+    int skipJump = emitJump(OpCode::JUMP);
+
+    // The VM enters the handler with the error message pushed
+    patchJump(handlerJump);
+    if (stmt.catchBlock != nullptr) {
+        int slotCount = stmt.catchSlotCount;
+        if (stmt.catchSlot < 0) {
+            emitOp(OpCode::POP);
+            if (slotCount > 0) {
+                emitOp(OpCode::RESERVE);
+                emitShort(slotCount);
+            }
+        } else if (slotCount > 1) {
+            // The message already occupies the catch variable's slot 0
+            emitOp(OpCode::RESERVE);
+            emitShort(slotCount - 1);
+        }
+
+        scopes.push_back({current, current->localCount});
+        current->localCount += slotCount;
+        compile(*stmt.catchBlock);
+        endScope(slotCount);
+    } else {
+        emitOp(OpCode::POP);
+    }
+    patchJump(skipJump);
+
+    if (stmt.finallyBlock != nullptr) {
+        compile(*stmt.finallyBlock);
+    }
+}
+
+void Compiler::visitThrowStmt(ThrowStmt& stmt) {
+    compile(*stmt.value);
+    emitOp(OpCode::THROW);
+}
+
+void Compiler::visitSwitchStmt(SwitchStmt& stmt) {
+    // The switch value lives in a hidden local above the current scopes
+    compile(*stmt.expr);
+    int valueSlot = current->localCount++;
+    beginLoop(true);
+
+    if (stmt.table != nullptr) {
+        compileSwitchTable(stmt, valueSlot);
+        current->localCount--;
+        emitOp(OpCode::POP);
+        return;
+    }
+
+    std::vector<int> endJumps;
+    for (const auto& caseStmt : stmt.cases) {
+        emitOp(OpCode::GET_LOCAL);
+        emitShort(valueSlot);
+        compile(*caseStmt.first);
+        emitOp(OpCode::EQUAL);
+        int nextJump = emitJump(OpCode::JUMP_IF_FALSE);
+        compile(*caseStmt.second);
+        endJumps.push_back(emitJump(OpCode::JUMP));
+        patchJump(nextJump);
+    }
+
+    if (stmt.defaultCase != nullptr) {
+        compile(*stmt.defaultCase);
+    }
+
+    for (int jump : endJumps) {
+        patchJump(jump);
+    }
+    for (int jump : current->loops.back().breakJumps) {
+        patchJump(jump);
+    }
+    current->loops.pop_back();
+
+    current->localCount--;
+    emitOp(OpCode::POP);
+}
+
+void Compiler::compileSwitchTable(SwitchStmt& stmt, int valueSlot) {
+    // One SWITCH jumps straight to the case; the cases follow it in order
+    int index = chunk().addSwitch(SwitchTable());
+    emitOp(OpCode::GET_LOCAL);
+    emitShort(valueSlot);
+    emitOp(OpCode::SWITCH);
+    emitShort(index);
+    int base = static_cast<int>(chunk().code.size());
+
+    std::vector<int> caseStarts;
+    std::vector<int> endJumps;
+    for (const auto& caseStmt : stmt.cases) {
+        caseStarts.push_back(static_cast<int>(chunk().code.size()) - base);
+        compile(*caseStmt.second);
+        endJumps.push_back(emitJump(OpCode::JUMP));
+    }
+
+    SwitchTable& table = chunk().switches[index];
+    table.otherwise = static_cast<int>(chunk().code.size()) - base;
+    for (const auto& entry : stmt.table->entries()) {
+        table.add(entry.first, caseStarts[entry.second]);
+    }
+    if (stmt.defaultCase != nullptr) {
+        compile(*stmt.defaultCase);
+    }
+
+    for (int jump : endJumps) {
+        patchJump(jump);
+    }
+    for (int jump : current->loops.back().breakJumps) {
+        patchJump(jump);
+    }
+    current->loops.pop_back();
+}
+
+void Compiler::visitExternStmt(ExternStmt& stmt) {
+    emitOp(OpCode::LOAD_LIBRARY, stmt.alias);
+    emitShort(makeConstant(Value(std::string(stmt.libraryPath.literal))));
+    emitShort(makeToken(stmt.alias));
+    emitShort(makeConstant(Value(stmt.libraryType)));
+    emitShort(makeConstant(Value(std::string("Failed to load external library: "))));
+    emitOp(OpCode::POP);
+
+    for (size_t i = 0; i < stmt.functions.size(); i++) {
+        const NativeSignature& signature = stmt.signatures[i];
+        if (!signature.declared) continue;
+        emitOp(OpCode::BIND_NATIVE, stmt.functions[i]);
+        emitShort(makeToken(stmt.alias));
+        emitShort(makeToken(stmt.functions[i]));
+        emitByte(static_cast<uint8_t>(signature.result));
+        emitByte(signature.arity);
+        for (int param = 0; param < signature.arity; param++) {
+            emitByte(static_cast<uint8_t>(signature.params[param]));
+        }
+    }
+
+    emitConstant(Value("library:" + stmt.alias.text()));
+    defineVariable(stmt.alias, stmt.slot);
+}
+
+void Compiler::visitPluginStmt(PluginStmt& stmt) {
+    emitOp(OpCode::LOAD_LIBRARY, stmt.alias);
+    emitShort(makeConstant(Value(std::string(stmt.pluginPath.literal))));
+    emitShort(makeToken(stmt.alias));
+    emitShort(makeConstant(Value(std::string("custom"))));
+    emitShort(makeConstant(Value(std::string("Failed to load plugin: "))));
+    emitOp(OpCode::POP);
+
+    emitConstant(Value("plugin:" + stmt.alias.text()));
+    defineVariable(stmt.alias, stmt.slot);
+}
+
+void Compiler::visitExpressionStmt(ExpressionStmt& stmt) {
+    compile(*stmt.expression);
+    emitOp(OpCode::POP);
+}
+
+void Compiler::visitPrintStmt(PrintStmt& stmt) {
+    compile(*stmt.expression);
+    emitOp(OpCode::PRINT);
+}
+
+void Compiler::visitVarStmt(VarStmt& stmt) {
+    if (stmt.initializer != nullptr) {
+        compile(*stmt.initializer);
+    } else {
+        emitOp(OpCode::NIL);
+    }
+    defineVariable(stmt.name, stmt.slot);
+}
+
+void Compiler::visitBlockStmt(BlockStmt& stmt) {
+    beginScope(stmt.slotCount);
+    for (const auto& statement : stmt.statements) {
+        compile(*statement);
+    }
+    endScope(stmt.slotCount);
+}
+
+void Compiler::visitIfStmt(IfStmt& stmt) {
+    compile(*stmt.condition);
+    int thenJump = emitJump(OpCode::JUMP_IF_FALSE);
+    compile(*stmt.thenBranch);
+
+    if (stmt.elseBranch != nullptr) {
+        int elseJump = emitJump(OpCode::JUMP);
+        patchJump(thenJump);
+        compile(*stmt.elseBranch);
+        patchJump(elseJump);
+    } else {
+        patchJump(thenJump);
+    }
+}
+
+void Compiler::visitWhileStmt(WhileStmt& stmt) {
+    int loopStart = static_cast<int>(chunk().code.size());
+    compile(*stmt.condition);
+    int exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+
+    beginLoop();
+    compile(*stmt.body);
+    endLoop(loopStart);
+    patchJump(exitJump);
+}
+
+void Compiler::visitForStmt(ForStmt& stmt) {
+    beginScope(stmt.slotCount);
+    if (stmt.initializer != nullptr) {
+        compile(*stmt.initializer);
+    }
+
+    int loopStart = static_cast<int>(chunk().code.size());
+    int exitJump = -1;
+    if (stmt.condition != nullptr) {
+        compile(*stmt.condition);
+        exitJump = emitJump(OpCode::JUMP_IF_FALSE);
+    }
+
+    // The increment runs as part of the loop's back edge, so continue
+    // reaches it
+    beginLoop();
+    compile(*stmt.body);
+    std::vector<int> continueJumps = std::move(current->loops.back().continueJumps);
+    current->loops.back().continueJumps.clear();
+    for (int jump : continueJumps) {
+        patchJump(jump);
+    }
+    if (stmt.increment != nullptr) {
+        compile(*stmt.increment);
+        emitOp(OpCode::POP);
+    }
+    endLoop(loopStart);
+
+    if (exitJump != -1) {
+        patchJump(exitJump);
+    }
+    endScope(stmt.slotCount);
+}
+
+void Compiler::visitForInStmt(ForInStmt& stmt) {
+    // The iterator lives in a hidden local below the loop variable's scope
+    compile(*stmt.iterable);
+    emitOp(OpCode::ITERATE, stmt.variable);
+    int iteratorSlot = current->localCount++;
+    beginScope(stmt.slotCount);
+
+    int loopStart = static_cast<int>(chunk().code.size());
+    emitOp(OpCode::FOR_ITER, stmt.variable);
+    emitShort(iteratorSlot);
+    int exitJump = static_cast<int>(chunk().code.size());
+    emitShort(0xffff);
+    defineVariable(stmt.variable, stmt.slot);
+
+    beginLoop();
+    compile(*stmt.body);
+    endLoop(loopStart);
+
+    patchJump(exitJump);
+    endScope(stmt.slotCount);
+    current->localCount--;
+    emitOp(OpCode::POP);
+}
+
+void Compiler::visitFunctionStmt(FunctionStmt& stmt) {
+    compileFunction(stmt.name.text(), stmt.name.line, stmt.params, stmt.body, stmt.slotCount, false, false, stmt.isAsync);
+    defineVariable(stmt.name, stmt.slot);
+}
+
+void Compiler::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.value != nullptr) {
+        compile(*stmt.value);
+    } else {
+        emitOp(OpCode::NIL);
+    }
+    emitOp(OpCode::RETURN);
+}
+
+void Compiler::visitBreakStmt(BreakStmt& stmt) {
+    LoopState& loop = current->loops.back();
+    emitLoopExit(loop, loop.breakJumps);
+}
+
+void Compiler::visitContinueStmt(ContinueStmt& stmt) {
+    for (auto loop = current->loops.rbegin(); loop != current->loops.rend(); ++loop) {
+        if (!loop->isSwitch) {
+            emitLoopExit(*loop, loop->continueJumps);
+            return;
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "chunk.hpp"
+#include "../parser/ast.hpp"
+#include <memory>
+#include <vector>
+
+class VM;
+
+// Lowers resolved statements to bytecode for the VM. Resolver slots map
+// directly onto the stack: every resolver scope reserves its slots when it
+// is entered, so a (depth, index) pair names a fixed stack slot of the
+// function owning that scope, or an upvalue when the owner is an
+// enclosing function.
+class Compiler : public ASTVisitor {
+private:
+    struct UpvalueRef {
+        bool isLocal;
+        int index;
+    };
+
+    // An enclosing loop, or a switch, which break also leaves
+    struct LoopState {
+        bool isSwitch;
+        int localCount; // locals that live across iterations
+        int tryDepth;
+        std::vector<int> breakJumps;
+        std::vector<int> continueJumps;
+    };
+
+    struct FunctionState {
+        FunctionState* enclosing;
+        std::shared_ptr<VmFunction> function;
+        std::vector<UpvalueRef> upvalues;
+        std::vector<LoopState> loops;
+        int localCount = 0;
+        int tryDepth = 0; // try blocks whose handler is installed
+    };
+
+    struct ScopeRecord {
+        FunctionState* owner;
+        int base; // stack slot of the scope's first local
+    };
+
+    VM& vm;
+    FunctionState* current = nullptr;
+    std::vector<ScopeRecord> scopes;
+    int line = 0;
+    int column = 0;
+
+public:
+    explicit Compiler(VM& vm);
+
+    // Returns the top-level script function; compile errors are reported
+    // through ErrorHandler.
+    std::shared_ptr<VmFunction> compile(const NodeList<StmtPtr>& statements);
+
+    // Expression visitors
+    Value visitLambdaExpr(LambdaExpr& expr) override;
+    Value visitTernaryExpr(TernaryExpr& expr) override;
+    Value visitSetExpr(SetExpr& expr) override;
+    Value visitSuperExpr(SuperExpr& expr) override;
+    Value visitThisExpr(ThisExpr& expr) override;
+    Value visitBinaryExpr(BinaryExpr& expr) override;
+    Value visitUnaryExpr(UnaryExpr& expr) override;
+    Value visitLiteralExpr(LiteralExpr& expr) override;
+    Value visitGroupingExpr(GroupingExpr& expr) override;
+    Value visitVariableExpr(VariableExpr& expr) override;
+    Value visitAssignExpr(AssignExpr& expr) override;
+    Value visitCallExpr(CallExpr& expr) override;
+    Value visitGetExpr(GetExpr& expr) override;
+    Value visitListExpr(ListExpr& expr) override;
+    Value visitIndexExpr(IndexExpr& expr) override;
+    Value visitMapExpr(MapExpr& expr) override;
+    Value visitSetIndexExpr(SetIndexExpr& expr) override;
+    Value visitExternExpr(ExternExpr& expr) override;
+    Value visitLoadLibraryExpr(LoadLibraryExpr& expr) override;
+
+    // Statement visitors
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitImportStmt(ImportStmt& stmt) override;
+    void visitTryStmt(TryStmt& stmt) override;
+    void visitThrowStmt(ThrowStmt& stmt) override;
+    void visitSwitchStmt(SwitchStmt& stmt) override;
+    void visitExternStmt(ExternStmt& stmt) override;
+    void visitPluginStmt(PluginStmt& stmt) override;
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitForStmt(ForStmt& stmt) override;
+    void visitForInStmt(ForInStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitBreakStmt(BreakStmt& stmt) override;
+    void visitContinueStmt(ContinueStmt& stmt) override;
+
+private:
+    void compile(Stmt& stmt);
+    void compile(Expr& expr);
+    void compileFunction(const std::string& name, int line, const NodeList<Token>& params,
+                         const NodeList<StmtPtr>& body, int slotCount, bool isMethod, bool isLambda,
+                         bool isAsync = false);
+    // Switch with a table from the Optimizer; the value is in valueSlot
+    void compileSwitchTable(SwitchStmt& stmt, int valueSlot);
+
+    Chunk& chunk();
+    void emitOp(OpCode op);
+    void emitOp(OpCode op, const Token& at);
+    void emitOp(OpCode op, int line, int column);
+    void emitByte(uint8_t byte);
+    void emitShort(int value);
+    void emitConstant(const Value& value);
+    int makeConstant(const Value& value);
+    int makeToken(const Token& token);
+    int makeCache();
+    int makeNativeSite();
+    int emitJump(OpCode op);
+    void patchJump(int offset);
+    void emitLoop(int loopStart);
+
+    void beginScope(int slotCount);
+    void endScope(int slotCount);
+    void beginLoop(bool isSwitch = false);
+    void endLoop(int loopStart);
+    void emitLoopExit(LoopState& loop, std::vector<int>& jumps);
+
+    void loadVariable(const Token& name, const VarSlot& slot);
+    void storeVariable(const Token& name, const VarSlot& slot);
+    void defineVariable(const Token& name, int slot);
+    int resolveUpvalue(FunctionState* function, FunctionState* owner, int stackSlot);
+    static int addUpvalue(FunctionState* function, bool isLocal, int index);
+
+    void compileError(const std::string& message);
+};
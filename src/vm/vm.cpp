@@ -0,0 +1,988 @@
+#include "vm.hpp"
+#include "../error/error_handler.hpp"
+#include "../runtime/async.hpp"
+#include "../runtime/hash_map.hpp"
+#include "../runtime/iterable.hpp"
+#include "../runtime/library_manager.hpp"
+#include "../runtime/module.hpp"
+#include "../runtime/native_functions.hpp"
+#include "../runtime/numeric_array.hpp"
+#include "../runtime/output.hpp"
+#include "../runtime/metrics.hpp"
+#include "../runtime/profiler.hpp"
+#include <cmath>
+#include <iostream>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Computed goto dispatch where the compiler supports labels as values,
+// a plain switch everywhere else.
+#if defined(__GNUC__) || defined(__clang__)
+#define FOCUS_VM_COMPUTED_GOTO 1
+#else
+#define FOCUS_VM_COMPUTED_GOTO 0
+#endif
+
+// The top-level script has no frame of its own in --profile output
+static bool isProfiled(const VmFunction& function) {
+    return !function.name.empty() || function.isLambda;
+}
+
+// VmClosure implementation
+VmClosure::VmClosure(std::shared_ptr<VmFunction> function, VM* vm)
+    : function(std::move(function)), upvalues(this->function->upvalueCount), vm(vm) {}
+
+int VmClosure::arity() {
+    return function->arity;
+}
+
+Value VmClosure::call(Interpreter& interpreter, Arguments arguments) {
+    return vm->callClosure(*this, nullptr, arguments);
+}
+
+Value VmClosure::callMethod(Interpreter& interpreter, const Value& instance, Arguments arguments) {
+    return vm->callClosure(*this, &instance, arguments);
+}
+
+std::string VmClosure::toString() {
+    if (function->isLambda) return "<lambda>";
+    return "<fn " + function->name + ">";
+}
+
+void VmClosure::trace(Tracer& tracer) const {
+    for (const auto& upvalue : upvalues) {
+        tracer.traced(upvalue);
+    }
+}
+
+// Open upvalues point into the stack, which holds their values itself
+void Upvalue::trace(Tracer& tracer) const {
+    if (location == &closed) tracer.value(closed);
+}
+
+// A mapping reads as zeros, which are valid values (the number 0), and
+// a finished task leaves nothing on it
+VM::ExecutionState::ExecutionState() : frameLimit(kTaskFrames) {
+    size_t bytes = kTaskStackSize * sizeof(Value);
+#if defined(_WIN32)
+    void* memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (memory == nullptr) throw std::runtime_error("Can't create a task: out of memory");
+#else
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw std::runtime_error("Can't create a task: out of memory");
+#endif
+    mapping = static_cast<Value*>(memory);
+    stack = mapping;
+    stackTop = mapping;
+    stackEnd = mapping + kTaskStackSize;
+    frames.reserve(kTaskFrames);
+}
+
+VM::ExecutionState::~ExecutionState() {
+#if defined(_WIN32)
+    VirtualFree(mapping, 0, MEM_RELEASE);
+#else
+    munmap(mapping, kTaskStackSize * sizeof(Value));
+#endif
+}
+
+// VM implementation
+VM::VM()
+    : scriptStack(new Value[kStackSize]), stack(scriptStack.get()), stackTop(stack), stackEnd(stack + kStackSize),
+      frameLimit(kMaxFrames) {
+    frames.reserve(kMaxFrames);
+
+    for (const auto& native : createNativeFunctions()) {
+        defineGlobal(native.first, Value(native.second));
+    }
+}
+
+std::vector<std::string> VM::globalNames() const {
+    std::vector<std::string> names;
+    names.reserve(globals.size());
+    for (const auto& cell : globals) {
+        names.push_back(cell.name);
+    }
+    return names;
+}
+
+int VM::globalSlot(const std::string& name) {
+    auto it = globalIndex.find(name);
+    if (it != globalIndex.end()) {
+        return it->second;
+    }
+
+    int slot = static_cast<int>(globals.size());
+    globals.push_back({name, Value(), false});
+    globalIndex.emplace(name, slot);
+    return slot;
+}
+
+void VM::defineGlobal(const std::string& name, const Value& value) {
+    GlobalCell& cell = globals[globalSlot(name)];
+    cell.value = value;
+    cell.defined = true;
+}
+
+void VM::interpret(const std::shared_ptr<VmFunction>& script) {
+    auto closure = std::make_shared<VmClosure>(script, this);
+
+    unwind(0, stack);
+    handlers.clear();
+
+    bool failed = false;
+    try {
+        Value* base = stackTop;
+        push(Value(std::static_pointer_cast<Callable>(closure)));
+        pushFrame(closure.get(), stackTop);
+        run(0, base);
+        pop();
+    } catch (const RuntimeError& error) {
+        ErrorHandler::runtimeError(error);
+        failed = true;
+    }
+    // The script's tasks end with it
+    EventLoop::local().finish(!failed);
+}
+
+Value VM::callClosure(VmClosure& closure, const Value* instance, Arguments arguments) {
+    if (closure.function->isAsync) return startTask(closure, instance, arguments);
+    return runClosure(closure, instance, arguments);
+}
+
+// The task keeps the closure, the receiver and its arguments, and runs on
+// an execution state of its own, swapped with whatever the VM runs when
+// the task resumes and swapped back when it stops
+Value VM::startTask(VmClosure& closure, const Value* instance, Arguments arguments) {
+    std::unique_ptr<ExecutionState> spare;
+    if (!spareStates.empty()) {
+        spare = std::move(spareStates.back());
+        spareStates.pop_back();
+    } else {
+        spare = std::make_unique<ExecutionState>();
+    }
+    std::shared_ptr<ExecutionState> state(spare.release(), [this](ExecutionState* finished) {
+        if (spareStates.size() < kSpareStates) {
+            spareStates.emplace_back(finished);
+        } else {
+            delete finished;
+        }
+    });
+
+    std::shared_ptr<VmClosure> task = closure.shared_from_this();
+    Value receiver = instance != nullptr ? *instance : Value();
+    std::vector<Value> copied(arguments.begin(), arguments.end());
+    auto future = EventLoop::local().spawn(
+        [this, task, receiver, isMethod = instance != nullptr, copied] {
+            return runClosure(*task, isMethod ? &receiver : nullptr, copied);
+        },
+        [this, state] { swapState(*state); });
+    return Value(future);
+}
+
+void VM::swapState(ExecutionState& state) {
+    std::swap(stack, state.stack);
+    std::swap(stackTop, state.stackTop);
+    std::swap(stackEnd, state.stackEnd);
+    std::swap(frameLimit, state.frameLimit);
+    frames.swap(state.frames);
+    handlers.swap(state.handlers);
+    openUpvalues.swap(state.openUpvalues);
+}
+
+Value VM::runClosure(VmClosure& closure, const Value* instance, Arguments arguments) {
+    Value* base = stackTop;
+    if (static_cast<size_t>(stackEnd - base) < kFrameHeadroom + arguments.size()) {
+        throw RuntimeError(Token(), "Stack overflow");
+    }
+    EventLoop::checkStack(); // natives calling back in nest on the task's own stack
+
+    // The caller keeps the closure alive, so the callee slot stays nil
+    push(Value());
+    if (instance != nullptr) {
+        push(*instance);
+    }
+
+    size_t count = std::min(arguments.size(), static_cast<size_t>(closure.function->arity));
+    for (size_t i = 0; i < count; i++) {
+        push(arguments[i]);
+    }
+
+    pushFrame(&closure, base + 1);
+    run(frames.size() - 1, base);
+    return pop();
+}
+
+void VM::run(size_t exitFrame, Value* entryTop) {
+    size_t handlerBase = handlers.size();
+
+    for (;;) {
+        try {
+            execute(exitFrame);
+            return;
+        } catch (const RuntimeError& error) {
+            if (handlers.size() == handlerBase) {
+                unwind(exitFrame, entryTop);
+                throw;
+            }
+
+            // Resume in the innermost try block started by this run
+            Handler handler = handlers.back();
+            handlers.pop_back();
+            unwind(handler.frameCount, handler.stackTop);
+            push(Value(std::string(error.what())));
+            frames.back().ip = handler.target;
+        } catch (...) {
+            unwind(exitFrame, entryTop);
+            handlers.resize(handlerBase);
+            throw;
+        }
+    }
+}
+
+void VM::pushFrame(VmClosure* closure, Value* slots) {
+    VmFunction& function = *closure->function;
+    function.ensureLoaded();
+
+    if (frames.size() == frameLimit || static_cast<size_t>(stackEnd - slots) < function.frameSlots + kFrameHeadroom) {
+        throw RuntimeError(Token(), "Stack overflow");
+    }
+
+    frames.push_back({closure, function.chunk.code.data(), slots});
+    Metrics::count(Metrics::Calls);
+    if (Profiler::enabled() && isProfiled(function)) {
+        Profiler::enter(&function, "script", [&function] {
+            return (function.isLambda ? "lambda" : function.name) + ":" + std::to_string(function.line);
+        });
+    }
+
+    // Locals beyond the parameters start out nil
+    Value* end = slots + function.frameSlots;
+    while (stackTop < end) {
+        *stackTop++ = Value();
+    }
+}
+
+// Calls the value below the argCount arguments on top of the stack.
+// Closures compiled for this VM get a new frame, and true is returned,
+// unless they are async: their call only starts a task;
+// the callee slot keeps them alive for the duration of the frame. Any
+// other callable runs to completion and its result replaces the callee.
+bool VM::callValue(int argCount, const CallFrame& frame, const uint8_t* ip) {
+    Value& callee = stackTop[-1 - argCount];
+    std::shared_ptr<Callable> function;
+    if (callee.isCallable()) {
+        function = callee.asCallable();
+    } else if (callee.isClass()) {
+        function = callee.asClass();
+    } else {
+        throw error(frame, ip, "Can only call functions and classes");
+    }
+
+    int arity = function->arity();
+    if (arity != -1 && argCount != arity) {
+        throw error(frame, ip, "Expected " + std::to_string(arity) + " arguments but got " + std::to_string(argCount));
+    }
+
+    auto closure = dynamic_cast<VmClosure*>(function.get());
+    if (closure != nullptr && closure->vm == this && !closure->function->isAsync) {
+        pushFrame(closure, stackTop - argCount);
+        return true;
+    }
+
+    // Natives read their arguments straight off the stack
+    Value result = function->call(interpreter, Arguments(stackTop - argCount, argCount));
+    while (argCount-- > 0) {
+        *--stackTop = Value();
+    }
+    stackTop[-1] = std::move(result);
+    return false;
+}
+
+void VM::unwind(size_t frameCount, Value* top) {
+    closeUpvalues(top);
+    while (stackTop > top) {
+        *--stackTop = Value();
+    }
+    if (Profiler::enabled()) {
+        for (size_t i = frames.size(); i > frameCount; i--) {
+            if (isProfiled(*frames[i - 1].closure->function)) Profiler::leave();
+        }
+    }
+    frames.resize(frameCount);
+}
+
+void VM::push(const Value& value) {
+    *stackTop++ = value;
+}
+
+Value VM::pop() {
+    --stackTop;
+    Value value = std::move(*stackTop);
+    *stackTop = Value();
+    return value;
+}
+
+std::shared_ptr<Upvalue> VM::captureUpvalue(Value* local) {
+    auto it = openUpvalues.end();
+    while (it != openUpvalues.begin() && (*(it - 1))->location >= local) {
+        --it;
+        if ((*it)->location == local) {
+            return *it;
+        }
+    }
+
+    auto upvalue = std::make_shared<Upvalue>(local);
+    openUpvalues.insert(it, upvalue);
+    return upvalue;
+}
+
+void VM::closeUpvalues(const Value* last) {
+    while (!openUpvalues.empty() && openUpvalues.back()->location >= last) {
+        Upvalue& upvalue = *openUpvalues.back();
+        upvalue.closed = *upvalue.location;
+        upvalue.location = &upvalue.closed;
+        upvalue.track();
+        openUpvalues.pop_back();
+    }
+}
+
+RuntimeError VM::error(const CallFrame& frame, const uint8_t* ip, const std::string& message) const {
+    const Chunk& chunk = frame.closure->function->chunk;
+    size_t offset = static_cast<size_t>(ip - chunk.code.data()) - 1;
+    return RuntimeError(Token(TokenType::IDENTIFIER, "", "", chunk.lines[offset], chunk.columns[offset]), message);
+}
+
+void VM::execute(size_t exitFrame) {
+    CallFrame* frame = &frames.back();
+    const uint8_t* ip = frame->ip;
+    Value* slots = frame->slots;
+    const Chunk* chunk = &frame->closure->function->chunk;
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, static_cast<uint16_t>((ip[-2] << 8) | ip[-1]))
+#define PEEK(distance) (stackTop[-1 - (distance)])
+#define DROP(count) do { for (int n_ = (count); n_ > 0; n_--) *--stackTop = Value(); } while (0)
+#define THROW_ERROR(message) throw error(*frame, ip, (message))
+#define LOAD_FRAME() do { \
+        frame = &frames.back(); \
+        ip = frame->ip; \
+        slots = frame->slots; \
+        chunk = &frame->closure->function->chunk; \
+    } while (0)
+
+#define NUMBER_OPERANDS() \
+    if (!PEEK(0).isNumber() || !PEEK(1).isNumber()) THROW_ERROR("Operands must be numbers")
+#define BINARY_OP(expression) do { \
+        NUMBER_OPERANDS(); \
+        double b = PEEK(0).asNumber(); \
+        double a = PEEK(1).asNumber(); \
+        DROP(1); \
+        PEEK(0) = Value(expression); \
+    } while (0)
+#define INTEGER_OP(op) \
+    BINARY_OP(static_cast<double>(static_cast<int>(a) op static_cast<int>(b)))
+#define HAS_ARRAY_OPERAND() (PEEK(0).isArray() || PEEK(1).isArray())
+// Replaces the operands with left op right, taken element by element;
+// only used when HAS_ARRAY_OPERAND()
+#define ARRAY_OP(op) do { \
+        Value result_; \
+        try { \
+            arrayArithmetic((op), PEEK(1), PEEK(0), result_); \
+        } catch (const std::runtime_error& e_) { \
+            THROW_ERROR(e_.what()); \
+        } \
+        DROP(1); \
+        PEEK(0) = std::move(result_); \
+    } while (0)
+
+#if FOCUS_VM_COMPUTED_GOTO
+    static const void* dispatchTable[] = {
+#define FOCUS_OPCODE_LABEL(name) &&op_##name,
+        FOCUS_OPCODES(FOCUS_OPCODE_LABEL)
+#undef FOCUS_OPCODE_LABEL
+    };
+// The indirect jump is only reached through a plain goto: one leaving a
+// handler's scope runs the destructors of its locals, a computed goto
+// does not. The compiler still copies the jump into every handler.
+#define DISPATCH() goto dispatch
+#define CASE(name) op_##name:
+dispatch:
+    goto *dispatchTable[READ_BYTE()];
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case OpCode::name:
+dispatch:
+    switch (static_cast<OpCode>(READ_BYTE())) {
+#endif
+
+    CASE(CONSTANT) {
+        push(chunk->constants[READ_SHORT()]);
+        DISPATCH();
+    }
+    CASE(NIL) {
+        push(Value());
+        DISPATCH();
+    }
+    CASE(TRUE) {
+        push(Value(true));
+        DISPATCH();
+    }
+    CASE(FALSE) {
+        push(Value(false));
+        DISPATCH();
+    }
+    CASE(POP) {
+        DROP(1);
+        DISPATCH();
+    }
+    CASE(DUP) {
+        push(PEEK(0));
+        DISPATCH();
+    }
+    CASE(RESERVE) {
+        int count = READ_SHORT();
+        if (static_cast<size_t>(stackEnd - stackTop) < count + kFrameHeadroom) {
+            THROW_ERROR("Stack overflow");
+        }
+        for (int i = 0; i < count; i++) {
+            push(Value());
+        }
+        DISPATCH();
+    }
+    CASE(END_SCOPE) {
+        int count = READ_SHORT();
+        closeUpvalues(stackTop - count);
+        DROP(count);
+        DISPATCH();
+    }
+    CASE(GET_LOCAL) {
+        push(slots[READ_SHORT()]);
+        DISPATCH();
+    }
+    CASE(SET_LOCAL) {
+        slots[READ_SHORT()] = PEEK(0);
+        DISPATCH();
+    }
+    CASE(GET_UPVALUE) {
+        push(*frame->closure->upvalues[READ_SHORT()]->location);
+        DISPATCH();
+    }
+    CASE(SET_UPVALUE) {
+        *frame->closure->upvalues[READ_SHORT()]->location = PEEK(0);
+        DISPATCH();
+    }
+    CASE(GET_GLOBAL) {
+        GlobalCell& cell = globals[READ_SHORT()];
+        if (!cell.defined) THROW_ERROR("Undefined variable '" + cell.name + "'");
+        push(cell.value);
+        DISPATCH();
+    }
+    CASE(SET_GLOBAL) {
+        GlobalCell& cell = globals[READ_SHORT()];
+        if (!cell.defined) THROW_ERROR("Undefined variable '" + cell.name + "'");
+        cell.value = PEEK(0);
+        DISPATCH();
+    }
+    CASE(DEFINE_GLOBAL) {
+        GlobalCell& cell = globals[READ_SHORT()];
+        cell.value = pop();
+        cell.defined = true;
+        DISPATCH();
+    }
+    CASE(GET_PROPERTY) {
+        const Token& name = chunk->tokens[READ_SHORT()];
+        PropertyCache* cache = chunk->caches[READ_SHORT()].get();
+        if (PEEK(0).isModule()) {
+            frame->ip = ip;
+            PEEK(0) = PEEK(0).asModule()->get(name);
+            DISPATCH();
+        }
+        if (!PEEK(0).isInstance()) THROW_ERROR("Only instances have properties");
+        PEEK(0) = PEEK(0).asInstance()->get(name, cache);
+        DISPATCH();
+    }
+    CASE(SET_PROPERTY) {
+        const Token& name = chunk->tokens[READ_SHORT()];
+        PropertyCache* cache = chunk->caches[READ_SHORT()].get();
+        if (!PEEK(1).isInstance()) THROW_ERROR("Only instances have fields");
+        PEEK(1).asInstance()->set(name, PEEK(0), cache);
+        Value value = pop();
+        PEEK(0) = std::move(value);
+        DISPATCH();
+    }
+    CASE(EQUAL) {
+        bool equal = PEEK(1) == PEEK(0);
+        DROP(1);
+        PEEK(0) = Value(equal);
+        DISPATCH();
+    }
+    CASE(NOT_EQUAL) {
+        bool equal = PEEK(1) == PEEK(0);
+        DROP(1);
+        PEEK(0) = Value(!equal);
+        DISPATCH();
+    }
+    CASE(GREATER) {
+        BINARY_OP(a > b);
+        DISPATCH();
+    }
+    CASE(GREATER_EQUAL) {
+        BINARY_OP(a >= b);
+        DISPATCH();
+    }
+    CASE(LESS) {
+        BINARY_OP(a < b);
+        DISPATCH();
+    }
+    CASE(LESS_EQUAL) {
+        BINARY_OP(a <= b);
+        DISPATCH();
+    }
+    CASE(ADD) {
+        Value& left = PEEK(1);
+        Value& right = PEEK(0);
+        if (left.isNumber() && right.isNumber()) {
+            double sum = left.asNumber() + right.asNumber();
+            DROP(1);
+            PEEK(0) = Value(sum);
+        } else if (left.isString() || right.isString()) {
+            Value concatenated = Value::concat(left, right);
+            DROP(1);
+            PEEK(0) = std::move(concatenated);
+        } else if (HAS_ARRAY_OPERAND()) {
+            ARRAY_OP(ArrayOp::Add);
+        } else {
+            THROW_ERROR("Operands must be two numbers or strings");
+        }
+        DISPATCH();
+    }
+    CASE(SUBTRACT) {
+        if (HAS_ARRAY_OPERAND()) {
+            ARRAY_OP(ArrayOp::Subtract);
+        } else {
+            BINARY_OP(a - b);
+        }
+        DISPATCH();
+    }
+    CASE(MULTIPLY) {
+        if (HAS_ARRAY_OPERAND()) {
+            ARRAY_OP(ArrayOp::Multiply);
+        } else {
+            BINARY_OP(a * b);
+        }
+        DISPATCH();
+    }
+    CASE(DIVIDE) {
+        if (HAS_ARRAY_OPERAND()) {
+            ARRAY_OP(ArrayOp::Divide);
+            DISPATCH();
+        }
+        NUMBER_OPERANDS();
+        if (PEEK(0).asNumber() == 0) THROW_ERROR("Division by zero");
+        BINARY_OP(a / b);
+        DISPATCH();
+    }
+    CASE(MODULO) {
+        NUMBER_OPERANDS();
+        if (PEEK(0).asNumber() == 0) THROW_ERROR("Modulo by zero");
+        BINARY_OP(fmod(a, b));
+        DISPATCH();
+    }
+    CASE(POWER) {
+        BINARY_OP(pow(a, b));
+        DISPATCH();
+    }
+    CASE(SHIFT_LEFT) {
+        INTEGER_OP(<<);
+        DISPATCH();
+    }
+    CASE(SHIFT_RIGHT) {
+        INTEGER_OP(>>);
+        DISPATCH();
+    }
+    CASE(BIT_AND) {
+        INTEGER_OP(&);
+        DISPATCH();
+    }
+    CASE(BIT_OR) {
+        INTEGER_OP(|);
+        DISPATCH();
+    }
+    CASE(BIT_XOR) {
+        INTEGER_OP(^);
+        DISPATCH();
+    }
+    CASE(AND) {
+        Value right = pop();
+        if (PEEK(0).isTruthy()) PEEK(0) = std::move(right);
+        DISPATCH();
+    }
+    CASE(OR) {
+        Value right = pop();
+        if (!PEEK(0).isTruthy()) PEEK(0) = std::move(right);
+        DISPATCH();
+    }
+    CASE(NOT) {
+        PEEK(0) = Value(!PEEK(0).isTruthy());
+        DISPATCH();
+    }
+    CASE(NEGATE) {
+        if (!PEEK(0).isNumber()) THROW_ERROR("Operand must be a number");
+        PEEK(0) = Value(-PEEK(0).asNumber());
+        DISPATCH();
+    }
+    CASE(BIT_NOT) {
+        if (!PEEK(0).isNumber()) THROW_ERROR("Operand must be a number");
+        PEEK(0) = Value(static_cast<double>(~static_cast<int>(PEEK(0).asNumber())));
+        DISPATCH();
+    }
+    CASE(AWAIT) {
+        if (PEEK(0).isFuture()) {
+            // Other tasks run meanwhile, with their own stacks swapped in
+            frame->ip = ip;
+            std::shared_ptr<Future> future = PEEK(0).asFuture();
+            try {
+                EventLoop::local().wait(*future);
+                PEEK(0) = future->get();
+            } catch (const std::runtime_error& e) {
+                THROW_ERROR(e.what());
+            }
+        }
+        DISPATCH();
+    }
+    CASE(PRINT) {
+        std::string line;
+        pop().appendTo(line);
+        line += '\n';
+        Output::write(line);
+        DISPATCH();
+    }
+    CASE(JUMP) {
+        uint16_t offset = READ_SHORT();
+        ip += offset;
+        DISPATCH();
+    }
+    CASE(JUMP_IF_FALSE) {
+        uint16_t offset = READ_SHORT();
+        if (!pop().isTruthy()) ip += offset;
+        DISPATCH();
+    }
+    CASE(LOOP) {
+        uint16_t offset = READ_SHORT();
+        ip -= offset;
+        Heap::safePoint();
+        DISPATCH();
+    }
+    CASE(ITERATE) {
+        auto iterator = makeIterator(PEEK(0));
+        if (iterator == nullptr) THROW_ERROR("Can only iterate over lists, strings and iterables");
+        PEEK(0) = Value(std::static_pointer_cast<Iterable>(iterator));
+        DISPATCH();
+    }
+    CASE(FOR_ITER) {
+        Value& iterable = slots[READ_SHORT()];
+        uint16_t offset = READ_SHORT();
+        // next() may call back into the VM (map, filter)
+        frame->ip = ip;
+        Value item;
+        if (static_cast<Iterator&>(*iterable.asIterable()).next(interpreter, item)) {
+            push(std::move(item));
+        } else {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    CASE(CALL) {
+        int argCount = READ_BYTE();
+        frame->ip = ip;
+        Heap::safePoint();
+        if (callValue(argCount, *frame, ip)) LOAD_FRAME();
+        DISPATCH();
+    }
+    CASE(INVOKE) {
+        const uint8_t* start = ip; // property errors point at the opcode
+        const Token& name = chunk->tokens[READ_SHORT()];
+        PropertyCache* cache = chunk->caches[READ_SHORT()].get();
+        int argCount = READ_BYTE();
+        frame->ip = ip;
+
+        Value& receiver = PEEK(argCount);
+        if (receiver.isModule()) {
+            // A module member is called like a callable stored in a field
+            PEEK(argCount + 1) = receiver.asModule()->get(name);
+            for (Value* slot = stackTop - argCount - 1; slot < stackTop - 1; slot++) {
+                *slot = std::move(slot[1]);
+            }
+            DROP(1);
+            if (callValue(argCount, *frame, ip)) LOAD_FRAME();
+            DISPATCH();
+        }
+        if (!receiver.isInstance()) throw error(*frame, start, "Only instances have properties");
+        auto property = receiver.asInstance()->lookup(name.text(), cache);
+
+        if (property.method == nullptr) {
+            if (property.field == nullptr) {
+                throw error(*frame, start, "Undefined property '" + name.text() + "'");
+            }
+            // A callable stored in a field: it takes the receiver's place
+            // in the nil slot, and the arguments move down over the receiver
+            PEEK(argCount + 1) = *property.field;
+            for (Value* slot = stackTop - argCount - 1; slot < stackTop - 1; slot++) {
+                *slot = std::move(slot[1]);
+            }
+            DROP(1);
+            if (callValue(argCount, *frame, ip)) LOAD_FRAME();
+            DISPATCH();
+        }
+
+        // The method is owned by the receiver's class, which the receiver
+        // in slot 0 of the new frame keeps alive
+        Callable* method = property.method;
+        int arity = method->arity();
+        if (arity != -1 && argCount != arity) {
+            THROW_ERROR("Expected " + std::to_string(arity) + " arguments but got " + std::to_string(argCount));
+        }
+
+        auto closure = dynamic_cast<VmClosure*>(method);
+        if (closure != nullptr && closure->vm == this && !closure->function->isAsync) {
+            pushFrame(closure, stackTop - argCount - 1);
+            LOAD_FRAME();
+            DISPATCH();
+        }
+
+        Value result = method->callMethod(interpreter, receiver, Arguments(stackTop - argCount, argCount));
+        DROP(argCount + 1);
+        PEEK(0) = std::move(result);
+        DISPATCH();
+    }
+    CASE(CLOSURE) {
+        auto closure = std::make_shared<VmClosure>(chunk->functions[READ_SHORT()], this);
+        for (auto& upvalue : closure->upvalues) {
+            bool isLocal = READ_BYTE() != 0;
+            uint16_t index = READ_SHORT();
+            upvalue = isLocal ? captureUpvalue(slots + index) : frame->closure->upvalues[index];
+        }
+        push(Value(std::static_pointer_cast<Callable>(closure)));
+        DISPATCH();
+    }
+    CASE(RETURN) {
+        Value result = pop();
+        closeUpvalues(slots);
+
+        // try blocks the returning frame did not leave are discarded
+        while (!handlers.empty() && handlers.back().frameCount >= frames.size()) {
+            handlers.pop_back();
+        }
+
+        if (Profiler::enabled() && isProfiled(*frames.back().closure->function)) {
+            Profiler::leave();
+        }
+        frames.pop_back();
+        while (stackTop > slots - 1) {
+            *--stackTop = Value();
+        }
+        push(result);
+
+        if (frames.size() == exitFrame) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    CASE(CLASS) {
+        const std::string& name = chunk->constants[READ_SHORT()].asString();
+        int methodCount = READ_BYTE();
+        bool hasSuperclass = READ_BYTE() != 0;
+
+        std::shared_ptr<FocusClass> superclass = nullptr;
+        if (hasSuperclass) {
+            const Value& superclassValue = PEEK(methodCount);
+            if (!superclassValue.isClass()) THROW_ERROR("Superclass must be a class");
+            superclass = superclassValue.asClass();
+        }
+
+        std::unordered_map<std::string, std::shared_ptr<Callable>> methods;
+        for (int i = methodCount - 1; i >= 0; i--) {
+            auto method = PEEK(i).asCallable();
+            methods[static_cast<VmClosure&>(*method).function->name] = method;
+        }
+
+        DROP(methodCount + (hasSuperclass ? 1 : 0));
+        push(Value(std::make_shared<FocusClass>(name, superclass, methods)));
+        DISPATCH();
+    }
+    CASE(LIST) {
+        int count = READ_SHORT();
+        auto list = std::make_shared<std::vector<Value>>(stackTop - count, stackTop);
+        DROP(count);
+        push(Value(list));
+        DISPATCH();
+    }
+    CASE(INDEX) {
+        const Value& object = PEEK(1);
+        const Value& index = PEEK(0);
+        if (object.isMap()) {
+            const Value* value = object.asMap()->find(index);
+            if (value == nullptr) THROW_ERROR("Key not found: " + index.toString());
+            Value found = *value;
+            DROP(1);
+            PEEK(0) = std::move(found);
+            DISPATCH();
+        }
+        if (!object.isList() && !object.isArray()) THROW_ERROR("Only lists, arrays and maps can be indexed");
+        if (!index.isNumber()) THROW_ERROR("List index must be a number");
+
+        int idx = static_cast<int>(index.asNumber());
+        if (object.isArray()) {
+            const auto& array = object.asArray();
+            if (idx < 0 || idx >= static_cast<int>(array->size())) {
+                THROW_ERROR("Array index out of range");
+            }
+            double element = (*array)[idx];
+            DROP(1);
+            PEEK(0) = Value(element);
+            DISPATCH();
+        }
+
+        auto list = object.asList();
+        if (idx < 0 || idx >= static_cast<int>(list->size())) {
+            THROW_ERROR("List index out of range");
+        }
+
+        DROP(1);
+        PEEK(0) = (*list)[idx];
+        DISPATCH();
+    }
+    CASE(MAP) {
+        int count = READ_SHORT();
+        auto map = std::make_shared<FocusMap>(count);
+        for (Value* entry = stackTop - 2 * count; entry < stackTop; entry += 2) {
+            map->set(entry[0], entry[1]);
+        }
+        DROP(2 * count);
+        push(Value(map));
+        DISPATCH();
+    }
+    CASE(SET_INDEX) {
+        if (!PEEK(2).isMap()) THROW_ERROR("Only map entries can be assigned");
+        PEEK(2).asMap()->set(PEEK(1), PEEK(0));
+        Value value = pop();
+        DROP(1);
+        PEEK(0) = std::move(value);
+        DISPATCH();
+    }
+    CASE(EXTERN_CALL) {
+        const Token& library = chunk->tokens[READ_SHORT()];
+        const Token& function = chunk->tokens[READ_SHORT()];
+        int argCount = READ_BYTE();
+        NativeCallSite& site = *chunk->nativeSites[READ_SHORT()];
+
+        frame->ip = ip;
+        Value result;
+        try {
+            result = LibraryManager::getInstance().callFunction(site, library.text(), function.text(),
+                                                                Arguments(stackTop - argCount, argCount));
+        } catch (const std::exception& e) {
+            throw RuntimeError(function, "External function call failed: " + std::string(e.what()));
+        }
+
+        DROP(argCount);
+        push(result);
+        DISPATCH();
+    }
+    CASE(EXTERN_SPAWN) {
+        const Token& library = chunk->tokens[READ_SHORT()];
+        const Token& function = chunk->tokens[READ_SHORT()];
+        int argCount = READ_BYTE();
+
+        frame->ip = ip;
+        Value result;
+        try {
+            result = Value(LibraryManager::getInstance().spawnFunction(
+                library.text(), function.text(), std::vector<Value>(stackTop - argCount, stackTop)));
+        } catch (const std::exception& e) {
+            throw RuntimeError(function, "External function call failed: " + std::string(e.what()));
+        }
+
+        DROP(argCount);
+        push(result);
+        DISPATCH();
+    }
+    CASE(LOAD_LIBRARY) {
+        const std::string& path = chunk->constants[READ_SHORT()].asString();
+        const Token& alias = chunk->tokens[READ_SHORT()];
+        const std::string& type = chunk->constants[READ_SHORT()].asString();
+        const std::string& message = chunk->constants[READ_SHORT()].asString();
+
+        if (!LibraryManager::getInstance().loadLibrary(alias.text(), path, type)) {
+            throw RuntimeError(alias, message + path);
+        }
+        push(Value(true));
+        DISPATCH();
+    }
+    CASE(IMPORT) {
+        push(Value(interpreter.getModules().import(chunk->tokens[READ_SHORT()].text())));
+        DISPATCH();
+    }
+    CASE(BIND_NATIVE) {
+        const Token& library = chunk->tokens[READ_SHORT()];
+        const Token& function = chunk->tokens[READ_SHORT()];
+        NativeSignature signature;
+        signature.declared = true;
+        signature.result = static_cast<NativeType>(READ_BYTE());
+        signature.arity = READ_BYTE();
+        for (int i = 0; i < signature.arity; i++) {
+            signature.params[i] = static_cast<NativeType>(READ_BYTE());
+        }
+
+        frame->ip = ip;
+        try {
+            LibraryManager::getInstance().bindFunction(library.text(), function.text(), signature);
+        } catch (const std::exception& e) {
+            throw RuntimeError(function, "Can't bind native function: " + std::string(e.what()));
+        }
+        DISPATCH();
+    }
+    CASE(TRY_BEGIN) {
+        uint16_t offset = READ_SHORT();
+        handlers.push_back({frames.size(), stackTop, ip + offset});
+        DISPATCH();
+    }
+    CASE(TRY_END) {
+        handlers.pop_back();
+        DISPATCH();
+    }
+    CASE(THROW) {
+        THROW_ERROR(PEEK(0).toString());
+    }
+    CASE(SUPER) {
+        throw RuntimeError(chunk->tokens[READ_SHORT()], "Super not fully implemented");
+    }
+    CASE(SWITCH) {
+        const SwitchTable& table = chunk->switches[READ_SHORT()];
+        ip += table.find(pop());
+        DISPATCH();
+    }
+
+#if !FOCUS_VM_COMPUTED_GOTO
+    }
+#endif
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef PEEK
+#undef DROP
+#undef THROW_ERROR
+#undef LOAD_FRAME
+#undef NUMBER_OPERANDS
+#undef BINARY_OP
+#undef HAS_ARRAY_OPERAND
+#undef ARRAY_OP
+#undef INTEGER_OP
+#undef DISPATCH
+#undef CASE
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "chunk.hpp"
+#include "../interpreter.hpp"
+#include "../error/exceptions.hpp"
+#include "../runtime/callable.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VM;
+
+// A captured variable. While open it points into the VM stack; when the
+// owning scope ends the value is moved into `closed`.
+// Registers with the collector once closed, as a closed upvalue may
+// hold the closure that captured it
+struct Upvalue final : public Traced, public std::enable_shared_from_this<Upvalue> {
+    Value* location;
+    Value closed;
+
+    explicit Upvalue(Value* location) : location(location) {}
+
+    void trace(Tracer& tracer) const override;
+    void clearReferences() override { closed = Value(); }
+    std::weak_ptr<const void> self() const override { return weak_from_this(); }
+};
+
+class VmClosure final : public Callable, public std::enable_shared_from_this<VmClosure> {
+public:
+    std::shared_ptr<VmFunction> function;
+    std::vector<std::shared_ptr<Upvalue>> upvalues;
+    VM* vm;
+
+    VmClosure(std::shared_ptr<VmFunction> function, VM* vm);
+
+    int arity() override;
+    Value call(Interpreter& interpreter, Arguments arguments) override;
+    Value callMethod(Interpreter& interpreter, const Value& instance, Arguments arguments) override;
+    std::string toString() override;
+    void trace(Tracer& tracer) const override;
+};
+
+// Stack-based virtual machine executing code produced by the Compiler.
+// Natives and other Callables are invoked through the regular Callable
+// interface, so they see the VM's own Interpreter instance.
+class VM {
+private:
+    struct CallFrame {
+        VmClosure* closure;
+        const uint8_t* ip;
+        Value* slots;
+    };
+
+    struct Handler {
+        size_t frameCount;
+        Value* stackTop;
+        const uint8_t* target;
+    };
+
+    struct GlobalCell {
+        std::string name;
+        Value value;
+        bool defined = false;
+    };
+
+    static constexpr size_t kMaxFrames = 4096;
+    static constexpr size_t kStackSize = kMaxFrames * 32;
+    static constexpr size_t kTaskFrames = 1024;
+    static constexpr size_t kTaskStackSize = kTaskFrames * 32;
+    static constexpr size_t kSpareStates = 64;
+
+    // What a task of an async function runs on, swapped with the VM's own
+    // whenever the task resumes and swapped back when it stops. The stack
+    // is mapped, so that only what a task uses is ever backed by memory.
+    struct ExecutionState {
+        Value* stack;
+        Value* stackTop;
+        Value* stackEnd;
+        size_t frameLimit;
+        std::vector<CallFrame> frames; // reserved up to frameLimit
+        std::vector<Handler> handlers;
+        std::vector<std::shared_ptr<Upvalue>> openUpvalues;
+
+        ExecutionState();
+        ExecutionState(const ExecutionState&) = delete;
+        ExecutionState& operator=(const ExecutionState&) = delete;
+        ~ExecutionState();
+
+    private:
+        Value* mapping; // the task's stack, whichever one is swapped in
+    };
+
+    std::unique_ptr<Value[]> scriptStack;
+    Value* stack; // of the script, or of the task that runs
+    Value* stackTop;
+    Value* stackEnd;
+    size_t frameLimit;
+    std::vector<CallFrame> frames; // reserved up to frameLimit, so frames never move
+    std::vector<Handler> handlers;
+    std::vector<std::shared_ptr<Upvalue>> openUpvalues; // sorted by location
+    std::vector<std::unique_ptr<ExecutionState>> spareStates; // of finished tasks
+    std::vector<GlobalCell> globals;
+    std::unordered_map<std::string, int> globalIndex;
+    Interpreter interpreter;
+
+public:
+    // Room kept free above a frame for expression temporaries
+    static constexpr size_t kFrameHeadroom = 1024;
+
+    VM();
+
+    void interpret(const std::shared_ptr<VmFunction>& script);
+    Value callClosure(VmClosure& closure, const Value* instance, Arguments arguments);
+
+    // Index of the global cell for name, created undefined if needed
+    int globalSlot(const std::string& name);
+    // Names of the global cells, by slot
+    std::vector<std::string> globalNames() const;
+    void defineGlobal(const std::string& name, const Value& value);
+
+private:
+    Value runClosure(VmClosure& closure, const Value* instance, Arguments arguments);
+    Value startTask(VmClosure& closure, const Value* instance, Arguments arguments);
+    void swapState(ExecutionState& state);
+    void run(size_t exitFrame, Value* entryTop);
+    void execute(size_t exitFrame);
+    void pushFrame(VmClosure* closure, Value* slots);
+    bool callValue(int argCount, const CallFrame& frame, const uint8_t* ip);
+    void unwind(size_t frameCount, Value* top);
+
+    void push(const Value& value);
+    Value pop();
+
+    std::shared_ptr<Upvalue> captureUpvalue(Value* local);
+    void closeUpvalues(const Value* last);
+
+    RuntimeError error(const CallFrame& frame, const uint8_t* ip, const std::string& message) const;
+};